@@ -0,0 +1,112 @@
+/************
+/RuntimeBench.c
+/  Microbenchmarks of the functions of the LLFI runtime library that the
+/  instrumented programs call for each dynamic instruction: doProfiling and
+/  doProfilingSite in the profiling executable, preFunc and injectFunc in the
+/  fault injection executable, and printInstTracer in both. Each function is
+/  called in a loop, like an instrumented loop would, and its cost per call is
+/  written to stdout as JSON, for llfi_bench.
+/
+/  Usage: RuntimeBench [<iterations>]
+/  Run it in an empty directory: it writes llfi.config.runtime.txt, and the
+/  runtime writes its trace and stat files there.
+*************/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "Utils.h"
+
+// the functions called by the instrumented programs
+void doProfiling(int opcode);
+void initProfilingSites(long numSites);
+void doProfilingSite(int opcode, long llfi_index);
+void initInjections(long numSites);
+bool preFunc(long llfi_index, unsigned opcode, unsigned my_reg_index,
+             unsigned total_reg_target_num);
+void injectFunc(long llfi_index, unsigned size, char *buf,
+                unsigned my_reg_index, unsigned reg_pos, char *opcode_str);
+void printInstTracer(long instID, char *opcode, int size, char *ptr,
+                     int maxPrints);
+
+#define DEFAULT_ITERATIONS 1000000
+// opcode of add in Instruction.def
+#define OPCODE_ADD 13
+// sites of the loop, as numbered by the index pass
+#define NUM_SITES 64
+
+static double _now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static bool firstResult = true;
+
+static void _printResult(const char *name, long long calls, double seconds) {
+  printf("%s\n    \"%s\": {\"calls\": %lld, \"seconds\": %.6f, "
+         "\"ns_per_call\": %.3f}", firstResult ? "" : ",", name, calls,
+         seconds, seconds * 1e9 / calls);
+  firstResult = false;
+}
+
+int main(int argc, char *argv[]) {
+  long long iterations = argc > 1 ? atoll(argv[1]) : DEFAULT_ITERATIONS;
+  if (iterations <= 0) {
+    fprintf(stderr, "ERROR: invalid number of iterations %s\n", argv[1]);
+    return 1;
+  }
+  // each injection is recorded in the stat file, so fewer are timed
+  long long injections = iterations / 100 > 100 ? iterations / 100 : 100;
+  long long i;
+  double start;
+
+  printf("{");
+
+  start = _now();
+  for (i = 0; i < iterations; i++)
+    doProfiling(OPCODE_ADD);
+  _printResult("doProfiling", iterations, _now() - start);
+
+  initProfilingSites(NUM_SITES);
+  start = _now();
+  for (i = 0; i < iterations; i++)
+    doProfilingSite(OPCODE_ADD, i % NUM_SITES);
+  _printResult("doProfilingSite", iterations, _now() - start);
+
+  // the golden trace, written to llfi.stat.trace.txt; the trace pass counts
+  // the instructions before calling the tracing function
+  long long value = 0;
+  start = _now();
+  for (i = 0; i < iterations; i++) {
+    value += i;
+    llfi_trace_count++;
+    printInstTracer(i % NUM_SITES, "add", sizeof(value), (char *)&value, 1);
+  }
+  _printResult("printInstTracer", iterations, _now() - start);
+
+  // the fault is never reached, so preFunc only counts the cycles
+  FILE *config = fopen("llfi.config.runtime.txt", "w");
+  if (config == NULL) {
+    fprintf(stderr, "ERROR: Unable to write llfi.config.runtime.txt\n");
+    return 1;
+  }
+  fprintf(config, "fi_type=bitflip\nfi_cycle=%lld\n", 1LL << 62);
+  fclose(config);
+  initInjections(NUM_SITES);
+
+  start = _now();
+  for (i = 0; i < iterations; i++)
+    preFunc(i % NUM_SITES, OPCODE_ADD, 0, 1);
+  _printResult("preFunc", iterations, _now() - start);
+
+  start = _now();
+  for (i = 0; i < injections; i++)
+    injectFunc(i % NUM_SITES, sizeof(value) * 8, (char *)&value, 0, 0, "add");
+  _printResult("injectFunc", injections, _now() - start);
+
+  printf("\n}\n");
+  return 0;
+}
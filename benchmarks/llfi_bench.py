@@ -0,0 +1,581 @@
+#! /usr/bin/env python3
+
+"""
+
+%(prog)s measures the performance of LLFI itself, and writes the results as JSON to track them across versions
+
+Usage: %(prog)s [OPTIONS]
+
+List of options:
+
+--programs <names>:         Programs of the test suite to benchmark (default: %(defaultprograms)s)
+--runs <number>:            Fault injection runs of the campaign of each program (default: 20)
+--repeat <number>:          Executions of each executable, of which the median time is kept (default: 3)
+--iterations <number>:      Calls of each runtime function in the microbenchmarks (default: 1000000)
+--workdir <directory>:      Directory of the benchmarked programs, kept after the benchmarks (default: a temporary directory, removed after the benchmarks)
+--output <file>:            JSON file of the results (default: llfi.bench.json)
+--no-programs:              Do not benchmark the programs of the test suite
+--no-runtime:               Do not run the microbenchmarks of the runtime functions
+--no-kernels:               Do not benchmark the protected ML kernels
+--verbose:                  Show the commands and their output
+--help(-h):                 Show help information
+
+For each program of the test suite, %(prog)s measures the time of instrument,
+the slowdown of the profiling executable and of the fault injection executable
+over the program compiled without instrumentation, when no fault is injected,
+and the fault injection runs per second of a campaign of injectfault. The
+microbenchmarks time the calls of the runtime functions of the instrumented
+programs: doProfiling, doProfilingSite, printInstTracer, preFunc and
+injectFunc. The kernel benchmarks time a multiply-accumulate main_graph
+kernel compiled without protection, with selective instruction duplication
+(SID, per instruction and per slice) and with range restriction, and write
+the slowdown of each protection over the unprotected kernel.
+"""
+
+import sys, os, shutil, subprocess, tempfile, time, json, datetime, platform
+import yaml
+
+script_path = os.path.realpath(os.path.dirname(__file__))
+sys.path.append(os.path.join(script_path, '../config'))
+import llvm_paths
+
+prog = os.path.basename(sys.argv[0])
+
+optbin = os.path.join(llvm_paths.LLVM_DST_ROOT, "bin/opt")
+llvmconfigbin = os.path.join(llvm_paths.LLVM_DST_ROOT, "bin/llvm-config")
+llcbin = os.path.join(llvm_paths.LLVM_DST_ROOT, "bin/llc")
+llvmgcc = os.path.join(llvm_paths.LLVM_GXX_BIN_DIR, "clang")
+llvmgxx = os.path.join(llvm_paths.LLVM_GXX_BIN_DIR, "clang++")
+instrument_script = os.path.join(script_path, "../bin/instrument")
+profile_script = os.path.join(script_path, "../bin/profile")
+injectfault_script = os.path.join(script_path, "../bin/injectfault")
+runtimebench = os.path.join(script_path, "RuntimeBench")
+sedpasses = os.path.join(script_path,
+                         "../llvm_passes/instruction_duplication/SEDPasses.so")
+testsuite_dir = os.path.join(script_path, "../test_suite")
+build_prog_script = os.path.join(testsuite_dir, "SCRIPTS/build_prog.py")
+
+# the programs of the test suite that run on their own, without a server
+defaultprograms = ["factorial", "mcf", "sudoku2", "bfs"]
+linklibs = ["-lpthread", "-lm"]
+# cycle of the fault of the executions timed without fault, never reached
+NO_FAULT_CYCLE = 1 << 62
+
+options = {
+  "programs": [],
+  "runs": 20,
+  "repeat": 3,
+  "iterations": 1000000,
+  "workdir": None,
+  "output": "llfi.bench.json",
+  "no_programs": False,
+  "no_runtime": False,
+  "no_kernels": False,
+  "verbose": False,
+}
+
+
+def usage(msg = None):
+  retval = 0
+  if msg is not None:
+    retval = 1
+    msg = "ERROR: " + msg
+    print(msg, file=sys.stderr)
+  print(__doc__ % dict(globals(), defaultprograms=' '.join(defaultprograms)),
+        file=sys.stderr)
+  sys.exit(retval)
+
+
+def verbosePrint(msg):
+  if options["verbose"]:
+    print(msg)
+
+
+def parseArgs(args):
+  global options
+  argid = 0
+  while argid < len(args):
+    arg = args[argid]
+    if arg == "--programs":
+      argid += 1
+      while argid < len(args) and not args[argid].startswith('-'):
+        options["programs"].append(args[argid])
+        argid += 1
+      continue
+    elif arg in ("--runs", "--repeat", "--iterations", "--workdir",
+                 "--output"):
+      argid += 1
+      if argid == len(args):
+        usage("Missing value for " + arg)
+      if arg == "--workdir" or arg == "--output":
+        options[arg[2:]] = os.path.abspath(args[argid])
+      else:
+        try:
+          options[arg[2:]] = int(args[argid])
+        except ValueError:
+          usage("Invalid value for " + arg + ": " + args[argid])
+        if options[arg[2:]] <= 0:
+          usage(arg + " must be greater than 0")
+    elif arg == "--no-programs":
+      options["no_programs"] = True
+    elif arg == "--no-runtime":
+      options["no_runtime"] = True
+    elif arg == "--no-kernels":
+      options["no_kernels"] = True
+    elif arg == "--verbose":
+      options["verbose"] = True
+    elif arg == "--help" or arg == "-h":
+      usage()
+    else:
+      usage("Invalid argument: " + arg)
+    argid += 1
+
+  if not options["programs"]:
+    options["programs"] = list(defaultprograms)
+
+
+def run(execlist, cwd, timeout = None):
+  """Runs the command, and returns its return code and its time in seconds"""
+  verbosePrint("\t" + ' '.join(execlist))
+  output = None if options["verbose"] else subprocess.DEVNULL
+  start = time.perf_counter()
+  try:
+    retcode = subprocess.call(execlist, cwd=cwd, stdout=output, stderr=output,
+                              timeout=timeout)
+  except subprocess.TimeoutExpired:
+    retcode = -1
+  return retcode, time.perf_counter() - start
+
+
+def median(values):
+  values = sorted(values)
+  middle = len(values) // 2
+  if len(values) % 2:
+    return values[middle]
+  return (values[middle - 1] + values[middle]) / 2.0
+
+
+def timeExecutable(execlist, cwd):
+  """Median time of the executions of the executable, None if it failed"""
+  times = []
+  for i in range(options["repeat"]):
+    retcode, seconds = run(execlist, cwd)
+    if retcode != 0:
+      return None
+    times.append(seconds)
+  return median(times)
+
+
+################################################################################
+# Runtime functions
+
+def benchRuntime():
+  rundir = tempfile.mkdtemp(prefix="llfi_bench_runtime_")
+  try:
+    execlist = [runtimebench, str(options["iterations"])]
+    verbosePrint("\t" + ' '.join(execlist))
+    p = subprocess.run(execlist, cwd=rundir, stdout=subprocess.PIPE,
+                       stderr=subprocess.DEVNULL)
+    if p.returncode != 0:
+      print("ERROR: the runtime microbenchmarks failed", file=sys.stderr)
+      return None
+    results = json.loads(p.stdout.decode())
+  finally:
+    shutil.rmtree(rundir, ignore_errors=True)
+
+  for name, result in results.items():
+    print("%-16s %10.1f ns/call" % (name, result["ns_per_call"]))
+  return results
+
+
+################################################################################
+# Protected ML kernels
+
+# Elements of the tensors of the kernel
+KERNEL_ELEMENTS = 1 << 16
+# ONNX operator id of add, see RangeRestriction.cpp
+KERNEL_OPERATOR = 6579265
+
+# main_graph computes C = A * B + C * 0.5 elementwise, like the fused operator
+# of a model; main calls it <repetitions> times and prints the sum of C. The
+# operator is delimited by the OMInstrumentPoint markers of onnx-mlir: range
+# restriction takes the operator from its tag 1 marker to its tag 2 marker,
+# and SID from its tag 2 marker to its tag 1 marker, so the markers of the SID
+# kernel are swapped. Without a fault, the two copies of SID are identical,
+# and -O2 merges them with their check.
+KERNEL_IR = """
+target triple = "TRIPLE"
+
+@.fmt = private unnamed_addr constant [4 x i8] c"%f\\0A\\00"
+
+declare i8* @malloc(i64)
+declare i32 @atoi(i8*)
+declare i32 @printf(i8*, ...)
+
+define void @OMInstrumentPoint(i64 %id, i64 %tag) noinline {
+entry:
+  ret void
+}
+
+define void @main_graph(float* %a, float* %b, float* %c, i64 %n) {
+entry:
+  call void @OMInstrumentPoint(i64 OPERATOR, i64 START_TAG)
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %pa = getelementptr inbounds float, float* %a, i64 %i
+  %pb = getelementptr inbounds float, float* %b, i64 %i
+  %pc = getelementptr inbounds float, float* %c, i64 %i
+  %va = load float, float* %pa, align 4
+  %vb = load float, float* %pb, align 4
+  %vc = load float, float* %pc, align 4
+  %prod = fmul float %va, %vb
+  %half = fmul float %vc, 0.5
+  %sum = fadd float %prod, %half
+  store float %sum, float* %pc, align 4
+  %next = add nuw i64 %i, 1
+  %done = icmp eq i64 %next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  call void @OMInstrumentPoint(i64 OPERATOR, i64 END_TAG)
+  ret void
+}
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %hasarg = icmp sgt i32 %argc, 1
+  br i1 %hasarg, label %parse, label %alloc
+
+parse:
+  %argp = getelementptr inbounds i8*, i8** %argv, i64 1
+  %arg = load i8*, i8** %argp, align 8
+  %parsed = call i32 @atoi(i8* %arg)
+  br label %alloc
+
+alloc:
+  %reps = phi i32 [ %parsed, %parse ], [ 1, %entry ]
+  %ra = call i8* @malloc(i64 BYTES)
+  %rb = call i8* @malloc(i64 BYTES)
+  %rc = call i8* @malloc(i64 BYTES)
+  %a = bitcast i8* %ra to float*
+  %b = bitcast i8* %rb to float*
+  %c = bitcast i8* %rc to float*
+  br label %init
+
+init:
+  %i = phi i64 [ 0, %alloc ], [ %inext, %init ]
+  %i7 = urem i64 %i, 7
+  %f7 = uitofp i64 %i7 to float
+  %va = fmul float %f7, 0.125
+  %i5 = urem i64 %i, 5
+  %f5 = uitofp i64 %i5 to float
+  %vb = fmul float %f5, 0.125
+  %pa = getelementptr inbounds float, float* %a, i64 %i
+  %pb = getelementptr inbounds float, float* %b, i64 %i
+  %pc = getelementptr inbounds float, float* %c, i64 %i
+  store float %va, float* %pa, align 4
+  store float %vb, float* %pb, align 4
+  store float 0.0, float* %pc, align 4
+  %inext = add nuw i64 %i, 1
+  %idone = icmp eq i64 %inext, ELEMENTS
+  br i1 %idone, label %run, label %init
+
+run:
+  %r = phi i32 [ 0, %init ], [ %rnext, %run ]
+  call void @main_graph(float* %a, float* %b, float* %c, i64 ELEMENTS)
+  %rnext = add nuw i32 %r, 1
+  %rdone = icmp sge i32 %rnext, %reps
+  br i1 %rdone, label %total, label %run
+
+total:
+  %j = phi i64 [ 0, %run ], [ %jnext, %total ]
+  %acc = phi double [ 0.0, %run ], [ %accnext, %total ]
+  %pcj = getelementptr inbounds float, float* %c, i64 %j
+  %vcj = load float, float* %pcj, align 4
+  %dcj = fpext float %vcj to double
+  %accnext = fadd double %acc, %dcj
+  %jnext = add nuw i64 %j, 1
+  %jdone = icmp eq i64 %jnext, ELEMENTS
+  br i1 %jdone, label %print, label %total
+
+print:
+  %fmt = getelementptr inbounds [4 x i8], [4 x i8]* @.fmt, i64 0, i64 0
+  %call = call i32 (i8*, ...) @printf(i8* %fmt, double %accnext)
+  ret i32 0
+}
+"""
+
+# The values of C stay in [0, 2): the learned range of the operator
+KERNEL_RANGE = "range=1,add,0,2\n"
+
+# <name>: (<passes of SEDPasses.so>, <tag of the start marker>)
+KERNEL_VARIANTS = [
+  ("unprotected", [], 1),
+  ("sid", ["--InstructionDuplicationPass", "-operatorName=all"], 2),
+  ("sid_slice", ["--InstructionDuplicationPass", "-operatorName=all",
+                 "--enableSliceDuplication"], 2),
+  ("rangerestriction", ["--RangeRestrictionPass", "-rrOperatorName=all",
+                        "-rrBoundsFile=llfi.stat.range.txt"], 1),
+]
+
+
+def hostTarget():
+  """The target triple of the host, for the vectorizers"""
+  try:
+    p = subprocess.run([llvmconfigbin, "--host-target"],
+                       stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    if p.returncode == 0:
+      return p.stdout.decode().strip()
+  except OSError:
+    pass
+  return ""
+
+
+def buildKernel(kerneldir, name, passes, starttag):
+  """Compiles the kernel with the protection passes and -O2, and returns the
+  executable, or None"""
+  irfile = os.path.join(kerneldir, name + ".ll")
+  with open(irfile, 'w') as f:
+    f.write(KERNEL_IR.replace("TRIPLE", hostTarget())
+                     .replace("OPERATOR", str(KERNEL_OPERATOR))
+                     .replace("START_TAG", str(starttag))
+                     .replace("END_TAG", str(3 - starttag))
+                     .replace("ELEMENTS", str(KERNEL_ELEMENTS))
+                     .replace("BYTES", str(KERNEL_ELEMENTS * 4)))
+  if passes:
+    protectedfile = os.path.join(kerneldir, name + "-protected.ll")
+    execlist = [optbin, "-load", sedpasses] + passes + \
+               ["--enable-new-pm=0", "-S", irfile, "-o", protectedfile]
+    retcode, _ = run(execlist, kerneldir)
+    if retcode != 0:
+      return None
+    irfile = protectedfile
+
+  optfile = os.path.join(kerneldir, name + "-O2.ll")
+  exe = os.path.join(kerneldir, name + ".exe")
+  retcode, _ = run([optbin, "-O2", "-S", irfile, "-o", optfile], kerneldir)
+  if retcode == 0:
+    retcode = buildNative(kerneldir, optfile, exe)
+  return exe if retcode == 0 else None
+
+
+def kernelOutput(exe, reps, cwd):
+  p = subprocess.run([exe, str(reps)], cwd=cwd, stdout=subprocess.PIPE,
+                     stderr=subprocess.DEVNULL)
+  return p.stdout.decode().strip() if p.returncode == 0 else None
+
+
+def benchKernels():
+  kerneldir = tempfile.mkdtemp(prefix="llfi_bench_kernels_")
+  reps = max(1, options["iterations"] * 100 // KERNEL_ELEMENTS)
+  results = {}
+  try:
+    with open(os.path.join(kerneldir, "llfi.stat.range.txt"), 'w') as f:
+      f.write(KERNEL_RANGE)
+    for name, passes, starttag in KERNEL_VARIANTS:
+      exe = buildKernel(kerneldir, name, passes, starttag)
+      if exe is None:
+        print("ERROR: Unable to build the " + name + " kernel", file=sys.stderr)
+        return None
+      output = kernelOutput(exe, reps, kerneldir)
+      seconds = timeExecutable([exe, str(reps)], kerneldir)
+      if output is None or seconds is None:
+        print("ERROR: the " + name + " kernel failed", file=sys.stderr)
+        return None
+      results[name] = {"elements": KERNEL_ELEMENTS * reps, "seconds": seconds,
+                       "ns_per_element": seconds * 1e9 / (KERNEL_ELEMENTS * reps),
+                       "output": output}
+  finally:
+    shutil.rmtree(kerneldir, ignore_errors=True)
+
+  unprotected = results["unprotected"]
+  for name, result in results.items():
+    result["slowdown"] = result["seconds"] / unprotected["seconds"]
+    # the protections must not change the result of a fault-free run
+    if result["output"] != unprotected["output"]:
+      print("WARNING: the " + name + " kernel printed " + result["output"] +
+            " instead of " + unprotected["output"], file=sys.stderr)
+    print("%-16s %10.3f ns/element  x%.2f" % (name, result["ns_per_element"],
+                                              result["slowdown"]))
+  return results
+
+
+################################################################################
+# Programs
+
+def readSuite():
+  with open(os.path.join(testsuite_dir, "test_suite.yaml")) as f:
+    try:
+      return yaml.safe_load(f)
+    except yaml.YAMLError:
+      usage("Unable to load test_suite.yaml")
+
+
+def writeInputYaml(progdir):
+  doc = {
+    "compileOption": {
+      "instSelMethod": [{"insttype": {"include": ["all"]}}],
+      "regSelMethod": "regloc",
+      "regloc": "dstreg",
+    },
+    "runOption": [{"run": {"numOfRuns": options["runs"],
+                           "fi_type": "bitflip"}}],
+  }
+  with open(os.path.join(progdir, "input.yaml"), 'w') as f:
+    yaml.dump(doc, f, default_flow_style=False)
+
+
+def buildNative(progdir, irfile, exe):
+  """Compiles the program without instrumentation"""
+  objfile = exe[:-len(".exe")] + ".o"
+  retcode, _ = run([llcbin, '-filetype=obj', '-o', objfile, irfile], progdir)
+  if retcode == 0:
+    execlist = [llvmgcc, '-no-pie', '-o', exe, objfile] + linklibs
+    retcode, _ = run(execlist, progdir)
+    if retcode != 0:
+      execlist[0] = llvmgxx
+      retcode, _ = run(execlist, progdir)
+  return retcode
+
+
+def benchProgram(name, suite):
+  """Returns the results of the program, or None if it is not in the suite or
+  could not be built"""
+  if name not in suite["PROGRAMS"]:
+    print("WARNING: program " + name + " is not defined in test_suite.yaml",
+          file=sys.stderr)
+    return None
+  files = suite["PROGRAMS"][name]
+  irfile = files[0]
+  inputs = suite["INPUTS"].get(name)
+  args = str(inputs).split() if inputs is not None else []
+
+  srcdir = os.path.join(testsuite_dir, "PROGRAMS", name)
+  if not os.path.isfile(os.path.join(srcdir, irfile)):
+    retcode, _ = run(["python3", build_prog_script, name], testsuite_dir)
+    if retcode != 0 or not os.path.isfile(os.path.join(srcdir, irfile)):
+      print("ERROR: Unable to build " + name, file=sys.stderr)
+      return None
+
+  progdir = os.path.join(options["workdir"], name)
+  shutil.rmtree(progdir, ignore_errors=True)
+  os.makedirs(progdir)
+  for f in files:
+    shutil.copy(os.path.join(srcdir, f), progdir)
+  writeInputYaml(progdir)
+  base = irfile[:irfile.rfind('.')]
+  results = {"args": ' '.join(args)}
+
+  native = os.path.join(progdir, base + "-native.exe")
+  if buildNative(progdir, irfile, native) != 0:
+    print("ERROR: Unable to compile " + name, file=sys.stderr)
+    return None
+
+  execlist = [instrument_script, "--readable"] + linklibs + [irfile]
+  retcode, seconds = run(execlist, progdir)
+  if retcode != 0:
+    print("ERROR: instrument failed for " + name, file=sys.stderr)
+    return None
+  results["instrument_seconds"] = seconds
+
+  profexe = os.path.join(progdir, "llfi", base + "-profiling.exe")
+  fiexe = os.path.join(progdir, "llfi", base + "-faultinjection.exe")
+  results["native_seconds"] = timeExecutable([native] + args, progdir)
+  results["profiling_seconds"] = timeExecutable([profexe] + args, progdir)
+
+  # the golden run of the campaign
+  retcode, _ = run([profile_script, profexe] + args, progdir)
+  if retcode != 0:
+    print("ERROR: profile failed for " + name, file=sys.stderr)
+    return None
+
+  with open(os.path.join(progdir, "llfi.config.runtime.txt"), 'w') as f:
+    f.write("fi_type=bitflip\nfi_cycle=%d\n" % NO_FAULT_CYCLE)
+  results["faultinjection_seconds"] = timeExecutable([fiexe] + args, progdir)
+
+  retcode, seconds = run([injectfault_script, fiexe] + args, progdir)
+  if retcode != 0:
+    print("ERROR: injectfault failed for " + name, file=sys.stderr)
+  else:
+    results["campaign_runs"] = options["runs"]
+    results["campaign_seconds"] = seconds
+    results["campaign_runs_per_second"] = options["runs"] / seconds
+
+  native_seconds = results["native_seconds"]
+  for exe in ("profiling", "faultinjection"):
+    seconds = results[exe + "_seconds"]
+    if native_seconds and seconds is not None:
+      results[exe + "_slowdown"] = seconds / native_seconds
+
+  print("%-12s instrument %7.2fs  profiling x%-7s  faultinjection x%-7s  "
+        "campaign %s runs/s" % (name, results["instrument_seconds"],
+        "%.2f" % results["profiling_slowdown"]
+            if "profiling_slowdown" in results else "n/a",
+        "%.2f" % results["faultinjection_slowdown"]
+            if "faultinjection_slowdown" in results else "n/a",
+        "%.2f" % results["campaign_runs_per_second"]
+            if "campaign_runs_per_second" in results else "n/a"))
+  return results
+
+
+def benchPrograms():
+  suite = readSuite()
+  keepworkdir = options["workdir"] is not None
+  if not keepworkdir:
+    options["workdir"] = tempfile.mkdtemp(prefix="llfi_bench_")
+  results = {}
+  try:
+    for name in options["programs"]:
+      result = benchProgram(name, suite)
+      if result is not None:
+        results[name] = result
+  finally:
+    if not keepworkdir:
+      shutil.rmtree(options["workdir"], ignore_errors=True)
+  return results
+
+
+def version():
+  try:
+    p = subprocess.run(["git", "describe", "--always", "--dirty"],
+                       cwd=os.path.dirname(os.path.realpath(__file__)),
+                       stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    if p.returncode == 0:
+      return p.stdout.decode().strip()
+  except OSError:
+    pass
+  return "unknown"
+
+
+def main(args):
+  parseArgs(args)
+  results = {
+    "version": version(),
+    "date": datetime.datetime.now().isoformat(timespec="seconds"),
+    "host": platform.node(),
+    "cpus": os.cpu_count(),
+    "options": {"runs": options["runs"], "repeat": options["repeat"],
+                "iterations": options["iterations"]},
+  }
+  failed = False
+  if not options["no_runtime"]:
+    results["runtime"] = benchRuntime()
+    failed = results["runtime"] is None
+  if not options["no_kernels"]:
+    results["kernels"] = benchKernels()
+    failed = failed or results["kernels"] is None
+  if not options["no_programs"]:
+    results["programs"] = benchPrograms()
+    failed = failed or len(results["programs"]) < len(options["programs"])
+
+  with open(options["output"], 'w') as f:
+    json.dump(results, f, indent=2, sort_keys=True)
+    f.write("\n")
+  print("Results written to " + options["output"])
+  return 1 if failed else 0
+
+
+if __name__=="__main__":
+  sys.exit(main(sys.argv[1:]))
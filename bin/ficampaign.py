@@ -0,0 +1,168 @@
+"""
+The protocol between ficoordinator and its fiworker daemons.
+
+A campaign runs the fault injection runs of injectfault on several workers,
+each in its own copy of the program directory, on this host or on others.
+The coordinator connects to each worker over TCP or a Unix socket, and they
+exchange JSON messages, one per line, with the field "op" naming the message.
+
+coordinator -> worker:
+  setup     {exe, sha256, args, inputs, token}: the fault injection
+            executable, relative to the program directory, the digest of its
+            content, its options, the input files among them and the token of
+            the campaign
+  runs      {runs: [{id, config, timeout, limits}]}: runs to execute in order,
+            config being the lines of llfi.config.runtime.txt of the run
+  cancel    {ids}: give the runs back if they have not started yet
+  bye       {}: the campaign is over
+
+worker -> coordinator:
+  hello     {worker, version}: sent on connection
+  ready     {}: the setup matches the program directory of the worker
+  error     {msg}: the setup failed, the coordinator drops the worker
+  started   {id}: the run is executing, it can no longer be cancelled
+  result    {id, ret, masked, seconds, files}: the outcome of the run, ret
+            being the return of injectfault's execute(), masked telling if
+            injectfault counted it as masked (MK), and files the outputs of the
+            run as {<directory under llfi>/<name>: <base64 content>}
+  cancelled {ids}: the runs given back, among the ones of a cancel
+  heartbeat {}: sent periodically, a silent worker is deemed lost
+
+A TCP address without a host is on localhost: a worker listens on all the
+interfaces only when asked to with 0.0.0.0:<port> or *:<port>. Whoever can
+connect to a worker can run its executable, so the coordinator and the workers
+share a token, given by --token or by the LLFI_CAMPAIGN_TOKEN environment
+variable, and a worker only accepts the setup of a coordinator with its token.
+"""
+
+import os, sys, json, socket, base64, hashlib, hmac, threading, importlib.util
+from importlib.machinery import SourceFileLoader
+
+PROTOCOL_VERSION = 2
+HEARTBEAT_INTERVAL = 5
+TOKEN_ENV = "LLFI_CAMPAIGN_TOKEN"
+
+# the directories of the outputs of a run under the llfi directory, as written
+# by injectfault
+output_dirs = ("std_output", "error_output", "llfi_stat_output", "prog_output")
+
+
+def parseAddress(address, listening = False):
+  """Returns the socket family and address of unix:<path>, <path> with a
+  slash, or [<host>:]<port>. The host is localhost if there is none, and all
+  the interfaces for 0.0.0.0 or *, to listen to only"""
+  if address.startswith("unix:"):
+    return socket.AF_UNIX, address[len("unix:"):]
+  if '/' in address:
+    return socket.AF_UNIX, address
+  host, _, port = address.rpartition(':')
+  if host in ("0.0.0.0", "*"):
+    if not listening:
+      raise ValueError("%s has no host to connect to" % address)
+    host = "0.0.0.0"
+  return socket.AF_INET, (host or "localhost", int(port))
+
+
+def isLocalAddress(address):
+  """Whether only the processes of this host can connect to the address"""
+  family, addr = parseAddress(address, listening=True)
+  return family == socket.AF_UNIX or addr[0] in ("localhost", "127.0.0.1")
+
+
+def checkToken(token, received):
+  """Whether the token received matches the token of this process, both being
+  None if there is no token"""
+  if token is None or received is None:
+    return token is None and received is None
+  return hmac.compare_digest(token.encode("UTF-8"), received.encode("UTF-8"))
+
+
+def connect(address, timeout):
+  family, addr = parseAddress(address)
+  sock = socket.socket(family, socket.SOCK_STREAM)
+  sock.settimeout(timeout)
+  try:
+    sock.connect(addr)
+  except:
+    sock.close()
+    raise
+  sock.settimeout(None)
+  return sock
+
+
+def listen(address):
+  family, addr = parseAddress(address, listening=True)
+  sock = socket.socket(family, socket.SOCK_STREAM)
+  if family == socket.AF_UNIX:
+    if os.path.exists(addr):
+      os.remove(addr)
+  else:
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+  sock.bind(addr)
+  sock.listen(1)
+  return sock
+
+
+class Channel:
+  """A connection sending and receiving the messages of the protocol. Several
+  threads can send at the same time."""
+
+  def __init__(self, sock):
+    self.sock = sock
+    self.reader = sock.makefile('rb')
+    self.lock = threading.Lock()
+
+  def send(self, op, **fields):
+    fields["op"] = op
+    data = (json.dumps(fields) + '\n').encode("UTF-8")
+    with self.lock:
+      self.sock.sendall(data)
+
+  def receive(self):
+    """Returns the next message, or None at the end of the connection"""
+    line = self.reader.readline()
+    if not line:
+      return None
+    return json.loads(line.decode("UTF-8"))
+
+  def close(self):
+    try:
+      self.sock.shutdown(socket.SHUT_RDWR)
+    except OSError:
+      pass
+    self.reader.close()
+    self.sock.close()
+
+
+def encodeFile(path):
+  with open(path, 'rb') as f:
+    return base64.b64encode(f.read()).decode("ascii")
+
+
+def decodeFile(data, path):
+  with open(path, 'wb') as f:
+    f.write(base64.b64decode(data))
+
+
+def digest(path):
+  sha = hashlib.sha256()
+  with open(path, 'rb') as f:
+    for block in iter(lambda: f.read(1 << 20), b''):
+      sha.update(block)
+  return sha.hexdigest()
+
+
+def loadInjectfault():
+  """Imports injectfault, installed without the .py extension, to run and
+  record the runs exactly like it does"""
+  script_path = os.path.realpath(os.path.dirname(__file__))
+  for name in ("injectfault", "injectfault.py"):
+    path = os.path.join(script_path, name)
+    if os.path.isfile(path):
+      loader = SourceFileLoader("injectfault", path)
+      spec = importlib.util.spec_from_loader("injectfault", loader)
+      module = importlib.util.module_from_spec(spec)
+      loader.exec_module(module)
+      return module
+  print("ERROR: Unable to find injectfault in " + script_path, file=sys.stderr)
+  sys.exit(1)
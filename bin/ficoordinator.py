@@ -0,0 +1,588 @@
+#! /usr/bin/env python3
+
+"""
+
+%(prog)s executes the fault injection runs of input.yaml on fiworker daemons, on this host or on others, instead of running them one after the other like injectfault
+
+Usage: %(prog)s [OPTIONS] <fault injection executable> <the same options that you use to run the excutable before>
+
+List of options:
+
+--worker <address>:       Address of a worker, unix:<path> or <path> for a Unix socket, [<host>:]<port> for TCP, on localhost without a host (repeatable, or comma separated)
+--token <token>:          Token of the campaign, the one of the workers (default: $LLFI_CAMPAIGN_TOKEN)
+--shard <number>:         Runs sent to a worker at once at most (default: 16)
+--retries <number>:       Times a run is sent again when its worker is lost (default: 3)
+--worker-timeout <secs>:  Seconds after which a silent worker is deemed lost, and a campaign without any worker gives up (default: 60)
+--reconnect <secs>:       Seconds between the attempts to connect to a lost worker (default: 10)
+--resume:                 Skip the runs of the campaign journal, to resume an interrupted campaign
+--verbose:                Show the workers and the return codes of the runs
+--help(-h):               Show help information
+
+Prerequisite:
+Like injectfault, %(prog)s is invoked from the parent directory of the
+<fault injection executable>, which contains input.yaml. Each worker serves a
+copy of this directory: start them with 'fiworker --listen <address> <copy>'.
+Several workers on one host, each with its own copy, stand for several hosts.
+The workers only accept a coordinator with their token: set the same
+LLFI_CAMPAIGN_TOKEN in the environment of the coordinator and of the workers.
+
+The runs of every run option of input.yaml are drawn up front, so that the
+campaign does not depend on the workers, and sent in shards: each worker gets
+a shard as soon as it has at most one run left, of a size decreasing with the
+runs left. Once all runs are sent, an idle worker takes back the second half
+of the runs not started yet of the worker with the most of them, so that the
+hangs of a worker do not hold back the runs queued behind them. The runs of a
+lost worker, which closed the connection or stopped sending heartbeats, are
+sent again to the other workers.
+
+The outputs of each run are stored like injectfault stores them, under the
+run id <run option>-<run>, in std_output, error_output, llfi_stat_output and
+prog_output, so that the tools reading them, like 'fiplanner --estimate', work
+the same. The campaign journal llfi/campaign_journal.txt lists the runs
+stored, with the worker that ran them.
+
+The window_len, fi_max_multiple and window_len_multiple run options are not
+supported.
+"""
+
+import sys, os, time, math, random, threading, queue, collections
+import yaml
+# ficampaign and the injectfault it loads are imported from bin, which has to
+# stay free of bytecode caches
+sys.dont_write_bytecode = True
+import ficampaign
+
+prog = os.path.basename(sys.argv[0])
+injectfault = ficampaign.loadInjectfault()
+
+journalname = "campaign_journal.txt"
+defaultTimeout = 500
+# seconds to wait for a worker to accept a connection
+connectTimeout = 5
+
+options = {
+  "workers": [],
+  "shard": 16,
+  "retries": 3,
+  "worker-timeout": 60,
+  "reconnect": 10,
+  "resume": False,
+  "verbose": False,
+  "token": os.environ.get(ficampaign.TOKEN_ENV),
+}
+
+fi_exe = ""
+optionlist = []
+inputList = []
+
+
+def usage(msg = None):
+  retval = 0
+  if msg is not None:
+    retval = 1
+    msg = "ERROR: " + msg
+    print(msg, file=sys.stderr)
+  print(__doc__ % globals(), file=sys.stderr)
+  sys.exit(retval)
+
+
+def parseArgs(args):
+  global options, fi_exe, optionlist, inputList
+  valueopts = ["--worker", "--shard", "--retries", "--worker-timeout",
+               "--reconnect", "--token"]
+  argid = 0
+  while argid < len(args) and args[argid].startswith("-"):
+    arg = args[argid]
+    if arg in valueopts:
+      argid += 1
+      if argid == len(args):
+        usage("Missing value for " + arg)
+      value = args[argid]
+      if arg == "--worker":
+        options["workers"].extend(w for w in value.split(',') if w)
+      elif arg == "--token":
+        options["token"] = value
+      else:
+        try:
+          options[arg[2:]] = int(value)
+        except ValueError:
+          usage("Invalid value for " + arg + ": " + value)
+    elif arg == "--resume":
+      options["resume"] = True
+    elif arg == "--verbose":
+      options["verbose"] = True
+    elif arg == "--help" or arg == "-h":
+      usage()
+    else:
+      usage("Invalid argument: " + arg)
+    argid += 1
+
+  if argid == len(args):
+    usage("Must provide the fault injection executable and its options")
+  if not options["workers"]:
+    usage("Must provide at least one --worker")
+  for key in ("shard", "worker-timeout", "reconnect"):
+    if options[key] <= 0:
+      usage("--" + key + " must be greater than 0")
+  if options["retries"] < 0:
+    usage("--retries must not be negative")
+  for worker in options["workers"]:
+    try:
+      ficampaign.parseAddress(worker)
+    except ValueError:
+      usage("Invalid worker address: " + worker)
+
+  # the executable and its options, as injectfault takes them
+  fi_exe = os.path.realpath(args[argid])
+  basedir = os.path.dirname(os.path.dirname(fi_exe))
+  optionlist = args[argid + 1:]
+  for index, opt in enumerate(optionlist):
+    if os.path.isfile(opt):
+      if os.path.realpath(os.path.dirname(opt)) != basedir:
+        usage("File %s passed through option is not under current directory" % opt)
+      optionlist[index] = os.path.basename(opt)
+      inputList.append(optionlist[index])
+  if not os.path.isfile(fi_exe):
+    usage("The executable " + fi_exe + " does not exist")
+  os.chdir(basedir)
+
+
+################################################################################
+# The runs of the campaign, as {id, config, timeout, limits}, config being the
+# lines of llfi.config.runtime.txt written by injectfault for the run
+
+def mlLayerLines(fi_cycle):
+  lines = []
+  for layerNum, layerName, cycleStart, cycleEnd in injectfault.fi_ml_stats:
+    if fi_cycle >= cycleStart and fi_cycle <= cycleEnd:
+      lines.append("ml_layer_name=" + layerName)
+      lines.append("ml_layer_number=" + str(layerNum))
+  return lines
+
+
+def drawRuns():
+  global defaultTimeout
+  try:
+    with open("input.yaml", 'r') as f:
+      doc = yaml.safe_load(f)
+  except IOError:
+    usage("No input.yaml file in the parent directory of fault injection executable")
+  except yaml.YAMLError:
+    usage("input.yaml is not formatted in proper YAML (reminder: use spaces, not tabs)")
+  if "defaultTimeout" in doc:
+    defaultTimeout = int(doc["defaultTimeout"])
+  if "runOption" not in doc:
+    usage("Please include runOption in input.yaml")
+
+  injectfault.readCycles()
+  totalcycles = int(injectfault.totalcycles)
+  runs = []
+  for ii, run in enumerate(doc["runOption"]):
+    run = run["run"]
+    if "numOfRuns" not in run:
+      usage("Must include a run number per fi config in input.yaml")
+    run_number = run["numOfRuns"]
+    injectfault.checkValues("run_number", run_number)
+    for key in ("window_len", "fi_max_multiple", "window_len_multiple",
+                "window_len_multiple_startindex",
+                "window_len_multiple_endindex"):
+      if key in run:
+        usage("The %s run option of FI config #%d is not supported by %s" %
+              (key, ii, prog))
+    timeout = int(run.get("timeOut", defaultTimeout))
+    limits = {"memory": run.get("memoryLimit"),
+              "cpu": run.get("cpuTimeLimit"),
+              "cgroup": run.get("cgroupDir")}
+    for limit in ("memory", "cpu"):
+      if limits[limit] is not None:
+        limits[limit] = int(limits[limit])
+
+    fi_plan = None
+    if "fiPlan" in run:
+      if "fi_cycle" in run or "fi_index" in run:
+        usage("fiPlan and fi_cycle or fi_index cannot be specified at the "
+              "same time in the input.yaml file")
+      fi_plan = injectfault.readPlan(run["fiPlan"])
+      if run_number > len(fi_plan):
+        usage("numOfRuns is greater than the %d runs of the plan %s" %
+              (len(fi_plan), run["fiPlan"]))
+
+    common = []
+    if "fi_type" in run:
+      fi_type = run["fi_type"]
+      if fi_type in ("SoftwareFault", "AutoInjection", "Automated"):
+        try:
+          fi_type = doc["compileOption"]["instSelMethod"][0]["customInstselector"]["include"][0]
+        except (KeyError, IndexError, TypeError):
+          usage("Cannot extract fi_type from instSelMethod. Please check the "
+                "customInstselector field in input.yaml")
+      common.append("fi_type=" + fi_type)
+    if run.get("virtualTime", False):
+      common.append("virtual_time=1")
+    if int(run.get("lockstep", 0)) > 0:
+      common.append("lockstep=" + str(run["lockstep"]))
+    if int(run.get("runtimeStats", 0)) > 0:
+      common.append("runtime_stats=" + str(run["runtimeStats"]))
+    for key in ("fi_reg_index", "fi_bit", "fi_num_bits"):
+      if key in run:
+        common.append(key + "=" + str(run[key]))
+
+    # seeded once per run option, like injectfault
+    rng = random.Random(run.get("fi_random_seed"))
+    for index in range(run_number):
+      lines = []
+      if fi_plan:
+        lines.append("fi_index=" + str(fi_plan[index][0]))
+        lines.append("fi_instance=" + str(fi_plan[index][1]))
+      elif "fi_cycle" in run:
+        lines.extend(mlLayerLines(int(run["fi_cycle"])))
+        lines.append("fi_cycle=" + str(run["fi_cycle"]))
+      elif "fi_index" in run:
+        lines.append("fi_index=" + str(run["fi_index"]))
+      else:
+        fi_cycle = rng.randint(1, totalcycles)
+        fi_thread = None
+        if len(injectfault.fi_thread_cycles) > 0:
+          fi_thread, fi_cycle = injectfault.threadOfCycle(fi_cycle)
+        # the ML layers are timed in the cycles of the main thread
+        if fi_thread is None or fi_thread == 0:
+          lines.extend(mlLayerLines(fi_cycle))
+        lines.append("fi_cycle=" + str(fi_cycle))
+        if fi_thread is not None:
+          lines.append("fi_thread=" + str(fi_thread))
+      runs.append({"id": "%d-%d" % (ii, index), "config": lines + common,
+                   "timeout": timeout, "limits": limits})
+  return runs
+
+
+################################################################################
+# The campaign store: the output directories of injectfault and the journal
+
+class Store:
+  def __init__(self, resume):
+    injectfault.fi_exe = fi_exe
+    injectfault.config()
+    self.llfi_dir = os.path.dirname(fi_exe)
+    self.path = os.path.join(self.llfi_dir, journalname)
+    self.done = set()
+    self.return_codes = collections.Counter()
+    if resume and os.path.isfile(self.path):
+      with open(self.path, 'r') as f:
+        for line in f:
+          if line.startswith("run="):
+            run_id, worker, ret, seconds = line[len("run="):].rstrip('\n').split(',')
+            self.done.add(run_id)
+    self.journal = open(self.path, 'a' if resume else 'w')
+    if not resume or self.journal.tell() == 0:
+      self.journal.write("# run=<run id>,<worker>,<return of the run>,<seconds>\n")
+      self.journal.write("# lost=<run id>: its workers were lost too many times\n")
+      self.journal.flush()
+
+  def store(self, worker, msg):
+    """Stores the outputs of a run, unless it is stored already"""
+    if msg["id"] in self.done:
+      return False
+    for name, data in msg["files"].items():
+      dirname, _, filename = name.partition('/')
+      if dirname not in ficampaign.output_dirs or \
+          filename != os.path.basename(filename) or filename in ("", ".", ".."):
+        print("WARNING: Ignoring the output %s of run %s from %s" %
+              (name, msg["id"], worker))
+        continue
+      ficampaign.decodeFile(data, os.path.join(self.llfi_dir, dirname, filename))
+    self.journal.write("run=%s,%s,%s,%.3f\n" %
+                       (msg["id"], worker, msg["ret"], msg["seconds"]))
+    self.journal.flush()
+    self.done.add(msg["id"])
+    ret = msg["ret"]
+    if ret.endswith("-limit"):
+      self.return_codes["RL"] += 1
+    elif ret == "timed-out":
+      self.return_codes["TO"] += 1
+    elif msg["masked"]:
+      self.return_codes["MK"] += 1
+    else:
+      self.return_codes[int(ret)] += 1
+    return True
+
+  def lost(self, run_id):
+    self.journal.write("lost=%s\n" % run_id)
+    self.journal.flush()
+
+  def close(self):
+    self.journal.close()
+
+
+################################################################################
+# The workers
+
+class Worker:
+  def __init__(self, address):
+    self.address = address
+    self.name = address
+    # down, setup (waiting for ready), ready or failed (never used again)
+    self.state = "down"
+    self.channel = None
+    # connection number, to ignore the messages of the previous connections
+    self.generation = 0
+    # ids of the runs sent and neither done nor cancelled, in order
+    self.assigned = []
+    self.running = None
+    self.cancelling = False
+    self.lastSeen = 0
+    self.retryAt = 0
+    self.runs = 0
+    self.losses = 0
+
+  def stealable(self):
+    return [run_id for run_id in self.assigned if run_id != self.running]
+
+
+def receiver(worker, generation, channel, events):
+  try:
+    while True:
+      msg = channel.receive()
+      events.put((worker, generation, msg))
+      if msg is None:
+        return
+  except (OSError, ValueError):
+    events.put((worker, generation, None))
+
+
+class Campaign:
+  def __init__(self, runs, store):
+    self.runs = dict((run["id"], run) for run in runs)
+    self.total = len(runs)
+    self.store = store
+    self.queue = collections.deque(run["id"] for run in runs
+                                   if run["id"] not in store.done)
+    self.attempts = collections.Counter()
+    self.failed = 0
+    self.steals = 0
+    self.retried = 0
+    self.events = queue.Queue()
+    self.workers = [Worker(address) for address in options["workers"]]
+    self.connectedAt = time.time()
+
+  def finished(self):
+    return len(self.store.done) + self.failed >= self.total
+
+  def log(self, msg):
+    if options["verbose"]:
+      print(msg)
+      sys.stdout.flush()
+
+  def send(self, worker, op, **fields):
+    try:
+      worker.channel.send(op, **fields)
+    except OSError as e:
+      self.lose(worker, str(e))
+
+  def connect(self, worker):
+    try:
+      sock = ficampaign.connect(worker.address, connectTimeout)
+    except (OSError, ValueError) as e:
+      if worker.retryAt == 0:
+        print("WARNING: Unable to connect to the worker %s: %s" %
+              (worker.address, e))
+      worker.retryAt = time.time() + options["reconnect"]
+      return
+    worker.channel = ficampaign.Channel(sock)
+    worker.generation += 1
+    worker.state = "setup"
+    worker.lastSeen = time.time()
+    threading.Thread(target=receiver, daemon=True,
+                     args=(worker, worker.generation, worker.channel,
+                           self.events)).start()
+    self.send(worker, "setup", exe=os.path.relpath(fi_exe),
+              sha256=ficampaign.digest(fi_exe), args=optionlist,
+              inputs=inputList, token=options["token"])
+
+  def lose(self, worker, reason):
+    """Closes the connection and queues the runs of the worker again"""
+    if worker.state in ("down", "failed"):
+      return
+    print("WARNING: Lost the worker %s: %s" % (worker.name, reason))
+    worker.channel.close()
+    worker.state = "down"
+    worker.generation += 1
+    worker.retryAt = time.time() + options["reconnect"]
+    worker.losses += 1
+    for run_id in reversed(worker.assigned):
+      self.attempts[run_id] += 1
+      if self.attempts[run_id] > options["retries"]:
+        print("ERROR: Giving up run %s, lost %d times" %
+              (run_id, self.attempts[run_id]))
+        self.store.lost(run_id)
+        self.failed += 1
+      else:
+        self.queue.appendleft(run_id)
+        self.retried += 1
+    worker.assigned = []
+    worker.running = None
+    worker.cancelling = False
+
+  def shardSize(self):
+    ready = sum(1 for worker in self.workers if worker.state == "ready")
+    size = int(math.ceil(len(self.queue) / (2.0 * max(ready, 1))))
+    return max(1, min(options["shard"], size))
+
+  def schedule(self):
+    # a worker gets its next shard while running the last run of its current
+    # one, so that it does not wait for it
+    for worker in self.workers:
+      if worker.state == "ready" and len(worker.assigned) <= 1 and self.queue:
+        shard = [self.queue.popleft()
+                 for i in range(min(self.shardSize(), len(self.queue)))]
+        worker.assigned.extend(shard)
+        self.log("%s: runs %s" % (worker.name, ' '.join(shard)))
+        self.send(worker, "runs", runs=[self.runs[run_id] for run_id in shard])
+
+    # then idle workers take the runs not started yet of the others, one
+    # cancel at a time
+    if self.queue or any(worker.cancelling for worker in self.workers):
+      return
+    if not any(worker.state == "ready" and not worker.assigned
+               for worker in self.workers):
+      return
+    victims = [worker for worker in self.workers if worker.state == "ready"
+               and (len(worker.stealable()) > 1 or
+                    (worker.stealable() and worker.running is not None))]
+    if not victims:
+      return
+    victim = max(victims, key=lambda worker: len(worker.stealable()))
+    stealable = victim.stealable()
+    ids = stealable[len(stealable) // 2:]
+    victim.cancelling = True
+    self.log("%s: cancel %s" % (victim.name, ' '.join(ids)))
+    self.send(victim, "cancel", ids=ids)
+
+  def handle(self, worker, msg):
+    worker.lastSeen = time.time()
+    op = msg["op"]
+    if op == "hello":
+      worker.name = msg["worker"]
+      if msg["version"] != ficampaign.PROTOCOL_VERSION:
+        print("ERROR: The worker %s speaks version %s of the protocol, not %d"
+              % (worker.name, msg["version"], ficampaign.PROTOCOL_VERSION))
+        worker.channel.close()
+        worker.state = "failed"
+    elif op == "ready":
+      worker.state = "ready"
+      self.log("%s: ready" % worker.name)
+    elif op == "error":
+      print("ERROR: The worker %s failed: %s" % (worker.name, msg["msg"]))
+      worker.channel.close()
+      worker.state = "failed"
+    elif op == "started":
+      worker.running = msg["id"]
+    elif op == "result":
+      if msg["id"] in worker.assigned:
+        worker.assigned.remove(msg["id"])
+      worker.running = None
+      worker.runs += 1
+      if self.store.store(worker.name, msg):
+        injectfault.print_progressbar(len(self.store.done), self.total)
+    elif op == "cancelled":
+      worker.cancelling = False
+      for run_id in reversed(msg["ids"]):
+        worker.assigned.remove(run_id)
+        self.queue.appendleft(run_id)
+      if msg["ids"]:
+        self.steals += 1
+    self.schedule()
+
+  def tick(self):
+    now = time.time()
+    for worker in self.workers:
+      if worker.state in ("setup", "ready"):
+        if now - worker.lastSeen > options["worker-timeout"]:
+          self.lose(worker, "no heartbeat for %d seconds" %
+                    options["worker-timeout"])
+      elif worker.state == "down" and now >= worker.retryAt:
+        self.connect(worker)
+    if any(worker.state in ("setup", "ready") for worker in self.workers):
+      self.connectedAt = now
+    elif now - self.connectedAt > options["worker-timeout"]:
+      print("ERROR: No worker for %d seconds, giving up. Run %s again with "
+            "--resume to resume the campaign." % (options["worker-timeout"], prog))
+      return False
+    self.schedule()
+    return True
+
+  def run(self):
+    lastTick = 0
+    while not self.finished():
+      if time.time() - lastTick >= 1:
+        lastTick = time.time()
+        if not self.tick():
+          return False
+      try:
+        worker, generation, msg = self.events.get(timeout=1)
+      except queue.Empty:
+        continue
+      if generation != worker.generation or worker.state in ("down", "failed"):
+        continue
+      if msg is None:
+        self.lose(worker, "connection closed")
+        self.schedule()
+      else:
+        self.handle(worker, msg)
+    return True
+
+  def close(self):
+    for worker in self.workers:
+      if worker.state in ("setup", "ready"):
+        try:
+          worker.channel.send("bye")
+        except OSError:
+          pass
+        worker.channel.close()
+        worker.state = "down"
+
+
+################################################################################
+def main(args):
+  parseArgs(args)
+  runs = drawRuns()
+  store = Store(options["resume"])
+  campaign = Campaign(runs, store)
+  print("======Fault Injection Campaign======")
+  print("%d runs on %d workers, %d stored already" %
+        (len(runs), len(campaign.workers), len(store.done)))
+  sys.stdout.flush()
+
+  start = time.time()
+  try:
+    completed = campaign.run()
+  except KeyboardInterrupt:
+    print("\nInterrupted. Run %s again with --resume to resume the campaign." % prog)
+    completed = False
+  finally:
+    campaign.close()
+    store.close()
+  elapsed = time.time() - start
+
+  print("")
+  print("========== SUMMARY ==========")
+  stored = len(store.done)
+  print("Runs stored: %d / %d, lost: %d" % (stored, len(runs), campaign.failed))
+  print("Runs sent again: %d, shards stolen: %d" %
+        (campaign.retried, campaign.steals))
+  print("Time: %.1f s, %.2f runs/s" %
+        (elapsed, sum(w.runs for w in campaign.workers) / max(elapsed, 1e-9)))
+  if options["verbose"]:
+    print("Workers: (worker:\truns\tlosses)")
+    for worker in campaign.workers:
+      print("  %s: %5d %5d" % (worker.name, worker.runs, worker.losses))
+    print("Return codes: (code:\toccurance)")
+    for r in list(store.return_codes.keys()):
+      print(("  %3s: %5d" % (str(r), store.return_codes[r])))
+  if not completed or campaign.failed > 0:
+    sys.exit(1)
+
+
+if __name__=="__main__":
+  if len(sys.argv) == 1:
+    usage('Must provide the fault injection executable and its options')
+  main(sys.argv[1:])
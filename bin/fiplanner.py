@@ -0,0 +1,513 @@
+#! /usr/bin/env python3
+
+"""
+
+%(prog)s plans the fault injection runs of a program instrumented with the 'profileSites' compile option, by stratified and importance sampling of the fault sites, and estimates the SDC and crash rates of the runs
+
+Usage: %(prog)s [OPTIONS] [<directory of source IR file>]
+
+List of options:
+
+--runs <number>:            Number of runs to plan
+--stratify <key>:           Group the sites into strata by 'class' (opcode class, e.g. control or address), 'opcode', 'function', 'layer' (ML layer), 'site' or 'none' (default: class)
+--allocation <scheme>:      Runs of each stratum: 'equal', 'proportional' to the cycles of the stratum, 'sqrt' of them, or 'neyman' to the cycles of the stratum times the deviation of its estimated SDC rate, with --model (default: equal)
+--minruns <number>:         Runs of each stratum at least, if there are enough runs (default: 1)
+--exponent <a>:             Sample the sites of a stratum in proportion to their cycles to the power a: 1 samples the cycles uniformly, like fault injection without a plan, 0 samples the sites uniformly (default: 1)
+--boost <opcode|class>=<f>: Sample the sites of this opcode or opcode class f times more (repeatable)
+--model:                    Sample the sites of a stratum in proportion to the deviation sqrt(p(1-p)) of their SDC probability p estimated by the 'estimateSDC' compile option
+--seed <number>:            Seed of the random draws
+--estimate:                 Estimate the outcome rates of the fault injection runs of the plan instead of planning
+--verbose:                  Show the strata
+--help(-h):                 Show help information
+
+%(prog)s reads llfi.stat.sitetable.txt, written by instrument, and the
+dynamic instances of each site in llfi.stat.prof.txt, written by profile, and
+writes the plan to llfi.config.fiplan.txt. A plan draws a stratum for each run,
+then a site of the stratum, then one of its dynamic instances uniformly. The
+fiPlan run option of input.yaml makes injectfault inject into the planned
+instances, in the order of the plan.
+
+With --estimate, %(prog)s reads the outcome of each fault injection run, and
+weighs it by the probability of its site without a plan over its probability in
+the plan, so that the rates estimate the ones of fault injection without a plan:
+the rate of the program is the sum of the rates of the strata weighted by their
+share of the cycles. If llfi.stat.sdc.txt exists, the SDC rates estimated by
+the 'estimateSDC' compile option are shown next to the ones of the runs, to
+validate the model before planning with --model.
+"""
+
+import sys, os, math, random
+
+prog = os.path.basename(sys.argv[0])
+
+sitetablefile = "llfi.stat.sitetable.txt"
+proffile = "llfi.stat.prof.txt"
+planfile = "llfi.config.fiplan.txt"
+sdcfile = "llfi.stat.sdc.txt"
+
+options = {
+  "dir": ".",
+  "runs": None,
+  "stratify": "class",
+  "allocation": "equal",
+  "minruns": 1,
+  "exponent": 1.0,
+  "boost": {},
+  "seed": None,
+  "model": False,
+  "estimate": False,
+  "verbose": False,
+}
+
+opcodeclasses = {
+  "control": ["icmp", "fcmp", "br", "switch", "indirectbr", "select"],
+  "address": ["getelementptr", "alloca", "inttoptr", "ptrtoint"],
+  "memory": ["load", "store", "atomicrmw", "cmpxchg", "fence"],
+  "fparith": ["fadd", "fsub", "fmul", "fdiv", "frem", "fneg"],
+  "intarith": ["add", "sub", "mul", "udiv", "sdiv", "urem", "srem", "shl",
+               "lshr", "ashr", "and", "or", "xor"],
+  "cast": ["trunc", "zext", "sext", "fptrunc", "fpext", "fptoui", "fptosi",
+           "uitofp", "sitofp", "bitcast", "addrspacecast"],
+  "call": ["call", "invoke"],
+  "vector": ["extractelement", "insertelement", "shufflevector",
+             "extractvalue", "insertvalue"],
+  "phi": ["phi"],
+}
+opcodeclass = dict((opcode, name) for name in opcodeclasses
+                   for opcode in opcodeclasses[name])
+
+outcomes = ["sdc", "crash", "hang", "benign"]
+
+
+def usage(msg = None):
+  retval = 0
+  if msg is not None:
+    retval = 1
+    msg = "ERROR: " + msg
+    print(msg, file=sys.stderr)
+  print(__doc__ % globals(), file=sys.stderr)
+  sys.exit(retval)
+
+
+def parseArgs(args):
+  global options
+  valueopts = ["--runs", "--stratify", "--allocation", "--minruns",
+               "--exponent", "--boost", "--seed"]
+  argid = 0
+  while argid < len(args):
+    arg = args[argid]
+    if arg in valueopts:
+      argid += 1
+      if argid == len(args):
+        usage("Missing value for " + arg)
+      value = args[argid]
+      try:
+        if arg in ("--runs", "--minruns", "--seed"):
+          options[arg[2:]] = int(value)
+        elif arg == "--exponent":
+          options["exponent"] = float(value)
+        elif arg == "--boost":
+          key, factor = value.split('=')
+          options["boost"][key] = float(factor)
+        else:
+          options[arg[2:]] = value
+      except ValueError:
+        usage("Invalid value for " + arg + ": " + value)
+    elif arg == "--model":
+      options["model"] = True
+    elif arg == "--estimate":
+      options["estimate"] = True
+    elif arg == "--verbose":
+      options["verbose"] = True
+    elif arg == "--help" or arg == "-h":
+      usage()
+    elif arg.startswith("-"):
+      usage("Invalid argument: " + arg)
+    else:
+      options["dir"] = arg
+    argid += 1
+
+  if options["stratify"] not in ("class", "opcode", "function", "layer",
+                                 "site", "none"):
+    usage("Invalid value for --stratify: " + options["stratify"])
+  if options["allocation"] not in ("equal", "proportional", "sqrt", "neyman"):
+    usage("Invalid value for --allocation: " + options["allocation"])
+  if options["allocation"] == "neyman" and not options["model"]:
+    usage("--allocation neyman needs --model")
+  if not options["estimate"] and (options["runs"] is None or
+                                  options["runs"] <= 0):
+    usage("--runs must be greater than 0")
+  if options["minruns"] < 0:
+    usage("--minruns must not be negative")
+  if options["exponent"] < 0:
+    usage("--exponent must not be negative")
+  for key, factor in options["boost"].items():
+    if factor <= 0:
+      usage("The factor of --boost " + key + " must be greater than 0")
+
+
+################################################################################
+# Planning
+
+def readSites(dirpath):
+  """Returns the sites of the site table that are executed by profiling, with
+  their dynamic instances and cycles"""
+  counts = {}
+  try:
+    with open(os.path.join(dirpath, proffile), 'r') as f:
+      for line in f:
+        if line.startswith("site="):
+          index, instances, cycles = line[len("site="):].split(',')
+          counts[int(index)] = (int(instances), int(cycles))
+  except IOError:
+    usage("Unable to open " + proffile + ", please run profile first")
+  if not counts:
+    usage(proffile + " has no site counts, please run instrument with the "
+          "profileSites compile option")
+
+  sites = []
+  try:
+    f = open(os.path.join(dirpath, sitetablefile), 'r')
+  except IOError:
+    usage("Unable to open " + sitetablefile + ", please run instrument with "
+          "the profileSites compile option")
+  for line in f:
+    if not line.startswith("site="):
+      continue
+    index, opcode, numregs, layernum, layername, func = \
+        line[len("site="):].rstrip('\n').split(',', 5)
+    index = int(index)
+    # the sites of opcodes without cycles are never injected
+    if index not in counts or counts[index][1] == 0:
+      continue
+    sites.append({"index": index, "opcode": opcode, "func": func,
+                  "layer": "%s:%s" % (layernum, layername.lower())
+                           if int(layernum) > 0 else "none",
+                  "instances": counts[index][0], "cycles": counts[index][1]})
+  f.close()
+  return sites
+
+
+def readModel(dirpath):
+  """Returns the estimated SDC probability of each site, or None if the
+  estimateSDC compile option was not used"""
+  model = {}
+  try:
+    with open(os.path.join(dirpath, sdcfile), 'r') as f:
+      for line in f:
+        if line.startswith("site="):
+          index, opcode, sdc = line[len("site="):].split(',')
+          model[int(index)] = float(sdc)
+  except IOError:
+    return None
+  return model
+
+
+def deviation(sdc):
+  """Standard deviation of the outcome of a run, with the SDC probabilities
+  of the model bounded away from 0 and 1, where the model is the least
+  accurate"""
+  sdc = min(max(sdc, 0.01), 0.99)
+  return math.sqrt(sdc * (1 - sdc))
+
+
+def stratumOf(site):
+  key = options["stratify"]
+  if key == "class":
+    return opcodeclass.get(site["opcode"], "other")
+  elif key == "opcode":
+    return site["opcode"]
+  elif key == "function":
+    return site["func"]
+  elif key == "layer":
+    return site["layer"]
+  elif key == "site":
+    return str(site["index"])
+  return "all"
+
+
+def allocateRuns(strata, runs):
+  """Splits the runs between the strata, by largest remainder"""
+  names = sorted(strata)
+  total = float(sum(strata[name]["cycles"] for name in names))
+  if options["allocation"] == "proportional":
+    shares = [strata[name]["cycles"] / total for name in names]
+  elif options["allocation"] == "sqrt":
+    roots = [math.sqrt(strata[name]["cycles"]) for name in names]
+    shares = [root / sum(roots) for root in roots]
+  elif options["allocation"] == "neyman":
+    # the runs minimize the variance of the SDC rate of the program
+    spreads = [strata[name]["cycles"] * deviation(sum(site["cycles"] *
+               site["sdc"] for site in strata[name]["sites"]) /
+               float(strata[name]["cycles"])) for name in names]
+    shares = [spread / sum(spreads) for spread in spreads]
+  else:
+    shares = [1.0 / len(names)] * len(names)
+
+  # the smallest strata get their minimum runs first
+  allocation = dict((name, 0) for name in names)
+  left = runs
+  for name in sorted(names, key=lambda name: strata[name]["cycles"]):
+    if left == 0:
+      break
+    allocation[name] = min(options["minruns"], left)
+    left -= allocation[name]
+
+  wanted = [max(share * runs - allocation[name], 0.0)
+            for name, share in zip(names, shares)]
+  if left > 0 and sum(wanted) > 0:
+    scale = left / sum(wanted)
+    wanted = [want * scale for want in wanted]
+    for name, want in zip(names, wanted):
+      allocation[name] += int(want)
+      left -= int(want)
+    order = sorted(range(len(names)),
+                   key=lambda i: wanted[i] - int(wanted[i]), reverse=True)
+    for i in order[:left]:
+      allocation[names[i]] += 1
+  return allocation
+
+
+def plan():
+  sites = readSites(options["dir"])
+  if options["seed"] is not None:
+    random.seed(options["seed"])
+  if options["model"]:
+    model = readModel(options["dir"])
+    if model is None:
+      usage("Unable to open " + sdcfile + ", please run instrument with the "
+            "estimateSDC compile option")
+    for site in sites:
+      site["sdc"] = model.get(site["index"], 0.0)
+
+  strata = {}
+  for site in sites:
+    stratum = strata.setdefault(stratumOf(site), {"sites": [], "cycles": 0})
+    stratum["sites"].append(site)
+    stratum["cycles"] += site["cycles"]
+  totalcycles = float(sum(stratum["cycles"] for stratum in strata.values()))
+  allocation = allocateRuns(strata, options["runs"])
+
+  runs = []
+  for name, stratum in strata.items():
+    # proposal of each site, and the weight of its runs: its probability
+    # without a plan over its probability in the plan
+    proposal = []
+    for site in stratum["sites"]:
+      boost = options["boost"].get(site["opcode"],
+          options["boost"].get(opcodeclass.get(site["opcode"], "other"), 1.0))
+      if options["model"]:
+        boost *= deviation(site["sdc"])
+      proposal.append(site["cycles"] ** options["exponent"] * boost)
+    norm = sum(proposal)
+    for site, q in zip(stratum["sites"], proposal):
+      site["weight"] = (site["cycles"] / float(stratum["cycles"])) / (q / norm)
+
+    for site in random.choices(stratum["sites"], weights=proposal,
+                               k=allocation[name]):
+      runs.append((site["index"], random.randint(1, site["instances"])))
+  # any prefix of the plan samples the strata alike, for fewer numOfRuns
+  random.shuffle(runs)
+
+  with open(os.path.join(options["dir"], planfile), 'w') as f:
+    f.write("# do not edit\n")
+    f.write("# stratum=<name>,<share of the cycles>,<runs>\n")
+    f.write("# site=<llfi index>,<stratum>,<weight>\n")
+    f.write("# run=<llfi index>,<dynamic instance>\n")
+    f.write("stratify=%s\n" % options["stratify"])
+    for name in sorted(strata):
+      f.write("stratum=%s,%.17g,%d\n" % (name,
+              strata[name]["cycles"] / totalcycles, allocation[name]))
+    for site in sorted(sites, key=lambda site: site["index"]):
+      f.write("site=%d,%s,%.17g\n" % (site["index"], stratumOf(site),
+                                      site["weight"]))
+    for index, instance in runs:
+      f.write("run=%d,%d\n" % (index, instance))
+
+  if options["verbose"]:
+    for name in sorted(strata):
+      print("stratum %s: %d sites, %.4f%% of the cycles, %d runs" % (name,
+            len(strata[name]["sites"]),
+            100 * strata[name]["cycles"] / totalcycles, allocation[name]))
+  print("Planned %d runs over %d strata of %d sites" % (len(runs),
+        len(strata), len(sites)))
+  if not options["verbose"]:
+    empty = [name for name in strata if allocation[name] == 0]
+    if empty:
+      print("WARNING: %d strata have no run, increase --runs" % len(empty))
+
+
+################################################################################
+# Estimation
+
+def readPlan(path):
+  strata = {}
+  sites = {}
+  runs = []
+  try:
+    f = open(path, 'r')
+  except IOError:
+    usage("Unable to open " + path + ", please run " + prog + " first")
+  for line in f:
+    line = line.rstrip('\n')
+    if line.startswith("stratum="):
+      name, share, numruns = line[len("stratum="):].rsplit(',', 2)
+      strata[name] = float(share)
+    elif line.startswith("site="):
+      index, rest = line[len("site="):].split(',', 1)
+      name, weight = rest.rsplit(',', 1)
+      sites[int(index)] = (name, float(weight))
+    elif line.startswith("run="):
+      index, instance = line[len("run="):].split(',')
+      runs.append((int(index), int(instance)))
+  f.close()
+  return strata, sites, runs
+
+
+def runOutcome(llfidir, run_id, golden):
+  errorfile = os.path.join(llfidir, "error_output", "errorfile-run-" + run_id)
+  if os.path.isfile(errorfile):
+    with open(errorfile, 'r') as f:
+      error = f.read()
+    return "hang" if "hang" in error else "crash"
+  lockstepfile = os.path.join(llfidir, "llfi_stat_output",
+                              "llfi.stat.lockstep." + run_id + ".txt")
+  if os.path.isfile(lockstepfile):
+    with open(lockstepfile, 'r') as f:
+      if "result=masked\n" in f.read():
+        return "benign"
+  outputfile = os.path.join(llfidir, "std_output",
+                            "std_outputfile-run-" + run_id)
+  output = None
+  if os.path.isfile(outputfile):
+    with open(outputfile, 'rb') as f:
+      output = f.read()
+  return "benign" if output == golden else "sdc"
+
+
+def readRuns(llfidir):
+  """Returns the injected llfi index and the outcome of each run"""
+  statdir = os.path.join(llfidir, "llfi_stat_output")
+  goldenfile = os.path.join(llfidir, "baseline", "golden_std_output")
+  try:
+    with open(goldenfile, 'rb') as f:
+      golden = f.read()
+  except IOError:
+    usage("Unable to open " + goldenfile + ", please run profile first")
+
+  prefix = "llfi.stat.fi.injectedfaults."
+  runs = []
+  for name in sorted(os.listdir(statdir)) if os.path.isdir(statdir) else []:
+    if not name.startswith(prefix) or not name.endswith(".txt"):
+      continue
+    run_id = name[len(prefix):-len(".txt")]
+    index = None
+    with open(os.path.join(statdir, name), 'r') as f:
+      for line in f:
+        for field in line.split(','):
+          field = field.strip()
+          if field.startswith("fi_index="):
+            index = int(field[len("fi_index="):])
+            break
+        if index is not None:
+          break
+    if index is not None:
+      runs.append((index, runOutcome(llfidir, run_id, golden)))
+  return runs
+
+
+def estimate():
+  strata, sites, planned = readPlan(os.path.join(options["dir"], planfile))
+  llfidir = os.path.join(options["dir"], "llfi")
+  runs = readRuns(llfidir)
+
+  # SDC rate of each stratum estimated by the model, weighted by the cycles
+  modelsdc = None
+  model = readModel(options["dir"])
+  if model is not None:
+    modelsdc = {}
+    for site in readSites(options["dir"]):
+      if site["index"] not in sites:
+        continue
+      name = sites[site["index"]][0]
+      acc = modelsdc.setdefault(name, [0.0, 0])
+      acc[0] += site["cycles"] * model.get(site["index"], 0.0)
+      acc[1] += site["cycles"]
+    modelsdc = dict((name, acc[0] / acc[1]) for name, acc in modelsdc.items()
+                    if acc[1] > 0)
+
+  # weighted outcomes of each stratum
+  results = dict((name, []) for name in strata)
+  unplanned = 0
+  for index, outcome in runs:
+    if index not in sites:
+      unplanned += 1
+      continue
+    name, weight = sites[index]
+    results[name].append((weight, outcome))
+
+  def rate(samples, outcome):
+    """Self-normalized importance sampling estimate and its variance"""
+    total = sum(weight for weight, _ in samples)
+    mean = sum(weight for weight, o in samples if o == outcome) / total
+    variance = sum((weight * ((o == outcome) - mean)) ** 2
+                   for weight, o in samples) / total ** 2
+    return mean, variance
+
+  print("%-16s %9s %6s %7s  %s%s" % ("stratum", "cycles%", "runs", "ess",
+        "  ".join("%-17s" % outcome for outcome in outcomes),
+        "  model sdc" if modelsdc is not None else ""))
+  overall = dict((outcome, [0.0, 0.0]) for outcome in outcomes)
+  covered = 0.0
+  modelrate = 0.0
+  for name in sorted(strata):
+    samples = results[name]
+    if not samples:
+      if options["verbose"]:
+        print("%-16s %8.4f%% %6d" % (name, 100 * strata[name], 0))
+      continue
+    covered += strata[name]
+    # effective sample size of the weighted runs
+    ess = sum(w for w, _ in samples) ** 2 / sum(w * w for w, _ in samples)
+    columns = []
+    for outcome in outcomes:
+      mean, variance = rate(samples, outcome)
+      overall[outcome][0] += strata[name] * mean
+      overall[outcome][1] += strata[name] ** 2 * variance
+      columns.append("%6.2f%% +-%6.2f%%" % (100 * mean,
+                                             196 * math.sqrt(variance)))
+    if modelsdc is not None:
+      modelrate += strata[name] * modelsdc.get(name, 0.0)
+      columns.append("%6.2f%%" % (100 * modelsdc.get(name, 0.0)))
+    print("%-16s %8.4f%% %6d %7.1f  %s" % (name, 100 * strata[name],
+          len(samples), ess, "  ".join(columns)))
+
+  if covered == 0:
+    print("No fault injection run of the plan was found in " + llfidir)
+    return
+  columns = ["%6.2f%% +-%6.2f%%" % (100 * overall[outcome][0] / covered,
+             196 * math.sqrt(overall[outcome][1]) / covered)
+             for outcome in outcomes]
+  if modelsdc is not None:
+    columns.append("%6.2f%%" % (100 * modelrate / covered))
+  print("%-16s %8.4f%% %6d %7s  %s" % ("program", 100 * covered,
+        len(runs) - unplanned, "", "  ".join(columns)))
+  print("The rates are given with their 95% confidence intervals")
+  if covered < 0.9999:
+    print("WARNING: the strata with runs only cover %.2f%% of the cycles" %
+          (100 * covered))
+  if unplanned:
+    print("WARNING: %d runs injected into sites that are not in the plan" %
+          unplanned)
+
+
+def main(args):
+  parseArgs(args)
+  if options["estimate"]:
+    estimate()
+  else:
+    plan()
+
+
+if __name__=="__main__":
+  main(sys.argv[1:])
@@ -0,0 +1,280 @@
+#! /usr/bin/env python3
+
+"""
+
+%(prog)s is a worker daemon of ficoordinator: it executes the fault injection runs of a campaign in its own copy of the program directory, and sends their outputs back to the coordinator
+
+Usage: %(prog)s [OPTIONS] <program directory>
+
+List of options:
+
+--listen <address>:   Address to listen to, unix:<path> or <path> for a Unix socket, [<host>:]<port> for TCP, on localhost without a host, and on all the interfaces with 0.0.0.0:<port> or *:<port> (default: unix:<program directory>/fiworker.sock)
+--name <name>:        Name of the worker in the campaign (default: <host>:<pid>)
+--token <token>:      Token of the campaign, that the coordinator must send (default: $LLFI_CAMPAIGN_TOKEN)
+--once:               Exit at the end of the first campaign
+--verbose:            Show the output of injectfault for each run
+--help(-h):           Show help information
+
+Prerequisite:
+The program directory is a copy of the directory of the program on the
+coordinator, with the fault injection executable under llfi/ and the input
+files of the program, like for injectfault. Each worker executes one run at a
+time and writes llfi.config.runtime.txt in its program directory, so the
+workers of a host need one copy each: start one worker per core to use.
+
+The outputs of a run are removed from the program directory once sent: the
+campaign is stored by the coordinator.
+
+Whoever can connect to the worker can run the executable with the inputs of
+its choice: give the worker a token when it listens to TCP on other hosts than
+localhost, preferably in the LLFI_CAMPAIGN_TOKEN environment variable, which
+other users cannot read, and the same token to ficoordinator.
+"""
+
+import sys, os, time, socket, threading, queue, contextlib, io, traceback
+# ficampaign and the injectfault it loads are imported from bin, which has to
+# stay free of bytecode caches
+sys.dont_write_bytecode = True
+import ficampaign
+
+prog = os.path.basename(sys.argv[0])
+injectfault = ficampaign.loadInjectfault()
+
+options = {
+  "dir": None,
+  "listen": None,
+  "name": "%s:%d" % (socket.gethostname(), os.getpid()),
+  "token": os.environ.get(ficampaign.TOKEN_ENV),
+  "once": False,
+  "verbose": False,
+}
+
+
+def usage(msg = None):
+  retval = 0
+  if msg is not None:
+    retval = 1
+    msg = "ERROR: " + msg
+    print(msg, file=sys.stderr)
+  print(__doc__ % globals(), file=sys.stderr)
+  sys.exit(retval)
+
+
+def parseArgs(args):
+  global options
+  argid = 0
+  while argid < len(args):
+    arg = args[argid]
+    if arg in ("--listen", "--name", "--token"):
+      argid += 1
+      if argid == len(args):
+        usage("Missing value for " + arg)
+      options[arg[2:]] = args[argid]
+    elif arg == "--once":
+      options["once"] = True
+    elif arg == "--verbose":
+      options["verbose"] = True
+    elif arg == "--help" or arg == "-h":
+      usage()
+    elif arg.startswith("-"):
+      usage("Invalid argument: " + arg)
+    elif options["dir"] is None:
+      options["dir"] = os.path.realpath(arg)
+    else:
+      usage("Only one program directory can be given")
+    argid += 1
+
+  if options["dir"] is None:
+    usage("Must provide the program directory")
+  if not os.path.isdir(options["dir"]):
+    usage("No such directory: " + options["dir"])
+  if options["listen"] is None:
+    options["listen"] = "unix:" + os.path.join(options["dir"], "fiworker.sock")
+  try:
+    local = ficampaign.isLocalAddress(options["listen"])
+  except ValueError:
+    usage("Invalid address: " + options["listen"])
+  if not local and options["token"] is None:
+    print("WARNING: Listening to %s without a token, any host that can "
+          "connect to it can run the executable" % options["listen"],
+          file=sys.stderr)
+
+
+################################################################################
+def setup(msg):
+  """Checks the token and the executable of the campaign, and prepares the
+  directories of injectfault. Returns an error message, or None"""
+  if not ficampaign.checkToken(options["token"], msg.get("token")):
+    return "The token of the coordinator does not match the one of the worker"
+  fi_exe = os.path.realpath(os.path.join(options["dir"], msg["exe"]))
+  if os.path.dirname(os.path.dirname(fi_exe)) != options["dir"]:
+    return "The executable %s is not under llfi/ of the program directory" % \
+        msg["exe"]
+  if not os.path.isfile(fi_exe):
+    return "No executable %s in %s" % (msg["exe"], options["dir"])
+  if ficampaign.digest(fi_exe) != msg["sha256"]:
+    return "The executable %s of %s differs from the one of the coordinator" \
+        % (msg["exe"], options["dir"])
+  for name in msg["inputs"]:
+    if not os.path.isfile(os.path.join(options["dir"], name)):
+      return "No input file %s in %s" % (name, options["dir"])
+
+  os.chdir(options["dir"])
+  injectfault.fi_exe = fi_exe
+  injectfault.optionlist = list(msg["args"])
+  injectfault.config()
+  injectfault.storeInputFiles()
+  return None
+
+
+def runOutputs(run_id):
+  """The outputs of the run, as {<directory under llfi>/<name>: <path>}"""
+  outputs = {}
+  stdname = "std_outputfile-run-" + run_id
+  errorname = "errorfile-run-" + run_id
+  tag = '.' + run_id + '.'
+  for dirname, path in (("std_output", injectfault.stddir),
+                        ("error_output", injectfault.errordir),
+                        ("llfi_stat_output", injectfault.llfi_stat_dir),
+                        ("prog_output", injectfault.outputdir)):
+    for name in os.listdir(path):
+      if name in (stdname, errorname) or tag in name:
+        outputs[dirname + '/' + name] = os.path.join(path, name)
+  return outputs
+
+
+def execute(run):
+  run_id = run["id"]
+  with open("llfi.config.runtime.txt", 'w') as ficonfig_File:
+    for line in run["config"]:
+      ficonfig_File.write(line + '\n')
+
+  injectfault.run_id = run_id
+  injectfault.outputfile = os.path.join(injectfault.stddir,
+                                        "std_outputfile-run-" + run_id)
+  injectfault.return_codes = {}
+  for limit in ("memory", "cpu", "cgroup"):
+    injectfault.run_limits[limit] = run["limits"].get(limit)
+  execlist = [injectfault.fi_exe] + injectfault.optionlist
+
+  start = time.time()
+  log = io.StringIO()
+  with contextlib.redirect_stdout(sys.stdout if options["verbose"] else log):
+    ret = injectfault.execute(execlist, run["timeout"])
+  injectfault.writeErrorFile(ret, os.path.join(injectfault.errordir,
+                                               "errorfile-run-" + run_id))
+  seconds = time.time() - start
+  # injectfault counts the runs ended by the lockstep as masked
+  masked = "MK" in injectfault.return_codes
+
+  files = {}
+  for name, path in runOutputs(run_id).items():
+    files[name] = ficampaign.encodeFile(path)
+    os.remove(path)
+  return ret, masked, seconds, files
+
+
+################################################################################
+def heartbeat(channel, stop):
+  while not stop.wait(ficampaign.HEARTBEAT_INTERVAL):
+    try:
+      channel.send("heartbeat")
+    except OSError:
+      return
+
+
+def receiver(channel, inbox):
+  try:
+    while True:
+      msg = channel.receive()
+      inbox.put(msg)
+      if msg is None:
+        return
+  except (OSError, ValueError):
+    inbox.put(None)
+
+
+def serve(channel):
+  """Executes the runs of one coordinator, until it says bye or goes away"""
+  inbox = queue.Queue()
+  stop = threading.Event()
+  threading.Thread(target=receiver, args=(channel, inbox), daemon=True).start()
+  threading.Thread(target=heartbeat, args=(channel, stop), daemon=True).start()
+  channel.send("hello", worker=options["name"],
+               version=ficampaign.PROTOCOL_VERSION)
+
+  ready = False
+  pending = []
+  try:
+    while True:
+      # handle every message received before starting the next run, so that
+      # the runs a cancel takes back are not started
+      try:
+        msg = inbox.get(block=not pending)
+      except queue.Empty:
+        msg = {"op": "next"}
+      if msg is None or msg["op"] == "bye":
+        return
+      elif msg["op"] == "setup":
+        error = setup(msg)
+        if error is not None:
+          print("ERROR: " + error, file=sys.stderr)
+          channel.send("error", msg=error)
+          return
+        ready = True
+        channel.send("ready")
+      elif msg["op"] == "runs" and ready:
+        pending.extend(msg["runs"])
+      elif msg["op"] == "cancel":
+        ids = set(msg["ids"])
+        cancelled = [run["id"] for run in pending if run["id"] in ids]
+        pending = [run for run in pending if run["id"] not in ids]
+        channel.send("cancelled", ids=cancelled)
+      elif msg["op"] == "next":
+        run = pending.pop(0)
+        channel.send("started", id=run["id"])
+        ret, masked, seconds, files = execute(run)
+        if options["verbose"]:
+          print("run %s: %s%s in %.2f s" % (run["id"], ret,
+                                           " (masked)" if masked else "",
+                                           seconds))
+        channel.send("result", id=run["id"], ret=ret, masked=masked,
+                     seconds=seconds, files=files)
+  except OSError as e:
+    print("WARNING: Lost the coordinator: " + str(e), file=sys.stderr)
+  except Exception:
+    # the coordinator sends the runs of the connection to the other workers
+    traceback.print_exc()
+    print("ERROR: Unable to execute the run, closing the connection",
+          file=sys.stderr)
+  finally:
+    stop.set()
+    channel.close()
+
+
+def main(args):
+  parseArgs(args)
+  try:
+    server = ficampaign.listen(options["listen"])
+  except (OSError, ValueError) as e:
+    print("ERROR: Unable to listen to %s: %s" % (options["listen"], e),
+          file=sys.stderr)
+    sys.exit(1)
+  print("%s: worker %s of %s listening to %s" %
+        (prog, options["name"], options["dir"], options["listen"]))
+  sys.stdout.flush()
+
+  while True:
+    sock, peer = server.accept()
+    print("%s: campaign started" % prog)
+    sys.stdout.flush()
+    serve(ficampaign.Channel(sock))
+    print("%s: campaign ended" % prog)
+    sys.stdout.flush()
+    if options["once"]:
+      break
+  server.close()
+
+
+if __name__=="__main__":
+  main(sys.argv[1:])
@@ -24,6 +24,8 @@ import yaml
 import time
 import random
 import shutil
+import resource
+import signal
 from subprocess import TimeoutExpired
 
 runOverride = False
@@ -31,6 +33,20 @@ optionlist = []
 defaultTimeout = 500
 fi_max_multiple_default = 100
 fi_ml_stats = []
+# cycles of each thread of a multithreaded program, as [thread id, cycles]
+fi_thread_cycles = []
+# written by a program that ends with an injected hang
+hangfile = "llfi.stat.fi.hang.txt"
+# written by a program whose injected fault used up its memory limit
+limitfile = "llfi.stat.fi.limit.txt"
+# written by a program run in lockstep with a golden process
+lockstepfile = "llfi.stat.lockstep.txt"
+
+# Resource limits of each run, set by the memoryLimit (MB) and cpuTimeLimit
+# (seconds) run options. Memory is limited with RLIMIT_AS, or with
+# memory.max of a per-run cgroup v2 under the cgroupDir run option, which
+# must have the memory controller in its cgroup.subtree_control.
+run_limits = {"memory": None, "cpu": None, "cgroup": None}
 
 # basedir is assigned in parseArgs(args)
 basedir = ""
@@ -139,6 +155,49 @@ def config():
     os.mkdir(llfi_stat_dir)
 
 
+################################################################################
+def makeRunCgroup():
+  if run_limits["cgroup"] is None or run_limits["memory"] is None:
+    return None
+  cgroup = os.path.join(run_limits["cgroup"], "llfi-run-" + str(os.getpid()))
+  try:
+    if not os.path.isdir(cgroup):
+      os.mkdir(cgroup)
+    with open(os.path.join(cgroup, "memory.max"), 'w') as f:
+      f.write(str(run_limits["memory"] * 1024 * 1024))
+    if os.path.isfile(os.path.join(cgroup, "memory.swap.max")):
+      with open(os.path.join(cgroup, "memory.swap.max"), 'w') as f:
+        f.write("0")
+  except (IOError, OSError) as e:
+    print("ERROR: Unable to set up the cgroup " + cgroup + ": " + str(e))
+    exit(1)
+  return cgroup
+
+def isCgroupOOM(cgroup):
+  with open(os.path.join(cgroup, "memory.events"), 'r') as f:
+    for line in f:
+      event, count = line.split()
+      if event in ("max", "oom_kill") and int(count) > 0:
+        return True
+  return False
+
+def limitRun(cgroup):
+  # runs in the child, before the program is executed
+  if cgroup is not None:
+    with open(os.path.join(cgroup, "cgroup.procs"), 'w') as f:
+      f.write(str(os.getpid()))
+  elif run_limits["memory"] is not None:
+    limit = run_limits["memory"] * 1024 * 1024
+    resource.setrlimit(resource.RLIMIT_AS, (limit, limit))
+  if run_limits["cpu"] is not None:
+    # SIGXCPU at the soft limit, SIGKILL one second later
+    resource.setrlimit(resource.RLIMIT_CPU,
+                       (run_limits["cpu"], run_limits["cpu"] + 1))
+
+def childCPUTime():
+  usage = resource.getrusage(resource.RUSAGE_CHILDREN)
+  return usage.ru_utime + usage.ru_stime
+
 ################################################################################
 def execute( execlist, timeout):
   global outputfile
@@ -146,7 +205,10 @@ def execute( execlist, timeout):
   print(' '.join(execlist))
   #get state of directory
   dirSnapshot()
-  p = subprocess.Popen(execlist, stdout = subprocess.PIPE)
+  cgroup = makeRunCgroup()
+  cputime = childCPUTime()
+  p = subprocess.Popen(execlist, stdout = subprocess.PIPE,
+                       preexec_fn = lambda: limitRun(cgroup))
   outputFile = open(outputfile, "wb")
   program_timed_out = False
   start_time = 0
@@ -162,6 +224,31 @@ def execute( execlist, timeout):
     (p_stdout,p_stderr) = p.communicate(timeout=timeout)
     program_timed_out = True
 
+  # an injected hang ends the program at once, and leaves a hang record
+  if hangfile not in dirBefore and os.path.isfile(hangfile):
+    program_timed_out = True
+
+  # the limit record only means the memory limit was hit if there is one,
+  # the injected memory exhaustion also ends at the memory of the machine
+  exceeded_limit = None
+  if (cgroup is not None and isCgroupOOM(cgroup)) or \
+      (run_limits["memory"] is not None and
+       limitfile not in dirBefore and os.path.isfile(limitfile)):
+    exceeded_limit = "memory"
+  elif run_limits["cpu"] is not None and \
+      (p.returncode == -signal.SIGXCPU or
+       childCPUTime() - cputime >= run_limits["cpu"]):
+    exceeded_limit = "cpu"
+  if cgroup is not None:
+    os.rmdir(cgroup)
+
+  # a run that ended once its state matched the golden process again, see
+  # runtime_lib/Lockstep.h
+  program_masked = False
+  if lockstepfile not in dirBefore and os.path.isfile(lockstepfile):
+    with open(lockstepfile) as f:
+      program_masked = "result=masked\n" in f.readlines()
+
   moveOutput()
   if program_timed_out:
     print("\tParent : Child timed out. Cleaning up ... ")
@@ -184,18 +271,30 @@ def execute( execlist, timeout):
   replenishInput() #for cases where program deletes input or alters them each run
 
   # Keep a dict of all return codes received.
-  if program_timed_out:
+  if exceeded_limit is not None:
+    if "RL" in return_codes:
+      return_codes["RL"] += 1
+    else:
+      return_codes["RL"] = 1
+  elif program_timed_out:
     if "TO" in return_codes:
       return_codes["TO"] += 1
     else:
       return_codes["TO"] = 1
+  elif program_masked:
+    if "MK" in return_codes:
+      return_codes["MK"] += 1
+    else:
+      return_codes["MK"] = 1
   else:
     if p.returncode in return_codes:
       return_codes[p.returncode] += 1
     else:
       return_codes[p.returncode] = 1
 
-  if program_timed_out:
+  if exceeded_limit is not None:
+    return exceeded_limit + "-limit"
+  elif program_timed_out:
     return "timed-out"
   else:
     return str(p.returncode)
@@ -225,6 +324,22 @@ def replenishInput():#TODO make condition to skip this if input is present
     if not os.path.isfile(each):#copy deleted inputfiles back to basedir
       shutil.copy2(os.path.join(inputdir, each), each)
 
+################################################################################
+def writeErrorFile(ret, errorfile):
+  # ret is the result of execute()
+  if ret == "timed-out":
+    error = "Program hang\n"
+  elif ret.endswith("-limit"):
+    error = "Program exceeded the " + ret[:-len("-limit")] + " limit\n"
+  elif int(ret) < 0:
+    error = "Program crashed, terminated by the system, return code " + ret + '\n'
+  elif int(ret) > 0:
+    error = "Program crashed, terminated by itself, return code " + ret + '\n'
+  else:
+    return
+  with open(errorfile, 'w') as error_File:
+    error_File.write(error)
+
 ################################################################################
 def moveOutput():
   #move all newly created files
@@ -253,7 +368,7 @@ def dirSnapshot():
 
 ################################################################################
 def readCycles():
-  global totalcycles, fi_ml_stats
+  global totalcycles, fi_ml_stats, fi_thread_cycles
   profinput= open("llfi.stat.prof.txt","r")
 
   while 1:
@@ -272,9 +387,38 @@ def readCycles():
       elif label == 'ml_layer':
         layerNum, layerName, cycleStart, cycleEnd = value.split(",")
         fi_ml_stats.append([int(layerNum), layerName, int(cycleStart), int(cycleEnd)])
+      elif label == 'thread_cycle':
+        threadId, cycles = value.split(",")
+        fi_thread_cycles.append([int(threadId), int(cycles)])
 
   profinput.close()
 
+# The runtime counts the cycles of each thread separately. Map a cycle of the
+# whole program, as numbered by total_cycle, to a thread and a cycle of that
+# thread, so that each thread is picked in proportion of its cycles.
+def threadOfCycle(cycle):
+  for threadId, cycles in fi_thread_cycles:
+    if cycle <= cycles:
+      return threadId, cycle
+    cycle -= cycles
+  return fi_thread_cycles[-1][0], fi_thread_cycles[-1][1]
+
+# The planned runs of fiplanner, as [llfi index, dynamic instance]
+def readPlan(planfile):
+  runs = []
+  try:
+    f = open(planfile, 'r')
+  except IOError:
+    print("ERROR: Unable to open the fault injection plan " + planfile +
+          ", please run fiplanner first.")
+    exit(1)
+  for line in f:
+    if line.startswith("run="):
+      index, instance = line[len("run="):].split(',')
+      runs.append([int(index), int(instance)])
+  f.close()
+  return runs
+
 ################################################################################
 def checkValues(key, val, var1 = None,var2 = None,var3 = None,var4 = None):
   #preliminary input checking for fi options
@@ -402,6 +546,38 @@ def main(args):
       run_number=run["run"]["numOfRuns"]
       checkValues("run_number", run_number)
 
+      # inject into the dynamic instances planned by fiplanner
+      fi_plan = None
+      if "fiPlan" in run["run"]:
+        fi_plan = readPlan(run["run"]["fiPlan"])
+        for key in ("fi_cycle", "fi_index", "window_len", "fi_max_multiple",
+                    "window_len_multiple", "window_len_multiple_startindex"):
+          if key in run["run"]:
+            print("ERROR: fiPlan and " + key + " cannot be specified at the "
+                  "same time in the input.yaml file.")
+            exit(1)
+        if run_number > len(fi_plan):
+          print("ERROR: numOfRuns is greater than the %d runs of the plan %s."
+                % (len(fi_plan), run["run"]["fiPlan"]))
+          exit(1)
+
+      # make the sleeps of the program virtual, see runtime_lib/VirtualTime.h
+      virtual_time = bool(run["run"].get("virtualTime", False))
+      # run a golden process in lockstep, see runtime_lib/Lockstep.h
+      lockstep = int(run["run"].get("lockstep", 0))
+      assert lockstep >= 0, "lockstep must not be negative"
+      # count and time the calls of the runtime, see runtime_lib/RuntimeStats.h
+      runtime_stats = int(run["run"].get("runtimeStats", 0))
+      assert runtime_stats >= 0, "runtimeStats must not be negative"
+
+      run_limits["memory"] = run["run"].get("memoryLimit")
+      run_limits["cpu"] = run["run"].get("cpuTimeLimit")
+      run_limits["cgroup"] = run["run"].get("cgroupDir")
+      for limit in ("memory", "cpu"):
+        if run_limits[limit] is not None:
+          run_limits[limit] = int(run_limits[limit])
+          assert run_limits[limit] > 0, "The resource limits must be greater than 0"
+
       # check for verbosity option, set at the FI run level
       if "verbose" in run["run"]:
         options["verbose"] = run["run"]["verbose"]
@@ -557,7 +733,7 @@ def main(args):
         window_len_multiple = int(totalcycles) - 1
       ##======================================================
       need_to_calc_fi_cycle = True
-      if ('fi_cycle' in locals()) or 'fi_index' in locals():
+      if ('fi_cycle' in locals()) or 'fi_index' in locals() or fi_plan:
         need_to_calc_fi_cycle = False
 
       # fault injection
@@ -570,15 +746,24 @@ def main(args):
         if('fi_cycle' not in locals() and 'fi_random_seed' in locals()):
           random.seed(fi_random_seed)
 
+        # last cycle of the thread the faults are injected into
+        maxcycle = int(totalcycles)
+        if 'fi_thread' in locals():
+          del fi_thread
         if need_to_calc_fi_cycle:
           ##BEHROOZ: I changed the below line to the current one to fix the fi_cycle
           fi_cycle = random.randint(1, int(totalcycles))
           ##fi_cycle = random.randint(0, int(totalcycles) - 1)
+          if len(fi_thread_cycles) > 0:
+            fi_thread, fi_cycle = threadOfCycle(fi_cycle)
+            maxcycle = dict(fi_thread_cycles)[fi_thread]
 
         ficonfig_File = open("llfi.config.runtime.txt", 'w')
 
         global fi_ml_stats
-        if 'fi_cycle' in locals() and len(fi_ml_stats)  > 0:
+        # the ML layers are timed in the cycles of the main thread
+        if 'fi_cycle' in locals() and len(fi_ml_stats)  > 0 and \
+            ('fi_thread' not in locals() or fi_thread == 0):
 
           # Find to which Ml layer this fi_cycle belongs to.
           for i in range(0, len(fi_ml_stats)):
@@ -586,13 +771,24 @@ def main(args):
               ficonfig_File.write("ml_layer_name="+fi_ml_stats[i][1]+'\n')
               ficonfig_File.write("ml_layer_number="+str(fi_ml_stats[i][0])+'\n')
 
-        if 'fi_cycle' in locals():
+        if fi_plan:
+          ficonfig_File.write("fi_index="+str(fi_plan[index][0])+'\n')
+          ficonfig_File.write("fi_instance="+str(fi_plan[index][1])+'\n')
+        elif 'fi_cycle' in locals():
           ficonfig_File.write("fi_cycle="+str(fi_cycle)+'\n')
+          if 'fi_thread' in locals():
+            ficonfig_File.write("fi_thread="+str(fi_thread)+'\n')
         elif 'fi_index' in locals():
           ficonfig_File.write("fi_index="+str(fi_index)+'\n')
 
         if 'fi_type' in locals():
           ficonfig_File.write("fi_type="+fi_type+'\n')
+        if virtual_time:
+          ficonfig_File.write("virtual_time=1\n")
+        if lockstep > 0:
+          ficonfig_File.write("lockstep="+str(lockstep)+'\n')
+        if runtime_stats > 0:
+          ficonfig_File.write("runtime_stats="+str(runtime_stats)+'\n')
         if 'fi_reg_index' in locals():
           ficonfig_File.write("fi_reg_index="+str(fi_reg_index)+'\n')
         if 'fi_bit' in locals():
@@ -604,7 +800,7 @@ def main(args):
         ##======== Add second corrupted regs QINING @MAR 27th===========
         if 'window_len' in locals():
           ##BEHROOZ: I changed the below line to the current one to fix the fi_cycle
-          fi_second_cycle = min(fi_cycle + random.randint(1, int(window_len)), int(totalcycles))
+          fi_second_cycle = min(fi_cycle + random.randint(1, int(window_len)), maxcycle)
           #fi_second_cycle = min(fi_cycle + random.randint(1, int(window_len)), int(totalcycles) - 1)
           ficonfig_File.write("fi_second_cycle="+str(fi_second_cycle)+'\n')
         ##==================================================================
@@ -629,9 +825,9 @@ def main(args):
           ##===== and here we are looking for the remaining cycles.=================
           fi_next_cycle = fi_cycle
           for index_multiple in range(1, int(selected_num_of_injection)):
-            fi_next_cycle = min(fi_next_cycle + random.randint(win_start_index, win_end_index), int(totalcycles))
+            fi_next_cycle = min(fi_next_cycle + random.randint(win_start_index, win_end_index), maxcycle)
             ficonfig_File.write("fi_next_cycle="+str(fi_next_cycle)+'\n')
-            if fi_next_cycle == int(totalcycles):
+            if fi_next_cycle == maxcycle:
               break
         ##==================================================================
         ficonfig_File.close()
@@ -640,18 +836,7 @@ def main(args):
         # formatting
         execlist.extend(optionlist)
         ret = execute(execlist, timeout)
-        if ret == "timed-out":
-          error_File = open(errorfile, 'w')
-          error_File.write("Program hang\n")
-          error_File.close()
-        elif int(ret) < 0:
-          error_File = open(errorfile, 'w')
-          error_File.write("Program crashed, terminated by the system, return code " + ret + '\n')
-          error_File.close()
-        elif int(ret) > 0:
-          error_File = open(errorfile, 'w')
-          error_File.write("Program crashed, terminated by itself, return code " + ret + '\n')
-          error_File.close()
+        writeErrorFile(ret, errorfile)
 
         # Print updates, print the number of injections finished
         print_progressbar(index+1, run_number)
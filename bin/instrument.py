@@ -17,6 +17,7 @@ List of options:
 --help(-h):                 Show help information
 --use-ml-specific-rt        Use ML-Specific FI runtime, that statically-links with the ML application to speedup the FI.
 --enable-ML-FI-stats        Enable FI statistics for ML applications.
+--no-driver:                Run opt and llc once per pass and executable instead of llfi-driver, which parses the IR once and compiles the executables in parallel
 
 Prerequisite:
 You need to have 'input.yaml' under the same directory as <source IR file>, which contains appropriate options for LLFI
@@ -50,8 +51,10 @@ basedir = ""
 
 if sys.platform == "linux" or sys.platform == "linux2":
   llfilib = os.path.join(script_path, "../llvm_passes/llfi-passes.so")
+  llfidriver = os.path.join(script_path, "../llvm_passes/llfi-driver")
 elif sys.platform == "darwin":
   llfilib = os.path.join(script_path, "../llvm_passes/llfi-passes.dylib")
+  llfidriver = os.path.join(script_path, "../llvm_passes/llfi-driver")
 else:
   print("ERROR: LLFI does not support platform " + sys.platform + ".")
   exit(1)
@@ -66,8 +69,14 @@ options = {
   "verbose": False,
   "IRonly": False,
   "genDotGraph": False,
+  "graphOptions": [],
   "useMLSpecificRT": False,
   "enableMLFIStats" : False,
+  "useDriver": True,
+  "optimize": False,
+  "taintTracking": False,
+  "lockstep": False,
+  "estimateSDC": False,
 }
 
 
@@ -112,6 +121,8 @@ def parseArgs(args):
         options["useMLSpecificRT"] = True
       elif arg == "--enable-ML-FI-stats":
         options["enableMLFIStats"] = True
+      elif arg == "--no-driver":
+        options["useDriver"] = False
       elif arg == "--help" or arg == "-h":
         usage()
       else:
@@ -295,6 +306,37 @@ def readCompileOption():
         print(("\n\nERROR: Invalid value for trace (forward/backward allowed) in input.yaml.\n"))
         exit(1)
 
+  ###Union instrumentation: write the site table, and select the active sites
+  ###at runtime with sitebitmap instead of re-running instrument
+  if "unionInstrumentation" in cOpt and cOpt["unionInstrumentation"] == True:
+    compileOptions.append('-fisitetable')
+
+  ###Site profiling: count the dynamic instances of each site for fiplanner
+  if "profileSites" in cOpt and cOpt["profileSites"] == True:
+    compileOptions.append('-profilesites')
+
+  ###Optimize the instrumented IR, keeping the fault injection sites
+  if "optimizeInstrumentation" in cOpt and cOpt["optimizeInstrumentation"] == True:
+    options["optimize"] = True
+
+  ###Taint tracking: measure the propagation of the injected fault in the
+  ###fault injection executable itself
+  if "taintTracking" in cOpt and cOpt["taintTracking"] == True:
+    options["taintTracking"] = True
+
+  ###SDC estimate: estimate the SDC probability of each site statically, with
+  ###the branch counts of the last profile if there is one
+  if "estimateSDC" in cOpt and cOpt["estimateSDC"] == True:
+    options["estimateSDC"] = True
+
+  ###Lockstep: compare the fault injection run with a golden process at the
+  ###checkpoints, enabled at runtime by the lockstep run option
+  if "lockstep" in cOpt and cOpt["lockstep"] == True:
+    options["lockstep"] = True
+    if "lockstepOption" in cOpt and "checkpoints" in cOpt["lockstepOption"]:
+      compileOptions.append('-lockstepcheckpoints=' +
+                            ','.join(cOpt["lockstepOption"]["checkpoints"]))
+
   ###Tracing Proppass
   if "tracingPropagation" in cOpt and cOpt["tracingPropagation"] == True:
     print(("\nWARNING: You enabled 'tracingPropagation' option in input.yaml. "
@@ -311,11 +353,27 @@ def readCompileOption():
         assert int(cOpt["tracingPropagationOption"]["maxTrace"])>0, "maxTrace must be greater than 0 in input.yaml"
         compileOptions.append('-maxtrace')
         compileOptions.append(str(cOpt["tracingPropagationOption"]["maxTrace"]))
+      if "compressTrace" in cOpt["tracingPropagationOption"]:
+        if(str(cOpt["tracingPropagationOption"]["compressTrace"]).lower() == "true"):
+          compileOptions.append('-compresstrace')
+      if "hashCheckpoints" in cOpt["tracingPropagationOption"]:
+        if(str(cOpt["tracingPropagationOption"]["hashCheckpoints"]).lower() == "true"):
+          compileOptions.append('-hashcheckpoints')
 
       ###Dot Graph Generation selection
       if "generateCDFG" in cOpt["tracingPropagationOption"]:
           if (str(cOpt["tracingPropagationOption"]["generateCDFG"]).lower() == "true"):
             options["genDotGraph"] = True
+      tpOpt = cOpt["tracingPropagationOption"]
+      if "cdfgFormat" in tpOpt:
+        assert tpOpt["cdfgFormat"] in ("dot", "graphml"), "cdfgFormat must be dot or graphml in input.yaml"
+        options["graphOptions"].append('-graphformat=' + tpOpt["cdfgFormat"])
+      if "cdfgSplit" in tpOpt:
+        assert tpOpt["cdfgSplit"] in ("none", "function", "layer"), "cdfgSplit must be none, function or layer in input.yaml"
+        options["graphOptions"].append('-graphsplit=' + tpOpt["cdfgSplit"])
+      if "cdfgFunctions" in tpOpt:
+        for func in tpOpt["cdfgFunctions"]:
+          options["graphOptions"].append('-graphfunc=' + func)
 
 ################################################################################
 def _suffixOfIR():
@@ -324,6 +382,45 @@ def _suffixOfIR():
   else:
     return ".bc"
 
+def runDriver(llfi_indexed_file):
+  # The driver takes the passes as pipelines, and the other compile options
+  # as options of the passes
+  passopts = [opt for opt in compileOptions if opt != '-insttracepass']
+  # passes run after the instrumentation of each variant
+  postpasses = ',insttracepass' if '-insttracepass' in compileOptions else ''
+  if options["optimize"]:
+    postpasses += ',default<O2>'
+  indexpasses = 'genllfiindexpass'
+  if options["genDotGraph"]:
+    indexpasses += ',dotgraphpass'
+  profpasses = 'profilingpass'
+  if options["estimateSDC"]:
+    profpasses = 'sdcestimatorpass,' + profpasses
+  fipasses = 'faultinjectionpass'
+  if options["taintTracking"]:
+    fipasses += ',tainttrackingpass'
+  if options["lockstep"]:
+    fipasses += ',locksteppass'
+
+  execlist = [llfidriver, '-llfi-plugin', llfilib,
+              '-index-passes', indexpasses,
+              '-index-output', llfi_indexed_file + _suffixOfIR(),
+              '-prof-passes', profpasses + postpasses,
+              '-prof-output', proffile + _suffixOfIR(),
+              '-fi-passes', fipasses + postpasses,
+              '-fi-output', fifile + _suffixOfIR()]
+  if not options["IRonly"]:
+    execlist.extend(['-prof-obj', proffile + '.o', '-fi-obj', fifile + '.o'])
+  if options["readable"]:
+    execlist.append("-S")
+  if options["enableMLFIStats"]:
+    execlist.append("-mlfistats")
+  execlist.extend(passopts)
+  if options["genDotGraph"]:
+    execlist.extend(options["graphOptions"])
+  execlist.append(options['source'])
+  return execCompilation(execlist)
+
 def compileProg():
   global proffile, fifile, compileOptions, defaultlinklibs
   srcbase = os.path.basename(options["source"])
@@ -334,101 +431,129 @@ def compileProg():
   fifile = progbin + "-faultinjection"
   tmpfiles = []
 
+  useDriver = options["useDriver"] and os.path.isfile(llfidriver)
+  if useDriver:
+    retcode = runDriver(llfi_indexed_file)
+    if not options["IRonly"]:
+      tmpfiles.extend([proffile + '.o', fifile + '.o'])
+  else:
+    retcode = runOptPasses(llfi_indexed_file)
+
+  if retcode != 0:
+    print("\nERROR: there was an error during running the "\
+                      "instrumentation pass, please follow"\
+                      " the provided instructions for %s." % prog, file=sys.stderr)
+    shutil.rmtree(options['dir'], ignore_errors = True)
+    sys.exit(retcode)
+
+  if not options["IRonly"]:
+    if not useDriver:
+      retcode = runLlc(tmpfiles)
+    linkProg(retcode, tmpfiles)
+
+def runOptPasses(llfi_indexed_file):
   execlist = [optbin, '-load-pass-plugin', llfilib, '-genllfiindexpass', '-o',
               llfi_indexed_file + _suffixOfIR(), options['source']]
   if options["readable"]:
     execlist.append('-S')
   if options["genDotGraph"]:
     execlist.append('-dotgraphpass')
+    execlist.extend(options["graphOptions"])
   retcode = execCompilation(execlist)
 
   if retcode == 0:
     execlist = [optbin, '-load-pass-plugin', llfilib, '-profilingpass']
+    if options["estimateSDC"]:
+      execlist.insert(3, '-sdcestimatorpass')
     execlist2 = ['-o', proffile + _suffixOfIR(), llfi_indexed_file + _suffixOfIR()]
     execlist.extend(compileOptions)
     execlist.extend(execlist2)
     if options["readable"]:
       execlist.append("-S")
+    if options["optimize"]:
+      execlist.append("-O2")
     if options["enableMLFIStats"]:
       execlist.append("-mlfistats")
     retcode = execCompilation(execlist)
 
   if retcode == 0:
     execlist = [optbin, '-load-pass-plugin', llfilib, '-faultinjectionpass']
+    if options["taintTracking"]:
+      execlist.append('-tainttrackingpass')
+    if options["lockstep"]:
+      execlist.append('-locksteppass')
     execlist2 = ['-o', fifile + _suffixOfIR(), llfi_indexed_file + _suffixOfIR()]
     execlist.extend(compileOptions)
     execlist.extend(execlist2)
     #print(execlist)
     if options["readable"]:
       execlist.append("-S")
+    if options["optimize"]:
+      execlist.append("-O2")
     retcode = execCompilation(execlist)
+  return retcode
 
-  if retcode != 0:
-    print("\nERROR: there was an error during running the "\
-                      "instrumentation pass, please follow"\
-                      " the provided instructions for %s." % prog, file=sys.stderr)
-    shutil.rmtree(options['dir'], ignore_errors = True)
-    sys.exit(retcode)
+def runLlc(tmpfiles):
+  execlist = [llcbin, '-filetype=obj', '-o', proffile + '.o', proffile + _suffixOfIR()]
+  tmpfiles.append(proffile + '.o')
+  retcode = execCompilation(execlist)
+  if retcode == 0:
+    execlist = [llcbin, '-filetype=obj', '-o', fifile + '.o', fifile + _suffixOfIR()]
+    tmpfiles.append(fifile + '.o')
+    retcode = execCompilation(execlist)
+  return retcode
+
+def linkProg(retcode, tmpfiles):
+  liblist = list(defaultlinklibs)
+  for lib_dir in options["L"]:
+    liblist.extend(["-L", lib_dir])
+  for lib in options["l"]:
+    liblist.append("-l" + lib)
+  liblist.append("-no-pie")
+  liblist.append("-Wl,-rpath")
+  liblist.append(llfilinklib)
 
-  if not options["IRonly"]:
-    if retcode == 0:
-      execlist = [llcbin, '-filetype=obj', '-o', proffile + '.o', proffile + _suffixOfIR()]
-      tmpfiles.append(proffile + '.o')
-      retcode = execCompilation(execlist)
-    if retcode == 0:
-      execlist = [llcbin, '-filetype=obj', '-o', fifile + '.o', fifile + _suffixOfIR()]
-      tmpfiles.append(fifile + '.o')
-      retcode = execCompilation(execlist)
+  if retcode == 0:
+    execlist = [llvmgcc, '-o', proffile + '.exe', proffile + '.o', '-L'+llfilinklib]
 
-    liblist = list(defaultlinklibs)
-    for lib_dir in options["L"]:
-      liblist.extend(["-L", lib_dir])
-    for lib in options["l"]:
-      liblist.append("-l" + lib)
-    liblist.append("-no-pie")
-    liblist.append("-Wl,-rpath")
-    liblist.append(llfilinklib)
-
-    if retcode == 0:
-      execlist = [llvmgcc, '-o', proffile + '.exe', proffile + '.o', '-L'+llfilinklib]
-
-      # Check whether we should use static or dynamic FI RT
-      execlist.extend(["-lllfi-rt"])
-      execlist.extend(liblist)
+    # Check whether we should use static or dynamic FI RT
+    execlist.extend(["-lllfi-rt"])
+    execlist.extend(liblist)
+    retcode = execCompilation(execlist)
+    if retcode != 0:
+      print("...Error compiling with " + os.path.basename(llvmgcc) + ", trying with " + os.path.basename(llvmgxx) + ".")
+      execlist[0] = llvmgxx
       retcode = execCompilation(execlist)
-      if retcode != 0:
-        print("...Error compiling with " + os.path.basename(llvmgcc) + ", trying with " + os.path.basename(llvmgxx) + ".")
-        execlist[0] = llvmgxx
-        retcode = execCompilation(execlist)
-    if retcode == 0:
-      execlist = [llvmgcc, '-o', fifile + '.exe', fifile + '.o', '-L'+llfilinklib]
-
-      # Check whether we should use static or dynamic FI RT
-      if options['useMLSpecificRT']:
-          execlist.extend(["-lml-lltfi-rt"])
-      else:
-          execlist.extend(["-lllfi-rt"])
+  if retcode == 0:
+    execlist = [llvmgcc, '-o', fifile + '.exe', fifile + '.o', '-L'+llfilinklib]
 
-      execlist.extend(liblist)
+    # Check whether we should use static or dynamic FI RT
+    if options['useMLSpecificRT']:
+        execlist.extend(["-lml-lltfi-rt"])
+    else:
+        # llfi-vt comes first, to interpose the clocks of the C library
+        execlist.extend(["-lllfi-vt", "-lllfi-rt"])
+
+    execlist.extend(liblist)
+    retcode = execCompilation(execlist)
+    if retcode != 0:
+      print("...Error compiling with " + os.path.basename(llvmgcc) + ", trying " + os.path.basename(llvmgxx) + ".")
+      execlist[0] = llvmgxx
       retcode = execCompilation(execlist)
-      if retcode != 0:
-        print("...Error compiling with " + os.path.basename(llvmgcc) + ", trying " + os.path.basename(llvmgxx) + ".")
-        execlist[0] = llvmgxx
-        retcode = execCompilation(execlist)
 
 
-    for tmpfile in tmpfiles:
-      try:
-        os.remove(tmpfile)
-      except:
-        pass
-    if retcode != 0:
-      print("\nERROR: there was an error during linking and generating executables,"\
-                           "Please take %s and %s and generate the executables manually (linking llfi-rt "\
-                           "in directory %s)." %(proffile + _suffixOfIR(), fifile + _suffixOfIR(), llfilinklib), file=sys.stderr)
-      sys.exit(retcode)
-    else:
-      print("\nSuccess", file=sys.stderr)
+  for tmpfile in tmpfiles:
+    try:
+      os.remove(tmpfile)
+    except:
+      pass
+  if retcode != 0:
+    print("\nERROR: there was an error during linking and generating executables,"\
+                         "Please take %s and %s and generate the executables manually (linking llfi-rt "\
+                         "in directory %s)." %(proffile + _suffixOfIR(), fifile + _suffixOfIR(), llfilinklib), file=sys.stderr)
+    sys.exit(retcode)
+  else:
+    print("\nSuccess", file=sys.stderr)
 
 
 ################################################################################
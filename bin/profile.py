@@ -78,6 +78,36 @@ def checkInputYaml():
   except:
     usage("input.yaml is not formatted in proper YAML (reminder: use spaces, not tabs)")
     exit(1)
+  return doc
+
+################################################################################
+def writeTraceConfig(doc):
+  # trace windows of the golden run, read by the tracing runtime
+  tpOpt = {}
+  if doc and "compileOption" in doc:
+    tpOpt = doc["compileOption"].get("tracingPropagationOption") or {}
+  lines = []
+  for window in tpOpt.get("traceWindows", []):
+    lines.append("trace_window=%s" % window)
+  for func in tpOpt.get("traceFunctions", []):
+    lines.append("trace_function=%s" % func)
+  for opcode in tpOpt.get("traceOpcodes", []):
+    lines.append("trace_opcode=%s" % opcode)
+  if "traceEvery" in tpOpt:
+    assert isinstance(tpOpt["traceEvery"], int) and tpOpt["traceEvery"] > 0, "traceEvery must be a positive integer in input.yaml"
+    lines.append("trace_every=%d" % tpOpt["traceEvery"])
+  if "hashInterval" in tpOpt:
+    assert isinstance(tpOpt["hashInterval"], int) and tpOpt["hashInterval"] > 0, "hashInterval must be a positive integer in input.yaml"
+    lines.append("hash_interval=%d" % tpOpt["hashInterval"])
+  if "hashFanout" in tpOpt:
+    assert isinstance(tpOpt["hashFanout"], int) and tpOpt["hashFanout"] > 1, "hashFanout must be an integer greater than 1 in input.yaml"
+    lines.append("hash_fanout=%d" % tpOpt["hashFanout"])
+
+  if os.path.isfile("llfi.config.trace.txt"):
+    os.remove("llfi.config.trace.txt")
+  if lines:
+    with open("llfi.config.trace.txt", "w") as f:
+      f.write('\n'.join(lines) + '\n')
 
 
 ################################################################################
@@ -152,9 +182,10 @@ def replenishInput():#TODO make condition to skip this if input is present
 ################################################################################
 def moveOutput():
   #move all newly created files that are not "llfi.stat.prof.txt" < -- since this is a product of profiling
+  #"llfi.stat.range.txt" is also kept, as it accumulates over the golden runs
   newfiles = [_file for _file in os.listdir(".")]
   for each in newfiles:
-    if each not in dirBefore and each != "llfi.stat.prof.txt":
+    if each not in dirBefore and each not in ("llfi.stat.prof.txt", "llfi.stat.range.txt"):
       fileSize = os.stat(each).st_size
       if fileSize == 0 and each.startswith("llfi"):
         #empty library output, can delete
@@ -177,8 +208,9 @@ def main(args):
   global optionlist, outputfile
 
   parseArgs(args)
-  checkInputYaml()
+  doc = checkInputYaml()
   config()
+  writeTraceConfig(doc)
 
   storeInputFiles()
   # baseline
@@ -0,0 +1,221 @@
+#! /usr/bin/env python3
+
+"""
+
+%(prog)s selects the active fault injection sites of a program instrumented with the 'unionInstrumentation' compile option, without re-running instrument
+
+Usage: %(prog)s [OPTIONS] [<directory of source IR file>]
+
+List of options:
+
+--includeinst <opcode>:     Select the sites of this instruction type, 'all' for every type (repeatable)
+--excludeinst <opcode>:     Exclude the sites of this instruction type (repeatable)
+--includefunc <function>:   Select the sites in this function, 'all' for every function (repeatable)
+--excludefunc <function>:   Exclude the sites in this function (repeatable)
+--index <llfi index>:       Select the site with this LLFI index (repeatable)
+--layerName <operator>:     Select the sites in the ML layers of this operator type, e.g. conv, 'all' for every layer (repeatable)
+--layerNo <number>:         Only select the <number>-th layer of the preceding --layerName, 0 for all of them (default: 0)
+--injector <fi_type>:       Use this fault injector for the selected sites instead of the fi_type of input.yaml
+--append:                   Add the selected sites to the current site bitmap instead of replacing it
+--verbose:                  Show the selected sites
+--help(-h):                 Show help information
+
+The options of different kinds are combined like the instruction selectors of
+instrument: a site is selected if it matches all of them. Without any option,
+every site is selected.
+
+%(prog)s reads llfi.stat.sitetable.txt, written by instrument, and writes the
+site bitmap llfi.config.sitebitmap.bin, and llfi.config.sitetypes.txt for
+--injector. Both executables read them from the directory of the source IR
+file, so re-run profile after changing the selected sites.
+"""
+
+import sys, os
+
+prog = os.path.basename(sys.argv[0])
+
+sitetablefile = "llfi.stat.sitetable.txt"
+sitebitmapfile = "llfi.config.sitebitmap.bin"
+sitetypesfile = "llfi.config.sitetypes.txt"
+
+options = {
+  "dir": ".",
+  "includeinst": [],
+  "excludeinst": [],
+  "includefunc": [],
+  "excludefunc": [],
+  "index": [],
+  "layers": [],
+  "injector": None,
+  "append": False,
+  "verbose": False,
+}
+
+
+def usage(msg = None):
+  retval = 0
+  if msg is not None:
+    retval = 1
+    msg = "ERROR: " + msg
+    print(msg, file=sys.stderr)
+  print(__doc__ % globals(), file=sys.stderr)
+  sys.exit(retval)
+
+
+def parseArgs(args):
+  global options
+  valueopts = ["--includeinst", "--excludeinst", "--includefunc",
+               "--excludefunc", "--index", "--layerName", "--layerNo",
+               "--injector"]
+  argid = 0
+  while argid < len(args):
+    arg = args[argid]
+    if arg in valueopts:
+      argid += 1
+      if argid == len(args):
+        usage("Missing value for " + arg)
+      value = args[argid]
+      if arg == "--index":
+        options["index"].append(int(value))
+      elif arg == "--layerName":
+        options["layers"].append([value.lower(), 0])
+      elif arg == "--layerNo":
+        if len(options["layers"]) == 0:
+          usage("--layerNo must follow a --layerName")
+        options["layers"][-1][1] = int(value)
+      elif arg == "--injector":
+        options["injector"] = value
+      else:
+        options[arg[2:]].append(value)
+    elif arg == "--append":
+      options["append"] = True
+    elif arg == "--verbose":
+      options["verbose"] = True
+    elif arg == "--help" or arg == "-h":
+      usage()
+    elif arg.startswith("-"):
+      usage("Invalid argument: " + arg)
+    else:
+      options["dir"] = arg
+    argid += 1
+
+
+def readSiteTable(path):
+  sites = []
+  try:
+    f = open(path, 'r')
+  except IOError:
+    usage("Unable to open " + path + ", please run instrument with the "
+          "unionInstrumentation compile option")
+  # Number the layers of each operator type, like the CustomTensorOperator
+  # instruction selector does.
+  layercounts = {}
+  layercount = {0: 0}
+  for line in f:
+    if line.startswith("layer="):
+      layernum, layername = line[len("layer="):].rstrip('\n').split(',', 1)
+      layername = layername.lower()
+      layercounts[layername] = layercounts.get(layername, 0) + 1
+      layercount[int(layernum)] = layercounts[layername]
+    elif line.startswith("site="):
+      index, opcode, numregs, layernum, layername, func = \
+          line[len("site="):].rstrip('\n').split(',', 5)
+      sites.append({"index": int(index), "opcode": opcode, "func": func,
+                    "layername": layername.lower(), "layernum": int(layernum),
+                    "layercount": layercount.get(int(layernum), 0)})
+  f.close()
+  return sites
+
+
+def isSelected(site):
+  if options["includeinst"] and "all" not in options["includeinst"] and \
+      site["opcode"] not in options["includeinst"]:
+    return False
+  if site["opcode"] in options["excludeinst"]:
+    return False
+  if options["includefunc"] and "all" not in options["includefunc"] and \
+      site["func"] not in options["includefunc"]:
+    return False
+  if site["func"] in options["excludefunc"]:
+    return False
+  if options["index"] and site["index"] not in options["index"]:
+    return False
+  if options["layers"]:
+    if site["layernum"] == 0:
+      return False
+    matched = False
+    for name, number in options["layers"]:
+      if name != "all" and name != site["layername"]:
+        continue
+      if name == "all" or number == 0 or number == site["layercount"]:
+        matched = True
+    if not matched:
+      return False
+  return True
+
+
+def readBitmap(path):
+  if not os.path.isfile(path):
+    return bytearray()
+  with open(path, 'rb') as f:
+    return bytearray(f.read())
+
+
+def readSiteTypes(path):
+  sitetypes = {}
+  if os.path.isfile(path):
+    with open(path, 'r') as f:
+      for line in f:
+        if line.startswith('#') or '=' not in line:
+          continue
+        index, fi_type = line.rstrip('\n').split('=', 1)
+        sitetypes[int(index)] = fi_type
+  return sitetypes
+
+
+def main(args):
+  parseArgs(args)
+  sites = readSiteTable(os.path.join(options["dir"], sitetablefile))
+  bitmappath = os.path.join(options["dir"], sitebitmapfile)
+  sitetypespath = os.path.join(options["dir"], sitetypesfile)
+
+  if options["append"]:
+    bitmap = readBitmap(bitmappath)
+    sitetypes = readSiteTypes(sitetypespath)
+  else:
+    bitmap = bytearray()
+    sitetypes = {}
+
+  maxindex = max([site["index"] for site in sites] + [-1])
+  if len(bitmap) < maxindex // 8 + 1:
+    bitmap.extend(bytearray(maxindex // 8 + 1 - len(bitmap)))
+
+  selected = [site for site in sites if isSelected(site)]
+  for site in selected:
+    bitmap[site["index"] // 8] |= 1 << (site["index"] % 8)
+    if options["injector"] is not None:
+      sitetypes[site["index"]] = options["injector"]
+    elif site["index"] in sitetypes:
+      del sitetypes[site["index"]]
+    if options["verbose"]:
+      print("site %d: %s in %s, layer %d %s" % (site["index"], site["opcode"],
+            site["func"], site["layernum"], site["layername"]))
+
+  with open(bitmappath, 'wb') as f:
+    f.write(bitmap)
+
+  if sitetypes:
+    with open(sitetypespath, 'w') as f:
+      f.write("# fault injector of each site, written by %s\n" % prog)
+      for index in sorted(sitetypes):
+        f.write("%d=%s\n" % (index, sitetypes[index]))
+  elif os.path.isfile(sitetypespath):
+    os.remove(sitetypespath)
+
+  print("Selected %d of %d sites" % (len(selected), len(sites)))
+  if len(selected) == 0:
+    print("WARNING: no site is selected, no fault will be injected")
+
+
+if __name__=="__main__":
+  main(sys.argv[1:])
@@ -6,6 +6,9 @@
 #include "core/FaultInjectionPass.h"
 #include "core/LLFIDotGraphPass.h"
 #include "core/InstTracePass.h"
+#include "core/LockstepPass.h"
+#include "core/TaintTrackingPass.h"
+#include "core/SDCEstimatorPass.h"
 
 using namespace llvm;
 
@@ -72,6 +75,39 @@ namespace llfi {
                   }
                   return false;
                 });
+
+              // For LockstepPass
+              PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "locksteppass") {
+                    MPM.addPass(llfi::LockstepPass());
+                    return true;
+                  }
+                  return false;
+                });
+
+              // For TaintTrackingPass
+              PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "tainttrackingpass") {
+                    MPM.addPass(llfi::TaintTrackingPass());
+                    return true;
+                  }
+                  return false;
+                });
+
+              // For SDCEstimatorPass
+              PB.registerPipelineParsingCallback(
+                [](StringRef Name, ModulePassManager &MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "sdcestimatorpass") {
+                    MPM.addPass(llfi::SDCEstimatorPass());
+                    return true;
+                  }
+                  return false;
+                });
             }};
   }
 
@@ -91,6 +91,22 @@ cl::opt < std::string > llfilogfile("llfilogfile",
       cl::Hidden,
       cl::desc("Name of compilation passes logging file"));
 
+/**
+ * Union instrumentation
+ */
+cl::opt< bool > fisitetable("fisitetable",
+    cl::init(false),
+    cl::desc("Write the instrumented fault injection sites to "
+             "llfi.stat.sitetable.txt, and select the active sites at runtime "
+             "from the site bitmap llfi.config.sitebitmap.bin"));
+
+// The fault injection planner (bin/fiplanner.py) samples the dynamic
+// instances of each site, counted by profiling.
+cl::opt< bool > profilesites("profilesites",
+    cl::init(false),
+    cl::desc("Write the fault injection sites to llfi.stat.sitetable.txt, and "
+             "count the dynamic instances of each site while profiling"));
+
 
 Controller *Controller::ctrl = NULL;
 
@@ -243,8 +259,8 @@ void Controller::init(Module &M) {
 }
 
 Controller::~Controller() {
-  delete ctrl;
-  ctrl = NULL;
+  if (ctrl == this)
+    ctrl = NULL;
 }
 
 void Controller::dump() const {
@@ -261,6 +277,10 @@ void Controller::dump() const {
 }
 
 Controller *Controller::getInstance(Module &M) {
+  // The selection refers to the instructions of one module, so it is redone
+  // when the passes run on another one, e.g. on each variant of llfi-driver
+  if (ctrl != NULL && ctrl->module != &M)
+    delete ctrl;
   if (ctrl == NULL)
     ctrl = new Controller(M);
   return ctrl;
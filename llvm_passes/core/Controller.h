@@ -47,7 +47,7 @@ class Controller {
 
  private:
   Controller() {}
-  Controller(Module &M) {
+  Controller(Module &M): module(&M) {
     init(M);
   }
   void init(Module &M);
@@ -74,6 +74,9 @@ class Controller {
   // set of functions present in module
   std::set<std::string> func_set;
 
+  // module the instructions above belong to
+  Module *module;
+
  private:
   static Controller *ctrl;
 };
@@ -1,85 +1,147 @@
 #include "llvm/IR/InstIterator.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/ThreadPool.h"
 
 #include "FIInstSelector.h"
 
 namespace llfi {
-void FIInstSelector::getFIInsts(Module &M, std::set<Instruction*> *fiinsts) {
-  getInitFIInsts(M, fiinsts);
-
-  std::set<Instruction* > bs;
-  std::set<Instruction* > fs;
-  // must do both of the computation on the fiinsts, and update
-  // fiinsts finally
-  if (includebackwardtrace)
-    getBackwardTraceofInsts(fiinsts, &bs);
-  if (includeforwardtrace)
-    getForwardTraceofInsts(fiinsts, &fs);
-
-  fiinsts->insert(bs.begin(), bs.end());
-  fiinsts->insert(fs.begin(), fs.end());
-}
-
-void FIInstSelector::getInitFIInsts(Module &M, 
-                                    std::set<Instruction*> *fiinsts) {
+FIInstNumbering::FIInstNumbering(Module &M) {
   for (Module::iterator m_it = M.begin(); m_it != M.end(); ++m_it) {
     if (!m_it->isDeclaration()) {
-      // m_it is a function
+      unsigned first = insts.size();
       for (inst_iterator f_it = inst_begin(&*m_it); f_it != inst_end(&*m_it);
            ++f_it) {
         Instruction *inst = &(*f_it);
-        if (isInstFITarget(inst)) {
-          fiinsts->insert(inst);
-        }
+        numbers[inst] = insts.size();
+        insts.push_back(inst);
       }
-    }  
+      funcranges.push_back(std::make_pair(first, (unsigned)insts.size()));
+    }
   }
 }
 
-void FIInstSelector::getBackwardTraceofInsts(
-    const std::set<Instruction* > *fiinsts, std::set<Instruction* > *bs) {
-  for (std::set<Instruction* >::const_iterator inst_it = fiinsts->begin();
-       inst_it != fiinsts->end(); ++inst_it) {
-    Instruction *inst = *inst_it;
-    getBackwardTraceofInst(inst, bs);
+void FIInstNumbering::toSet(const BitVector &bits,
+                            std::set<Instruction*> *fiinsts) const {
+  for (int n = bits.find_first(); n != -1; n = bits.find_next(n))
+    fiinsts->insert(fiinsts->end(), insts[n]);
+}
+
+void FIInstSelector::getFIInsts(Module &M, std::set<Instruction*> *fiinsts) {
+  FIInstNumbering numbering(M);
+  BitVector bits;
+  getFIInsts(M, numbering, &bits);
+  numbering.toSet(bits, fiinsts);
+}
+
+void FIInstSelector::getFIInsts(Module &M, const FIInstNumbering &numbering,
+                                BitVector *fiinsts) {
+  fiinsts->clear();
+  fiinsts->resize(numbering.size());
+  getInitFIInsts(M, numbering, fiinsts);
+
+  if (includebackwardtrace || includeforwardtrace)
+    addTraceofInsts(numbering, fiinsts);
+}
+
+void FIInstSelector::getInitFIInsts(Module &,
+                                    const FIInstNumbering &numbering,
+                                    BitVector *fiinsts) {
+  for (unsigned n = 0; n < numbering.size(); ++n) {
+    if (isInstFITarget(numbering.getInst(n)))
+      fiinsts->set(n);
   }
 }
 
-void FIInstSelector::getForwardTraceofInsts(
-    const std::set<Instruction* > *fiinsts, std::set<Instruction* > *fs) {
-  for (std::set<Instruction* >::const_iterator inst_it = fiinsts->begin();
-       inst_it != fiinsts->end(); ++inst_it) {
-    Instruction *inst = *inst_it;
-    getForwardTraceofInst(inst, fs);
+void FIInstSelector::addTraceofInsts(const FIInstNumbering &numbering,
+                                     BitVector *fiinsts) {
+  // use-def chains do not leave a function, so the functions are independent.
+  // Each one gets its own bit vectors, as neighbouring functions may share
+  // words of fiinsts.
+  const std::vector<std::pair<unsigned, unsigned> > &ranges =
+      numbering.getFuncRanges();
+  std::vector<BitVector> traces(ranges.size());
+
+  ThreadPool pool(hardware_concurrency());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    unsigned first = ranges[i].first, last = ranges[i].second;
+    if (fiinsts->find_first_in(first, last) == -1)
+      continue;
+
+    BitVector *trace = &traces[i];
+    pool.async([this, &numbering, fiinsts, first, last, trace]() {
+      // must do both of the computation on the fiinsts, and update
+      // fiinsts finally
+      trace->resize(last - first);
+      if (includebackwardtrace)
+        getBackwardTraceofInsts(numbering, *fiinsts, first, last, trace);
+      if (includeforwardtrace)
+        getForwardTraceofInsts(numbering, *fiinsts, first, last, trace);
+    });
+  }
+  pool.wait();
+
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    const BitVector &trace = traces[i];
+    for (int n = trace.find_first(); n != -1; n = trace.find_next(n))
+      fiinsts->set(ranges[i].first + n);
   }
 }
 
-void FIInstSelector::getBackwardTraceofInst(Instruction *inst,
-                                            std::set<Instruction*> *bs) {
-  for (User::op_iterator op_it = inst->op_begin(); 
-       op_it != inst->op_end(); ++op_it) {
-    Value *src = *op_it;
-    if (Instruction *src_inst = dyn_cast<Instruction>(src)) {
-      if (bs->find(src_inst) == bs->end()) {
-        bs->insert(src_inst);
-        getBackwardTraceofInst(src_inst, bs);
+void FIInstSelector::getBackwardTraceofInsts(const FIInstNumbering &numbering,
+                                             const BitVector &fiinsts,
+                                             unsigned first, unsigned last,
+                                             BitVector *bs) {
+  BitVector visited(last - first);
+  std::vector<Instruction*> worklist;
+  for (int n = fiinsts.find_first_in(first, last); n != -1;
+       n = fiinsts.find_first_in(n + 1, last))
+    worklist.push_back(numbering.getInst(n));
+
+  while (!worklist.empty()) {
+    Instruction *inst = worklist.back();
+    worklist.pop_back();
+    for (User::op_iterator op_it = inst->op_begin();
+         op_it != inst->op_end(); ++op_it) {
+      Value *src = *op_it;
+      if (Instruction *src_inst = dyn_cast<Instruction>(src)) {
+        unsigned n = numbering.getNumber(src_inst) - first;
+        if (!visited.test(n)) {
+          visited.set(n);
+          worklist.push_back(src_inst);
+        }
       }
     }
   }
+  *bs |= visited;
 }
 
-void FIInstSelector::getForwardTraceofInst(Instruction *inst,
-                                           std::set<Instruction*> *fs) {
-  for (Value::user_iterator user_it = inst->user_begin();
-       user_it != inst->user_end(); ++user_it) {
-    User *user = *user_it;
-    if (Instruction *user_inst = dyn_cast<Instruction>(user)) {
-      if (fs->find(user_inst) == fs->end()) {
-        fs->insert(user_inst);
-        getForwardTraceofInst(user_inst, fs);
+void FIInstSelector::getForwardTraceofInsts(const FIInstNumbering &numbering,
+                                            const BitVector &fiinsts,
+                                            unsigned first, unsigned last,
+                                            BitVector *fs) {
+  BitVector visited(last - first);
+  std::vector<Instruction*> worklist;
+  for (int n = fiinsts.find_first_in(first, last); n != -1;
+       n = fiinsts.find_first_in(n + 1, last))
+    worklist.push_back(numbering.getInst(n));
+
+  while (!worklist.empty()) {
+    Instruction *inst = worklist.back();
+    worklist.pop_back();
+    for (Value::user_iterator user_it = inst->user_begin();
+         user_it != inst->user_end(); ++user_it) {
+      User *user = *user_it;
+      if (Instruction *user_inst = dyn_cast<Instruction>(user)) {
+        unsigned n = numbering.getNumber(user_inst) - first;
+        if (!visited.test(n)) {
+          visited.set(n);
+          worklist.push_back(user_inst);
+        }
       }
     }
   }
+  *fs |= visited;
 }
 
 void FIInstSelector::getCompileTimeInfo(std::map<std::string, std::string>& info) {
@@ -1,20 +1,51 @@
 #ifndef FI_INST_SELECTOR_H
 #define FI_INST_SELECTOR_H
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Instruction.h"
 
 #include <set>
 #include <map>
+#include <vector>
 
 using namespace llvm;
 
 namespace llfi {
+// Dense numbering of the instructions of a module, in the order of the LLFI
+// indices: the instructions of a function have consecutive numbers, so sets of
+// instructions are stored as bit vectors and each function is a bit range.
+class FIInstNumbering {
+ public:
+  explicit FIInstNumbering(Module &M);
+
+  unsigned size() const { return insts.size(); }
+  unsigned getNumber(Instruction *inst) const {
+    return numbers.find(inst)->second;
+  }
+  Instruction *getInst(unsigned number) const { return insts[number]; }
+
+  // [first, last) range of numbers of each defined function
+  const std::vector<std::pair<unsigned, unsigned> > &getFuncRanges() const {
+    return funcranges;
+  }
+
+  void toSet(const BitVector &bits, std::set<Instruction*> *insts) const;
+
+ private:
+  std::vector<Instruction*> insts;
+  DenseMap<Instruction*, unsigned> numbers;
+  std::vector<std::pair<unsigned, unsigned> > funcranges;
+};
+
 class FIInstSelector {
  public:
   FIInstSelector(): includebackwardtrace(false), includeforwardtrace(false) {}
 
  public:
   void getFIInsts(Module &M, std::set<Instruction*> *fiinsts);
+  void getFIInsts(Module &M, const FIInstNumbering &numbering,
+                  BitVector *fiinsts);
   virtual void getCompileTimeInfo(std::map<std::string, std::string>& info);
 
   virtual std::string getInstSelectorClass(){
@@ -32,20 +63,23 @@ class FIInstSelector {
  private:
   // get the initial fault injection instruction without backtrace or forward
   // trace, selection from source code may need to rewrite this function
-  virtual void getInitFIInsts(Module &M, std::set<Instruction*> *fiinsts);
+  virtual void getInitFIInsts(Module &M, const FIInstNumbering &numbering,
+                              BitVector *fiinsts);
 
   virtual bool isInstFITarget(Instruction* inst) = 0;
 
  protected:
-  // only get the "instructions" that are the backward/forward trace of inst
-  void getBackwardTraceofInsts(const std::set<Instruction*> *fiinsts,
-                          std::set<Instruction*> *bs);
-  void getForwardTraceofInsts(const std::set<Instruction*> *fiinsts,
-                          std::set<Instruction*> *fs);
-  void getBackwardTraceofInst(Instruction *inst, 
-                              std::set<Instruction*> *bs);
-  void getForwardTraceofInst(Instruction *inst,
-                             std::set<Instruction*> *fs);
+  // add the backward/forward trace of the instructions of fiinsts to fiinsts,
+  // one function per thread
+  void addTraceofInsts(const FIInstNumbering &numbering, BitVector *fiinsts);
+  // only get the "instructions" that are the backward/forward trace of the
+  // instructions of fiinsts in the function range [first, last)
+  void getBackwardTraceofInsts(const FIInstNumbering &numbering,
+                               const BitVector &fiinsts, unsigned first,
+                               unsigned last, BitVector *bs);
+  void getForwardTraceofInsts(const FIInstNumbering &numbering,
+                              const BitVector &fiinsts, unsigned first,
+                              unsigned last, BitVector *fs);
  protected:
   bool includebackwardtrace;
   bool includeforwardtrace;
@@ -6,32 +6,25 @@ namespace llfi {
 
 void FIInstSelectorManager::getFIInsts(Module &M,
                                          std::set<Instruction*> *fiinsts) {
+  FIInstNumbering numbering(M);
 
-  // Create a set for each selector and print compiletime info
-  std::vector<std::set<Instruction*>*> allInsts;
+  // Intersect the instructions of each selector and print compiletime info
+  BitVector merge;
   for(it = selectors.begin(); it != selectors.end(); ++it) {
-    allInsts.push_back(new std::set<Instruction*>);
      std::map<std::string, std::string> info;
      (*it)->getCompileTimeInfo(info);
      printCompileTimeInfo(info);
-     (*it)->getFIInsts(M, allInsts.back());
-  }
 
-  // Merge allInsts into fiinsts
-  std::set<Instruction*> merge = *(allInsts[0]);
-  for(size_t i = 1; i < allInsts.size(); ++i) {
-    std::set<Instruction*> tmp;
-    tmp.swap(merge);
-    std::set_intersection(tmp.begin(), tmp.end(),
-                          allInsts[i]->begin(), allInsts[i]->end(),
-                          std::inserter(merge, merge.begin()));
+     BitVector insts;
+     (*it)->getFIInsts(M, numbering, &insts);
+     if (it == selectors.begin())
+       merge.swap(insts);
+     else
+       merge &= insts;
   }
 
-  fiinsts->swap(merge);
-
-  for(size_t i = 0; i < allInsts.size(); ++i) {
-    delete allInsts[i];
-  }
+  fiinsts->clear();
+  numbering.toSet(merge, fiinsts);
 }
 
 int FIInstSelectorManager::printCompileTimeInfo(std::map<std::string, std::string>& info) {
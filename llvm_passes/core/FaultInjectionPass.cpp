@@ -15,14 +15,20 @@
 // fault injection function. This function definition is linked to the 
 // instrumented bitcode file (after this pass). 
 //===----------------------------------------------------------------------===//
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <vector>
+#include <cstring>
 
 #include "FaultInjectionPass.h"
 #include "Controller.h"
@@ -31,6 +37,8 @@
 namespace llfi {
 
 char FaultInjectionPass::ID=0;
+extern cl::opt< bool > fisitetable;
+extern cl::opt< bool > profilesites;
 
 std::string FaultInjectionPass::getFIFuncNameforType(const Type *type) {
   std::string funcname;
@@ -161,10 +169,17 @@ void FaultInjectionPass::insertInjectionFuncCall(
       ArrayRef<Value*> args_array_ref(args);
 
       Instruction *insertptr = getInsertPtrforRegsofInst(fi_reg, fi_inst);
-      Instruction *ficall =
+      CallInst *ficall =
           CallInst::Create(injectfunc, args_array_ref, "fi", insertptr);
+      // every site keeps its own call after optimizations
+      ficall->setCannotMerge();
       setInjectFaultInst(fi_reg, fi_inst, ficall); // sets the instruction metadata
 
+      std::pair<Instruction*, unsigned> &site =
+          fi_sites[getLLFIIndexofInst(fi_inst)];
+      site.first = fi_inst;
+      site.second++;
+
       // redirect the data dependencies
       if (fi_reg == fi_inst) {
         // inject into destination
@@ -218,10 +233,22 @@ void FaultInjectionPass::createInjectionFuncforType(
   // args[0] llfi index, args[1] fault injection instruction
   // args[2] for opcode, args[3] for reg index, args[4] for total num of fi reg
 
+  // The injection functions are small, and are inlined into the sites when
+  // the instrumented program is optimized
+  f->setLinkage(GlobalValue::InternalLinkage);
+  f->addFnAttr(Attribute::AlwaysInline);
+  f->addFnAttr(Attribute::NoUnwind);
+
   BasicBlock* entryblock = BasicBlock::Create(context, "entry", f);
-  // store the value of target instruction to memory
+  // memory for the value of target instruction, only used when the fault is
+  // injected
   AllocaInst *tmploc = new AllocaInst(fitype, 0, "tmploc", entryblock);
-  new StoreInst(args[1], tmploc, entryblock);
+
+  // with union instrumentation, the sites that are not active in the site
+  // bitmap skip preFunc, see insertSiteBitmapCheck()
+  BasicBlock *selectblock = entryblock;
+  if (fisitetable)
+    selectblock = BasicBlock::Create(context, "select", f);
 
   std::vector<Value*> pre_fi_args(4);
   pre_fi_args[0] = args[0]; //LLFI index
@@ -232,14 +259,20 @@ void FaultInjectionPass::createInjectionFuncforType(
   // LLVM 3.3 Upgrade
   ArrayRef<Value*> pre_fi_args_array_ref(pre_fi_args);
 
-  Value *prefuncval = CallInst::Create(pre_fi_func, pre_fi_args_array_ref, "pre_cond", entryblock);
+  CallInst *prefuncval = CallInst::Create(pre_fi_func, pre_fi_args_array_ref, "pre_cond", selectblock);
+  prefuncval->setCannotMerge();
 
   BasicBlock *fiblock = BasicBlock::Create(context, "inject", f);	
   BasicBlock *exitblock = BasicBlock::Create(context,"exit", f );
   //if prefuncval is true, goto inject function
-  BranchInst::Create(fiblock, exitblock, prefuncval, entryblock);		
+  BranchInst::Create(fiblock, exitblock, prefuncval, selectblock);
   BranchInst *fi2exit_branch = BranchInst::Create(exitblock, fiblock);
 
+  if (fisitetable)
+    insertSiteBitmapCheck(M, args[0], entryblock, selectblock, exitblock);
+
+  new StoreInst(args[1], tmploc, fi2exit_branch);
+
   std::vector<Value*> fi_args(6);
   fi_args[0] = args[0]; //LLFI index
   const DataLayout &td = M.getDataLayout();
@@ -257,11 +290,54 @@ void FaultInjectionPass::createInjectionFuncforType(
   //================================================
   ArrayRef<Value*> fi_args_array_ref(fi_args);
 	
-  CallInst::Create(injectfunc, fi_args_array_ref, "",
-                   fi2exit_branch);
+  CallInst *ficall = CallInst::Create(injectfunc, fi_args_array_ref, "",
+                                      fi2exit_branch);
+  ficall->setCannotMerge();
+
+  LoadInst *updateval = new LoadInst(fitype, tmploc, "updateval",
+                                     fi2exit_branch);
+
+  // the value is unchanged on all the paths that skip the injection
+  PHINode *retval = PHINode::Create(fitype, 0, "retval", exitblock);
+  for (BasicBlock *pred : predecessors(exitblock))
+    retval->addIncoming(pred == fiblock ? updateval : args[1], pred);
+  ReturnInst::Create(context, retval, exitblock);
+}
 
-  LoadInst *updateval = new LoadInst(fitype, tmploc, "updateval", exitblock);
-  ReturnInst::Create(context, updateval, exitblock);
+// Branch from entryblock to selectblock if the site of the llfi index is
+// active in the site bitmap of the runtime (llfi_site_bitmap, one bit per llfi
+// index), and to exitblock otherwise. Without a bitmap all sites are active.
+void FaultInjectionPass::insertSiteBitmapCheck(Module &M, Value *index,
+                                               BasicBlock *entryblock,
+                                               BasicBlock *selectblock,
+                                               BasicBlock *exitblock) {
+  LLVMContext &context = M.getContext();
+  Function *f = entryblock->getParent();
+  Type *i8type = Type::getInt8Ty(context);
+  Type *i64type = Type::getInt64Ty(context);
+  Type *bitmaptype = PointerType::get(i8type, 0);
+
+  Constant *bitmapgv = M.getOrInsertGlobal("llfi_site_bitmap", bitmaptype);
+  Constant *bitsgv = M.getOrInsertGlobal("llfi_site_bitmap_bits", i64type);
+
+  BasicBlock *rangeblock =
+      BasicBlock::Create(context, "site_range", f, selectblock);
+  BasicBlock *bitblock = BasicBlock::Create(context, "site_bit", f, selectblock);
+
+  IRBuilder<> IRB(entryblock);
+  Value *bitmap = IRB.CreateLoad(bitmaptype, bitmapgv, "site_bitmap");
+  IRB.CreateCondBr(IRB.CreateIsNull(bitmap), selectblock, rangeblock);
+
+  IRB.SetInsertPoint(rangeblock);
+  Value *bits = IRB.CreateLoad(i64type, bitsgv, "site_bitmap_bits");
+  IRB.CreateCondBr(IRB.CreateICmpULT(index, bits), bitblock, exitblock);
+
+  IRB.SetInsertPoint(bitblock);
+  Value *byteptr = IRB.CreateGEP(i8type, bitmap, IRB.CreateLShr(index, 3));
+  Value *byte = IRB.CreateLoad(i8type, byteptr, "site_byte");
+  Value *shift = IRB.CreateTrunc(IRB.CreateAnd(index, 7), i8type);
+  Value *bit = IRB.CreateAnd(IRB.CreateLShr(byte, shift), 1);
+  IRB.CreateCondBr(IRB.CreateIsNotNull(bit), selectblock, exitblock);
 }
 
 void FaultInjectionPass::createInjectionFunctions(Module &M) {
@@ -291,9 +367,84 @@ bool FaultInjectionPass::runOnModule(Module &M) {
   insertInjectionFuncCall(fi_inst_regs_map, M);
 
   finalize(M);
+
+  if (fisitetable || profilesites)
+    writeSiteTable(M);
   return true;
 }
 
+// Write one line per ML layer and one line per instrumented instruction, in
+// llfi index order:
+//   layer=<ml layer num>,<ml layer name>
+//   site=<llfi index>,<opcode>,<fi reg num>,<ml layer num>,<ml layer name>,
+//        <function>
+// ML layers are numbered in the order of the OMInstrumentPoint start markers
+// of main_graph, like the profiling runtime does. Instructions outside of a
+// layer have layer number 0 and an empty layer name.
+// ONNX operator ids are the operator names as little-endian characters.
+static std::string getLayerName(int64_t name) {
+  const char *name_str = reinterpret_cast<const char*>(&name);
+  return std::string(name_str, strnlen(name_str, sizeof(name)));
+}
+
+void FaultInjectionPass::writeSiteTable(Module &M) {
+  std::map<Instruction*, std::pair<long, int64_t> > inst_layer_map;
+  std::vector<int64_t> layers;
+  Function *main_graph = M.getFunction("main_graph");
+  if (main_graph != NULL) {
+    long layer_num = 0;
+    int64_t layer_name = 0;
+    bool in_layer = false;
+    for (inst_iterator it = inst_begin(main_graph);
+         it != inst_end(main_graph); ++it) {
+      CallInst *ci = dyn_cast<CallInst>(&*it);
+      Function *callee = ci ? ci->getCalledFunction() : NULL;
+      if (callee != NULL && callee->getName() == "OMInstrumentPoint") {
+        ConstantInt *op = dyn_cast<ConstantInt>(ci->getArgOperand(0));
+        ConstantInt *kind = dyn_cast<ConstantInt>(ci->getArgOperand(1));
+        in_layer = kind != NULL && kind->getSExtValue() == 1;
+        if (in_layer) {
+          layer_num++;
+          layer_name = op != NULL ? op->getSExtValue() : 0;
+          layers.push_back(layer_name);
+        }
+        continue;
+      }
+      if (in_layer)
+        inst_layer_map[&*it] = std::make_pair(layer_num, layer_name);
+    }
+  }
+
+  std::error_code err;
+  raw_fd_ostream sitetable("llfi.stat.sitetable.txt", err, sys::fs::OF_None);
+  if (err) {
+    errs() << "ERROR: Unable to open site table file llfi.stat.sitetable.txt\n";
+    exit(1);
+  }
+
+  sitetable << "# do not edit\n";
+  sitetable << "# site=<llfi index>,<opcode>,<fi reg num>,<ml layer num>,"
+            << "<ml layer name>,<function>\n";
+  for (size_t i = 0; i < layers.size(); ++i)
+    sitetable << "layer=" << i + 1 << "," << getLayerName(layers[i]) << "\n";
+  for (std::map<long, std::pair<Instruction*, unsigned> >::const_iterator it =
+       fi_sites.begin(); it != fi_sites.end(); ++it) {
+    Instruction *fi_inst = it->second.first;
+    long layer_num = 0;
+    std::string layer_name;
+    if (inst_layer_map.find(fi_inst) != inst_layer_map.end()) {
+      layer_num = inst_layer_map[fi_inst].first;
+      layer_name = getLayerName(inst_layer_map[fi_inst].second);
+    }
+    sitetable << "site=" << it->first << "," << fi_inst->getOpcodeName() << ","
+              << it->second.second << "," << layer_num << "," << layer_name
+              << ","
+              << demangleFuncName(fi_inst->getFunction()->getName().str())
+              << "\n";
+  }
+  sitetable.close();
+}
+
 void FaultInjectionPass::checkforMainFunc(Module &M) {
   Function* mainfunc = M.getFunction("main");
   if (mainfunc == NULL) {
@@ -307,9 +458,17 @@ void FaultInjectionPass::finalize(Module &M) {
   Function *mainfunc = M.getFunction("main");
   BasicBlock *entryblock = &mainfunc->front();
 
-  // function call for initInjections
+  // function call for initInjections, with the number of llfi indices
+  long numsites = 0;
+  for (Function &F : M)
+    for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it)
+      if (isLLFIIndexedInst(&*it))
+        numsites = std::max(numsites, getLLFIIndexofInst(&*it) + 1);
   FunctionCallee initfunc = getLLFILibInitInjectionFunc(M);
-  CallInst::Create(initfunc, "", entryblock->getFirstNonPHI());
+  CallInst::Create(initfunc,
+                   {ConstantInt::get(Type::getInt64Ty(M.getContext()),
+                                     numsites)},
+                   "", entryblock->getFirstNonPHI());
   
   // function call for postInjections
   FunctionCallee postfifunc = getLLFILibPostInjectionFunc(M);
@@ -342,6 +501,7 @@ FunctionCallee FaultInjectionPass::getLLFILibPreFIFunc(Module &M) {
       Type::getInt1Ty(context), pre_fi_func_param_types_array_ref, false);
   FunctionCallee pre_fi_func =
       M.getOrInsertFunction("preFunc", pre_fi_func_type);
+  setLLFIRuntimeFuncAttrs(pre_fi_func, false);
   return pre_fi_func;
 }
 
@@ -364,13 +524,15 @@ FunctionCallee FaultInjectionPass::getLLFILibFIFunc(Module &M) {
       Type::getVoidTy(context), fi_func_param_types_array_ref, false);
   FunctionCallee injectfunc =
       M.getOrInsertFunction("injectFunc", injectfunctype);
+  // the injectors may write to the memory the target value points to
+  setLLFIRuntimeFuncAttrs(injectfunc, true);
   return injectfunc;
 }
 
 FunctionCallee FaultInjectionPass::getLLFILibInitInjectionFunc(Module &M) {
   LLVMContext &context = M.getContext();
-  FunctionType *fi_init_func_type =
-      FunctionType::get(Type::getVoidTy(context), false);
+  FunctionType *fi_init_func_type = FunctionType::get(
+      Type::getVoidTy(context), {Type::getInt64Ty(context)}, false);
   FunctionCallee initfunc =
       M.getOrInsertFunction("initInjections", fi_init_func_type);
   return initfunc;
@@ -34,6 +34,11 @@ namespace llfi {
                                     std::string &funcname, FunctionCallee fi_func,
                                     FunctionCallee pre_func);
     void createInjectionFunctions(Module &M);
+    void insertSiteBitmapCheck(Module &M, Value *index,
+                               BasicBlock *entryblock,
+                               BasicBlock *selectblock,
+                               BasicBlock *exitblock);
+    void writeSiteTable(Module &M);
 
   private:
     std::string getFIFuncNameforType(const Type* type);
@@ -45,6 +50,8 @@ namespace llfi {
 
   private:
     std::map<const Type*, std::string> fi_rettype_funcname_map;
+    // instrumented instructions by llfi index, with their number of fi regs
+    std::map<long, std::pair<Instruction*, unsigned> > fi_sites;
   };
 
   // For New PM
@@ -14,11 +14,8 @@ namespace llfi {
     for (Module::iterator m_it = M.begin(); m_it != M.end(); ++m_it) {
       if (!m_it->isDeclaration()) {
         // m_it is a function
-        for (inst_iterator f_it = inst_begin(&*m_it); f_it != inst_end(&*m_it);
-             ++f_it) {
-          currinst = &(*f_it);
-          setLLFIIndexofInst(currinst);
-        }
+        setLLFIIndexofFunc(&*m_it);
+        currinst = &m_it->back().back();
       }
     }
 
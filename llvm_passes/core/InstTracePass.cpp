@@ -10,6 +10,8 @@ Author: Sam Coulter
   instruction to a file specified during the pass.
 ***************/
 
+#include <algorithm>
+#include <climits>
 #include <vector>
 #include <cmath>
 
@@ -19,6 +21,7 @@ Author: Sam Coulter
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/IR/InstIterator.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
@@ -26,6 +29,7 @@ Author: Sam Coulter
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
 #include "Utils.h"
 #include "InstTracePass.h"
@@ -36,11 +40,37 @@ cl::opt<bool> debugtrace("debugtrace",
 cl::opt<int> maxtrace( "maxtrace",
     cl::desc("Maximum number of dynamic instructions that will be traced after fault injection"),
             cl::init(1000));
+cl::opt<bool> hashcheckpoints("hashcheckpoints",
+    cl::desc("Write hash checkpoints of the traced values (see InstTraceLib.c)"),
+    cl::init(false));
+cl::opt<bool> compresstrace("compresstrace",
+    cl::desc("Write the trace compressed by value prediction (see InstTraceLib.c)"),
+    cl::init(false));
 
 using namespace llvm;
 
 namespace llfi {
 
+  //State of a site in llfi_trace_sites, see InstTraceLib.c
+  static const int TRACE_SITE_FILTERED = 2;
+
+  bool InstTrace::doInitialization(Module &M) {
+    functionRanges.clear();
+    long numsites = 0;
+    for (Function &F : M)
+      for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it)
+        if (llfi::isLLFIIndexedInst(&*it))
+          numsites = std::max(numsites, getLLFIIndexofInst(&*it) + 1);
+
+    Type *sitestype = ArrayType::get(Type::getInt8Ty(M.getContext()),
+                                     numsites);
+    sitesgv = new GlobalVariable(M, sitestype, false,
+                                 GlobalValue::InternalLinkage,
+                                 Constant::getNullValue(sitestype),
+                                 "llfi_trace_sites");
+    return true;
+  }
+
   bool InstTrace::doFinalization(Module &M) {
     //Dont forget to delete the output filename string!
     Function* mainfunc = M.getFunction("main");
@@ -67,6 +97,42 @@ namespace llfi {
       CallInst::Create(postracingfunc, "", term);
     }
 
+    //Pass the traced functions, sorted by llfi index, and the sites to the
+    //runtime at the start of main:
+    //  initTracing({name, first llfi index, last llfi index}[], count,
+    //              hashcheckpoints, sites, number of sites)
+    std::sort(functionRanges.begin(), functionRanges.end(),
+              [](const std::pair<Function*, std::pair<long, long> > &a,
+                 const std::pair<Function*, std::pair<long, long> > &b) {
+                return a.second.first < b.second.first;
+              });
+    Type *i64type = Type::getInt64Ty(context);
+    Type *nametype = Type::getInt8PtrTy(context);
+    StructType *functype = StructType::get(nametype, i64type, i64type);
+    std::vector<Constant*> funcs;
+    IRBuilder<> IRB(&*mainfunc->getEntryBlock().getFirstInsertionPt());
+    for (auto &range : functionRanges) {
+      Constant *name = IRB.CreateGlobalStringPtr(range.first->getName(),
+                                                 "llfi_trace_func");
+      funcs.push_back(ConstantStruct::get(functype, name,
+          ConstantInt::get(i64type, range.second.first),
+          ConstantInt::get(i64type, range.second.second)));
+    }
+    ArrayType *tabletype = ArrayType::get(functype, funcs.size());
+    GlobalVariable *table = new GlobalVariable(M, tabletype, true,
+        GlobalValue::PrivateLinkage, ConstantArray::get(tabletype, funcs),
+        "llfi_trace_functions");
+    FunctionCallee initfunc = M.getOrInsertFunction("initTracing",
+        Type::getVoidTy(context), PointerType::get(functype, 0), i64type,
+        Type::getInt32Ty(context), Type::getInt8PtrTy(context), i64type);
+    Type *sitestype = sitesgv->getValueType();
+    IRB.CreateCall(initfunc, {IRB.CreateConstGEP2_32(tabletype, table, 0, 0),
+                              ConstantInt::get(i64type, funcs.size()),
+                              IRB.getInt32(hashcheckpoints),
+                              IRB.CreateConstGEP2_32(sitestype, sitesgv, 0, 0),
+                              ConstantInt::get(i64type,
+                                  sitestype->getArrayNumElements())});
+
     return true;
   }
 
@@ -93,14 +159,23 @@ namespace llfi {
     LLVMContext& context = F.getContext();
     Module *M = F.getParent();
 
+    Type *i64type = Type::getInt64Ty(context);
+    Constant *countgv = M->getOrInsertGlobal("llfi_trace_count", i64type);
+    Constant *nextgv = M->getOrInsertGlobal("llfi_trace_next", i64type);
+    Constant *hashgv = M->getOrInsertGlobal("llfi_trace_hash", i64type);
+
+    //The blocks are split at the traced instructions, collect them first
+    Type *i8type = Type::getInt8Ty(context);
+    std::pair<long, long> range(LONG_MAX, LONG_MIN);
+    std::vector<Instruction*> insts;
+    for (inst_iterator instIterator = inst_begin(F), lastInst = inst_end(F);
+         instIterator != lastInst; ++instIterator)
+      insts.push_back(&*instIterator);
+
     //iterate through each instruction of the function
-    inst_iterator lastInst;
-    for (inst_iterator instIterator = inst_begin(F),
-         lastInst = inst_end(F);
-         instIterator != lastInst; ++instIterator) {
+    for (Instruction *inst : insts) {
 
         //Print some Debug Info as the pass is being run
-      Instruction *inst = &*instIterator;
 
       if (debugtrace) {
         if (!llfi::isLLFIIndexedInst(inst)) {
@@ -115,11 +190,45 @@ namespace llfi {
         //Find instrumentation point for current instruction
         Instruction *insertPoint = getInsertPoint(inst);
 
-        //Skip instrumentation for terminating instructions
-        if (insertPoint->isTerminator()) {
+        //Skip instrumentation for terminating instructions. The other ones
+        //are traced before the terminator of their block if need be, so that
+        //the golden and the fault injection builds trace the same instructions
+        if (inst->isTerminator()) {
           continue;
         }
 
+        //The addresses differ between the golden and the fault injection
+        //builds, only the other values are hashed
+        if (hashcheckpoints && !inst->getType()->isVoidTy() &&
+            !inst->getType()->isPtrOrPtrVectorTy())
+          addValueHash(inst, hashgv, insertPoint);
+
+        //Count the instruction, and only call the tracing function when the
+        //count reaches llfi_trace_next, set by the runtime to the start of
+        //the next trace window
+        IRBuilder<> IRB(insertPoint);
+        Value *count = IRB.CreateAdd(
+            IRB.CreateLoad(i64type, countgv, "llfi_trace_count"),
+            ConstantInt::get(i64type, 1));
+        IRB.CreateStore(count, countgv);
+        Value *due = IRB.CreateICmpUGE(
+            count, IRB.CreateLoad(i64type, nextgv, "llfi_trace_next"));
+        insertPoint = SplitBlockAndInsertIfThen(due, insertPoint, false);
+
+        //Nor for the sites that the runtime filtered out
+        long index = fetchLLFIInstructionID(inst);
+        IRB.SetInsertPoint(insertPoint);
+        Value *site = IRB.CreateLoad(i8type,
+            IRB.CreateConstInBoundsGEP2_64(sitesgv->getValueType(), sitesgv,
+                                           0, index),
+            "llfi_trace_site");
+        Value *traced = IRB.CreateICmpNE(
+            site, ConstantInt::get(i8type, TRACE_SITE_FILTERED));
+        insertPoint = SplitBlockAndInsertIfThen(traced, insertPoint, false);
+
+        range.first = std::min(range.first, index);
+        range.second = std::max(range.second, index);
+
         //======== Find insertion location for alloca QINING @SET 15th============
         Instruction* alloca_insertPoint = inst->getParent()->getParent()->begin()->getFirstNonPHIOrDbgOrLifetime();
         //========================================================================
@@ -178,7 +287,9 @@ namespace llfi {
         FunctionType* traceFuncType = FunctionType::get(Type::getVoidTy(context), 
                                                         parameterVector_array_ref, false);
         FunctionCallee traceFunc =
-            M->getOrInsertFunction("printInstTracer", traceFuncType);
+            M->getOrInsertFunction(compresstrace ? "printCompressedInstTracer"
+                                                 : "printInstTracer",
+                                   traceFuncType);
 
         //Insert the tracing function, passing it the proper arguments
         std::vector<Value*> traceArgs;
@@ -218,6 +329,8 @@ namespace llfi {
       }
     }//Function Iteration
 
+    if (range.first <= range.second)
+      functionRanges.push_back(std::make_pair(&F, range));
     return true; //Tell LLVM that the Function was modified
   }//RunOnFunction
 
@@ -1,3 +1,6 @@
+#include <utility>
+#include <vector>
+
 #include "llvm/IR/PassManager.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
@@ -12,9 +15,7 @@ namespace llfi {
 
     InstTrace() : FunctionPass(ID) {}
 
-    virtual bool doInitialization(Module &M) {
-      return false;
-    }
+    virtual bool doInitialization(Module &M);
 
     virtual bool doFinalization(Module &M);
 
@@ -23,6 +24,14 @@ namespace llfi {
     Instruction* getInsertPoint(Instruction* llfiIndexedInst);
 
     virtual bool runOnFunction(Function &F);
+
+   private:
+    // range of the llfi indices of the traced instructions of each function,
+    // passed to the runtime to select the functions to trace
+    std::vector<std::pair<Function*, std::pair<long, long> > > functionRanges;
+    // state of each site, set by the runtime to skip the sites of the
+    // functions and opcodes that are not traced
+    GlobalVariable *sitesgv;
   };
 
   struct NewInstTrace:  llvm::PassInfoMixin<NewInstTrace> {
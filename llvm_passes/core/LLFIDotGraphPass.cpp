@@ -1,7 +1,8 @@
+#include <algorithm>
 #include <vector>
-#include <cmath>
 #include <string>
 
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/GlobalValue.h"
@@ -13,6 +14,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Value.h"
@@ -29,151 +31,315 @@ using namespace llvm;
 
 namespace llfi {
 
-struct instNode {
-  std::string name, label;
-  Instruction *raw;
-  std::string dotNode();
-  instNode(Instruction *target);
+enum GraphFormat { GraphDot, GraphML };
+enum GraphSplit { SplitNone, SplitFunction, SplitLayer };
+
+static cl::opt<GraphFormat> graphformat("graphformat",
+    cl::desc("Format of the program graph"),
+    cl::values(clEnumValN(GraphDot, "dot",
+                          "Graphviz, llfi.stat.graph.dot (default)"),
+               clEnumValN(GraphML, "graphml",
+                          "GraphML, llfi.stat.graph.graphml")),
+    cl::init(GraphDot));
+
+static cl::opt<GraphSplit> graphsplit("graphsplit",
+    cl::desc("Write the program graph in several files"),
+    cl::values(clEnumValN(SplitNone, "none",
+                          "One graph of the module (default)"),
+               clEnumValN(SplitFunction, "function",
+                          "One graph per function, "
+                          "llfi.stat.graph.<function>"),
+               clEnumValN(SplitLayer, "layer",
+                          "One graph per function, and one per operator "
+                          "delimited by OMInstrumentPoint calls, "
+                          "llfi.stat.graph.<function>.layer<N>")),
+    cl::init(SplitNone));
+
+static cl::list<std::string> graphfunc("graphfunc",
+    cl::desc("Function of the program graph (default: all)"),
+    cl::ZeroOrMore);
+
+// Streams the nodes and edges of a graph to a file. The nodes of a basic
+// block are written between beginBlock and endBlock.
+class GraphWriter {
+ public:
+  GraphWriter(const std::string &filename)
+      : out(filename, ec, sys::fs::OF_None) {
+    if (ec) {
+      errs() << "ERROR: Unable to open the program graph " << filename << ": "
+             << ec.message() << "\n";
+      exit(1);
+    }
+  }
+  virtual ~GraphWriter() {}
+
+  virtual void beginBlock(StringRef func, StringRef block) = 0;
+  virtual void endBlock() = 0;
+  // line is 0 if the instruction has no debug location
+  virtual void node(long index, const char *opcode, unsigned line) = 0;
+  virtual void edge(long from, long to, bool datadep) = 0;
+
+ protected:
+  std::error_code ec;
+  raw_fd_ostream out;
 };
 
-instNode::instNode(Instruction *target) {
-  raw = target;
-
-  long llfiID = llfi::getLLFIIndexofInst(target);
-  name = "llfiID_" + longToString(llfiID);
-  FILE *outputFile = fopen("llfi.index.map.txt", "a");
-
-  label = std::string(" [shape=record,label=\"") + longToString(llfiID);
-  label += std::string("\\n") + target->getOpcodeName() + "\\n";
-  DebugLoc dbgLoc = target->getDebugLoc();
-  if (bool(dbgLoc) && dbgLoc.getLine()) {
-    label += "(Line #: " + intToString(dbgLoc.getLine()) + ")\\n";
-    /* if (MDNode *N= target->getMetadata("dbg")){
-       label += "(In File: " + DILocation (N).getFilename().str().substr(DILocation (N).getFilename().str().find_last_of("/\\")+1)+")";
-    } */
-    if (outputFile)
-      fprintf(outputFile, "%s line_%s\n", name.c_str(),intToString(target->getDebugLoc().getLine()).c_str()); 
-  } 
-  else{
-    if (outputFile)
-      fprintf(outputFile, "%s line_N/A\n", name.c_str());
-  }
-  label += "\"]";
-}
+class DotGraphWriter : public GraphWriter {
+ public:
+  DotGraphWriter(const std::string &filename)
+      : GraphWriter(filename), inblock(false) {
+    out << "digraph \"LLFI Program Graph\" {\n";
+  }
 
-std::string instNode::dotNode() {
-  return name + label;
-}
+  ~DotGraphWriter() {
+    out << "{ rank = sink;"
+      "Legend [shape=none, margin=0, label=<"
+       "<TABLE BORDER=\"0\" CELLBORDER=\"1\" CELLSPACING=\"0\" CELLPADDING=\"4\">"
+       " <TR>"
+       "  <TD COLSPAN=\"2\"><B>Legend</B></TD>"
+       " </TR>"
+       " <TR>"
+       "  <TD>Correct Control Flow</TD>"
+       "  <TD><FONT COLOR=\"black\"> solid arrow </FONT></TD>"
+       " </TR>"
+       " <TR>"
+       "  <TD>Data Dependancy</TD>"
+       "  <TD><FONT COLOR=\"blue\"> solid arrow </FONT></TD>"
+       " </TR>"
+       " <TR>"
+       "  <TD>Error Propogation Flow</TD>"
+       "  <TD><FONT COLOR=\"red\">solid arrow </FONT></TD>"
+       " </TR>"
+       " <TR>"
+       "  <TD>The Affected Instruction(s) by Fault Injection  </TD>"
+       "  <TD BGCOLOR=\"YELLOW\"></TD>"
+       " </TR>"
+       " <TR>"
+       "  <TD>The Instruction(s) LLFI Injects Faults to</TD>"
+       "  <TD BGCOLOR=\"red\"></TD>"
+       " </TR>"
+       "</TABLE>"
+     ">];"
+     "}";
+    out << "}\n";
+  }
+
+  void beginBlock(StringRef func, StringRef block) {
+    out << "subgraph \"cluster_" << func << "_" << block << "\" {\n";
+    out << "label = \"" << func << "_" << block << "\";\n";
+    inblock = true;
+  }
 
-struct bBlockGraph {
-  BasicBlock* raw;
-  std::string name;
-  std::string funcName;
-  std::vector<instNode> instNodes;
-  Instruction* entryInst;
-  Instruction* exitInst;
-  bBlockGraph(BasicBlock *target);
-  bool addInstruction(Instruction* inst);
-  bool writeToStream(std::ofstream &target);
+  // The edges are written after the cluster of the block, as a node first
+  // named in a cluster would be drawn in it.
+  void endBlock() {
+    out << "}\n" << blockedges;
+    blockedges.clear();
+    inblock = false;
+  }
+
+  void node(long index, const char *opcode, unsigned line) {
+    out << "llfiID_" << index << " [shape=record,label=\"" << index << "\\n"
+        << opcode << "\\n";
+    if (line != 0)
+      out << "(Line #: " << line << ")\\n";
+    out << "\"];\n";
+  }
+
+  void edge(long from, long to, bool datadep) {
+    raw_string_ostream edges(blockedges);
+    raw_ostream &os = inblock ? static_cast<raw_ostream&>(edges) : out;
+    os << "llfiID_" << from << " -> llfiID_" << to;
+    if (datadep)
+      os << " [color=\"" << DATADEPCOLOUR << "\"]";
+    os << ";\n";
+  }
+
+ private:
+  bool inblock;
+  std::string blockedges;
 };
 
-bBlockGraph::bBlockGraph(BasicBlock *BB) {
-  raw = BB;
-  name = BB->getName().str();
-  funcName = BB->getParent()->getName().str();
-  BasicBlock::iterator lastInst;
-  for (BasicBlock::iterator instIterator = BB->begin(),
-     lastInst = BB->end();
-     instIterator != lastInst;
-     ++instIterator) {
+class GraphMLWriter : public GraphWriter {
+ public:
+  GraphMLWriter(const std::string &filename) : GraphWriter(filename) {
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+           "<key id=\"index\" for=\"node\" attr.name=\"llfi_index\" "
+           "attr.type=\"long\"/>\n"
+           "<key id=\"opcode\" for=\"node\" attr.name=\"opcode\" "
+           "attr.type=\"string\"/>\n"
+           "<key id=\"line\" for=\"node\" attr.name=\"line\" "
+           "attr.type=\"int\"/>\n"
+           "<key id=\"block\" for=\"node\" attr.name=\"block\" "
+           "attr.type=\"string\"/>\n"
+           "<key id=\"kind\" for=\"edge\" attr.name=\"kind\" "
+           "attr.type=\"string\"/>\n"
+           "<graph id=\"LLFI Program Graph\" edgedefault=\"directed\">\n";
+  }
 
-    Instruction *inst = &*instIterator;
+  ~GraphMLWriter() {
+    out << "</graph>\n</graphml>\n";
+  }
+
+  void beginBlock(StringRef func, StringRef block) {
+    blockname.clear();
+    raw_string_ostream name(blockname);
+    printXML(name, func);
+    name << "_";
+    printXML(name, block);
+  }
+
+  void endBlock() {}
+
+  void node(long index, const char *opcode, unsigned line) {
+    out << "<node id=\"llfiID_" << index << "\"><data key=\"index\">" << index
+        << "</data><data key=\"opcode\">" << opcode << "</data>";
+    if (line != 0)
+      out << "<data key=\"line\">" << line << "</data>";
+    out << "<data key=\"block\">" << blockname << "</data></node>\n";
+  }
 
-    addInstruction(inst);
+  void edge(long from, long to, bool datadep) {
+    out << "<edge source=\"llfiID_" << from << "\" target=\"llfiID_" << to
+        << "\"><data key=\"kind\">" << (datadep ? "data" : "control")
+        << "</data></edge>\n";
   }
-  entryInst = &(BB->front());
-  exitInst = &(BB->back());
+
+ private:
+  static void printXML(raw_ostream &os, StringRef str) {
+    for (char c : str) {
+      switch (c) {
+        case '&': os << "&amp;"; break;
+        case '<': os << "&lt;"; break;
+        case '>': os << "&gt;"; break;
+        case '"': os << "&quot;"; break;
+        default: os << c;
+      }
+    }
+  }
+
+  std::string blockname;
+};
+
+// name is the file name without the extension of the format
+static std::unique_ptr<GraphWriter> createGraphWriter(const std::string &name) {
+  if (graphformat == GraphML)
+    return std::unique_ptr<GraphWriter>(new GraphMLWriter(name + ".graphml"));
+  return std::unique_ptr<GraphWriter>(new DotGraphWriter(name + ".dot"));
 }
-bool bBlockGraph::addInstruction(Instruction* inst) {
-  instNodes.push_back(instNode(inst));
 
-  return true;
+// The name of a function in the name of a file
+static std::string getFileName(StringRef func) {
+  std::string name = "llfi.stat.graph.";
+  for (char c : func)
+    name += isalnum(c) || c == '_' || c == '-' || c == '.' ? c : '_';
+  return name;
 }
 
-bool bBlockGraph::writeToStream(std::ofstream &target) {
-  target << "subgraph \"cluster_" << funcName << "_" << name << "\" {\n";
-  target << "label = \"" << funcName << "_" << name << "\";\n";
-  for (unsigned int i = 0; i < instNodes.size(); i++) {
-    target << instNodes.at(i).dotNode() << ";\n";
-  }
-  target << "}\n";
-  for (unsigned int i = 1; i < instNodes.size(); i++) {
-    target << instNodes.at(i-1).name << " -> " << instNodes.at(i).name << ";\n";
+static unsigned getLine(Instruction *inst) {
+  DebugLoc dbgLoc = inst->getDebugLoc();
+  return bool(dbgLoc) ? dbgLoc.getLine() : 0;
+}
+
+// 1 for the call that starts an operator, 2 for the call that ends it, 0
+// for the other instructions
+static int getOMInstrumentPointKind(Instruction *inst) {
+  CallInst *call = dyn_cast<CallInst>(inst);
+  if (call == NULL || call->getCalledFunction() == NULL ||
+      call->getCalledFunction()->getName() != "OMInstrumentPoint" ||
+      call->arg_size() < 2)
+    return 0;
+  ConstantInt *kind = dyn_cast<ConstantInt>(call->getArgOperand(1));
+  return kind != NULL ? kind->getSExtValue() : 0;
+}
+
+llfiDotGraph::llfiDotGraph() : FunctionPass(ID) {}
+
+llfiDotGraph::~llfiDotGraph() {}
+
+bool llfiDotGraph::doInitialization(Module &) {
+  std::error_code ec;
+  indexmap.reset(new raw_fd_ostream("llfi.index.map.txt", ec,
+                                    sys::fs::OF_None));
+  if (ec) {
+    errs() << "ERROR: Unable to open llfi.index.map.txt: " << ec.message()
+           << "\n";
+    exit(1);
   }
-  return true;
+  if (graphsplit == SplitNone)
+    graph = createGraphWriter("llfi.stat.graph");
+  return false;
 }
 
+bool llfiDotGraph::doFinalization(Module &) {
+  graph.reset();
+  indexmap.reset();
+  return false;
+}
 
 bool llfiDotGraph::runOnFunction(Function &F) {
-  //Create handles to the functions parent module and context
-  LLVMContext &context = F.getContext();
-
-  std::vector<bBlockGraph> blocks;
-
-  Function::iterator lastBlock;
-  //iterate through each basicblock of the function
-  for (Function::iterator blockIterator = F.begin(), lastBlock = F.end();
-    blockIterator != lastBlock; ++blockIterator) {
-
-    BasicBlock* block = &*blockIterator;
-
-    bBlockGraph b(block);
-    blocks.push_back(b);
-  }
-  for (unsigned int i = 0; i < blocks.size(); i++) {
-    bBlockGraph currBlock = blocks.at(i);
-    for (unsigned int i = 0; i < currBlock.instNodes.size(); i++) {
-      Instruction *inst = currBlock.instNodes.at(i).raw;
-      std::string nodeName = currBlock.instNodes.at(i).name;
-      instNode node = currBlock.instNodes.at(i);
-      if (!inst->use_empty()) {
-        // TODO: optimize the algorithm below later
-  // Iterates over the uses of instruction and finds their basic blocks and annotates them
-        for (Value::use_iterator useIter = inst->use_begin();
-             useIter != inst->use_end(); useIter++) {
-          Value* userValue = *useIter;
-          for (unsigned int f = 0; f < blocks.size(); f++) {
-            bBlockGraph searchBlock = blocks.at(f);
-            for (unsigned int d = 0; d < searchBlock.instNodes.size(); d++) {
-              Instruction* targetInst = searchBlock.instNodes.at(d).raw;
-              if (userValue == targetInst) {
-                instNode targetNode = searchBlock.instNodes.at(d);
-                outfs << nodeName << " -> " << targetNode.name;
-                outfs << " [color=\"" << DATADEPCOLOUR << "\"];\n";
-              }
-            }
-          }
-        }
-      }
-    }
+  for (Instruction &I : instructions(F)) {
+    unsigned line = getLine(&I);
+    *indexmap << "llfiID_" << getLLFIIndexofInst(&I) << " line_";
+    if (line != 0)
+      *indexmap << line << "\n";
+    else
+      *indexmap << "N/A\n";
   }
 
-  for (unsigned int i = 0; i < blocks.size(); i++) {
-    bBlockGraph block = blocks.at(i);
-    block.writeToStream(outfs);
-    if (block.exitInst->getOpcode() == Instruction::Br) {
-      BranchInst* exitInst = (BranchInst*)block.exitInst;
-      for (unsigned int s = 0; s < exitInst->getNumSuccessors(); s++) {
-        BasicBlock* succ = exitInst->getSuccessor(s);
-        for (unsigned int d = 0; d < blocks.size(); d++) {
-          if (blocks.at(d).raw == succ) {
-            std::string from = block.instNodes.back().name;
-            std::string to = blocks.at(d).instNodes.front().name;
-            outfs << from << " -> "  << to << ";\n";
-          }
+  if (!graphfunc.empty() &&
+      std::find(graphfunc.begin(), graphfunc.end(), F.getName().str()) ==
+          graphfunc.end())
+    return false;
+  if (F.isDeclaration())
+    return false;
+
+  std::unique_ptr<GraphWriter> funcgraph, layergraph;
+  GraphWriter *curr = graph.get();
+  if (graphsplit != SplitNone) {
+    funcgraph = createGraphWriter(getFileName(F.getName()));
+    curr = funcgraph.get();
+  }
+  // operators are numbered in the order of their start markers, like the
+  // layers of the profiling runtime
+  long layer = 0;
+
+  for (BasicBlock &BB : F) {
+    curr->beginBlock(F.getName(), BB.getName());
+    long prev = -1;
+    for (Instruction &I : BB) {
+      long index = getLLFIIndexofInst(&I);
+      curr->node(index, I.getOpcodeName(), getLine(&I));
+      if (prev != -1)
+        curr->edge(prev, index, false);
+      prev = index;
+
+      for (User *U : I.users())
+        if (Instruction *user = dyn_cast<Instruction>(U))
+          curr->edge(index, getLLFIIndexofInst(user), true);
+
+      int kind = graphsplit == SplitLayer ? getOMInstrumentPointKind(&I) : 0;
+      if (kind == 1 || (kind == 2 && layergraph)) {
+        curr->endBlock();
+        if (kind == 1) {
+          layergraph = createGraphWriter(getFileName(F.getName()) + ".layer" +
+                                         std::to_string(++layer));
+          curr = layergraph.get();
+        } else {
+          layergraph.reset();
+          curr = funcgraph.get();
         }
+        curr->beginBlock(F.getName(), BB.getName());
       }
     }
+    curr->endBlock();
+
+    Instruction *term = BB.getTerminator();
+    if (term != NULL)
+      for (BasicBlock *succ : successors(&BB))
+        curr->edge(getLLFIIndexofInst(term),
+                   getLLFIIndexofInst(&succ->front()), false);
   }
 
   return false;
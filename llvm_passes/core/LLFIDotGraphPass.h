@@ -1,57 +1,26 @@
-#include <iostream>
-#include <fstream>
-#include "llvm/Support/raw_os_ostream.h"
+#include <memory>
+#include "llvm/Support/raw_ostream.h"
 
 namespace llfi{
 
+  class GraphWriter;
+
+  // Writes the control and data flow graph of the program, streamed through
+  // buffered writers (see LLFIDotGraphPass.cpp), and the source line of each
+  // llfi index to llfi.index.map.txt.
   struct llfiDotGraph : public FunctionPass {
     static char ID;
-    std::ofstream outfs;
-    llfiDotGraph() : FunctionPass(ID) {}
-
-    virtual bool doInitialization(Module &M) {
-      outfs.open("llfi.stat.graph.dot", std::ios::trunc);
-      outfs << "digraph \"LLFI Program Graph\" {\n";
-
-      return false;
-    }
-
-    virtual bool doFinalization(Module &M) {
-      outfs << "{ rank = sink;"
-        "Legend [shape=none, margin=0, label=<"
-         "<TABLE BORDER=\"0\" CELLBORDER=\"1\" CELLSPACING=\"0\" CELLPADDING=\"4\">"
-         " <TR>"
-         "  <TD COLSPAN=\"2\"><B>Legend</B></TD>"
-         " </TR>"
-         " <TR>"
-         "  <TD>Correct Control Flow</TD>"
-         "  <TD><FONT COLOR=\"black\"> solid arrow </FONT></TD>"
-         " </TR>"
-         " <TR>"
-         "  <TD>Data Dependancy</TD>"
-         "  <TD><FONT COLOR=\"blue\"> solid arrow </FONT></TD>"
-         " </TR>"
-         " <TR>"
-         "  <TD>Error Propogation Flow</TD>"
-         "  <TD><FONT COLOR=\"red\">solid arrow </FONT></TD>"
-         " </TR>"
-         " <TR>"
-         "  <TD>The Affected Instruction(s) by Fault Injection  </TD>"
-         "  <TD BGCOLOR=\"YELLOW\"></TD>"
-         " </TR>"
-         " <TR>"
-         "  <TD>The Instruction(s) LLFI Injects Faults to</TD>"
-         "  <TD BGCOLOR=\"red\"></TD>"
-         " </TR>"
-         "</TABLE>"
-       ">];"
-       "}";
-      outfs << "}\n";
-      outfs.close();
-      return false;
-    }
+    llfiDotGraph();
+    ~llfiDotGraph();
 
+    virtual bool doInitialization(Module &M);
+    virtual bool doFinalization(Module &M);
     virtual bool runOnFunction(Function &F);
+
+   private:
+    std::unique_ptr<raw_fd_ostream> indexmap;
+    // graph of the whole module, without -graphsplit
+    std::unique_ptr<GraphWriter> graph;
   };
 
   struct NewLLFIDotGraph : llvm::PassInfoMixin<NewLLFIDotGraph> {
@@ -0,0 +1,171 @@
+//===- LockstepPass.cpp - Lockstep execution with a golden process -------===//
+//
+//                     LLFI Distribution
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// The pass lets the fault injection executable compare its state with a
+// golden process while it runs, instead of tracing both runs and diffing the
+// traces offline. It runs after the FaultInjectionPass.
+//
+// Every thread keeps a hash of the values produced since its last checkpoint:
+// the results of the instructions with an llfi index, and of the fault
+// injection calls in place of the instructions they corrupt. The checkpoints
+// are the returns, the loop back-edges and the OMInstrumentPoint calls, as
+// selected by -lockstepcheckpoints. At a checkpoint, llfiLockstepCheckpoint()
+// of LockstepLib.c compares the hash with the one of the golden process, and
+// the hash restarts.
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/CFG.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "LockstepPass.h"
+#include "Utils.h"
+
+using namespace llvm;
+
+static cl::list< std::string > lockstepcheckpoints("lockstepcheckpoints",
+    cl::desc("Checkpoints of the lockstep execution: return, backedge, "
+             "ominstrument (default: all)"),
+    cl::CommaSeparated, cl::ZeroOrMore);
+
+namespace llfi {
+
+char LegacyLockstepPass::ID=0;
+
+static bool isCheckpointKind(StringRef kind) {
+  if (lockstepcheckpoints.empty())
+    return true;
+  for (const std::string &checkpoint : lockstepcheckpoints)
+    if (checkpoint == kind)
+      return true;
+  return false;
+}
+
+bool LegacyLockstepPass::runOnModule(Module &M) {
+  LLVMContext &context = M.getContext();
+  i64type = Type::getInt64Ty(context);
+
+  for (const std::string &checkpoint : lockstepcheckpoints) {
+    if (checkpoint != "return" && checkpoint != "backedge" &&
+        checkpoint != "ominstrument") {
+      errs() << "ERROR: Unknown lockstep checkpoint " << checkpoint << "\n";
+      exit(1);
+    }
+  }
+
+  for (Function &F : M) {
+    for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it) {
+      CallBase *CB = dyn_cast<CallBase>(&*it);
+      if (CB != NULL && CB->getMetadata("llfi_injectfault") &&
+          CB->getCalledFunction() != NULL)
+        fifuncs.insert(CB->getCalledFunction());
+    }
+  }
+
+  // the indices are read before the instrumentation adds instructions
+  for (Function &F : M) {
+    if (F.isDeclaration() || fifuncs.count(&F))
+      continue;
+    for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it)
+      if (isLLFIIndexedInst(&*it))
+        indices[&*it] = getLLFIIndexofInst(&*it);
+  }
+
+  hashgv = new GlobalVariable(M, i64type, false, GlobalValue::InternalLinkage,
+                              ConstantInt::get(i64type, HASH_OFFSET),
+                              "llfi_lockstep_hash", nullptr,
+                              GlobalValue::GeneralDynamicTLSModel);
+
+  checkpointfunc = M.getOrInsertFunction("llfiLockstepCheckpoint",
+      FunctionType::get(Type::getVoidTy(context), {i64type, i64type}, false));
+  // the checkpoint exits the program once its state is the golden one
+  setLLFIRuntimeFuncAttrs(checkpointfunc, true);
+
+  for (Function &F : M)
+    if (!F.isDeclaration() && !fifuncs.count(&F))
+      instrumentFunction(F);
+  return true;
+}
+
+void LegacyLockstepPass::instrumentFunction(Function &F) {
+  // the values are hashed in the order of the instructions, for the same
+  // executable from the same IR
+  std::vector<Instruction*> hashed;
+  std::set<BasicBlock*> latches;
+  std::vector<std::pair<Instruction*, long> > checkpoints;
+
+  for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it) {
+    Instruction *I = &*it;
+    CallBase *CB = dyn_cast<CallBase>(I);
+    if (CB != NULL && CB->getMetadata("llfi_injectfault")) {
+      hashed.push_back(CB);
+      continue;
+    }
+    if (indices.count(I) && !I->getType()->isVoidTy()) {
+      // the target of a fault injection call is hashed with the fault, as the
+      // call returns it
+      bool injected = false;
+      for (User *U : I->users()) {
+        CallBase *user = dyn_cast<CallBase>(U);
+        if (user != NULL && user->getMetadata("llfi_injectfault") &&
+            user->getArgOperand(1) == I)
+          injected = true;
+      }
+      if (!injected)
+        hashed.push_back(I);
+    }
+
+    long site = indices.count(I) ? indices[I] : -1;
+    if (isa<ReturnInst>(I) && isCheckpointKind("return"))
+      checkpoints.push_back(std::make_pair(I, site));
+    if (CB != NULL && CB->getCalledFunction() != NULL &&
+        CB->getCalledFunction()->getName() == "OMInstrumentPoint" &&
+        isCheckpointKind("ominstrument"))
+      checkpoints.push_back(std::make_pair(I->getNextNode(), site));
+  }
+
+  if (isCheckpointKind("backedge")) {
+    SmallVector<std::pair<const BasicBlock*, const BasicBlock*>, 8> backedges;
+    FindFunctionBackedges(F, backedges);
+    for (auto &backedge : backedges) {
+      BasicBlock *latch = const_cast<BasicBlock*>(backedge.first);
+      if (latches.insert(latch).second) {
+        Instruction *term = latch->getTerminator();
+        checkpoints.push_back(std::make_pair(term,
+            indices.count(term) ? indices[term] : -1));
+      }
+    }
+  }
+
+  for (Instruction *I : hashed) {
+    Instruction *insertpt = isa<PHINode>(I) ?
+        &*I->getParent()->getFirstInsertionPt() : I->getNextNode();
+    if (insertpt != NULL && !I->isTerminator())
+      addValueHash(I, hashgv, insertpt);
+  }
+  for (auto &checkpoint : checkpoints)
+    addCheckpoint(checkpoint.first, checkpoint.second);
+}
+
+void LegacyLockstepPass::addCheckpoint(Instruction *insertpt, long site) {
+  IRBuilder<> IRB(insertpt);
+  IRB.CreateCall(checkpointfunc, {ConstantInt::get(i64type, site),
+                                  IRB.CreateLoad(i64type, hashgv)});
+  IRB.CreateStore(ConstantInt::get(i64type, HASH_OFFSET), hashgv);
+}
+
+// Registration for the old PM
+static RegisterPass<LegacyLockstepPass> X("locksteppass",
+                                     "Lockstep execution pass", false, false);
+}
@@ -0,0 +1,63 @@
+// Lockstep execution of the fault injection variant with a golden process,
+// run after the FaultInjectionPass.
+#ifndef LOCKSTEP_PASS_H
+#define LOCKSTEP_PASS_H
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+namespace llfi {
+
+  // For legacy PM
+  class LegacyLockstepPass: public ModulePass {
+   public:
+    LegacyLockstepPass() : ModulePass(ID) {}
+    virtual bool runOnModule(Module &M);
+    static char ID;
+
+   private:
+    void instrumentFunction(Function &F);
+    void addCheckpoint(Instruction *insertpt, long site);
+
+   private:
+    Type *i64type;
+    // thread-local hash of the values produced since the last checkpoint
+    GlobalVariable *hashgv;
+    FunctionCallee checkpointfunc;
+
+    // the fault injection functions created by the FaultInjectionPass
+    std::set<Function*> fifuncs;
+    std::map<Instruction*, long> indices;
+  };
+
+  // For new PM
+  struct LockstepPass:  llvm::PassInfoMixin<LockstepPass> {
+    llvm::PreservedAnalyses run(llvm::Module &M,
+                                llvm::ModuleAnalysisManager &){
+
+      auto obj = new LegacyLockstepPass();
+      bool isChanged = obj->runOnModule(M);
+
+      delete obj;
+      return (isChanged) ? llvm::PreservedAnalyses::none():
+                           llvm::PreservedAnalyses::all();
+    }
+
+    // Without isRequired returning true, this pass will be skipped for functions
+    // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+    // all functions with optnone.
+    static bool isRequired() { return true; }
+  };
+}
+#endif
@@ -15,6 +15,7 @@
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instruction.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/Support/raw_ostream.h"
@@ -22,6 +23,7 @@
 #include "llvm/Support/CommandLine.h"
 
 
+#include <algorithm>
 #include <list>
 #include <map>
 #include <vector>
@@ -36,6 +38,8 @@ namespace llfi {
 
 char LegacyProfilingPass::ID=0;
 extern cl::opt< std::string > llfilogfile;
+extern cl::opt< bool > fisitetable;
+extern cl::opt< bool > profilesites;
 
 // Flag to enable/disable output of FI statistics for ML applications in the
 // llfi.stat.fi.injectedfaults.txt file.
@@ -129,20 +133,33 @@ bool LegacyProfilingPass::runOnModule(Module &M) {
     Instruction *insertptr = getInsertPtrforRegsofInst(fi_reg, fi_inst);
 
     // function declaration
-    FunctionCallee profilingfunc = getLLFILibProfilingFunc(M);
+    // with union instrumentation, only the sites that are active in the site
+    // bitmap are profiled, and with -profilesites the dynamic instances of
+    // each site are also counted, so the profiling function also gets the
+    // llfi index
+    bool sitefunc = fisitetable || profilesites;
+    FunctionCallee profilingfunc = profilesites ?
+        getLLFILibProfilingSiteFunc(M, "doProfilingSite") :
+        fisitetable ? getLLFILibProfilingSiteFunc(M, "doProfilingActiveSite") :
+        getLLFILibProfilingFunc(M);
 
     // prepare for the calling argument and call the profiling function
-    std::vector<Value*> profilingarg(1);
+    std::vector<Value*> profilingarg(sitefunc ? 2 : 1);
     const IntegerType* itype = IntegerType::get(context, 32);
 
     //LLVM 3.3 Upgrading
     IntegerType* itype_non_const = const_cast<IntegerType*>(itype);
     Value* opcode = ConstantInt::get(itype_non_const, fi_inst->getOpcode());
     profilingarg[0] = opcode;
+    if (sitefunc)
+      profilingarg[1] = ConstantInt::get(Type::getInt64Ty(context),
+                                         getLLFIIndexofInst(fi_inst));
     ArrayRef<Value*> profilingarg_array_ref(profilingarg);
 
-    CallInst::Create(profilingfunc, profilingarg_array_ref,
-                     "", insertptr);
+    CallInst *profilingcall = CallInst::Create(profilingfunc,
+                                               profilingarg_array_ref,
+                                               "", insertptr);
+    profilingcall->setCannotMerge();
   }
 
   logFile.close();
@@ -150,10 +167,34 @@ bool LegacyProfilingPass::runOnModule(Module &M) {
   if (mlfistats)
     insertCallForMLFIStats(M);
 
+  if (profilesites)
+    addInitProfilingSitesFuncCall(M);
   addEndProfilingFuncCall(M);
   return true;
 }
 
+// Pass the number of llfi indices to the runtime at the start of main, so that
+// each thread allocates its site counters once:
+//   initProfilingSites(number of sites)
+void LegacyProfilingPass::addInitProfilingSitesFuncCall(Module &M) {
+  Function* mainfunc = M.getFunction("main");
+  if (mainfunc == NULL)
+    return;
+
+  long numsites = 0;
+  for (Function &F : M)
+    for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it)
+      if (isLLFIIndexedInst(&*it))
+        numsites = std::max(numsites, getLLFIIndexofInst(&*it) + 1);
+
+  LLVMContext &context = M.getContext();
+  Type *i64type = Type::getInt64Ty(context);
+  FunctionCallee initfunc = M.getOrInsertFunction("initProfilingSites",
+      Type::getVoidTy(context), i64type);
+  CallInst::Create(initfunc, {ConstantInt::get(i64type, numsites)}, "",
+                   &*mainfunc->getEntryBlock().getFirstInsertionPt());
+}
+
 void LegacyProfilingPass::addEndProfilingFuncCall(Module &M) {
   Function* mainfunc = M.getFunction("main");
   if (mainfunc != NULL) {
@@ -185,6 +226,19 @@ FunctionCallee LegacyProfilingPass::getLLFILibProfilingFunc(Module &M) {
       Type::getVoidTy(context), paramtypes_array_ref, false);
   FunctionCallee profilingfunc =
       M.getOrInsertFunction("doProfiling", profilingfunctype);
+  setLLFIRuntimeFuncAttrs(profilingfunc, false);
+  return profilingfunc;
+}
+
+FunctionCallee LegacyProfilingPass::getLLFILibProfilingSiteFunc(Module &M,
+    StringRef name) {
+  LLVMContext &context = M.getContext();
+  FunctionType* profilingfunctype = FunctionType::get(
+      Type::getVoidTy(context),
+      {Type::getInt32Ty(context), Type::getInt64Ty(context)}, false);
+  FunctionCallee profilingfunc =
+      M.getOrInsertFunction(name, profilingfunctype);
+  setLLFIRuntimeFuncAttrs(profilingfunc, false);
   return profilingfunc;
 }
 
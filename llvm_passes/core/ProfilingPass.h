@@ -24,9 +24,11 @@ namespace llfi {
     static char ID;
 
    private:
+    void addInitProfilingSitesFuncCall(Module &M);
     void addEndProfilingFuncCall(Module &M);
    private:
      FunctionCallee getLLFILibProfilingFunc(Module &M);
+     FunctionCallee getLLFILibProfilingSiteFunc(Module &M, StringRef name);
      FunctionCallee getLLFILibEndProfilingFunc(Module &M);
   };
 
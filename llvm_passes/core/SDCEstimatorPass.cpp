@@ -0,0 +1,543 @@
+//===- SDCEstimatorPass.cpp - Static estimate of the SDC probability ------===//
+//
+//                     LLFI Distribution
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// The pass estimates the probability that a single bit flip in each fault
+// injection site is a silent data corruption (SDC), without running the
+// program, to screen a program before a fault injection campaign. It models
+// the propagation of the fault like Trident:
+// - within a value, by the bits of each operand that reach the result of its
+//   user, e.g. the bits shifted out by a shift by a constant are masked
+// - through memory, from a store to the loads of the same object; the objects
+//   whose address escapes share their estimate, and the ones written by the
+//   output functions of the C library are outputs
+// - through control flow: a compare flips its branch with a probability
+//   given by the branch counts of profiling, and a flipped branch is an SDC
+//   unless its paths reconverge without side effects, in which case the fault
+//   goes on through the phis of the join block
+// - through the arguments and return values of the functions
+// A fault in a value printed by an output function or returned by main is an
+// SDC. The probability of a value is 1 - prod(1 - p) over its uses, and at
+// least the one of its phis, computed to a fixed point over the loops.
+//
+// The site counts of llfi.stat.prof.txt, written by profiling with
+// -profilesites, give the branch counts and weigh the estimate of the whole
+// program; without them, the branches are taken half of the time and the
+// sites weigh the same. The pass writes llfi.stat.sdc.txt, read by
+// bin/fiplanner.py to sample the sites and to compare the estimates with the
+// rates of a campaign.
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/CaptureTracking.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cmath>
+#include <fstream>
+#include <list>
+#include <set>
+#include <string>
+
+#include "SDCEstimatorPass.h"
+#include "Controller.h"
+#include "Utils.h"
+
+using namespace llvm;
+using namespace llvm::PatternMatch;
+
+namespace llfi {
+
+char LegacySDCEstimatorPass::ID=0;
+
+static cl::opt< std::string > sdcprofile("sdcprofile",
+    cl::init("llfi.stat.prof.txt"),
+    cl::desc("Profile whose site counts give the branch counts of the SDC "
+             "estimate"));
+static cl::opt< double > sdcaddrcrash("sdcaddrcrash", cl::init(0.5),
+    cl::desc("Probability that a fault in an address crashes the program"));
+static cl::opt< double > sdcdivergence("sdcdivergence", cl::init(1.0),
+    cl::desc("Probability that a flipped branch whose paths have side effects "
+             "is an SDC"));
+static cl::opt< double > sdccmp("sdccmp", cl::init(0.5),
+    cl::desc("Probability that a fault in an operand of a relational compare "
+             "flips its result"));
+
+static const char *sdcfilename = "llfi.stat.sdc.txt";
+static const unsigned MAX_SWEEPS = 100;
+
+static double combine(double p, double q) {
+  return 1 - (1 - p) * (1 - q);
+}
+
+static bool isOutputFunc(StringRef name) {
+  return name == "printf" || name == "fprintf" || name == "puts" ||
+         name == "fputs" || name == "putchar" || name == "putc" ||
+         name == "fputc" || name == "fwrite" || name == "write" ||
+         name == "exit" || name == "_exit";
+}
+
+// Whether argument k of the output function is a buffer that it writes out,
+// rather than a stream or a value.
+static bool isOutputBufferArg(StringRef name, unsigned k) {
+  if (name == "printf")
+    return true;
+  if (name == "fprintf")
+    return k >= 1;
+  if (name == "write")
+    return k == 1;
+  if (name == "puts" || name == "fputs" || name == "fwrite")
+    return k == 0;
+  return false;
+}
+
+// Memory objects are keyed by their allocation if their address does not
+// escape, and share the NULL key otherwise.
+static const Value *objectOf(Value *ptr) {
+  const Value *obj = getUnderlyingObject(ptr);
+  if ((isa<AllocaInst>(obj) || isa<GlobalVariable>(obj)) &&
+      !PointerMayBeCaptured(obj, false, true))
+    return obj;
+  return NULL;
+}
+
+// The buffers written out are keyed by their allocation even if their address
+// escapes, as passing them to the output function captures it, and by the
+// NULL key if their allocation is unknown. Constant globals, like the format
+// strings, are not written by the program.
+static const Value *outputObjectOf(Value *ptr) {
+  const Value *obj = getUnderlyingObject(ptr);
+  return isIdentifiedObject(obj) ? obj : NULL;
+}
+
+bool LegacySDCEstimatorPass::runOnModule(Module &M) {
+  readProfile();
+  computeBlockCounts(M);
+  for (Function &F : M) {
+    if (!F.isDeclaration())
+      computeBranches(F);
+  }
+
+  // the objects written by the output functions
+  for (Function &F : M) {
+    for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it) {
+      CallBase *CB = dyn_cast<CallBase>(&*it);
+      if (CB == NULL || CB->getCalledFunction() == NULL ||
+          !isOutputFunc(CB->getCalledFunction()->getName()))
+        continue;
+      StringRef name = CB->getCalledFunction()->getName();
+      for (unsigned k = 0; k < CB->arg_size(); ++k) {
+        Value *arg = CB->getArgOperand(k);
+        if (!arg->getType()->isPointerTy() || !isOutputBufferArg(name, k))
+          continue;
+        GlobalVariable *GV =
+            dyn_cast<GlobalVariable>(getUnderlyingObject(arg));
+        if (GV != NULL && GV->isConstant())
+          continue;
+        outputobjs[outputObjectOf(arg)] = true;
+      }
+    }
+  }
+
+  for (unsigned sweep = 0; sweep < MAX_SWEEPS; ++sweep) {
+    if (!propagate(M))
+      break;
+  }
+
+  writeEstimates(M);
+  return false;
+}
+
+// Lines of the form site=<llfi index>,<dynamic instances>,<cycles>
+void LegacySDCEstimatorPass::readProfile() {
+  std::ifstream file(sdcprofile);
+  if (!file.is_open())
+    return;
+
+  std::string line;
+  while (std::getline(file, line)) {
+    long index;
+    long long count, cycle;
+    if (sscanf(line.c_str(), "site=%ld,%lld,%lld", &index, &count,
+               &cycle) != 3)
+      continue;
+    instances[index] = count;
+    cycles[index] = cycle;
+  }
+}
+
+void LegacySDCEstimatorPass::computeBlockCounts(Module &M) {
+  if (instances.empty())
+    return;
+  for (Function &F : M) {
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        if (!isLLFIIndexedInst(&I))
+          continue;
+        auto count = instances.find(getLLFIIndexofInst(&I));
+        if (count != instances.end())
+          blockcounts[&BB] = std::max(blockcounts[&BB], count->second);
+      }
+    }
+  }
+}
+
+// A flipped branch whose paths reach their join block without side effects
+// only changes the values of the phis of the join block.
+void LegacySDCEstimatorPass::computeBranches(Function &F) {
+  PostDominatorTree PDT(F);
+  for (BasicBlock &BB : F) {
+    Instruction *term = BB.getTerminator();
+    if (term->getNumSuccessors() < 2)
+      continue;
+    DomTreeNode *node = PDT.getNode(&BB);
+    if (node == NULL || node->getIDom() == NULL ||
+        node->getIDom()->getBlock() == NULL)
+      continue;
+    BasicBlock *join = node->getIDom()->getBlock();
+
+    bool sideeffects = false;
+    std::set<BasicBlock*> visited;
+    std::list<BasicBlock*> worklist(succ_begin(&BB), succ_end(&BB));
+    while (!worklist.empty() && !sideeffects) {
+      BasicBlock *block = worklist.front();
+      worklist.pop_front();
+      if (block == join || !visited.insert(block).second)
+        continue;
+      // the branch is in a loop of the paths
+      if (block == &BB) {
+        sideeffects = true;
+        break;
+      }
+      for (Instruction &I : *block) {
+        if ((I.mayWriteToMemory() && !isa<DbgInfoIntrinsic>(I)) ||
+            isa<ReturnInst>(I) || isa<UnreachableInst>(I)) {
+          sideeffects = true;
+          break;
+        }
+      }
+      worklist.insert(worklist.end(), succ_begin(block), succ_end(block));
+    }
+    if (sideeffects)
+      continue;
+
+    std::vector<PHINode*> &phis = joinphis[term];
+    for (PHINode &phi : join->phis())
+      phis.push_back(&phi);
+  }
+}
+
+// Probability that the branch goes to its successor succ, from the counts of
+// the blocks with a single predecessor.
+double LegacySDCEstimatorPass::takenProbability(BranchInst *BI,
+                                                unsigned succ) {
+  long long total = blockcounts.lookup(BI->getParent());
+  if (total <= 0)
+    return 0.5;
+  for (unsigned i = 0; i < 2; ++i) {
+    BasicBlock *S = BI->getSuccessor(i);
+    if (S->getSinglePredecessor() != BI->getParent() || !blockcounts.count(S))
+      continue;
+    double p = std::min(1.0, (double)blockcounts.lookup(S) / total);
+    return i == succ ? p : 1 - p;
+  }
+  return 0.5;
+}
+
+// An equality compare of two values that differ is almost never flipped by a
+// single bit flip, while one of equal values always is.
+double LegacySDCEstimatorPass::cmpFlipProbability(CmpInst *cmp) {
+  CmpInst::Predicate pred = cmp->getPredicate();
+  bool eq = pred == CmpInst::ICMP_EQ || pred == CmpInst::FCMP_OEQ ||
+            pred == CmpInst::FCMP_UEQ;
+  bool ne = pred == CmpInst::ICMP_NE || pred == CmpInst::FCMP_ONE ||
+            pred == CmpInst::FCMP_UNE;
+  if (!eq && !ne)
+    return sdccmp;
+
+  double ptrue = 0.5;
+  if (cmp->hasOneUse()) {
+    BranchInst *BI = dyn_cast<BranchInst>(cmp->user_back());
+    if (BI != NULL && BI->isConditional() && BI->getCondition() == cmp)
+      ptrue = takenProbability(BI, 0);
+  }
+  return eq ? ptrue : 1 - ptrue;
+}
+
+// Fraction of the bits of operand k that reach the result of BO.
+static double bitMasking(BinaryOperator *BO, unsigned k) {
+  unsigned bits = BO->getType()->getScalarSizeInBits();
+  const APInt *C;
+  if (bits == 0 || !match(BO->getOperand(1 - k), m_APInt(C)))
+    return 1.0;
+
+  switch (BO->getOpcode()) {
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr:
+      if (k == 1)
+        return 1.0;
+      return (double)(bits - std::min<uint64_t>(C->getLimitedValue(), bits)) /
+             bits;
+    case Instruction::And:
+      return (double)C->countPopulation() / bits;
+    case Instruction::Or:
+      return (double)(bits - C->countPopulation()) / bits;
+    case Instruction::Mul:
+      if (C->isZero())
+        return 0.0;
+      return (double)(bits - C->countTrailingZeros()) / bits;
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+      if (k == 1 || !C->isPowerOf2())
+        return 1.0;
+      return (double)(bits - C->logBase2()) / bits;
+    case Instruction::URem:
+    case Instruction::SRem:
+      if (k == 1 || !C->isPowerOf2())
+        return 1.0;
+      return (double)C->logBase2() / bits;
+    default:
+      return 1.0;
+  }
+}
+
+// Fraction of the bits of the operand of CI that reach its result.
+static double castMasking(CastInst *CI) {
+  unsigned srcbits = CI->getSrcTy()->getScalarSizeInBits();
+  unsigned dstbits = CI->getDestTy()->getScalarSizeInBits();
+  switch (CI->getOpcode()) {
+    case Instruction::Trunc:
+    case Instruction::FPTrunc:
+      return srcbits > 0 ? (double)dstbits / srcbits : 1.0;
+    case Instruction::FPToSI:
+    case Instruction::FPToUI:
+      // the low bits of the mantissa are rounded off
+      return 0.5;
+    default:
+      return 1.0;
+  }
+}
+
+double LegacySDCEstimatorPass::valueSDC(Value *V) {
+  return sdc.lookup(V);
+}
+
+double LegacySDCEstimatorPass::memorySDC(Value *ptr) {
+  if (outputobjs.lookup(outputObjectOf(ptr)))
+    return 1.0;
+  // an escaped object may be written out through a pointer whose allocation
+  // is unknown
+  const Value *obj = objectOf(ptr);
+  if (obj == NULL && outputobjs.lookup(NULL))
+    return 1.0;
+  return memsdc.lookup(obj);
+}
+
+// Probability that a fault in operand k of U is an SDC.
+double LegacySDCEstimatorPass::operandSDC(Instruction *U, unsigned k) {
+  if (StoreInst *SI = dyn_cast<StoreInst>(U)) {
+    double stored = memorySDC(SI->getPointerOperand());
+    if (k == SI->getPointerOperandIndex())
+      return (1 - sdcaddrcrash) * stored;
+    return stored;
+  }
+  if (isa<LoadInst>(U))
+    return (1 - sdcaddrcrash) * valueSDC(U);
+  if (isa<BranchInst>(U) || isa<SwitchInst>(U))
+    return valueSDC(U);
+  if (isa<ReturnInst>(U)) {
+    Function *F = U->getFunction();
+    return F->getName() == "main" ? 1.0 : retsdc.lookup(F);
+  }
+
+  if (CallBase *CB = dyn_cast<CallBase>(U)) {
+    // a fault in the called address crashes the program
+    if (k >= CB->arg_size())
+      return 0.0;
+    Function *callee = CB->getCalledFunction();
+    if (callee != NULL && isOutputFunc(callee->getName()))
+      return 1.0;
+    if (MemTransferInst *MT = dyn_cast<MemTransferInst>(CB)) {
+      double copied = memorySDC(MT->getRawDest());
+      return k == 2 ? copied : (1 - sdcaddrcrash) * copied;
+    }
+    if (MemSetInst *MS = dyn_cast<MemSetInst>(CB)) {
+      double set = memorySDC(MS->getRawDest());
+      return k == 0 ? (1 - sdcaddrcrash) * set : set;
+    }
+    if (callee != NULL && !callee->isDeclaration() && k < callee->arg_size())
+      return valueSDC(callee->getArg(k));
+
+    // the functions of the libraries compute their result from their
+    // arguments, and read the memory of their pointers
+    double result = CB->getType()->isVoidTy() ? 0.0 : valueSDC(CB);
+    Value *arg = CB->getArgOperand(k);
+    if (arg->getType()->isPointerTy())
+      return (1 - sdcaddrcrash) * combine(result, memorySDC(arg));
+    return result;
+  }
+
+  if (CmpInst *cmp = dyn_cast<CmpInst>(U))
+    return cmpFlipProbability(cmp) * valueSDC(cmp);
+  if (SelectInst *select = dyn_cast<SelectInst>(U))
+    return k == 0 ? valueSDC(select) : 0.5 * valueSDC(select);
+  if (BinaryOperator *BO = dyn_cast<BinaryOperator>(U))
+    return bitMasking(BO, k) * valueSDC(BO);
+  if (CastInst *CI = dyn_cast<CastInst>(U))
+    return castMasking(CI) * valueSDC(CI);
+  return valueSDC(U);
+}
+
+// One sweep over the module. Returns true if an estimate changed.
+bool LegacySDCEstimatorPass::propagate(Module &M) {
+  bool changed = false;
+  auto update = [&](Value *V, double p) {
+    p = std::min(1.0, std::max(0.0, p));
+    double &old = sdc[V];
+    if (std::fabs(p - old) > 1e-9)
+      changed = true;
+    old = p;
+  };
+  // A value that goes around a loop through a phi reaches the same uses
+  // again, so the phis take the maximum of their paths instead of combining
+  // them, which would converge to 1.
+  auto usesSDC = [&](Value *V) {
+    double p = 0.0, phis = 0.0;
+    for (Use &U : V->uses()) {
+      Instruction *user = dyn_cast<Instruction>(U.getUser());
+      if (user == NULL)
+        continue;
+      if (isa<PHINode>(user))
+        phis = std::max(phis, operandSDC(user, U.getOperandNo()));
+      else
+        p = combine(p, operandSDC(user, U.getOperandNo()));
+    }
+    return std::max(p, phis);
+  };
+
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+
+    for (BasicBlock &block : make_range(F.getBasicBlockList().rbegin(),
+                                        F.getBasicBlockList().rend())) {
+      BasicBlock *BB = &block;
+      for (auto I = BB->rbegin(); I != BB->rend(); ++I) {
+        if (I->isTerminator()) {
+          if (I->getNumSuccessors() < 2)
+            continue;
+          auto join = joinphis.find(&*I);
+          if (join == joinphis.end()) {
+            update(&*I, sdcdivergence);
+          } else {
+            double p = 0.0;
+            for (PHINode *phi : join->second)
+              p = combine(p, valueSDC(phi));
+            update(&*I, p);
+          }
+        } else if (!I->getType()->isVoidTy()) {
+          update(&*I, usesSDC(&*I));
+        }
+      }
+    }
+
+    for (Argument &arg : F.args())
+      update(&arg, usesSDC(&arg));
+
+    double ret = 0.0;
+    for (User *user : F.users()) {
+      CallBase *CB = dyn_cast<CallBase>(user);
+      if (CB != NULL && CB->getCalledFunction() == &F &&
+          !CB->getType()->isVoidTy())
+        ret = combine(ret, valueSDC(CB));
+    }
+    if (std::fabs(ret - retsdc.lookup(&F)) > 1e-9)
+      changed = true;
+    retsdc[&F] = ret;
+  }
+
+  // the memory of an object is read by its loads and by the functions of the
+  // libraries
+  DenseMap<const Value*, double> newmemsdc;
+  for (Function &F : M) {
+    for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it) {
+      if (LoadInst *LI = dyn_cast<LoadInst>(&*it)) {
+        double &p = newmemsdc[objectOf(LI->getPointerOperand())];
+        p = combine(p, valueSDC(LI));
+      } else if (MemTransferInst *MT = dyn_cast<MemTransferInst>(&*it)) {
+        double &p = newmemsdc[objectOf(MT->getRawSource())];
+        p = combine(p, memorySDC(MT->getRawDest()));
+      }
+    }
+  }
+  for (auto &entry : newmemsdc) {
+    if (std::fabs(entry.second - memsdc.lookup(entry.first)) > 1e-9)
+      changed = true;
+  }
+  memsdc.swap(newmemsdc);
+  return changed;
+}
+
+void LegacySDCEstimatorPass::writeEstimates(Module &M) {
+  std::map<Instruction*, std::list< int >* > *fi_inst_regs_map;
+  Controller *ctrl = Controller::getInstance(M);
+  ctrl->getFIInstRegsMap(&fi_inst_regs_map);
+
+  // each register of a site is injected with the same probability
+  std::map<long, std::pair<Instruction*, double> > sites;
+  for (auto &inst_regs : *fi_inst_regs_map) {
+    Instruction *fi_inst = inst_regs.first;
+    std::list<int> *fi_regs = inst_regs.second;
+    if (fi_regs->empty())
+      continue;
+    double p = 0.0;
+    for (int reg : *fi_regs) {
+      p += reg == DST_REG_POS ? valueSDC(fi_inst) :
+                                operandSDC(fi_inst, (unsigned)reg);
+    }
+    sites[getLLFIIndexofInst(fi_inst)] =
+        std::make_pair(fi_inst, p / fi_regs->size());
+  }
+
+  // the sites weigh by their profiled cycles, like the cycles drawn by fault
+  // injection, or the same without a profile
+  double total = 0.0, weighted = 0.0;
+  for (auto &site : sites) {
+    double weight = cycles.empty() ? 1.0 : (double)cycles[site.first];
+    total += weight;
+    weighted += weight * site.second.second;
+  }
+
+  std::error_code err;
+  raw_fd_ostream sdcfile(sdcfilename, err, sys::fs::OF_None);
+  if (err) {
+    errs() << "ERROR: Unable to open SDC estimate file " << sdcfilename << "\n";
+    exit(1);
+  }
+  sdcfile << "# do not edit\n";
+  sdcfile << "# estimated probability that a fault in a site is an SDC\n";
+  sdcfile << "# site=<llfi index>,<opcode>,<sdc probability>\n";
+  sdcfile << "weighting=" << (cycles.empty() ? "sites" : "cycles") << "\n";
+  sdcfile << "program_sdc=" << format("%.6f", total > 0 ? weighted / total : 0.0)
+          << "\n";
+  for (auto &site : sites) {
+    sdcfile << "site=" << site.first << ","
+            << site.second.first->getOpcodeName() << ","
+            << format("%.6f", site.second.second) << "\n";
+  }
+  sdcfile.close();
+}
+
+}
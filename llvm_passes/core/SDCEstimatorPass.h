@@ -0,0 +1,80 @@
+// Static estimate of the probability that a fault in each fault injection
+// site is a silent data corruption, run on the indexed IR before the
+// ProfilingPass.
+#ifndef SDC_ESTIMATOR_PASS_H
+#define SDC_ESTIMATOR_PASS_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+#include <map>
+#include <vector>
+
+using namespace llvm;
+
+namespace llfi {
+
+  // For legacy PM
+  class LegacySDCEstimatorPass: public ModulePass {
+   public:
+    LegacySDCEstimatorPass() : ModulePass(ID) {}
+    virtual bool runOnModule(Module &M);
+    static char ID;
+
+   private:
+    void readProfile();
+    void computeBlockCounts(Module &M);
+    void computeBranches(Function &F);
+    double takenProbability(BranchInst *BI, unsigned succ);
+    double cmpFlipProbability(CmpInst *cmp);
+
+    bool propagate(Module &M);
+    double operandSDC(Instruction *U, unsigned k);
+    double valueSDC(Value *V);
+    double memorySDC(Value *ptr);
+    void writeEstimates(Module &M);
+
+   private:
+    // dynamic instances of each llfi index, from the site counts of profiling
+    std::map<long, long long> instances;
+    // and their cycles, to weigh the estimate of the program
+    std::map<long, long long> cycles;
+    DenseMap<BasicBlock*, long long> blockcounts;
+
+    // probability that a fault in a value, in the memory of an object (NULL
+    // for the unknown objects) or in the return value of a function is an SDC
+    DenseMap<Value*, double> sdc;
+    DenseMap<const Value*, double> memsdc;
+    DenseMap<Function*, double> retsdc;
+    // the objects whose memory is written by the output functions
+    DenseMap<const Value*, bool> outputobjs;
+
+    // SDC probability of a diverged branch whose paths reconverge without
+    // side effects: the phis of the join block that the branch selects
+    DenseMap<Instruction*, std::vector<PHINode*> > joinphis;
+  };
+
+  // For new PM
+  struct SDCEstimatorPass:  llvm::PassInfoMixin<SDCEstimatorPass> {
+    llvm::PreservedAnalyses run(llvm::Module &M,
+                                llvm::ModuleAnalysisManager &){
+
+      auto obj = new LegacySDCEstimatorPass();
+      obj->runOnModule(M);
+
+      delete obj;
+      return llvm::PreservedAnalyses::all();
+    }
+
+    // Without isRequired returning true, this pass will be skipped for functions
+    // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+    // all functions with optnone.
+    static bool isRequired() { return true; }
+  };
+}
+#endif
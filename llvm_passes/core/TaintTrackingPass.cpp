@@ -0,0 +1,614 @@
+//===- TaintTrackingPass.cpp - Shadow taint tracking of injected faults ---===//
+//
+//                     LLFI Distribution
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// The pass measures the propagation of the injected fault in the fault
+// injection run itself, instead of diffing the traces of a golden and a
+// faulty run. It runs after the FaultInjectionPass.
+//
+// Every value has an i64 shadow, whose bit i is set if bit i of the value is
+// derived from the injected fault. Values larger than 64 bits are either fully
+// tainted or not tainted. The taint is introduced by the calls of the fault
+// injection functions, as the bits that differ between their argument and
+// their result, and propagates:
+// - bitwise through the logic operations, shifts by constants and integer
+//   casts, and to the bit and all the bits above it through add and sub
+// - to the whole result through the other operations
+// - through memory, with the shadow memory of TaintTrackingLib.c
+// - through the arguments and return values of the instrumented functions,
+//   with thread-local shadows; the other functions taint their whole result
+//   if an argument is tainted
+// Control flow does not propagate the taint.
+//
+// At the exit of the program, postTaintTracking() writes llfi.stat.taint.txt
+// with the tainted static sites, the tainted bytes written by the output
+// functions, and the dynamic instructions from the first injected fault to
+// the last tainted instruction.
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "TaintTrackingPass.h"
+#include "Utils.h"
+
+using namespace llvm;
+
+namespace llfi {
+
+char LegacyTaintTrackingPass::ID=0;
+
+// arguments whose shadows are passed to the instrumented functions
+static const unsigned MAX_TAINT_PARAMS = 32;
+
+bool LegacyTaintTrackingPass::runOnModule(Module &M) {
+  DL = &M.getDataLayout();
+  LLVMContext &context = M.getContext();
+  i64type = Type::getInt64Ty(context);
+  i8ptrtype = PointerType::get(Type::getInt8Ty(context), 0);
+
+  for (Function &F : M) {
+    for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it) {
+      CallBase *CB = dyn_cast<CallBase>(&*it);
+      if (CB != NULL && CB->getMetadata("llfi_injectfault") &&
+          CB->getCalledFunction() != NULL)
+        fifuncs.insert(CB->getCalledFunction());
+    }
+  }
+
+  // the indices are read before the instrumentation adds instructions
+  numsites = 0;
+  for (Function &F : M) {
+    if (F.isDeclaration() || fifuncs.count(&F))
+      continue;
+    for (inst_iterator it = inst_begin(F); it != inst_end(F); ++it) {
+      if (isLLFIIndexedInst(&*it)) {
+        long index = getLLFIIndexofInst(&*it);
+        indices[&*it] = index;
+        numsites = std::max(numsites, (uint64_t)index + 1);
+      }
+    }
+  }
+
+  createGlobals(M);
+  getRuntimeFuncs(M);
+
+  std::vector<Function*> funcs;
+  for (Function &F : M)
+    if (!F.isDeclaration() && !fifuncs.count(&F))
+      funcs.push_back(&F);
+  for (Function *F : funcs)
+    instrumentFunction(*F);
+
+  addPostTaintTrackingFuncCall(M);
+  return true;
+}
+
+void LegacyTaintTrackingPass::createGlobals(Module &M) {
+  LLVMContext &context = M.getContext();
+  auto createTLS = [&](Type *T, const char *name) {
+    return new GlobalVariable(M, T, false, GlobalValue::InternalLinkage,
+                              Constant::getNullValue(T), name, nullptr,
+                              GlobalValue::GeneralDynamicTLSModel);
+  };
+  paramsgv = createTLS(ArrayType::get(i64type, MAX_TAINT_PARAMS),
+                       "llfi_taint_params");
+  retvalgv = createTLS(i64type, "llfi_taint_retval");
+  countgv = createTLS(i64type, "llfi_taint_count");
+  firstgv = createTLS(i64type, "llfi_taint_first");
+  lastgv = createTLS(i64type, "llfi_taint_last");
+
+  Type *sitestype = ArrayType::get(Type::getInt8Ty(context), numsites);
+  sitesgv = new GlobalVariable(M, sitestype, false,
+                               GlobalValue::InternalLinkage,
+                               Constant::getNullValue(sitestype),
+                               "llfi_taint_sites");
+}
+
+void LegacyTaintTrackingPass::getRuntimeFuncs(Module &M) {
+  LLVMContext &context = M.getContext();
+  Type *voidtype = Type::getVoidTy(context);
+
+  loadfunc = M.getOrInsertFunction("llfiTaintLoad",
+      FunctionType::get(i64type, {i8ptrtype, i64type}, false));
+  storefunc = M.getOrInsertFunction("llfiTaintStore",
+      FunctionType::get(voidtype, {i8ptrtype, i64type, i64type}, false));
+  copyfunc = M.getOrInsertFunction("llfiTaintCopy",
+      FunctionType::get(voidtype, {i8ptrtype, i8ptrtype, i64type}, false));
+  outputfunc = M.getOrInsertFunction("llfiTaintOutput",
+      FunctionType::get(voidtype, {i8ptrtype, i64type, i64type}, false));
+  outputstringfunc = M.getOrInsertFunction("llfiTaintOutputString",
+      FunctionType::get(voidtype, {i8ptrtype, i64type}, false));
+  posttaintfunc = M.getOrInsertFunction("postTaintTracking",
+      FunctionType::get(voidtype, {i8ptrtype, i64type, i64type, i64type},
+                        false));
+
+  // the shadow memory is not accessible to the program
+  setLLFIRuntimeFuncAttrs(loadfunc, false);
+  setLLFIRuntimeFuncAttrs(storefunc, false);
+  setLLFIRuntimeFuncAttrs(copyfunc, false);
+  setLLFIRuntimeFuncAttrs(outputfunc, false);
+  setLLFIRuntimeFuncAttrs(outputstringfunc, true);
+}
+
+void LegacyTaintTrackingPass::instrumentFunction(Function &F) {
+  shadows.clear();
+
+  // the instructions of the blocks are taken before any shadow code is
+  // inserted, so that the shadow code is not instrumented
+  ReversePostOrderTraversal<Function*> RPOT(&F);
+  std::vector<std::pair<BasicBlock*, std::vector<Instruction*> > > blocks;
+  for (BasicBlock *BB : RPOT) {
+    blocks.emplace_back(BB, std::vector<Instruction*>());
+    for (Instruction &I : *BB)
+      blocks.back().second.push_back(&I);
+  }
+
+  // the shadows of the arguments are cleared once read, as the uninstrumented
+  // callers do not pass any
+  IRBuilder<> IRB(&*F.getEntryBlock().getFirstInsertionPt());
+  for (Argument &arg : F.args()) {
+    if (arg.getArgNo() >= MAX_TAINT_PARAMS)
+      break;
+    Value *param = IRB.CreateConstInBoundsGEP2_32(paramsgv->getValueType(),
+                                                  paramsgv, 0, arg.getArgNo());
+    shadows[&arg] = IRB.CreateLoad(i64type, param, "taint_arg");
+    IRB.CreateStore(ConstantInt::get(i64type, 0), param);
+  }
+
+  // the shadows of the operands are computed first, except for the phis,
+  // which get their incoming shadows at the end
+  std::vector<PHINode*> shadowphis;
+  for (auto &block : blocks)
+    instrumentBlock(*block.first, block.second, shadowphis);
+
+  for (PHINode *shadowphi : shadowphis) {
+    PHINode *phi = cast<PHINode>(shadows.find(shadowphi)->second);
+    for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i)
+      shadowphi->addIncoming(getShadow(phi->getIncomingValue(i)),
+                             phi->getIncomingBlock(i));
+  }
+}
+
+void LegacyTaintTrackingPass::instrumentBlock(
+    BasicBlock &BB, const std::vector<Instruction*> &insts,
+    std::vector<PHINode*> &shadowphis) {
+  if (BB.getFirstInsertionPt() == BB.end())
+    return;
+
+  IRBuilder<> IRB(BB.getFirstNonPHI());
+  uint64_t numinsts = 0;
+  for (Instruction *I : insts) {
+    if (PHINode *phi = dyn_cast<PHINode>(I)) {
+      PHINode *shadowphi = IRB.CreatePHI(i64type, phi->getNumIncomingValues(),
+                                         "taint_phi");
+      shadows[phi] = shadowphi;
+      // the original phi of each shadow phi, to add the incoming shadows
+      shadows[shadowphi] = phi;
+      shadowphis.push_back(shadowphi);
+    } else if (!isa<DbgInfoIntrinsic>(I)) {
+      numinsts++;
+    }
+  }
+
+  // dynamic instructions of the thread, counted per block
+  IRB.SetInsertPoint(&*BB.getFirstInsertionPt());
+  Value *count = IRB.CreateAdd(IRB.CreateLoad(i64type, countgv),
+                               ConstantInt::get(i64type, numinsts),
+                               "taint_count");
+  IRB.CreateStore(count, countgv);
+
+  Value *blocktainted = IRB.getFalse();
+  Value *blocksource = IRB.getFalse();
+  for (Instruction *I : insts) {
+    if (isa<PHINode>(I) || isa<DbgInfoIntrinsic>(I))
+      continue;
+
+    // the shadow code is inserted between I and next
+    Instruction *next = I->isTerminator() ? I : I->getNextNode();
+    Value *source = NULL;
+    Value *shadow = instrumentInst(I, &source);
+    if (shadow == NULL)
+      continue;
+    shadows[I] = shadow;
+
+    IRB.SetInsertPoint(next);
+    if (source != NULL)
+      blocksource = IRB.CreateOr(blocksource, source);
+
+    Value *tainted = IRB.CreateICmpNE(shadow, ConstantInt::get(i64type, 0));
+    if (isa<Constant>(tainted))
+      continue;
+    blocktainted = IRB.CreateOr(blocktainted, tainted);
+
+    // a fault injection call is the instruction of its llfi index, argument 0
+    long index = -1;
+    if (indices.count(I))
+      index = indices[I];
+    else if (source != NULL)
+      if (ConstantInt *idx = dyn_cast<ConstantInt>(I->getOperand(0)))
+        index = idx->getSExtValue();
+    if (index >= 0 && (uint64_t)index < numsites) {
+      Value *site = IRB.CreateConstInBoundsGEP2_64(sitesgv->getValueType(),
+                                                   sitesgv, 0, index);
+      Value *sitetainted = IRB.CreateOr(
+          IRB.CreateLoad(IRB.getInt8Ty(), site),
+          IRB.CreateZExt(tainted, IRB.getInt8Ty()));
+      IRB.CreateStore(sitetainted, site);
+    }
+  }
+
+  IRB.SetInsertPoint(BB.getTerminator());
+  if (!isa<Constant>(blocktainted)) {
+    Value *last = IRB.CreateLoad(i64type, lastgv);
+    IRB.CreateStore(IRB.CreateSelect(blocktainted, count, last), lastgv);
+  }
+  if (!isa<Constant>(blocksource)) {
+    Value *first = IRB.CreateLoad(i64type, firstgv);
+    Value *isfirst = IRB.CreateAnd(blocksource, IRB.CreateIsNull(first));
+    IRB.CreateStore(IRB.CreateSelect(isfirst, count, first), firstgv);
+  }
+}
+
+// Returns the shadow of the result of I, NULL if it has none. source is set
+// to whether a call of a fault injection function injected a fault.
+Value *LegacyTaintTrackingPass::instrumentInst(Instruction *I,
+                                               Value **source) {
+  Type *T = I->getType();
+  IRBuilder<> IRB(I->isTerminator() ? I : I->getNextNode());
+
+  if (ReturnInst *ret = dyn_cast<ReturnInst>(I)) {
+    if (ret->getReturnValue() != NULL)
+      IRB.CreateStore(getShadow(ret->getReturnValue()), retvalgv);
+    return NULL;
+  }
+
+  if (StoreInst *store = dyn_cast<StoreInst>(I)) {
+    Value *val = store->getValueOperand();
+    Value *ptr = store->getPointerOperand();
+    Value *shadow = IRB.CreateOr(getShadow(val),
+        allOnesIf(getShadow(ptr), val->getType(), IRB));
+    IRB.CreateCall(storefunc, {IRB.CreatePointerCast(ptr, i8ptrtype),
+        ConstantInt::get(i64type, getStoreSize(val->getType())), shadow});
+    return NULL;
+  }
+
+  if (isa<AtomicRMWInst>(I) || isa<AtomicCmpXchgInst>(I)) {
+    Value *ptr = I->getOperand(0);
+    Type *valtype = I->getOperand(1)->getType();
+    IRBuilder<> before(I);
+    Value *old = before.CreateCall(loadfunc,
+        {before.CreatePointerCast(ptr, i8ptrtype),
+         ConstantInt::get(i64type, getStoreSize(valtype))});
+    Value *shadow = allOnesIf(IRB.CreateOr(old, getAnyShadow(I, IRB)),
+                              valtype, IRB);
+    IRB.CreateCall(storefunc, {IRB.CreatePointerCast(ptr, i8ptrtype),
+        ConstantInt::get(i64type, getStoreSize(valtype)), shadow});
+    return allOnesIf(shadow, T, IRB);
+  }
+
+  if (CallBase *CB = dyn_cast<CallBase>(I))
+    return instrumentCall(CB, IRB, source);
+
+  if (T->isVoidTy() || I->isTerminator() || isa<LandingPadInst>(I) ||
+      isa<VAArgInst>(I))
+    return NULL;
+
+  if (AllocaInst *alloca = dyn_cast<AllocaInst>(I)) {
+    // clear the shadow of a stack slot used by a previous call
+    if (alloca->isStaticAlloca())
+      IRB.CreateCall(storefunc, {IRB.CreatePointerCast(alloca, i8ptrtype),
+          ConstantInt::get(i64type,
+                           getStoreSize(alloca->getAllocatedType())),
+          ConstantInt::get(i64type, 0)});
+    return ConstantInt::get(i64type, 0);
+  }
+
+  if (LoadInst *load = dyn_cast<LoadInst>(I)) {
+    Value *ptr = load->getPointerOperand();
+    Value *shadow = IRB.CreateCall(loadfunc,
+        {IRB.CreatePointerCast(ptr, i8ptrtype),
+         ConstantInt::get(i64type, getStoreSize(T))}, "taint_load");
+    return IRB.CreateOr(IRB.CreateAnd(shadow, getMask(T)),
+                        allOnesIf(getShadow(ptr), T, IRB));
+  }
+
+  bool scalar = !T->isVectorTy() && !T->isAggregateType();
+
+  if (BinaryOperator *binop = dyn_cast<BinaryOperator>(I)) {
+    Value *s0 = getShadow(binop->getOperand(0));
+    Value *s1 = getShadow(binop->getOperand(1));
+    Value *both = IRB.CreateOr(s0, s1);
+    if (!scalar)
+      return allOnesIf(both, T, IRB);
+
+    ConstantInt *amount = dyn_cast<ConstantInt>(binop->getOperand(1));
+    switch (binop->getOpcode()) {
+      case Instruction::And:
+      case Instruction::Or:
+      case Instruction::Xor:
+        return both;
+      case Instruction::Add:
+      case Instruction::Sub:
+        // carries propagate the taint to the bits above the lowest tainted bit
+        return IRB.CreateAnd(IRB.CreateOr(both, IRB.CreateNeg(both)),
+                             getMask(T));
+      case Instruction::Shl:
+        if (amount != NULL && amount->getZExtValue() < 64)
+          return IRB.CreateAnd(IRB.CreateShl(s0, amount->getZExtValue()),
+                               getMask(T));
+        return allOnesIf(both, T, IRB);
+      case Instruction::LShr:
+        if (amount != NULL && amount->getZExtValue() < 64)
+          return IRB.CreateLShr(s0, amount->getZExtValue());
+        return allOnesIf(both, T, IRB);
+      case Instruction::AShr:
+        if (amount != NULL && T->isIntegerTy()) {
+          Value *narrow = IRB.CreateTrunc(s0, T);
+          return IRB.CreateAnd(
+              IRB.CreateSExt(IRB.CreateAShr(narrow, amount), i64type),
+              getMask(T));
+        }
+        return allOnesIf(both, T, IRB);
+      default:
+        return allOnesIf(both, T, IRB);
+    }
+  }
+
+  if (isa<UnaryOperator>(I))
+    return getShadow(I->getOperand(0));
+
+  if (CastInst *cast = dyn_cast<CastInst>(I)) {
+    Value *s = getShadow(cast->getOperand(0));
+    Type *srctype = cast->getSrcTy();
+    if (!scalar || srctype->isVectorTy())
+      return allOnesIf(s, T, IRB);
+    switch (cast->getOpcode()) {
+      case Instruction::Trunc:
+      case Instruction::ZExt:
+      case Instruction::PtrToInt:
+      case Instruction::IntToPtr:
+      case Instruction::AddrSpaceCast:
+        return IRB.CreateAnd(s, getMask(T));
+      case Instruction::SExt:
+        // the shadow of the sign bit is extended like the sign bit
+        return IRB.CreateAnd(IRB.CreateSExt(IRB.CreateTrunc(s, srctype),
+                                            i64type), getMask(T));
+      case Instruction::BitCast:
+        if (DL->getTypeSizeInBits(srctype) == DL->getTypeSizeInBits(T))
+          return s;
+        return allOnesIf(s, T, IRB);
+      default:
+        return allOnesIf(s, T, IRB);
+    }
+  }
+
+  if (SelectInst *select = dyn_cast<SelectInst>(I)) {
+    Value *chosen = IRB.CreateSelect(select->getCondition(),
+                                     getShadow(select->getTrueValue()),
+                                     getShadow(select->getFalseValue()));
+    return IRB.CreateOr(chosen,
+                        allOnesIf(getShadow(select->getCondition()), T, IRB));
+  }
+
+  if (GetElementPtrInst *gep = dyn_cast<GetElementPtrInst>(I)) {
+    Value *indices = ConstantInt::get(i64type, 0);
+    for (Use &idx : gep->indices())
+      indices = IRB.CreateOr(indices, getShadow(idx));
+    return IRB.CreateOr(getShadow(gep->getPointerOperand()),
+                        allOnesIf(indices, T, IRB));
+  }
+
+  if (isa<FreezeInst>(I))
+    return getShadow(I->getOperand(0));
+
+  // compares, vector and aggregate operations
+  return allOnesIf(getAnyShadow(I, IRB), T, IRB);
+}
+
+Value *LegacyTaintTrackingPass::instrumentCall(CallBase *CB, IRBuilder<> &IRB,
+                                               Value **source) {
+  Type *T = CB->getType();
+  Function *callee = CB->getCalledFunction();
+
+  // the fault injection functions return their argument 1, with the fault
+  if (callee != NULL && fifuncs.count(callee)) {
+    Value *orig = CB->getArgOperand(1);
+    Value *origbits = toBits(orig, IRB);
+    if (origbits == NULL)
+      return getShadow(orig);
+    Value *diff = IRB.CreateXor(toBits(CB, IRB), origbits);
+    if (!scalarOrSmall(T))
+      diff = allOnesIf(diff, T, IRB);
+    *source = IRB.CreateICmpNE(diff, ConstantInt::get(i64type, 0));
+    return IRB.CreateOr(diff, getShadow(orig));
+  }
+
+  if (IntrinsicInst *intr = dyn_cast<IntrinsicInst>(CB)) {
+    if (MemTransferInst *transfer = dyn_cast<MemTransferInst>(intr)) {
+      IRB.CreateCall(copyfunc,
+          {IRB.CreatePointerCast(transfer->getRawDest(), i8ptrtype),
+           IRB.CreatePointerCast(transfer->getRawSource(), i8ptrtype),
+           IRB.CreateZExtOrTrunc(transfer->getLength(), i64type)});
+      return NULL;
+    }
+    if (MemSetInst *memset = dyn_cast<MemSetInst>(intr)) {
+      IRB.CreateCall(storefunc,
+          {IRB.CreatePointerCast(memset->getRawDest(), i8ptrtype),
+           IRB.CreateZExtOrTrunc(memset->getLength(), i64type),
+           allOnesIf(getShadow(memset->getValue()),
+                     memset->getValue()->getType(), IRB)});
+      return NULL;
+    }
+    if (T->isVoidTy())
+      return NULL;
+    return allOnesIf(getAnyShadow(CB, IRB), T, IRB);
+  }
+
+  if (callee != NULL && callee->isDeclaration()) {
+    if (!isa<InvokeInst>(CB))
+      instrumentOutput(CB, IRB);
+    if (T->isVoidTy())
+      return NULL;
+    return allOnesIf(getAnyShadow(CB, IRB), T, IRB);
+  }
+
+  // instrumented function, or an indirect call: pass the shadows of the
+  // arguments, and read the shadow of the return value, cleared before the
+  // call in case the callee is not instrumented
+  if (isa<InvokeInst>(CB)) {
+    // the return value is only available in the normal destination
+    if (T->isVoidTy())
+      return NULL;
+    return allOnesIf(getAnyShadow(CB, IRB), T, IRB);
+  }
+
+  IRBuilder<> before(CB);
+  for (unsigned i = 0; i < CB->arg_size() && i < MAX_TAINT_PARAMS; ++i) {
+    Value *param = before.CreateConstInBoundsGEP2_32(
+        paramsgv->getValueType(), paramsgv, 0, i);
+    before.CreateStore(getShadow(CB->getArgOperand(i)), param);
+  }
+  if (T->isVoidTy())
+    return NULL;
+  before.CreateStore(ConstantInt::get(i64type, 0), retvalgv);
+  return IRB.CreateAnd(IRB.CreateLoad(i64type, retvalgv, "taint_retval"),
+                       getMask(T));
+}
+
+// Tainted bytes written by the output functions of the C library
+void LegacyTaintTrackingPass::instrumentOutput(CallBase *CB, IRBuilder<> &IRB) {
+  StringRef name = CB->getCalledFunction()->getName();
+  auto arg = [&](unsigned i) { return CB->getArgOperand(i); };
+  auto argptr = [&](unsigned i) {
+    return IRB.CreatePointerCast(arg(i), i8ptrtype);
+  };
+  auto arglen = [&](unsigned i) {
+    return IRB.CreateZExtOrTrunc(arg(i), i64type);
+  };
+  Value *nullptr8 = ConstantPointerNull::get(cast<PointerType>(i8ptrtype));
+
+  if (name == "write" && CB->arg_size() == 3) {
+    IRB.CreateCall(outputfunc, {argptr(1), arglen(2),
+        IRB.CreateOr(getShadow(arg(1)), getShadow(arg(2)))});
+  } else if (name == "fwrite" && CB->arg_size() == 4) {
+    IRB.CreateCall(outputfunc, {argptr(0), IRB.CreateMul(arglen(1), arglen(2)),
+        IRB.CreateOr(getShadow(arg(0)),
+                     IRB.CreateOr(getShadow(arg(1)), getShadow(arg(2))))});
+  } else if ((name == "puts" && CB->arg_size() == 1) ||
+             (name == "fputs" && CB->arg_size() == 2)) {
+    IRB.CreateCall(outputstringfunc, {argptr(0), getShadow(arg(0))});
+  } else if ((name == "putchar" && CB->arg_size() == 1) ||
+             ((name == "putc" || name == "fputc") && CB->arg_size() == 2)) {
+    IRB.CreateCall(outputfunc, {nullptr8, ConstantInt::get(i64type, 1),
+                                getShadow(arg(0))});
+  } else if ((name == "printf" || name == "fprintf") &&
+             CB->getType()->isIntegerTy()) {
+    // the whole output, if one of the printed values is tainted
+    unsigned first = name == "printf" ? 1 : 2;
+    Value *tainted = ConstantInt::get(i64type, 0);
+    for (unsigned i = first; i < CB->arg_size(); ++i)
+      tainted = IRB.CreateOr(tainted, getShadow(arg(i)));
+    if (isa<Constant>(tainted))
+      return;
+    Value *written = IRB.CreateSExt(CB, i64type);
+    written = IRB.CreateSelect(IRB.CreateICmpSGT(written,
+                                   ConstantInt::get(i64type, 0)),
+                               written, ConstantInt::get(i64type, 0));
+    IRB.CreateCall(outputfunc, {nullptr8, written, tainted});
+  }
+}
+
+void LegacyTaintTrackingPass::addPostTaintTrackingFuncCall(Module &M) {
+  std::set<Instruction*> exitinsts;
+  getProgramExitInsts(M, exitinsts);
+  assert (exitinsts.size() != 0
+          && "Program does not have explicit exit point");
+
+  for (Instruction *exitinst : exitinsts) {
+    IRBuilder<> IRB(exitinst);
+    IRB.CreateCall(posttaintfunc,
+        {IRB.CreatePointerCast(sitesgv, i8ptrtype),
+         ConstantInt::get(i64type, numsites),
+         IRB.CreateLoad(i64type, firstgv), IRB.CreateLoad(i64type, lastgv)});
+  }
+}
+
+Value *LegacyTaintTrackingPass::getShadow(Value *V) {
+  std::map<Value*, Value*>::iterator shadow = shadows.find(V);
+  if (shadow != shadows.end())
+    return shadow->second;
+  // constants, globals, and the values of unreachable blocks
+  return ConstantInt::get(i64type, 0);
+}
+
+Value *LegacyTaintTrackingPass::getAnyShadow(User *U, IRBuilder<> &IRB) {
+  Value *shadow = ConstantInt::get(i64type, 0);
+  for (Use &op : U->operands())
+    if (!isa<BasicBlock>(op) && !isa<Function>(op))
+      shadow = IRB.CreateOr(shadow, getShadow(op));
+  return shadow;
+}
+
+// All the bits of a value of type T if shadow is not 0
+Value *LegacyTaintTrackingPass::allOnesIf(Value *shadow, Type *T,
+                                          IRBuilder<> &IRB) {
+  return IRB.CreateSelect(
+      IRB.CreateICmpNE(shadow, ConstantInt::get(i64type, 0)), getMask(T),
+      ConstantInt::get(i64type, 0));
+}
+
+bool LegacyTaintTrackingPass::scalarOrSmall(Type *T) {
+  return T->isSized() && !T->isAggregateType() &&
+         DL->getTypeSizeInBits(T) <= 64;
+}
+
+// The bits of V as an i64: exact for the values of up to 64 bits, and not 0
+// for the larger values that are not 0. NULL for aggregates.
+Value *LegacyTaintTrackingPass::toBits(Value *V, IRBuilder<> &IRB) {
+  Type *T = V->getType();
+  if (!T->isSized() || T->isAggregateType())
+    return NULL;
+  if (T->isPtrOrPtrVectorTy() && !T->isVectorTy())
+    return IRB.CreatePtrToInt(V, i64type);
+  if (T->isPtrOrPtrVectorTy())
+    return NULL;
+
+  uint64_t bits = DL->getTypeSizeInBits(T);
+  Value *asint = IRB.CreateBitCast(V, IRB.getIntNTy(bits));
+  if (bits <= 64)
+    return IRB.CreateZExt(asint, i64type);
+  return IRB.CreateZExt(
+      IRB.CreateICmpNE(asint, ConstantInt::get(asint->getType(), 0)),
+      i64type);
+}
+
+Constant *LegacyTaintTrackingPass::getMask(Type *T) {
+  if (T->isSized() && !T->isAggregateType()) {
+    uint64_t bits = DL->getTypeSizeInBits(T);
+    if (bits < 64)
+      return ConstantInt::get(i64type, (1ULL << bits) - 1);
+  }
+  return ConstantInt::get(i64type, ~0ULL);
+}
+
+uint64_t LegacyTaintTrackingPass::getStoreSize(Type *T) {
+  return T->isSized() ? DL->getTypeStoreSize(T).getFixedSize() : 0;
+}
+
+// Registration for the old PM
+static RegisterPass<LegacyTaintTrackingPass> X("tainttrackingpass",
+                                     "Taint tracking pass", false, false);
+}
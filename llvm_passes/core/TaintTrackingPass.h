@@ -0,0 +1,89 @@
+// Shadow taint tracking of the injected faults, run on the fault injection
+// variant after the FaultInjectionPass.
+#ifndef TAINT_TRACKING_PASS_H
+#define TAINT_TRACKING_PASS_H
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace llvm;
+
+namespace llfi {
+
+  // For legacy PM
+  class LegacyTaintTrackingPass: public ModulePass {
+   public:
+    LegacyTaintTrackingPass() : ModulePass(ID) {}
+    virtual bool runOnModule(Module &M);
+    static char ID;
+
+   private:
+    void createGlobals(Module &M);
+    void getRuntimeFuncs(Module &M);
+    void instrumentFunction(Function &F);
+    void instrumentBlock(BasicBlock &BB, const std::vector<Instruction*> &insts,
+                         std::vector<PHINode*> &shadowphis);
+    Value *instrumentInst(Instruction *I, Value **source);
+    Value *instrumentCall(CallBase *CB, IRBuilder<> &IRB, Value **source);
+    void instrumentOutput(CallBase *CB, IRBuilder<> &IRB);
+    void addPostTaintTrackingFuncCall(Module &M);
+
+    Value *getShadow(Value *V);
+    Value *getAnyShadow(User *U, IRBuilder<> &IRB);
+    Value *allOnesIf(Value *shadow, Type *T, IRBuilder<> &IRB);
+    Value *toBits(Value *V, IRBuilder<> &IRB);
+    bool scalarOrSmall(Type *T);
+    Constant *getMask(Type *T);
+    uint64_t getStoreSize(Type *T);
+
+   private:
+    const DataLayout *DL;
+    Type *i64type;
+    Type *i8ptrtype;
+
+    // thread-local shadows of the arguments and return value of the
+    // instrumented functions, and the counters of the taint lifetime
+    GlobalVariable *paramsgv, *retvalgv;
+    GlobalVariable *countgv, *firstgv, *lastgv;
+    // one byte per llfi index, set if the instruction produced a taint
+    GlobalVariable *sitesgv;
+    uint64_t numsites;
+
+    FunctionCallee loadfunc, storefunc, copyfunc;
+    FunctionCallee outputfunc, outputstringfunc, posttaintfunc;
+
+    // the fault injection functions created by the FaultInjectionPass
+    std::set<Function*> fifuncs;
+    std::map<Value*, Value*> shadows;
+    std::map<Instruction*, long> indices;
+  };
+
+  // For new PM
+  struct TaintTrackingPass:  llvm::PassInfoMixin<TaintTrackingPass> {
+    llvm::PreservedAnalyses run(llvm::Module &M,
+                                llvm::ModuleAnalysisManager &){
+
+      auto obj = new LegacyTaintTrackingPass();
+      bool isChanged = obj->runOnModule(M);
+
+      delete obj;
+      return (isChanged) ? llvm::PreservedAnalyses::none():
+                           llvm::PreservedAnalyses::all();
+    }
+
+    // Without isRequired returning true, this pass will be skipped for functions
+    // decorated with the optnone LLVM attribute. Note that clang -O0 decorates
+    // all functions with optnone.
+    static bool isRequired() { return true; }
+  };
+}
+#endif
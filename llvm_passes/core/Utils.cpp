@@ -1,4 +1,7 @@
 
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/ValueMap.h"
+
 #include "Utils.h"
 
 namespace llfi {
@@ -146,13 +149,68 @@ void setInjectFaultInst(Value *reg, Instruction *inst, Instruction *ficall) {
   ficall->setMetadata("llfi_injectfault", node);
 }
 
+// The LLFI indices of the instructions of a function are consecutive, so
+// only the index of its first instruction and the number of indexed
+// instructions are stored, as the llfi_index_base metadata of the function.
+// Each indexed instruction carries the same empty llfi_index node, which tells
+// it apart from the instructions inserted after indexing, and its index is the
+// base plus the number of indexed instructions before it. Files indexed with
+// one !{i64 index} node per instruction are still read.
+//
+// A pass that clones an indexed instruction must move its llfi_index node to
+// the clone, like the instruction duplication pass, or the indices after it
+// shift; the number of indexed instructions catches it.
+//
+// The indices of a function are computed at its first query. The cache is
+// per thread, like the LLVMContext of the module, and its value handles drop
+// the instructions the passes delete, so that their addresses are not reused
+// with a stale index.
+static thread_local ValueMap<const Instruction*,
+                             std::pair<const Function*, long> >
+    llfi_index_cache;
+
+static void computeLLFIIndicesofFunc(const Function *func) {
+  MDNode *basenode = func->getMetadata("llfi_index_base");
+  if (!basenode) {
+    errs() << "ERROR: LLFI indices for instructions are required for the pass, "
+        << "please run genllfiindexpass first\n";
+    exit(3);
+  }
+  long base = mdconst::extract<ConstantInt>(basenode->getOperand(0))
+      ->getSExtValue();
+  long index = base;
+  unsigned kind = func->getContext().getMDKindID("llfi_index");
+  for (const_inst_iterator it = inst_begin(func); it != inst_end(func); ++it) {
+    if (it->getMetadata(kind))
+      llfi_index_cache[&*it] = std::make_pair(func, index++);
+  }
+  if (basenode->getNumOperands() > 1 &&
+      mdconst::extract<ConstantInt>(basenode->getOperand(1))->getSExtValue() !=
+      index - base) {
+    errs() << "ERROR: The indexed instructions of " << func->getName()
+        << " were cloned or deleted after genllfiindexpass, its LLFI indices "
+        << "are no longer valid\n";
+    exit(3);
+  }
+}
+
 long getLLFIIndexofInst(Instruction *inst) {
   MDNode *mdnode = inst->getMetadata("llfi_index");
   if (mdnode) {
-    Constant *cns =
-        dyn_cast<ConstantAsMetadata>(mdnode->getOperand(0))->getValue();
-    ConstantInt *cns_index = dyn_cast<ConstantInt>(cns);
-    return cns_index->getSExtValue();
+    if (mdnode->getNumOperands() != 0) {
+      Constant *cns =
+          dyn_cast<ConstantAsMetadata>(mdnode->getOperand(0))->getValue();
+      ConstantInt *cns_index = dyn_cast<ConstantInt>(cns);
+      return cns_index->getSExtValue();
+    }
+
+    const Function *func = inst->getFunction();
+    auto it = llfi_index_cache.find(inst);
+    if (it == llfi_index_cache.end() || it->second.first != func) {
+      computeLLFIIndicesofFunc(func);
+      it = llfi_index_cache.find(inst);
+    }
+    return it->second.second;
   } else {
     errs() << "ERROR: LLFI indices for instructions are required for the pass, "
         << "please run genllfiindexpass first\n";
@@ -161,16 +219,21 @@ long getLLFIIndexofInst(Instruction *inst) {
 }
 
 static long fi_index = 1;
-void setLLFIIndexofInst(Instruction *inst) {
+void setLLFIIndexofFunc(Function *func) {
   assert (fi_index >= 0 && "static instruction number exceeds index max");
-  Function *func = inst->getParent()->getParent();
   LLVMContext &context = func->getContext();
-  std::vector<Metadata *> llfiindex(1);
-  llfiindex[0] = ConstantAsMetadata::get(
-      ConstantInt::get(Type::getInt64Ty(context), fi_index++));
-  ArrayRef<Metadata *> llfiarr(llfiindex);
-  MDNode *mdnode = MDNode::get(context, llfiarr);
-  inst->setMetadata("llfi_index", mdnode);
+  Type *i64type = Type::getInt64Ty(context);
+  long count = func->getInstructionCount();
+  MDNode *basenode = MDNode::get(context, {
+      ConstantAsMetadata::get(ConstantInt::get(i64type, fi_index)),
+      ConstantAsMetadata::get(ConstantInt::get(i64type, count))});
+  func->setMetadata("llfi_index_base", basenode);
+
+  MDNode *mdnode = MDNode::get(context, None);
+  for (inst_iterator it = inst_begin(func); it != inst_end(func); ++it) {
+    it->setMetadata("llfi_index", mdnode);
+    llfi_index_cache[&*it] = std::make_pair(func, fi_index++);
+  }
 }
 
 void genFullNameOpcodeMap(
@@ -217,4 +280,42 @@ GlobalVariable* findOrCreateGlobalNameString(Module &M, std::string name)
 }
 //================================================
 
+
+// The runtime functions are C functions, so they do not unwind. Their side
+// effects keep them from being deleted or hoisted by the optimizations. The
+// ones that only access the state of the runtime are inaccessiblememonly: the
+// values of the program stay in registers across them, and the loads and
+// stores of the program can move across them.
+void setLLFIRuntimeFuncAttrs(FunctionCallee func, bool accessesprogrammem) {
+  Function *f = dyn_cast<Function>(func.getCallee());
+  if (f == NULL)
+    return;
+  f->addFnAttr(Attribute::NoUnwind);
+  if (!accessesprogrammem)
+    f->addFnAttr(Attribute::InaccessibleMemOnly);
+}
+
+void addValueHash(Value *V, Value *hashgv, Instruction *insertpt) {
+  Type *T = V->getType();
+  if (!T->isSized() || T->isAggregateType() ||
+      (T->isVectorTy() && T->isPtrOrPtrVectorTy()))
+    return;
+
+  IRBuilder<> IRB(insertpt);
+  Type *i64type = IRB.getInt64Ty();
+  Value *bits;
+  if (T->isPointerTy()) {
+    bits = IRB.CreatePtrToInt(V, i64type);
+  } else {
+    const DataLayout &DL = insertpt->getModule()->getDataLayout();
+    Value *asint = IRB.CreateBitCast(V,
+        IRB.getIntNTy(DL.getTypeSizeInBits(T)));
+    bits = IRB.CreateZExtOrTrunc(asint, i64type);
+  }
+  Value *hash = IRB.CreateLoad(i64type, hashgv);
+  hash = IRB.CreateMul(IRB.CreateXor(hash, bits),
+                       ConstantInt::get(i64type, HASH_PRIME));
+  IRB.CreateStore(hash, hashgv);
+}
+
 }
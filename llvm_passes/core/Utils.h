@@ -39,9 +39,10 @@ Instruction *getInsertPtrforRegsofInst(Value *reg, Instruction *inst);
 
 void getProgramExitInsts(Module &M, std::set<Instruction*> &exitinsts);
 
-// get or set the LLFI index of the specified instruction. use metadata
+// get the LLFI index of the specified instruction, or set the LLFI indices of
+// all the instructions of the specified function. use metadata
 long getLLFIIndexofInst(Instruction *inst);
-void setLLFIIndexofInst(Instruction *inst);
+void setLLFIIndexofFunc(Function *func);
 
 // get the map of opcode name and their opcode
 void genFullNameOpcodeMap(std::map<std::string, unsigned> &opcodenamemap);
@@ -59,6 +60,20 @@ Instruction* changeInsertPtrIfInjectFaultInst(Instruction *inst);
 //======== Add opcode_str QINING @SEP 13th========
 GlobalVariable* findOrCreateGlobalNameString(Module &M, std::string name);
 //================================================
+
+// set the attributes of an LLFI runtime function called by the
+// instrumentation, so that optimizations after the instrumentation neither
+// delete nor move the calls, but keep the code around them optimized
+void setLLFIRuntimeFuncAttrs(FunctionCallee func, bool accessesprogrammem);
+
+// FNV-1a, on the values instead of the bytes
+static const uint64_t HASH_OFFSET = 0xcbf29ce484222325ULL;
+static const uint64_t HASH_PRIME = 0x100000001b3ULL;
+
+// hash = (hash ^ bits of V) * HASH_PRIME before insertpt, with hashgv the i64
+// global of the hash, for the first-class values of up to 64 bits; the larger
+// ones are truncated, and the aggregates are not hashed.
+void addValueHash(Value *V, Value *hashgv, Instruction *insertpt);
 }
 
 #endif
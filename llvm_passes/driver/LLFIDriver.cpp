@@ -0,0 +1,290 @@
+//===- LLFIDriver.cpp - One-shot LLFI instrumentation driver -------------===//
+//
+//                     LLFI Distribution
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// llfi-driver produces the indexed, profiling and fault injection variants of
+// a program from a single parse of its IR, instead of one opt run per variant
+// and one llc run per executable.
+//
+// The llfi-passes plugin is loaded like opt does, so the passes accept the
+// same options. The source IR is indexed once, and each variant is a copy of
+// the indexed module that its pipeline runs on. The passes share state
+// through the Controller, so they run one variant after the other. The
+// variants are then serialized to bitcode in memory, and each one is written
+// and compiled to an object file in its own thread and LLVMContext.
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/CodeGen/CommandFlags.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace llvm;
+
+static codegen::RegisterCodeGenFlags CGF;
+
+static cl::opt<std::string> inputfile(cl::Positional,
+    cl::desc("<source IR file>"), cl::Required);
+
+static cl::opt<std::string> pluginfile("llfi-plugin",
+    cl::desc("Path of the llfi-passes plugin"), cl::value_desc("filename"),
+    cl::Required);
+
+static cl::opt<std::string> indexpasses("index-passes",
+    cl::desc("Pipeline run on the source IR"), cl::init("genllfiindexpass"));
+static cl::opt<std::string> indexoutput("index-output",
+    cl::desc("Output file of the indexed IR"), cl::value_desc("filename"));
+
+static cl::opt<std::string> profpasses("prof-passes",
+    cl::desc("Pipeline of the profiling variant"), cl::init("profilingpass"));
+static cl::opt<std::string> profoutput("prof-output",
+    cl::desc("Output file of the profiling IR"), cl::value_desc("filename"));
+static cl::opt<std::string> profobj("prof-obj",
+    cl::desc("Object file of the profiling variant"),
+    cl::value_desc("filename"));
+
+static cl::opt<std::string> fipasses("fi-passes",
+    cl::desc("Pipeline of the fault injection variant"),
+    cl::init("faultinjectionpass"));
+static cl::opt<std::string> fioutput("fi-output",
+    cl::desc("Output file of the fault injection IR"),
+    cl::value_desc("filename"));
+static cl::opt<std::string> fiobj("fi-obj",
+    cl::desc("Object file of the fault injection variant"),
+    cl::value_desc("filename"));
+
+static cl::opt<bool> outputassembly("S",
+    cl::desc("Write the IR files in the human-readable format"));
+
+namespace {
+struct Variant {
+  std::string name;
+  std::string irfile;
+  std::string objfile;
+  SmallVector<char, 0> bitcode;
+  std::string error;
+};
+}
+
+// Load the plugin before the options are parsed, so that its options are
+// registered. A pass plugin loaded by llvm::PassPlugin stays loaded.
+static std::unique_ptr<PassPlugin> loadPlugin(int argc, char **argv) {
+  std::string path;
+  StringRef prefix = "-llfi-plugin";
+  for (int i = 1; i < argc; ++i) {
+    StringRef arg = argv[i];
+    if (arg.startswith("--"))
+      arg = arg.drop_front();
+    if (arg == prefix && i + 1 < argc)
+      path = argv[i + 1];
+    else if (arg.startswith(prefix) && arg[prefix.size()] == '=')
+      path = arg.drop_front(prefix.size() + 1).str();
+  }
+  if (path.empty()) {
+    errs() << "ERROR: the llfi-passes plugin is required (-llfi-plugin)\n";
+    exit(1);
+  }
+
+  Expected<PassPlugin> plugin = PassPlugin::Load(path);
+  if (!plugin) {
+    errs() << "ERROR: unable to load the plugin " << path << ": "
+        << toString(plugin.takeError()) << "\n";
+    exit(1);
+  }
+  return std::make_unique<PassPlugin>(*plugin);
+}
+
+static void runPipeline(Module &M, PassPlugin &plugin, StringRef pipeline) {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  PassBuilder PB;
+  plugin.registerPassBuilderCallbacks(PB);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM;
+  if (Error err = PB.parsePassPipeline(MPM, pipeline)) {
+    errs() << "ERROR: invalid pipeline '" << pipeline << "': "
+        << toString(std::move(err)) << "\n";
+    exit(1);
+  }
+  MPM.addPass(VerifierPass());
+  MPM.run(M, MAM);
+}
+
+static bool writeIR(Module &M, StringRef filename, std::string &error) {
+  std::error_code ec;
+  ToolOutputFile out(filename, ec,
+                     outputassembly ? sys::fs::OF_TextWithCRLF
+                                    : sys::fs::OF_None);
+  if (ec) {
+    error = "unable to open " + filename.str() + ": " + ec.message();
+    return false;
+  }
+  if (outputassembly)
+    M.print(out.os(), nullptr);
+  else
+    WriteBitcodeToFile(M, out.os());
+  out.keep();
+  return true;
+}
+
+// Same as llc -filetype=obj, with the code generation options of llc.
+static bool emitObject(Module &M, StringRef filename, std::string &error) {
+  Triple triple(M.getTargetTriple());
+  if (triple.getTriple().empty())
+    triple.setTriple(sys::getDefaultTargetTriple());
+
+  const Target *target = TargetRegistry::lookupTarget(
+      codegen::getMArch(), triple, error);
+  if (!target)
+    return false;
+
+  TargetOptions options = codegen::InitTargetOptionsFromCodeGenFlags(triple);
+  std::unique_ptr<TargetMachine> TM(target->createTargetMachine(
+      triple.getTriple(), codegen::getCPUStr(), codegen::getFeaturesStr(),
+      options, codegen::getExplicitRelocModel(),
+      codegen::getExplicitCodeModel(), CodeGenOpt::Default));
+  M.setDataLayout(TM->createDataLayout());
+  codegen::setFunctionAttributes(codegen::getCPUStr(),
+                                 codegen::getFeaturesStr(), M);
+
+  std::error_code ec;
+  ToolOutputFile out(filename, ec, sys::fs::OF_None);
+  if (ec) {
+    error = "unable to open " + filename.str() + ": " + ec.message();
+    return false;
+  }
+
+  legacy::PassManager PM;
+  if (TM->addPassesToEmitFile(PM, out.os(), nullptr, CGFT_ObjectFile)) {
+    error = "the target does not support object file emission";
+    return false;
+  }
+  PM.run(M);
+  out.keep();
+  return true;
+}
+
+// Runs in its own thread: LLVMContexts are not shared between threads.
+static void finishVariant(Variant *variant) {
+  LLVMContext context;
+  Expected<std::unique_ptr<Module>> M = parseBitcodeFile(
+      MemoryBufferRef(StringRef(variant->bitcode.data(),
+                                variant->bitcode.size()), variant->name),
+      context);
+  if (!M) {
+    variant->error = toString(M.takeError());
+    return;
+  }
+
+  if (!variant->irfile.empty() &&
+      !writeIR(**M, variant->irfile, variant->error))
+    return;
+  if (!variant->objfile.empty())
+    emitObject(**M, variant->objfile, variant->error);
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+
+  InitializeAllTargets();
+  InitializeAllTargetMCs();
+  InitializeAllAsmPrinters();
+
+  std::unique_ptr<PassPlugin> plugin = loadPlugin(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+      "LLFI one-shot instrumentation driver\n");
+
+  LLVMContext context;
+  SMDiagnostic diag;
+  std::unique_ptr<Module> M = parseIRFile(inputfile, diag, context);
+  if (!M) {
+    diag.print(argv[0], errs());
+    return 1;
+  }
+
+  runPipeline(*M, *plugin, indexpasses);
+
+  // Every module stays alive until the end, as the state kept by the passes
+  // is keyed by the addresses of modules and instructions.
+  std::list<Variant> variants;
+  std::list<std::unique_ptr<Module> > modules;
+
+  if (!indexoutput.empty()) {
+    variants.push_back(Variant());
+    Variant &variant = variants.back();
+    variant.name = "index";
+    variant.irfile = indexoutput;
+    raw_svector_ostream os(variant.bitcode);
+    WriteBitcodeToFile(*M, os);
+  }
+
+  struct { const char *name; cl::opt<std::string> *passes, *ir, *obj; }
+  specs[] = {{"profiling", &profpasses, &profoutput, &profobj},
+             {"faultinjection", &fipasses, &fioutput, &fiobj}};
+  for (auto &spec : specs) {
+    if (spec.ir->empty() && spec.obj->empty())
+      continue;
+    modules.push_back(CloneModule(*M));
+    runPipeline(*modules.back(), *plugin, *spec.passes);
+
+    variants.push_back(Variant());
+    Variant &variant = variants.back();
+    variant.name = spec.name;
+    variant.irfile = *spec.ir;
+    variant.objfile = *spec.obj;
+    raw_svector_ostream os(variant.bitcode);
+    WriteBitcodeToFile(*modules.back(), os);
+  }
+
+  std::list<std::thread> threads;
+  for (Variant &variant : variants)
+    threads.emplace_back(finishVariant, &variant);
+  for (std::thread &thread : threads)
+    thread.join();
+
+  int retval = 0;
+  for (Variant &variant : variants) {
+    if (!variant.error.empty()) {
+      errs() << "ERROR: " << variant.name << ": " << variant.error << "\n";
+      retval = 1;
+    }
+  }
+  return retval;
+}
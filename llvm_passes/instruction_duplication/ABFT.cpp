@@ -0,0 +1,597 @@
+#define DEBUG_TYPE "ABFTPass"
+
+#include "llvm/Pass.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+
+#include <vector>
+#include <string>
+#include <map>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+
+using namespace llvm;
+using namespace std;
+
+// Algorithm-based fault tolerance (ABFT) for the contractions of ML models.
+//
+// MatMul, Gemm and Conv are lowered by onnx-mlir into loop nests whose
+// innermost statement is a multiply-accumulate
+//
+//   Acc[...] = Acc[...] + A[...] * B[...]
+//
+// where Acc is either the output tensor itself, or a scalar accumulator that
+// is copied into the output tensor C once the reduction loops are done. The
+// pass recognises such nests, inside the operators of main_graph delimited
+// by OMInstrumentPoint, from the affine address recurrences computed by
+// ScalarEvolution. Every loop of the nest must then be of one of three kinds:
+//
+//   i-loop: indexes A and C, not B (rows of a matrix multiply),
+//   j-loop: indexes B and C, not A (columns of a matrix multiply),
+//   r-loop: indexes A and B, not C (the reduction).
+//
+// This covers the matrix multiply, and the convolution with the output
+// channels as j-loops and the output pixels as i-loops. After the nest, a
+// call to lltfiABFTCheck (shared_lib/ABFTHelperFunctions.cpp) compares the
+// row and column checksums of C against the ones predicted from A and B,
+// which costs O(|I||R| + |J||R| + |I||J|) instead of the O(|I||J||R|) of the
+// contraction. With -abftCorrection, a single corrupted element, located at
+// the intersection of the mismatching row and column, is corrected in place.
+namespace ABFT {
+
+    static cl::opt< string > abftOperatorName("abftOperatorName",
+        cl::desc("Name of operator(s) to protect with checksums. Semi-colon \
+        seperated values. Example: conv;matmul;gemm;all. Default: all"),
+        cl::init("all"));
+
+    static cl::opt< bool > abftCorrection("abftCorrection",
+        cl::desc("Boolean value to indicate whether to correct a single \
+            corrupted output element located by the checksums. \
+            Default: False"), cl::init(false));
+
+    static cl::opt< double > abftTolerance("abftTolerance",
+        cl::desc("Relative tolerance of the checksum comparison, to absorb \
+            the floating-point rounding differences. Default: 1e-3"),
+        cl::init(1e-3));
+
+    // Return an array our of string of semi-colon seperated values.
+    static vector<string> getSemiColonSeperateVals(string inp) {
+
+        vector<string> retval;
+        stringstream ss(inp);
+        string token;
+
+        while (getline(ss, token, ';'))
+            retval.push_back(token);
+
+        return retval;
+    }
+
+    // Get unique Id corresponding to the ONNX contraction operators.
+    static int64_t getOperatorNumber(string name) {
+
+        transform(name.begin(), name.end(), name.begin(),
+                        [](unsigned char c){ return tolower(c); });
+
+        // ONNX assigns unique IDs to each tensor operator.
+        map<string, int64_t> ONNXOperatorId = {
+            {"conv", 1986948931},
+            {"matmul", 119251066446157},
+            {"gemm", 1835885895}
+        };
+
+        if (ONNXOperatorId.find(name) == ONNXOperatorId.end())
+            return -1;
+
+        return ONNXOperatorId[name];
+    }
+
+    // Initial value of the accumulator, as passed to lltfiABFTCheck.
+    enum InitKind {
+        INIT_CONSTANT = 1, // Initialized to a constant inside the nest.
+        INIT_SNAPSHOT = 2  // Accumulated into the previous content of C.
+    };
+
+    struct ContractionNest {
+        vector<Loop*> loops; // Outermost first.
+        const SCEV *baseA, *baseB, *baseC;
+        Type *ptrTyA, *ptrTyB, *ptrTyC;
+        vector<int64_t> tripCounts, strideA, strideB, strideC;
+        InitKind initKind;
+        double initValue;
+        int64_t operatorId;
+    };
+}
+
+using namespace ABFT;
+
+namespace llfi {
+
+    class ABFTPass: public FunctionPass
+    {
+
+    private:
+        bool isInitialized;
+        vector<int64_t> operatorValues;
+        bool protectAllOperators;
+        int64_t siteNumber;
+
+        LoopInfo *LI;
+        ScalarEvolution *SE;
+        DominatorTree *DT;
+
+        void initialize() {
+
+            for (string name : getSemiColonSeperateVals(abftOperatorName)) {
+
+                if (name.find("all") != string::npos) {
+                    protectAllOperators = true;
+                    break;
+                }
+
+                int64_t temp = getOperatorNumber(name);
+
+                if (temp == -1) {
+                    errs() << "ERROR: Invalid operator name: " << name
+                        << ", only conv, matmul and gemm are supported\n";
+                    exit(1);
+                }
+
+                operatorValues.push_back(temp);
+            }
+        }
+
+        bool shouldProtect(int64_t number) {
+
+            if (protectAllOperators)
+                return getOperatorNumber("conv") == number ||
+                    getOperatorNumber("matmul") == number ||
+                    getOperatorNumber("gemm") == number;
+
+            return find(operatorValues.begin(), operatorValues.end(), number)
+                != operatorValues.end();
+        }
+
+        // Strip the affine recurrences of the loops of the nest from the
+        // address S, and record their steps in strides. Returns the address
+        // of the first element, or NULL if S is not affine in these loops.
+        const SCEV* decomposeAddress(const SCEV* S, const vector<Loop*>& loops,
+                map<const Loop*, int64_t>& strides) {
+
+            while (const SCEVAddRecExpr* AR = dyn_cast<SCEVAddRecExpr>(S)) {
+                if (find(loops.begin(), loops.end(), AR->getLoop()) ==
+                        loops.end())
+                    break;
+
+                const SCEVConstant* step = dyn_cast<SCEVConstant>(
+                                            AR->getStepRecurrence(*SE));
+                if (!AR->isAffine() || !step)
+                    return NULL;
+
+                strides[AR->getLoop()] = step->getAPInt().getSExtValue();
+                S = AR->getStart();
+            }
+
+            for (Loop* L : loops) {
+                if (!SE->isLoopInvariant(S, L))
+                    return NULL;
+            }
+
+            return S;
+        }
+
+        // All the ancestor loops of L, innermost first.
+        vector<Loop*> getLoopNest(Loop* L) {
+
+            vector<Loop*> loops;
+            for (; L; L = L->getParentLoop())
+                loops.push_back(L);
+            return loops;
+        }
+
+        // Recognise the contraction nest whose multiply-accumulate is stored
+        // by S. Returns false if S is not such a statement, or if the nest
+        // is not in the form the checksums can handle.
+        bool analyzeContraction(StoreInst* S, ContractionNest& nest) {
+
+            Type* floatTy = Type::getFloatTy(S->getContext());
+            BinaryOperator* sum = dyn_cast<BinaryOperator>(S->getValueOperand());
+            if (!sum || sum->getOpcode() != Instruction::FAdd ||
+                    sum->getType() != floatTy)
+                return false;
+
+            BinaryOperator* mul = NULL;
+            LoadInst* acc = NULL;
+            for (unsigned i = 0; i < 2; i++) {
+                BinaryOperator* op = dyn_cast<BinaryOperator>(sum->getOperand(i));
+                if (op && op->getOpcode() == Instruction::FMul) {
+                    mul = op;
+                    acc = dyn_cast<LoadInst>(sum->getOperand(1 - i));
+                    break;
+                }
+            }
+            if (!mul || !acc)
+                return false;
+
+            LoadInst* loadA = dyn_cast<LoadInst>(mul->getOperand(0));
+            LoadInst* loadB = dyn_cast<LoadInst>(mul->getOperand(1));
+            if (!loadA || !loadB || loadA->getType() != floatTy ||
+                    loadB->getType() != floatTy)
+                return false;
+
+            Loop* innermost = LI->getLoopFor(S->getParent());
+            const SCEV* accPtr = SE->getSCEV(S->getPointerOperand());
+            if (!innermost || SE->getSCEV(acc->getPointerOperand()) != accPtr)
+                return false;
+
+            // The multiply-accumulate must run in every iteration.
+            if (!innermost->getLoopLatch() ||
+                    !DT->dominates(S->getParent(), innermost->getLoopLatch()))
+                return false;
+
+            vector<Loop*> ancestors = getLoopNest(innermost);
+            const SCEV* ptrA = SE->getSCEV(loadA->getPointerOperand());
+            const SCEV* ptrB = SE->getSCEV(loadB->getPointerOperand());
+
+            map<const Loop*, int64_t> accStrides;
+            if (!decomposeAddress(accPtr, ancestors, accStrides))
+                return false;
+
+            // The output is either the accumulator itself, or, for a scalar
+            // accumulator, the location its final value is copied to.
+            StoreInst* output = S;
+            if (accStrides.empty()) {
+                output = NULL;
+                for (Loop* L : ancestors) {
+                    if (L == innermost)
+                        continue;
+                    for (BasicBlock* bb : L->blocks()) {
+                        if (LI->getLoopFor(bb) != L)
+                            continue;
+                        for (Instruction& I : *bb) {
+                            StoreInst* store = dyn_cast<StoreInst>(&I);
+                            LoadInst* copy = store ?
+                                dyn_cast<LoadInst>(store->getValueOperand()) :
+                                NULL;
+                            if (copy && SE->getSCEV(copy->getPointerOperand())
+                                    == accPtr) {
+                                output = store;
+                                break;
+                            }
+                        }
+                        if (output)
+                            break;
+                    }
+                    if (output)
+                        break;
+                }
+                if (!output)
+                    return false;
+            }
+            const SCEV* ptrC = SE->getSCEV(output->getPointerOperand());
+
+            map<const Loop*, int64_t> stridesA, stridesB, stridesC;
+            if (!decomposeAddress(ptrA, ancestors, stridesA) ||
+                    !decomposeAddress(ptrB, ancestors, stridesB) ||
+                    !decomposeAddress(ptrC, ancestors, stridesC))
+                return false;
+
+            // Walk up the nest: first the reduction loops, then the loops
+            // indexing the output. Stop at the first loop of another kind.
+            vector<Loop*> loops;
+            Loop* outermostReduction = NULL;
+            bool inReduction = true;
+            unsigned numI = 0, numJ = 0;
+            for (Loop* L : ancestors) {
+                bool a = stridesA.count(L), b = stridesB.count(L),
+                     c = stridesC.count(L);
+
+                if (inReduction && a && b && !c) {
+                    loops.push_back(L);
+                    outermostReduction = L;
+                    continue;
+                }
+                if (!outermostReduction)
+                    return false;
+                inReduction = false;
+
+                if (a && c && !b)
+                    numI++;
+                else if (b && c && !a)
+                    numJ++;
+                else
+                    break;
+                loops.push_back(L);
+            }
+            if (numI == 0 || numJ == 0)
+                return false;
+
+            // The copy of a scalar accumulator must happen after the
+            // reduction loops, in every iteration of their parent loop.
+            Loop* outputLoop = outermostReduction->getParentLoop();
+            if (output != S && (LI->getLoopFor(output->getParent()) !=
+                    outputLoop || !outputLoop->getLoopLatch() ||
+                    !DT->dominates(output->getParent(),
+                        outputLoop->getLoopLatch())))
+                return false;
+
+            reverse(loops.begin(), loops.end());
+            Loop* outermost = loops.front();
+            if (!outermost->getLoopPreheader() || !outermost->getExitBlock() ||
+                    !outermost->hasDedicatedExits())
+                return false;
+
+            // Every inner loop must be entered in every iteration of its
+            // parent, and have a known trip count.
+            for (unsigned i = 0; i < loops.size(); i++) {
+                unsigned tripCount = SE->getSmallConstantTripCount(loops[i]);
+                if (tripCount == 0)
+                    return false;
+                nest.tripCounts.push_back(tripCount);
+
+                if (i > 0 && (!loops[i - 1]->getLoopLatch() ||
+                        !DT->dominates(loops[i]->getHeader(),
+                            loops[i - 1]->getLoopLatch())))
+                    return false;
+            }
+
+            // Base addresses, expandable in front of the nest.
+            map<const Loop*, int64_t> unused;
+            nest.baseA = decomposeAddress(ptrA, loops, unused);
+            nest.baseB = decomposeAddress(ptrB, loops, unused);
+            nest.baseC = decomposeAddress(ptrC, loops, unused);
+            BasicBlock* preheader = outermost->getLoopPreheader();
+            for (const SCEV* base : {nest.baseA, nest.baseB, nest.baseC}) {
+                if (!base || !SE->dominates(base, preheader))
+                    return false;
+            }
+            nest.ptrTyA = loadA->getPointerOperandType();
+            nest.ptrTyB = loadB->getPointerOperandType();
+            nest.ptrTyC = output->getPointerOperandType();
+
+            // Strides in number of elements.
+            for (Loop* L : loops) {
+                for (auto p : {make_pair(&stridesA, &nest.strideA),
+                        make_pair(&stridesB, &nest.strideB),
+                        make_pair(&stridesC, &nest.strideC)}) {
+                    int64_t stride = p.first->count(L) ? (*p.first)[L] : 0;
+                    if (stride % 4 != 0)
+                        return false;
+                    p.second->push_back(stride / 4);
+                }
+            }
+
+            // Find the initialization of the accumulator inside the nest.
+            StoreInst* init = NULL;
+            for (BasicBlock* bb : outermost->blocks()) {
+                if (outermostReduction->contains(bb))
+                    continue;
+                for (Instruction& I : *bb) {
+                    StoreInst* store = dyn_cast<StoreInst>(&I);
+                    if (store && store != output &&
+                            SE->getSCEV(store->getPointerOperand()) == accPtr)
+                        init = store;
+                }
+            }
+
+            if (init) {
+                ConstantFP* initValue = dyn_cast<ConstantFP>(
+                                            init->getValueOperand());
+                if (!initValue)
+                    return false;
+                nest.initKind = INIT_CONSTANT;
+                nest.initValue = initValue->getValueAPF().convertToFloat();
+            } else {
+                // Without an initialization, the products are accumulated
+                // into the previous content of C.
+                if (output != S)
+                    return false;
+                nest.initKind = INIT_SNAPSHOT;
+                nest.initValue = 0.0;
+            }
+
+            nest.loops = loops;
+            return true;
+        }
+
+        Value* createInt64Array(Module* M, vector<int64_t>& values,
+                IRBuilder<>& IRB) {
+
+            ArrayType* arrTy = ArrayType::get(IRB.getInt64Ty(), values.size());
+            vector<Constant*> elements;
+            for (int64_t v : values)
+                elements.push_back(IRB.getInt64(v));
+
+            GlobalVariable* gv = new GlobalVariable(*M, arrTy, true,
+                GlobalValue::PrivateLinkage,
+                ConstantArray::get(arrTy, elements), "llfi_abft_nest");
+            return IRB.CreateConstInBoundsGEP2_64(arrTy, gv, 0, 0);
+        }
+
+        // Insert the checksum computation in front of the nest, if needed,
+        // and the verification after it.
+        void protectContraction(ContractionNest& nest) {
+
+            Loop* outermost = nest.loops.front();
+            Module* M = outermost->getHeader()->getModule();
+            LLVMContext& context = M->getContext();
+            const DataLayout& DL = M->getDataLayout();
+
+            Type* int64Ty = Type::getInt64Ty(context);
+            Type* int64PtrTy = Type::getInt64PtrTy(context);
+            Type* floatPtrTy = Type::getFloatPtrTy(context);
+            int64_t site = ++siteNumber;
+            int64_t numLoops = nest.loops.size();
+
+            SCEVExpander Expander(*SE, DL, "abft");
+
+            if (nest.initKind == INIT_SNAPSHOT) {
+                Instruction* insertPt =
+                    outermost->getLoopPreheader()->getTerminator();
+                IRBuilder<> IRB(insertPt);
+
+                FunctionCallee Fn = M->getOrInsertFunction(
+                    "lltfiABFTSnapshot", Type::getVoidTy(context), int64Ty,
+                    floatPtrTy, int64Ty, int64PtrTy, int64PtrTy, int64PtrTy,
+                    int64PtrTy);
+
+                Value* C = Expander.expandCodeFor(nest.baseC, nest.ptrTyC,
+                                insertPt);
+                IRB.CreateCall(Fn, {IRB.getInt64(site),
+                    IRB.CreatePointerCast(C, floatPtrTy),
+                    IRB.getInt64(numLoops),
+                    createInt64Array(M, nest.tripCounts, IRB),
+                    createInt64Array(M, nest.strideA, IRB),
+                    createInt64Array(M, nest.strideB, IRB),
+                    createInt64Array(M, nest.strideC, IRB)});
+            }
+
+            Instruction* insertPt =
+                &*outermost->getExitBlock()->getFirstInsertionPt();
+            IRBuilder<> IRB(insertPt);
+
+            FunctionCallee Fn = M->getOrInsertFunction(
+                "lltfiABFTCheck", Type::getVoidTy(context), int64Ty, int64Ty,
+                floatPtrTy, floatPtrTy, floatPtrTy, int64Ty, int64PtrTy,
+                int64PtrTy, int64PtrTy, int64PtrTy, Type::getInt32Ty(context),
+                Type::getFloatTy(context), Type::getInt32Ty(context),
+                Type::getDoubleTy(context));
+
+            Value* A = Expander.expandCodeFor(nest.baseA, nest.ptrTyA, insertPt);
+            Value* B = Expander.expandCodeFor(nest.baseB, nest.ptrTyB, insertPt);
+            Value* C = Expander.expandCodeFor(nest.baseC, nest.ptrTyC, insertPt);
+
+            IRB.CreateCall(Fn, {IRB.getInt64(site),
+                IRB.getInt64(nest.operatorId),
+                IRB.CreatePointerCast(A, floatPtrTy),
+                IRB.CreatePointerCast(B, floatPtrTy),
+                IRB.CreatePointerCast(C, floatPtrTy),
+                IRB.getInt64(numLoops),
+                createInt64Array(M, nest.tripCounts, IRB),
+                createInt64Array(M, nest.strideA, IRB),
+                createInt64Array(M, nest.strideB, IRB),
+                createInt64Array(M, nest.strideC, IRB),
+                IRB.getInt32(nest.initKind),
+                ConstantFP::get(Type::getFloatTy(context), nest.initValue),
+                IRB.getInt32(abftCorrection ? 1 : 0),
+                ConstantFP::get(Type::getDoubleTy(context), abftTolerance)});
+        }
+
+    public:
+
+        static char ID;
+
+        ABFTPass():FunctionPass(ID)
+        {
+            isInitialized = false;
+            protectAllOperators = false;
+            siteNumber = 0;
+        }
+
+        virtual void getAnalysisUsage(AnalysisUsage &AU) const
+        {
+            AU.addRequired<LoopInfoWrapperPass>();
+            AU.addRequired<ScalarEvolutionWrapperPass>();
+            AU.addRequired<DominatorTreeWrapperPass>();
+        }
+
+        bool runOnMainGraph(Function& F)
+        {
+            // Parse input options.
+            if (!isInitialized) {
+                isInitialized = true;
+                initialize();
+            }
+
+            LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+            SE = &getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+            DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+
+            // Collect the stores of the selected operators. The second
+            // argument of OMInstrumentPoint is 1 before an operator and 2
+            // after it.
+            vector<pair<StoreInst*, int64_t>> candidates;
+            int64_t currOperator = -1;
+
+            for (BasicBlock &bb : F) {
+                for (Instruction &I : bb) {
+
+                    if (CallInst* callinst = dyn_cast<CallInst>(&I)) {
+                        Function* callee = callinst->getCalledFunction();
+
+                        if (callee && callee->getName() == "OMInstrumentPoint") {
+                            ConstantInt* ci1 = dyn_cast<ConstantInt>(
+                                                callinst->getArgOperand(0));
+                            ConstantInt* ci2 = dyn_cast<ConstantInt>(
+                                                callinst->getArgOperand(1));
+
+                            currOperator = ci2->getSExtValue() == 1 ?
+                                ci1->getSExtValue() : -1;
+                        }
+                        continue;
+                    }
+
+                    StoreInst* store = dyn_cast<StoreInst>(&I);
+                    if (store && currOperator != -1 &&
+                            shouldProtect(currOperator))
+                        candidates.push_back({store, currOperator});
+                }
+            }
+
+            vector<ContractionNest> nests;
+            for (auto &candidate : candidates) {
+                ContractionNest nest;
+                if (!analyzeContraction(candidate.first, nest))
+                    continue;
+
+                // Protect every nest once.
+                bool isProtected = false;
+                for (ContractionNest& other : nests)
+                    isProtected |= other.loops.front() == nest.loops.front();
+                if (isProtected)
+                    continue;
+
+                nest.operatorId = candidate.second;
+                nests.push_back(nest);
+            }
+
+            for (ContractionNest& nest : nests)
+                protectContraction(nest);
+
+            DEBUG_WITH_TYPE("ABFTPass",
+                dbgs() << "ABFT: protected " << nests.size()
+                    << " contraction loop nests\n");
+
+            return !nests.empty();
+        }
+
+        virtual bool runOnFunction(Function &F)
+        {
+
+            if (F.getName() == "main_graph") {
+                return runOnMainGraph(F);
+            }
+
+            return false;
+        }
+    };
+
+    char ABFTPass::ID = 0;
+
+    static RegisterPass<ABFTPass>
+        X("ABFTPass", "Checksum-based protection of ML contractions",
+            false, false);
+}
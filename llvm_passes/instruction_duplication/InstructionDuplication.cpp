@@ -14,6 +14,7 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
@@ -25,6 +26,7 @@
 #include <algorithm>
 #include <cctype>
 #include <unordered_map>
+#include <unordered_set>
 #include <cassert>
 
 using namespace llvm;
@@ -44,6 +46,12 @@ namespace SID {
         cl::desc("Boolean value to indicate whether to do arithmetic chain \
             duplication or not. Default: False"), cl::init(false));
 
+    static cl::opt< bool > enableSliceDuplication("enableSliceDuplication",
+        cl::desc("Boolean value to indicate whether to duplicate use-def \
+            slices of arithmetic instructions and check only at the slice \
+            sinks. Takes precedence over enableChainDuplication. \
+            Default: False"), cl::init(false));
+
     // Return an array our of string of comma-seperated values.
     vector<string> getCommaSeperateVals(string inp) {
 
@@ -92,8 +100,68 @@ namespace SID {
         return ONNXOperatorId[opname];
     }
 
+    // Return the integer (or integer vector) type with the same bit layout as
+    // the given floating-point (or floating-point vector) type.
+    static Type* getBitcastIntType(Type* ty) {
+
+        Type* scalarTy = ty->getScalarType();
+        Type* intTy = IntegerType::get(ty->getContext(),
+                            scalarTy->getPrimitiveSizeInBits().getFixedSize());
+
+        if (VectorType* vecTy = dyn_cast<VectorType>(ty))
+            return VectorType::get(intTy, vecTy->getElementCount());
+
+        return intTy;
+    }
+
+    // Emit the comparison of an instruction with its duplicate inline, right
+    // after the duplicate. The check is a lane-wise compare-and-select on the
+    // integer view of the two values: lanes that agree keep the original
+    // value, lanes that disagree get the bitwise AND of both copies, which is
+    // the correction done by compareFloatValues in SIDHelperFunctions.cpp.
+    // Being branch-free and free of calls, it works for half, float, double
+    // and their vector forms, and does not get in the way of the vectorizers.
+    // Every instruction of the check is added to checkInsts.
+    Value* insertInlineCheck(Instruction* inst, Instruction* duplicatedInst,
+            vector<Instruction*>& checkInsts) {
+
+        IRBuilder<> IRB(duplicatedInst->getNextNode());
+        Type* intTy = getBitcastIntType(inst->getType());
+
+        Value* origBits = IRB.CreateBitCast(inst, intTy, "sid.orig");
+        Value* duplBits = IRB.CreateBitCast(duplicatedInst, intTy, "sid.dupl");
+        Value* isEqual = IRB.CreateICmpEQ(origBits, duplBits, "sid.eq");
+        Value* corrected = IRB.CreateAnd(origBits, duplBits, "sid.and");
+        Value* selected = IRB.CreateSelect(isEqual, origBits, corrected,
+                            "sid.sel");
+        Value* result = IRB.CreateBitCast(selected, inst->getType(),
+                            "sid.checked");
+
+        for (Value* v : {origBits, duplBits, isEqual, corrected, selected,
+                result}) {
+            if (Instruction* checkInst = dyn_cast<Instruction>(v))
+                checkInsts.push_back(checkInst);
+        }
+
+        return result;
+    }
+
+    // Redirect all uses of inst, except the ones made by the check itself,
+    // to the checked value.
+    void replaceUsesWithCheckedValue(Instruction* inst, Value* checked,
+            vector<Instruction*>& checkInsts) {
+
+        auto isNotCheck = [&](Use &operand) {
+            Instruction* user = dyn_cast<Instruction>(operand.getUser());
+            return find(checkInsts.begin(), checkInsts.end(), user) ==
+                checkInsts.end();
+        };
+
+        inst->replaceUsesWithIf(checked, isNotCheck);
+    }
+
     // Add Metadata to LLVM instructions; Only for debugging purposes!
-    void addMetadata(Instruction *ins, char *st = NULL){
+    void addMetadata(Instruction *ins, const char *st = NULL){
          LLVMContext& C = ins->getContext();
          MDNode* N = MDNode::get(C, MDString::get(C, (!st) ? "t" : st));
 
@@ -139,10 +207,11 @@ namespace llfi{
         vector<int64_t> llfiIndexes;
         bool injectInAllIndexes;
         bool isChainDuplication;
+        bool isSliceDuplication;
 
         // Initializes Layer name and granularity of instruction duplication.
         void initializeGranularityAndLayerName(string llfiIndex,
-                string layerName, bool isChainDupl) {
+                string layerName, bool isChainDupl, bool isSliceDupl) {
 
             // Parse operators.
             vector<string> OperatorNames = getCommaSeperateVals(layerName);
@@ -164,8 +233,9 @@ namespace llfi{
                 operatorValues.push_back(temp);
             }
 
-            // Parse enableChainDuplication boolean
+            // Parse enableChainDuplication and enableSliceDuplication booleans
             isChainDuplication = isChainDupl;
+            isSliceDuplication = isSliceDupl;
 
             // Parse LLFIIndexes for FI.
             vector<string> LLFIIndexes = getCommaSeperateVals(llfiIndex);
@@ -194,6 +264,8 @@ namespace llfi{
             isInitialized = false;
             injectInAllIndexes = false;
             injectInAllOperators = false;
+            isChainDuplication = false;
+            isSliceDuplication = false;
         }
 
         // Duplicate a single arithmetic instruction
@@ -214,23 +286,10 @@ namespace llfi{
             // Insert the duplicate instruction
             duplicatedInst->insertBefore(inst->getNextNode());
 
-            IRBuilder<> IRB(inst->getParent());
-            IRB.SetInsertPoint(duplicatedInst->getNextNode());
-
-            auto Fn = inst->getFunction()->getParent()->getOrInsertFunction(
-                    "compareFloatValues", Type::getFloatTy(inst->getContext()),
-                    Type::getFloatTy(inst->getContext()),
-                    Type::getFloatTy(inst->getContext()));
-
-            Value *funret = IRB.CreateCall(Fn, {inst, duplicatedInst});
-
-            auto myIf = [&](Use &operand) {
-                if (isa<CallInst>(operand.getUser()))
-                    return false;
-                return true;
-            };
-
-            inst->replaceUsesWithIf(funret, myIf);
+            // Compare the two copies inline and use the checked value.
+            vector<Instruction*> checkInsts;
+            Value *checked = insertInlineCheck(inst, duplicatedInst, checkInsts);
+            replaceUsesWithCheckedValue(inst, checked, checkInsts);
         }
 
         // Duplicate a chain of arithmetic instructions.
@@ -275,52 +334,53 @@ namespace llfi{
                     RF_IgnoreMissingLocals);
             }
 
-            // Insert the compareFloatValue function
-            IRBuilder<> IRB(lastInst->getParent());
-            IRB.SetInsertPoint(lastInstDupl->getNextNode());
-
-            auto Fn = lastInst->getFunction()->getParent()->
-                        getOrInsertFunction("compareFloatValues",
-                            Type::getFloatTy(lastInst->getContext()),
-                            Type::getFloatTy(lastInst->getContext()),
-                            Type::getFloatTy(lastInst->getContext())
-                            );
-
-            Value *funret = IRB.CreateCall(Fn, {lastInst, lastInstDupl});
-
-            // Replace all use of the arithmatic instruction with the function
-            // return value
-            auto myIf = [&](Use &operand) {
-                if (isa<CallInst>(operand.getUser()))
-                    return false;
-                return true;
-            };
-
-            lastInst->replaceUsesWithIf(funret, myIf);
+            // Compare the last instructions of the two chains inline, and
+            // replace all uses of the arithmetic instruction with the checked
+            // value.
+            vector<Instruction*> checkInsts;
+            Value *checked = insertInlineCheck(lastInst, lastInstDupl,
+                                checkInsts);
+            replaceUsesWithCheckedValue(lastInst, checked, checkInsts);
         }
 
         bool isArithmeticInstruction(Instruction* inst)
         {
-            // Don't do instruction duplication in FCmp.
+            // Don't do instruction duplication in FCmp. Scalar (half, float,
+            // double) as well as vector floating-point results are handled.
             if (inst != NULL && (inst->getOpcode() == Instruction::FAdd ||
                         inst->getOpcode() == Instruction::FSub ||
                         inst->getOpcode() == Instruction::FMul ||
-                        inst->getOpcode() == Instruction::FDiv))
+                        inst->getOpcode() == Instruction::FDiv) &&
+                    inst->getType()->isFPOrFPVectorTy())
                 return true;
             else
                 return false;
         }
 
+        // Instructions that can be part of a duplicated slice: the arithmetic
+        // instructions, and the floating-point negation and conversions that
+        // usually sit between them.
+        bool isSliceInstruction(Instruction* inst)
+        {
+            if (isArithmeticInstruction(inst))
+                return true;
+
+            if (inst != NULL && inst->getType()->isFPOrFPVectorTy() &&
+                    (inst->getOpcode() == Instruction::FNeg ||
+                     inst->getOpcode() == Instruction::FPExt ||
+                     inst->getOpcode() == Instruction::FPTrunc))
+                return true;
+
+            return false;
+        }
+
         bool checkInstructionIndex(Instruction* inst) {
 
             if (injectInAllIndexes) return true;
 
-            MDNode *mdnode = inst->getMetadata("llfi_index");
             long vindex = 0;
-            if (mdnode) {
-                ConstantInt *cns_index = mdconst::dyn_extract<ConstantInt>(mdnode->getOperand(0));
-                vindex = cns_index->getSExtValue();
-            }
+            if (llfi::isLLFIIndexedInst(inst))
+                vindex = llfi::getLLFIIndexofInst(inst);
 
             for(long idx : llfiIndexes) {
 
@@ -467,6 +527,155 @@ namespace llfi{
             return true;
         }
 
+        // Duplicate every instruction of a use-def slice, and check only the
+        // slice sinks, i.e. the members whose value escapes the slice through
+        // a store, a (loop-carried) PHI, a call or any other non-member user.
+        // Returns the number of checks inserted.
+        unsigned duplicateSlice(vector<Instruction*>& slice)
+        {
+            unordered_set<Instruction*> members(slice.begin(), slice.end());
+            vector<Instruction*> sinks;
+
+            for (Instruction* inst : slice) {
+                for (User* user : inst->users()) {
+                    Instruction* userInst = dyn_cast<Instruction>(user);
+                    if (!userInst || !members.count(userInst)) {
+                        sinks.push_back(inst);
+                        break;
+                    }
+                }
+            }
+
+            // Clone the slice right after the original instructions, and make
+            // the clones use each other.
+            llvm::ValueToValueMapTy vmap;
+            vector<Instruction*> new_instructions;
+
+            for (Instruction* inst : slice) {
+                Instruction* duplicatedInst = inst->clone();
+
+                // Move the metadata, like the other duplication paths
+                MDNode *mdnode = inst->getMetadata("llfi_index");
+                inst->setMetadata("llfi_index", NULL);
+                duplicatedInst->setMetadata("llfi_index", mdnode);
+                addMetadata(duplicatedInst, "Duplicated_Instruction_In_Slice");
+                duplicatedInst->insertAfter(inst);
+
+                new_instructions.push_back(duplicatedInst);
+                vmap[inst] = duplicatedInst;
+            }
+
+            for (auto *i : new_instructions) {
+                llvm::RemapInstruction(i, vmap, RF_NoModuleLevelChanges |
+                    RF_IgnoreMissingLocals);
+            }
+
+            // Check the sinks. Users inside the slice keep using the
+            // unchecked value, so that both copies stay independent until the
+            // value leaves the slice.
+            for (Instruction* sink : sinks) {
+                Instruction* duplicatedSink = cast<Instruction>(vmap[sink]);
+
+                vector<Instruction*> checkInsts;
+                Value* checked = insertInlineCheck(sink, duplicatedSink,
+                                    checkInsts);
+
+                auto isOutsideSlice = [&](Use &operand) {
+                    Instruction* user = dyn_cast<Instruction>(operand.getUser());
+                    if (user && members.count(user))
+                        return false;
+                    return find(checkInsts.begin(), checkInsts.end(), user) ==
+                        checkInsts.end();
+                };
+
+                sink->replaceUsesWithIf(checked, isOutsideSlice);
+            }
+
+            return sinks.size();
+        }
+
+        bool doArithmeticSliceDuplication(Function& F)
+        {
+            vector<Instruction*> candidates;
+            bool isCustomTensorOperator = false;
+
+            // Find all the slice instructions inside the selected operators.
+            for (BasicBlock &bb : F) {
+                for (Instruction &I : bb) {
+                    Instruction* inst = &I;
+
+                    if (CallInst* callinst = dyn_cast<CallInst>(inst)) {
+                        Function* callee = callinst->getCalledFunction();
+
+                        // If this is OMInstrument function?
+                        if (callee && callee->getName() == "OMInstrumentPoint") {
+
+                            ConstantInt* ci1 = dyn_cast<ConstantInt>(
+                                                callinst->getArgOperand(0));
+                            ConstantInt* ci2 = dyn_cast<ConstantInt>(
+                                                callinst->getArgOperand(1));
+
+                            int64_t argValue1 = ci1->getSExtValue();
+                            int64_t argValue2 = ci2->getSExtValue();
+
+                            if (argValue2 == 2 && shouldInjectFault(argValue1))
+                                isCustomTensorOperator = true;
+
+                            if (argValue2 == 1 && shouldInjectFault(argValue1))
+                                isCustomTensorOperator = false;
+                        }
+                    }
+
+                    if (isCustomTensorOperator && isSliceInstruction(inst) &&
+                            checkInstructionIndex(inst))
+                        candidates.push_back(inst);
+                }
+            }
+
+            // Group the candidates into slices: two candidates belong to the
+            // same slice if one uses the other. Slices may span basic blocks,
+            // e.g. the multiply and the accumulation of a loop body.
+            unordered_map<Instruction*, unsigned> position;
+            vector<unsigned> parent(candidates.size());
+            for (unsigned i = 0; i < candidates.size(); i++) {
+                position[candidates[i]] = i;
+                parent[i] = i;
+            }
+
+            auto findRoot = [&](unsigned i) {
+                while (parent[i] != i) {
+                    parent[i] = parent[parent[i]];
+                    i = parent[i];
+                }
+                return i;
+            };
+
+            for (unsigned i = 0; i < candidates.size(); i++) {
+                for (Value* op : candidates[i]->operands()) {
+                    Instruction* opInst = dyn_cast<Instruction>(op);
+                    if (!opInst || !position.count(opInst))
+                        continue;
+                    parent[findRoot(i)] = findRoot(position[opInst]);
+                }
+            }
+
+            // Members of a slice are kept in program order.
+            map<unsigned, vector<Instruction*>> slices;
+            for (unsigned i = 0; i < candidates.size(); i++)
+                slices[findRoot(i)].push_back(candidates[i]);
+
+            unsigned numChecks = 0;
+            for (auto &slice : slices)
+                numChecks += duplicateSlice(slice.second);
+
+            DEBUG_WITH_TYPE("InstructionDuplicationPass",
+                    dbgs() << "SID: duplicated " << candidates.size()
+                    << " instructions in " << slices.size() << " slices with "
+                    << numChecks << " checks\n");
+
+            return !candidates.empty();
+        }
+
         bool shouldInjectFault(int64_t number) {
 
 		    if (injectInAllOperators) return true;
@@ -486,10 +695,14 @@ namespace llfi{
             // Parse input options.
             if (!isInitialized) {
                 isInitialized = true;
-                initializeGranularityAndLayerName(llfiIndex, layerName, enableChainDuplication);
+                initializeGranularityAndLayerName(llfiIndex, layerName,
+                    enableChainDuplication, enableSliceDuplication);
             }
 
-            if (isChainDuplication){
+            if (isSliceDuplication){
+                return doArithmeticSliceDuplication(F);
+            }
+            else if (isChainDuplication){
                 return doArithmeticChainDuplication(F);
             }
             else {
@@ -0,0 +1,328 @@
+#define DEBUG_TYPE "RangeRestrictionPass"
+
+#include "llvm/Pass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+using namespace llvm;
+using namespace std;
+
+// Range restriction for ML applications.
+//
+// The pass works on the operators of main_graph delimited by the
+// OMInstrumentPoint calls, like the InstructionDuplicationPass. Every
+// floating-point value stored by a selected operator is considered an output
+// of that operator. In profile mode, each stored value is reported to the
+// profiling runtime (lltfiRangeProfile in ProfilingLib.cpp), which learns the
+// [min, max] range of every operator over the golden runs and writes it to
+// llfi.stat.range.txt. In restrict mode, the learned ranges are read back and
+// every stored value is clamped into the range of its operator with the
+// minnum/maxnum intrinsics, which keeps the loops vectorizable. A NaN is
+// clamped to the lower bound.
+namespace RR {
+
+    static cl::opt< string > rrMode("rrMode", cl::desc("Mode of the range \
+        restriction pass: profile (learn the ranges from golden runs) or \
+        restrict (clamp the operator outputs). Default: restrict"),
+        cl::init("restrict"));
+
+    static cl::opt< string > rrOperatorName("rrOperatorName", cl::desc("Name \
+        of operator(s) to protect. Semi-colon seperated values. \
+        Example: conv;relu;matmul;maxpool;all"), cl::init("all"));
+
+    static cl::opt< string > rrBoundsFile("rrBoundsFile", cl::desc("Ranges \
+        learned in profile mode. Default: llfi.stat.range.txt"),
+        cl::init("llfi.stat.range.txt"));
+
+    static cl::opt< double > rrMargin("rrMargin", cl::desc("Fraction of the \
+        learned range added below the minimum and above the maximum before \
+        clamping. Default: 0.1"), cl::init(0.1));
+
+    // Return an array our of string of semi-colon seperated values.
+    static vector<string> getSemiColonSeperateVals(string inp) {
+
+        vector<string> retval;
+        stringstream ss(inp);
+        string token;
+
+        while (getline(ss, token, ';'))
+            retval.push_back(token);
+
+        return retval;
+    }
+
+    // Get unique Id corresponding to the ONNX operator.
+    static int64_t getOperatorNumber(string name) {
+
+        transform(name.begin(), name.end(), name.begin(),
+                        [](unsigned char c){ return tolower(c); });
+
+        // ONNX assigns unique IDs to each tensor operator.
+        map<string, int64_t> ONNXOperatorId = {
+            {"conv", 1986948931},
+            {"relu", 1970038098},
+            {"maxpool", 30521821366870349},
+            {"matmul", 119251066446157},
+            {"add", 6579265},
+            {"avgpool", 30521821365761601},
+            {"softmax", 33884119937478483}
+        };
+
+        if (ONNXOperatorId.find(name) == ONNXOperatorId.end())
+            return -1;
+
+        return ONNXOperatorId[name];
+    }
+
+    struct OperatorRange {
+        double min;
+        double max;
+    };
+
+    // Read the ranges written by the profiling runtime. Each line has the
+    // form: range=<layer number>,<operator name>,<min>,<max>
+    static bool readRanges(string filename, map<int64_t, OperatorRange>& ranges) {
+
+        ifstream file(filename);
+        if (!file.is_open())
+            return false;
+
+        string line;
+        while (getline(file, line)) {
+            if (line.rfind("range=", 0) != 0)
+                continue;
+
+            stringstream ss(line.substr(6));
+            string layerNo, name, minVal, maxVal;
+            getline(ss, layerNo, ',');
+            getline(ss, name, ',');
+            getline(ss, minVal, ',');
+            getline(ss, maxVal, ',');
+
+            ranges[atoll(layerNo.c_str())] = {strtod(minVal.c_str(), NULL),
+                strtod(maxVal.c_str(), NULL)};
+        }
+
+        return true;
+    }
+}
+
+using namespace RR;
+
+namespace llfi {
+
+    class RangeRestrictionPass: public FunctionPass
+    {
+
+    private:
+        bool isInitialized;
+        bool isProfileMode;
+        vector<int64_t> operatorValues;
+        bool protectAllOperators;
+        map<int64_t, OperatorRange> ranges;
+
+        void initialize() {
+
+            if (rrMode == "profile") {
+                isProfileMode = true;
+            } else if (rrMode == "restrict") {
+                isProfileMode = false;
+            } else {
+                errs() << "ERROR: Invalid rrMode: " << rrMode << "\n";
+                exit(1);
+            }
+
+            for (string name : getSemiColonSeperateVals(rrOperatorName)) {
+
+                if (name.find("all") != string::npos) {
+                    protectAllOperators = true;
+                    break;
+                }
+
+                int64_t temp = getOperatorNumber(name);
+
+                if (temp == -1) {
+                    errs() << "ERROR: Invalid operator name: " << name << "\n";
+                    exit(1);
+                }
+
+                operatorValues.push_back(temp);
+            }
+
+            if (!isProfileMode && !readRanges(rrBoundsFile, ranges)) {
+                errs() << "ERROR: Unable to open the range file "
+                    << rrBoundsFile << "\n";
+                exit(1);
+            }
+        }
+
+        bool shouldProtect(int64_t number) {
+
+            if (protectAllOperators) return true;
+
+            return find(operatorValues.begin(), operatorValues.end(), number)
+                != operatorValues.end();
+        }
+
+        // Report the range of the stored value to the profiling runtime.
+        void insertRangeProfile(StoreInst* store, int64_t layerNo,
+                int64_t operatorId) {
+
+            Module* M = store->getModule();
+            LLVMContext& context = M->getContext();
+            Type* doubleTy = Type::getDoubleTy(context);
+            Type* int64Ty = Type::getInt64Ty(context);
+
+            FunctionCallee Fn = M->getOrInsertFunction("lltfiRangeProfile",
+                Type::getVoidTy(context), int64Ty, int64Ty, doubleTy, doubleTy);
+
+            IRBuilder<> IRB(store);
+            Value* val = store->getValueOperand();
+            Value* minVal = val;
+            Value* maxVal = val;
+
+            if (val->getType()->isVectorTy()) {
+                minVal = IRB.CreateFPMinReduce(val);
+                maxVal = IRB.CreateFPMaxReduce(val);
+            }
+
+            minVal = IRB.CreateFPCast(minVal, doubleTy);
+            maxVal = IRB.CreateFPCast(maxVal, doubleTy);
+
+            IRB.CreateCall(Fn, {ConstantInt::get(int64Ty, layerNo),
+                ConstantInt::get(int64Ty, operatorId), minVal, maxVal});
+        }
+
+        // Clamp the stored value into the learned range of its operator.
+        void insertRangeRestriction(StoreInst* store, OperatorRange& range) {
+
+            double margin = (range.max - range.min) * rrMargin;
+            Type* valTy = store->getValueOperand()->getType();
+
+            IRBuilder<> IRB(store);
+            Value* lower = ConstantFP::get(valTy, range.min - margin);
+            Value* upper = ConstantFP::get(valTy, range.max + margin);
+
+            Value* clamped = IRB.CreateMaxNum(store->getValueOperand(), lower);
+            clamped = IRB.CreateMinNum(clamped, upper);
+
+            store->setOperand(0, clamped);
+        }
+
+    public:
+
+        static char ID;
+
+        RangeRestrictionPass():FunctionPass(ID)
+        {
+            isInitialized = false;
+            isProfileMode = false;
+            protectAllOperators = false;
+        }
+
+        bool runOnMainGraph(Function& F)
+        {
+            // Parse input options.
+            if (!isInitialized) {
+                isInitialized = true;
+                initialize();
+            }
+
+            // Operators are numbered in the order of their start markers,
+            // which is the layer numbering of the profiling runtime.
+            vector<pair<StoreInst*, pair<int64_t, int64_t>>> outputs;
+            int64_t layerNo = 0;
+            int64_t currOperator = -1;
+
+            for (BasicBlock &bb : F) {
+                for (Instruction &I : bb) {
+
+                    if (CallInst* callinst = dyn_cast<CallInst>(&I)) {
+                        Function* callee = callinst->getCalledFunction();
+
+                        // If this is OMInstrument function? The second
+                        // argument is 1 before an operator and 2 after it.
+                        if (callee && callee->getName() == "OMInstrumentPoint") {
+
+                            ConstantInt* ci1 = dyn_cast<ConstantInt>(
+                                                callinst->getArgOperand(0));
+                            ConstantInt* ci2 = dyn_cast<ConstantInt>(
+                                                callinst->getArgOperand(1));
+
+                            if (ci2->getSExtValue() == 1) {
+                                layerNo++;
+                                currOperator = ci1->getSExtValue();
+                            } else {
+                                currOperator = -1;
+                            }
+                        }
+                        continue;
+                    }
+
+                    StoreInst* store = dyn_cast<StoreInst>(&I);
+                    if (store && currOperator != -1 &&
+                            shouldProtect(currOperator) &&
+                            store->getValueOperand()->getType()->isFPOrFPVectorTy())
+                        outputs.push_back({store, {layerNo, currOperator}});
+                }
+            }
+
+            unsigned numProtected = 0;
+            for (auto &output : outputs) {
+
+                StoreInst* store = output.first;
+                int64_t outputLayerNo = output.second.first;
+
+                if (isProfileMode) {
+                    insertRangeProfile(store, outputLayerNo, output.second.second);
+                    numProtected++;
+                    continue;
+                }
+
+                auto range = ranges.find(outputLayerNo);
+                if (range == ranges.end())
+                    continue;
+
+                insertRangeRestriction(store, range->second);
+                numProtected++;
+            }
+
+            if (!isProfileMode && numProtected < outputs.size())
+                errs() << "WARNING: No learned range for "
+                    << outputs.size() - numProtected << " of "
+                    << outputs.size() << " operator outputs; they are not "
+                    << "protected\n";
+
+            return numProtected != 0;
+        }
+
+        virtual bool runOnFunction(Function &F)
+        {
+
+            if (F.getName() == "main_graph") {
+                return runOnMainGraph(F);
+            }
+
+            return false;
+        }
+    };
+
+    char RangeRestrictionPass::ID = 0;
+
+    static RegisterPass<RangeRestrictionPass>
+        X("RangeRestrictionPass", "Range restriction of ML operator outputs",
+            false, false);
+}
@@ -0,0 +1,220 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <map>
+#include <vector>
+
+// Checksums of the contraction nests protected by the ABFTPass.
+//
+// A nest is described by one entry per loop, outermost first: its trip count
+// and the stride (in elements) of A, B and C along it. A loop is an i-loop if
+// it indexes A and C, a j-loop if it indexes B and C, and an r-loop
+// (reduction) if it indexes A and B. The nest computes
+//
+//   C[i, j] = init[i, j] + sum_r A[i, r] * B[j, r]
+//
+// over the tuples i, j and r of i-, j- and r-loop indices, so that
+//
+//   sum_i C[i, j] - sum_i init[i, j] = sum_r (sum_i A[i, r]) * B[j, r]
+//   sum_j C[i, j] - sum_j init[i, j] = sum_r A[i, r] * (sum_j B[j, r])
+//
+// Both sides are computed in O(|I||R| + |J||R| + |I||J|).
+
+namespace {
+
+enum { INIT_CONSTANT = 1, INIT_SNAPSHOT = 2 };
+
+struct Checksums {
+  std::vector<double> rows;
+  std::vector<double> cols;
+};
+
+static std::map<int64_t, Checksums> snapshots;
+
+// Offsets of all the index tuples of the loops whose stride in 'select' is
+// non-zero, in the tensor whose strides are 'stride'.
+static std::vector<int64_t> tupleOffsets(int64_t numLoops, const int64_t *trips,
+                                         const int64_t *select,
+                                         const int64_t *stride) {
+  std::vector<int64_t> offsets(1, 0);
+  for (int64_t l = 0; l < numLoops; l++) {
+    if (select[l] == 0)
+      continue;
+    std::vector<int64_t> next;
+    next.reserve(offsets.size() * trips[l]);
+    for (int64_t base : offsets)
+      for (int64_t t = 0; t < trips[l]; t++)
+        next.push_back(base + t * stride[l]);
+    offsets.swap(next);
+  }
+  return offsets;
+}
+
+// Loops indexing C but not the tensor 'other' (A for the j-loops, B for the
+// i-loops).
+static std::vector<int64_t> outputLoops(int64_t numLoops, const int64_t *strideC,
+                                        const int64_t *strideOther) {
+  std::vector<int64_t> select(numLoops, 0);
+  for (int64_t l = 0; l < numLoops; l++)
+    select[l] = strideC[l] != 0 && strideOther[l] == 0;
+  return select;
+}
+
+static void sumC(const float *C, const std::vector<int64_t> &rowC,
+                 const std::vector<int64_t> &colC, Checksums &sums) {
+  sums.rows.assign(rowC.size(), 0.0);
+  sums.cols.assign(colC.size(), 0.0);
+  for (size_t i = 0; i < rowC.size(); i++)
+    for (size_t j = 0; j < colC.size(); j++) {
+      double v = C[rowC[i] + colC[j]];
+      sums.rows[i] += v;
+      sums.cols[j] += v;
+    }
+}
+
+static void getOperatorName(int64_t opId, char *name) {
+  memcpy(name, &opId, sizeof(opId));
+  name[sizeof(opId)] = '\0';
+}
+
+} // namespace
+
+extern "C" {
+
+// Record the checksums of C before a nest that accumulates into it.
+void lltfiABFTSnapshot(int64_t site, float *C, int64_t numLoops,
+                       const int64_t *trips, const int64_t *strideA,
+                       const int64_t *strideB, const int64_t *strideC) {
+  std::vector<int64_t> iSelect = outputLoops(numLoops, strideC, strideB);
+  std::vector<int64_t> jSelect = outputLoops(numLoops, strideC, strideA);
+  std::vector<int64_t> rowC = tupleOffsets(numLoops, trips, &iSelect[0], strideC);
+  std::vector<int64_t> colC = tupleOffsets(numLoops, trips, &jSelect[0], strideC);
+
+  sumC(C, rowC, colC, snapshots[site]);
+}
+
+void lltfiABFTCheck(int64_t site, int64_t opId, float *A, float *B, float *C,
+                    int64_t numLoops, const int64_t *trips,
+                    const int64_t *strideA, const int64_t *strideB,
+                    const int64_t *strideC, int32_t initKind, float initValue,
+                    int32_t correct, double tolerance) {
+  std::vector<int64_t> iSelect = outputLoops(numLoops, strideC, strideB);
+  std::vector<int64_t> jSelect = outputLoops(numLoops, strideC, strideA);
+  std::vector<int64_t> rSelect(numLoops, 0);
+  for (int64_t l = 0; l < numLoops; l++)
+    rSelect[l] = strideC[l] == 0;
+
+  std::vector<int64_t> rowA = tupleOffsets(numLoops, trips, &iSelect[0], strideA);
+  std::vector<int64_t> rowC = tupleOffsets(numLoops, trips, &iSelect[0], strideC);
+  std::vector<int64_t> colB = tupleOffsets(numLoops, trips, &jSelect[0], strideB);
+  std::vector<int64_t> colC = tupleOffsets(numLoops, trips, &jSelect[0], strideC);
+  std::vector<int64_t> redA = tupleOffsets(numLoops, trips, &rSelect[0], strideA);
+  std::vector<int64_t> redB = tupleOffsets(numLoops, trips, &rSelect[0], strideB);
+
+  // Column and row sums of A and B along the output dimensions.
+  std::vector<double> sumA(redA.size(), 0.0), absSumA(redA.size(), 0.0);
+  std::vector<double> sumB(redB.size(), 0.0), absSumB(redB.size(), 0.0);
+  for (size_t r = 0; r < redA.size(); r++) {
+    for (size_t i = 0; i < rowA.size(); i++) {
+      double v = A[rowA[i] + redA[r]];
+      sumA[r] += v;
+      absSumA[r] += fabs(v);
+    }
+    for (size_t j = 0; j < colB.size(); j++) {
+      double v = B[colB[j] + redB[r]];
+      sumB[r] += v;
+      absSumB[r] += fabs(v);
+    }
+  }
+
+  // Predicted checksums, and their magnitude for the tolerance.
+  std::vector<double> expectedCols(colB.size(), 0.0), magCols(colB.size(), 0.0);
+  for (size_t j = 0; j < colB.size(); j++)
+    for (size_t r = 0; r < redB.size(); r++) {
+      double v = B[colB[j] + redB[r]];
+      expectedCols[j] += sumA[r] * v;
+      magCols[j] += absSumA[r] * fabs(v);
+    }
+
+  std::vector<double> expectedRows(rowA.size(), 0.0), magRows(rowA.size(), 0.0);
+  for (size_t i = 0; i < rowA.size(); i++)
+    for (size_t r = 0; r < redA.size(); r++) {
+      double v = A[rowA[i] + redA[r]];
+      expectedRows[i] += v * sumB[r];
+      magRows[i] += fabs(v) * absSumB[r];
+    }
+
+  // Add the initial content of C.
+  if (initKind == INIT_CONSTANT) {
+    for (size_t j = 0; j < colC.size(); j++) {
+      expectedCols[j] += (double)initValue * rowC.size();
+      magCols[j] += fabs((double)initValue) * rowC.size();
+    }
+    for (size_t i = 0; i < rowC.size(); i++) {
+      expectedRows[i] += (double)initValue * colC.size();
+      magRows[i] += fabs((double)initValue) * colC.size();
+    }
+  } else if (initKind == INIT_SNAPSHOT) {
+    std::map<int64_t, Checksums>::iterator snapshot = snapshots.find(site);
+    if (snapshot == snapshots.end())
+      return;
+    Checksums &before = snapshot->second;
+    for (size_t j = 0; j < colC.size(); j++) {
+      expectedCols[j] += before.cols[j];
+      magCols[j] += fabs(before.cols[j]);
+    }
+    for (size_t i = 0; i < rowC.size(); i++) {
+      expectedRows[i] += before.rows[i];
+      magRows[i] += fabs(before.rows[i]);
+    }
+    snapshots.erase(snapshot);
+  }
+
+  Checksums actual;
+  sumC(C, rowC, colC, actual);
+
+  // Mismatching rows and columns.
+  std::vector<size_t> badRows, badCols;
+  for (size_t i = 0; i < rowC.size(); i++) {
+    double diff = actual.rows[i] - expectedRows[i];
+    if (!(fabs(diff) <= tolerance * magRows[i] + 1e-30))
+      badRows.push_back(i);
+  }
+  for (size_t j = 0; j < colC.size(); j++) {
+    double diff = actual.cols[j] - expectedCols[j];
+    if (!(fabs(diff) <= tolerance * magCols[j] + 1e-30))
+      badCols.push_back(j);
+  }
+
+  if (badRows.empty() && badCols.empty())
+    return;
+
+  // A single corrupted element is at the intersection of the mismatching
+  // row and column. Restore it from the column checksum.
+  int corrected = 0;
+  if (correct && badRows.size() == 1 && badCols.size() == 1) {
+    size_t i = badRows[0], j = badCols[0];
+    float *elem = &C[rowC[i] + colC[j]];
+    double others = actual.cols[j] - *elem;
+    *elem = (float)(expectedCols[j] - others);
+    corrected = 1;
+  }
+
+  char name[sizeof(opId) + 1];
+  getOperatorName(opId, name);
+
+  FILE *abftFile = fopen("llfi.stat.abft.txt", "a");
+  if (abftFile == NULL) {
+    fprintf(stderr, "ERROR: Unable to open ABFT result file llfi.stat.abft.txt\n");
+    return;
+  }
+  fprintf(abftFile,
+          "ABFT: site=%lld, operator=%s, mismatched_rows=%zu, "
+          "mismatched_cols=%zu, corrected=%d\n",
+          (long long)site, name, badRows.size(), badCols.size(), corrected);
+  fclose(abftFile);
+}
+
+} // extern "C"
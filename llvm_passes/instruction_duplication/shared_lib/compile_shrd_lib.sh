@@ -1,3 +1,4 @@
 #!/bin/sh
 
 clang++ -S -fno-inline -fPIC -emit-llvm SIDHelperFunctions.cpp -o SIDHelperFunctions.ll -O3
+clang++ -S -fPIC -emit-llvm ABFTHelperFunctions.cpp -o ABFTHelperFunctions.ll -O3
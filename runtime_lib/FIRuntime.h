@@ -0,0 +1,594 @@
+#ifndef LLFI_LIB_FI_RUNTIME_H
+#define LLFI_LIB_FI_RUNTIME_H
+
+// Fault injection runtime, specialized at compile time. An FIRuntime is
+// assembled from four policies:
+//
+//   Trigger       selects the dynamic instruction and the register to inject:
+//                 CycleTrigger (cycles weighted by the opcodes, see
+//                 Instruction.def), CountTrigger (one cycle per call of
+//                 preFunc), IndexTrigger (every dynamic instance of
+//                 fi_index) or InstanceTrigger (the fi_instance-th dynamic
+//                 instance of fi_index, as planned by bin/fiplanner.py)
+//   Multiplicity  how many of the configured cycles are injected:
+//                 SingleFault or MultipleFaults
+//   FaultModel    corrupts the target: RegistryFault (the fault injectors of
+//                 FaultInjectorManager, one or more bits) or BitFlipFault
+//   Sink          records the injected faults: StatSink or MLStatSink
+//
+// preFunc and injectFunc of an FIRuntime only contain the checks of its
+// policies. The state of the runtime has internal linkage: each library
+// includes this header in one translation unit, and picks its
+// instantiations there.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Utils.h"
+
+#ifndef OPTION_LENGTH
+#define OPTION_LENGTH 512
+#endif
+
+namespace llfi {
+
+// Runtime configuration, read from llfi.config.runtime.txt.
+struct FIConfig {
+  char fi_type[OPTION_LENGTH];
+  // cycles to inject at, in increasing order: fi_cycle, fi_second_cycle and
+  // the fi_next_cycle options. Empty to inject at fi_index.
+  std::vector<long long> fi_cycles;
+  long fi_index;
+  // dynamic instance of fi_index to inject, counted from 1 over all the
+  // threads, 0 for every instance
+  long long fi_instance;
+
+  // NOTE: the following config are randomly generated if not specified
+  // in practice, use the following two configs only when you want to
+  // reproduce a previous fault injection experiment
+  int fi_reg_index;
+  int fi_bit;
+  int fi_num_bits;
+  // at most this number of fi_cycles are injected, 0 for all of them
+  int fi_max_multiple;
+
+  // For emitting FI stats for a particular layer of ML applications.
+  int fi_ml_layer_num;
+  char fi_ml_layer_name[100];
+
+  // thread whose cycles fi_cycles count, -1 for the first thread that
+  // reaches them
+  int fi_thread;
+
+  bool virtual_time;
+  // checkpoints in a row that match the golden process after the fault for
+  // the run to end as masked, 0 without a golden process (see Lockstep.h)
+  int lockstep;
+  // one call of each hook in runtime_stats is timed, 0 without runtime
+  // statistics (see RuntimeStats.h)
+  long long runtime_stats;
+
+  FIConfig() : fi_index(-1), fi_instance(0), fi_reg_index(-1), fi_bit(-1), fi_num_bits(1),
+               fi_max_multiple(0), fi_ml_layer_num(-1), fi_thread(-1),
+               virtual_time(false), lockstep(0), runtime_stats(0) {
+    strncpy(fi_type, "bitflip", OPTION_LENGTH);
+    fi_ml_layer_name[0] = '\0';
+  }
+};
+
+static FIConfig fi_config;
+
+static FILE *injectedfaultsFile = NULL;
+
+// Cleared by turnOffInjections() and postInjections().
+static bool fi_enabled = true;
+
+static void _stripNewline(char *str) {
+  size_t len = strlen(str);
+  if (len > 0 && str[len - 1] == '\n')
+    str[len - 1] = '\0';
+}
+
+static void parseFIConfigFile() {
+  const char *ficonfigfilename = "llfi.config.runtime.txt";
+  FILE *ficonfigFile = fopen(ficonfigfilename, "r");
+  if (ficonfigFile == NULL) {
+    fprintf(stderr, "ERROR: Unable to open llfi config file %s\n",
+            ficonfigfilename);
+    exit(1);
+  }
+
+  const unsigned CONFIG_LINE_LENGTH = 1024;
+  char line[CONFIG_LINE_LENGTH];
+  char option[OPTION_LENGTH];
+  char *value = NULL;
+  while (fgets(line, CONFIG_LINE_LENGTH, ficonfigFile) != NULL) {
+    if (line[0] == '#')
+      continue;
+
+    value = strtok(line, "=");
+    strncpy(option, value, OPTION_LENGTH - 1);
+    option[OPTION_LENGTH - 1] = '\0';
+    value = strtok(NULL, "=");
+
+    if (strcmp(option, "fi_type") == 0) {
+      strncpy(fi_config.fi_type, value, OPTION_LENGTH - 1);
+      fi_config.fi_type[OPTION_LENGTH - 1] = '\0';
+      _stripNewline(fi_config.fi_type);
+    } else if (strcmp(option, "fi_cycle") == 0 ||
+               strcmp(option, "fi_second_cycle") == 0 ||
+               strcmp(option, "fi_next_cycle") == 0) {
+      assert(atoll(value) > 0 && "invalid fi_cycle in config file");
+      fi_config.fi_cycles.push_back(atoll(value));
+    } else if (strcmp(option, "fi_index") == 0) {
+      fi_config.fi_index = atol(value);
+      assert(fi_config.fi_index >= 0 && "invalid fi_index in config file");
+    } else if (strcmp(option, "fi_instance") == 0) {
+      fi_config.fi_instance = atoll(value);
+      assert(fi_config.fi_instance > 0 && "invalid fi_instance in config file");
+    } else if (strcmp(option, "fi_reg_index") == 0) {
+      fi_config.fi_reg_index = atoi(value);
+      assert(fi_config.fi_reg_index >= 0 &&
+             "invalid fi_reg_index in config file");
+    } else if (strcmp(option, "fi_bit") == 0) {
+      fi_config.fi_bit = atoi(value);
+      assert(fi_config.fi_bit >= 0 && "invalid fi_bit in config file");
+    } else if (strcmp(option, "fi_num_bits") == 0) {
+      fi_config.fi_num_bits = atoi(value);
+      assert(fi_config.fi_num_bits >= 1 && "invalid fi_num_bits in config file");
+    } else if (strcmp(option, "fi_max_multiple") == 0) {
+      fi_config.fi_max_multiple = atoi(value);
+      assert(fi_config.fi_max_multiple > 0 &&
+             "invalid fi_max_multiple in config file");
+    } else if (strcmp(option, "ml_layer_name") == 0) {
+      strncpy(fi_config.fi_ml_layer_name, value,
+              sizeof(fi_config.fi_ml_layer_name) - 1);
+      fi_config.fi_ml_layer_name[sizeof(fi_config.fi_ml_layer_name) - 1] = '\0';
+      _stripNewline(fi_config.fi_ml_layer_name);
+    } else if (strcmp(option, "ml_layer_number") == 0) {
+      fi_config.fi_ml_layer_num = atoi(value);
+      assert(fi_config.fi_ml_layer_num > 0 &&
+             "ml_layer_number should be grater than 0");
+    } else if (strcmp(option, "fi_thread") == 0) {
+      fi_config.fi_thread = atoi(value);
+      assert(fi_config.fi_thread >= 0 && "invalid fi_thread in config file");
+    } else if (strcmp(option, "virtual_time") == 0) {
+      fi_config.virtual_time = atoi(value) != 0;
+    } else if (strcmp(option, "lockstep") == 0) {
+      fi_config.lockstep = atoi(value);
+      assert(fi_config.lockstep >= 0 && "invalid lockstep in config file");
+    } else if (strcmp(option, "runtime_stats") == 0) {
+      fi_config.runtime_stats = atoll(value);
+      assert(fi_config.runtime_stats >= 0 &&
+             "invalid runtime_stats in config file");
+    } else {
+      fprintf(stderr,
+              "ERROR: Unknown option %s for LLFI runtime fault injection\n",
+              option);
+      exit(1);
+    }
+  }
+  fclose(ficonfigFile);
+
+  std::sort(fi_config.fi_cycles.begin(), fi_config.fi_cycles.end());
+}
+
+static void openInjectedFaultsFile() {
+  const char *injectedfaultsfilename = "llfi.stat.fi.injectedfaults.txt";
+  injectedfaultsFile = fopen(injectedfaultsfilename, "a");
+  if (injectedfaultsFile == NULL) {
+    fprintf(stderr, "ERROR: Unable to open injected faults stat file %s\n",
+            injectedfaultsfilename);
+    exit(1);
+  }
+}
+
+/**
+ * Multiplicity
+ */
+
+// Index in fi_config.fi_cycles of the next fault to inject. Threads claim
+// the faults with a compare-and-swap, so that each one is injected once.
+static int fi_cycle_cursor = 0;
+static int fi_cycle_limit = 0;
+// Cycle of the fault being injected by the current thread, -1 for fi_index.
+static __thread long long fi_fault_cycle = -1;
+
+static void initFICycles() {
+  fi_cycle_limit = fi_config.fi_cycles.size();
+  if (fi_config.fi_max_multiple > 0)
+    fi_cycle_limit = std::min(fi_cycle_limit, fi_config.fi_max_multiple);
+}
+
+struct SingleFault {
+  // -1 once the fault is injected
+  static int next() {
+    return __atomic_load_n(&fi_cycle_cursor, __ATOMIC_RELAXED) == 0 ? 0 : -1;
+  }
+  static bool claim(int) {
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&fi_cycle_cursor, &expected, 1, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      return false;
+    fi_fault_cycle = fi_config.fi_cycles[0];
+    return true;
+  }
+  static void skip(int) {
+    int expected = 0;
+    __atomic_compare_exchange_n(&fi_cycle_cursor, &expected, 1, false,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+  }
+};
+
+struct MultipleFaults {
+  // -1 once all the faults are injected
+  static int next() {
+    int index = __atomic_load_n(&fi_cycle_cursor, __ATOMIC_RELAXED);
+    return index < fi_cycle_limit ? index : -1;
+  }
+  static bool claim(int index) {
+    if (!__atomic_compare_exchange_n(&fi_cycle_cursor, &index, index + 1,
+                                     false, __ATOMIC_RELAXED,
+                                     __ATOMIC_RELAXED))
+      return false;
+    fi_fault_cycle = fi_config.fi_cycles[index];
+    return true;
+  }
+  static void skip(int index) {
+    __atomic_compare_exchange_n(&fi_cycle_cursor, &index, index + 1, false,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+  }
+};
+
+/**
+ * Trigger
+ */
+
+static inline bool isFIThread() {
+  return fi_config.fi_thread < 0 || fi_config.fi_thread == getLLFIThreadId();
+}
+
+// each register target of the instruction get equal probability of getting
+// selected. the idea comes from equal probability of drawing lots
+static inline bool selectReg(unsigned my_reg_index,
+                             unsigned total_reg_target_num) {
+  // NOTE: if fi_reg_index specified, use it, otherwise, randomly generate
+  if (fi_config.fi_reg_index >= 0)
+    return my_reg_index == (unsigned)fi_config.fi_reg_index;
+  return getLLFIRandom() <= 1.0 / (total_reg_target_num - my_reg_index);
+}
+
+// Index of the next cycle to inject, -1 if there is none. The cycles that
+// the thread has passed without injecting them, like a second cycle in the
+// same dynamic instruction, are skipped so that the following ones are
+// still injected.
+template <class Multiplicity>
+static inline int nextFICycle(long long curr) {
+  int index = Multiplicity::next();
+  while (index >= 0 && fi_config.fi_cycles[index] < curr && isFIThread()) {
+    Multiplicity::skip(index);
+    index = Multiplicity::next();
+  }
+  return index;
+}
+
+static int opcodecyclearray[OPCODE_CYCLE_ARRAY_LEN];
+static __thread long long curr_cycle = 1;
+static __thread bool is_fault_injected_in_curr_dyn_inst = false;
+
+// fi_cycles count the cycles of the opcodes in Instruction.def.
+struct CycleTrigger {
+  template <class Multiplicity>
+  static bool select(long, unsigned opcode, unsigned my_reg_index,
+                     unsigned total_reg_target_num) {
+    int opcodecycles = opcodecyclearray[opcode];
+    if (opcodecycles < 0)
+      return false;
+    if (my_reg_index == 0)
+      is_fault_injected_in_curr_dyn_inst = false;
+
+    bool reg_selected = false;
+    int index = nextFICycle<Multiplicity>(curr_cycle);
+    if (index >= 0 && !is_fault_injected_in_curr_dyn_inst) {
+      long long fi_cycle = fi_config.fi_cycles[index];
+      if (fi_cycle >= curr_cycle && fi_cycle < curr_cycle + opcodecycles &&
+          isFIThread() && selectReg(my_reg_index, total_reg_target_num) &&
+          Multiplicity::claim(index)) {
+        is_fault_injected_in_curr_dyn_inst = true;
+        reg_selected = true;
+      }
+    }
+
+    if (my_reg_index == total_reg_target_num - 1)
+      curr_cycle += opcodecycles;
+    return reg_selected;
+  }
+};
+
+// fi_cycles count the calls of preFunc, as profiled for ML applications.
+static __thread long long curr_count = 0;
+
+struct CountTrigger {
+  template <class Multiplicity>
+  static bool select(long, unsigned, unsigned, unsigned) {
+    curr_count++;
+    int index = nextFICycle<Multiplicity>(curr_count);
+    return index >= 0 && curr_count == fi_config.fi_cycles[index] &&
+           isFIThread() && Multiplicity::claim(index);
+  }
+};
+
+// inject into every runtime instance of the instruction fi_index
+struct IndexTrigger {
+  template <class Multiplicity>
+  static bool select(long llfi_index, unsigned opcode, unsigned my_reg_index,
+                     unsigned total_reg_target_num) {
+    if (opcodecyclearray[opcode] < 0)
+      return false;
+    if (my_reg_index == 0)
+      is_fault_injected_in_curr_dyn_inst = false;
+
+    if (llfi_index != fi_config.fi_index || is_fault_injected_in_curr_dyn_inst ||
+        !selectReg(my_reg_index, total_reg_target_num))
+      return false;
+    is_fault_injected_in_curr_dyn_inst = true;
+    return true;
+  }
+};
+
+// inject into the fi_instance-th runtime instance of the instruction
+// fi_index. The instances are counted over all the threads, like the site
+// counts of profiling.
+static long long fi_index_instances = 0;
+static __thread bool is_fi_instance = false;
+
+struct InstanceTrigger {
+  template <class Multiplicity>
+  static bool select(long llfi_index, unsigned opcode, unsigned my_reg_index,
+                     unsigned total_reg_target_num) {
+    if (llfi_index != fi_config.fi_index || opcodecyclearray[opcode] < 0)
+      return false;
+    if (my_reg_index == 0) {
+      is_fault_injected_in_curr_dyn_inst = false;
+      is_fi_instance = __atomic_add_fetch(&fi_index_instances, 1,
+          __ATOMIC_RELAXED) == fi_config.fi_instance;
+    }
+
+    if (!is_fi_instance || is_fault_injected_in_curr_dyn_inst ||
+        !selectReg(my_reg_index, total_reg_target_num))
+      return false;
+    is_fault_injected_in_curr_dyn_inst = true;
+    return true;
+  }
+};
+
+/**
+ * Sink
+ */
+
+struct FaultRecord {
+  const char *fi_type;
+  long llfi_index;
+  long long fi_cycle;
+  unsigned my_reg_index;
+  unsigned reg_pos;
+  unsigned size;
+  unsigned fi_bit;
+  const char *opcode_str;
+  // set by BitFlipFault, which records the target after the fault
+  uint32_t oldHex, newHex;
+  float oldFloat, newFloat;
+};
+
+struct StatSink {
+  static void record(const FaultRecord &r) {
+    // For ML applications emit the layer name and number in which fault is
+    // injected.
+    if (fi_config.fi_ml_layer_num > 0)
+      fprintf(injectedfaultsFile,
+          "FI stat: fi_type=%s, fi_max_multiple=%d, fi_index=%ld, fi_cycle=%lld, fi_reg_index=%u, "
+          "fi_reg_pos=%u, fi_reg_width=%u, fi_bit=%u, opcode=%s, ml_layer_name=%s, ml_layer_num=%d\n",
+          r.fi_type, fi_config.fi_max_multiple ? fi_config.fi_max_multiple : -1,
+          r.llfi_index, r.fi_cycle, r.my_reg_index, r.reg_pos, r.size,
+          r.fi_bit, r.opcode_str, fi_config.fi_ml_layer_name,
+          fi_config.fi_ml_layer_num);
+    else
+      fprintf(injectedfaultsFile,
+          "FI stat: fi_type=%s, fi_max_multiple=%d, fi_index=%ld, fi_cycle=%lld, fi_reg_index=%u, "
+          "fi_reg_pos=%u, fi_reg_width=%u, fi_bit=%u, opcode=%s\n",
+          r.fi_type, fi_config.fi_max_multiple ? fi_config.fi_max_multiple : -1,
+          r.llfi_index, r.fi_cycle, r.my_reg_index, r.reg_pos, r.size,
+          r.fi_bit, r.opcode_str);
+    fflush(injectedfaultsFile);
+  }
+};
+
+// Also records the target before and after the fault, as a float.
+struct MLStatSink {
+  static void record(const FaultRecord &r) {
+    if (fi_config.fi_ml_layer_num > 0)
+      fprintf(injectedfaultsFile,
+          "FI stat: fi_type=%s, fi_max_multiple=%d, fi_index=%ld, "
+          "fi_cycle=%lld, fi_reg_index=%u, fi_reg_pos=%u, fi_reg_width=%u, "
+          "fi_bit=%u, opcode=%s, oldHex=0x%x, newHex=0x%x, oldFloat=%f, "
+          " newFloat=%f, ml_layer_name=%s, ml_layer_number=%d\n",
+          r.fi_type, fi_config.fi_max_multiple, r.llfi_index, r.fi_cycle,
+          r.my_reg_index, r.reg_pos, r.size, r.fi_bit, r.opcode_str,
+          r.oldHex, r.newHex, r.oldFloat, r.newFloat,
+          fi_config.fi_ml_layer_name, fi_config.fi_ml_layer_num);
+    else
+      fprintf(injectedfaultsFile,
+          "FI stat: fi_type=%s, fi_max_multiple=%d, fi_index=%ld, "
+          "fi_cycle=%lld, fi_reg_index=%u, fi_reg_pos=%u, fi_reg_width=%u, "
+          "fi_bit=%u, opcode=%s, oldHex=0x%x, newHex=0x%x, oldFloat=%f, "
+          " newFloat=%f\n",
+          r.fi_type, fi_config.fi_max_multiple, r.llfi_index, r.fi_cycle,
+          r.my_reg_index, r.reg_pos, r.size, r.fi_bit, r.opcode_str,
+          r.oldHex, r.newHex, r.oldFloat, r.newFloat);
+    fflush(injectedfaultsFile);
+  }
+};
+
+/**
+ * FaultModel
+ */
+
+// Fault injector of each site of union instrumentation (-fisitetable), read
+// from llfi.config.sitetypes.txt, whose lines have the form
+// <llfi index>=<fi_type>. Sites without an entry use fi_config.fi_type.
+struct SiteType {
+  long llfi_index;
+  char *fi_type;
+};
+static struct SiteType *site_types = NULL;
+static int site_types_count = 0;
+
+static int _compareSiteTypes(const void *a, const void *b) {
+  long index_a = ((const struct SiteType*)a)->llfi_index;
+  long index_b = ((const struct SiteType*)b)->llfi_index;
+  return (index_a > index_b) - (index_a < index_b);
+}
+
+static inline void parseSiteTypesFile() {
+  FILE *sitetypesFile = fopen("llfi.config.sitetypes.txt", "r");
+  if (sitetypesFile == NULL)
+    return;
+
+  const unsigned CONFIG_LINE_LENGTH = 1024;
+  char line[CONFIG_LINE_LENGTH];
+  int capacity = 0;
+  while (fgets(line, CONFIG_LINE_LENGTH, sitetypesFile) != NULL) {
+    if (line[0] == '#')
+      continue;
+
+    char *index = strtok(line, "=");
+    char *type = strtok(NULL, "=\n");
+    if (index == NULL || type == NULL) {
+      fprintf(stderr, "ERROR: Invalid line in llfi.config.sitetypes.txt\n");
+      exit(1);
+    }
+
+    if (site_types_count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      site_types = (struct SiteType*) realloc(site_types,
+                                              capacity * sizeof(struct SiteType));
+      assert(site_types != NULL && "unable to allocate the site types");
+    }
+    site_types[site_types_count].llfi_index = atol(index);
+    site_types[site_types_count].fi_type = strdup(type);
+    site_types_count++;
+  }
+  fclose(sitetypesFile);
+
+  qsort(site_types, site_types_count, sizeof(struct SiteType),
+        _compareSiteTypes);
+}
+
+static const char *getSiteFaultType(long llfi_index) {
+  if (site_types_count == 0)
+    return fi_config.fi_type;
+
+  struct SiteType key = {llfi_index, NULL};
+  struct SiteType *site = (struct SiteType*) bsearch(&key, site_types,
+      site_types_count, sizeof(struct SiteType), _compareSiteTypes);
+  return site != NULL ? site->fi_type : fi_config.fi_type;
+}
+
+} // namespace llfi
+
+// the real implementation of the fault injection function, in
+// FaultInjectorManager.cpp
+extern "C" void injectFaultImpl(const char *fi_type, long llfi_index,
+                                unsigned size, unsigned fi_bit, char *buf);
+
+namespace llfi {
+
+// Injects fi_num_bits distinct bits with the fault injector of the site.
+// Each fault is recorded before it is injected, as it may end the program.
+struct RegistryFault {
+  template <class Sink>
+  static void inject(FaultRecord &r, char *buf) {
+    start_tracing_flag = TRACING_FI_RUN_FAULT_INSERTED; //Tell instTraceLib that we have injected a fault
+    llfi_trace_next = 0;
+    r.fi_type = getSiteFaultType(r.llfi_index);
+
+    std::vector<bool> score_board(r.size);
+    for (unsigned runs = 0; runs < (unsigned)fi_config.fi_num_bits &&
+         runs < r.size; runs++) {
+      // NOTE: if fi_bit specified, use it, otherwise, randomly generate
+      if (fi_config.fi_bit >= 0) {
+        r.fi_bit = fi_config.fi_bit;
+      } else {
+        do {
+          r.fi_bit = getLLFIRandom() * r.size;
+        } while (score_board[r.fi_bit]);
+        score_board[r.fi_bit] = true;
+      }
+      assert(r.fi_bit < r.size && "fi_bit larger than the target size");
+
+      Sink::record(r);
+      injectFaultImpl(r.fi_type, r.llfi_index, r.size, r.fi_bit, buf);
+    }
+  }
+};
+
+// Flips one random bit of the target.
+struct BitFlipFault {
+  template <class Sink>
+  static void inject(FaultRecord &r, char *buf) {
+    assert(strcmp(fi_config.fi_type, "bitflip") == 0 &&
+           "Not recognized fi_type");
+    r.fi_type = fi_config.fi_type;
+    r.fi_bit = getLLFIRandom() * r.size;
+
+    memcpy(&r.oldHex, buf, sizeof(r.oldHex));
+    memcpy(&r.oldFloat, buf, sizeof(r.oldFloat));
+    buf[r.fi_bit / 8] ^= 0x1 << (r.fi_bit % 8);
+    memcpy(&r.newHex, buf, sizeof(r.newHex));
+    memcpy(&r.newFloat, buf, sizeof(r.newFloat));
+
+    Sink::record(r);
+  }
+};
+
+/**
+ * Runtime
+ */
+
+template <class Trigger, class Multiplicity, class FaultModel, class Sink>
+struct FIRuntime {
+  static bool preFunc(long llfi_index, unsigned opcode, unsigned my_reg_index,
+                      unsigned total_reg_target_num) {
+    if (!__atomic_load_n(&fi_enabled, __ATOMIC_RELAXED))
+      return false;
+    return Trigger::template select<Multiplicity>(llfi_index, opcode,
+        my_reg_index, total_reg_target_num);
+  }
+
+  static void injectFunc(long llfi_index, unsigned size, char *buf,
+                         unsigned my_reg_index, unsigned reg_pos,
+                         char *opcode_str) {
+    fprintf(stderr, "MSG: injectFunc() has being called\n");
+    if (!__atomic_load_n(&fi_enabled, __ATOMIC_RELAXED))
+      return;
+
+    FaultRecord r = FaultRecord();
+    r.llfi_index = llfi_index;
+    r.fi_cycle = fi_fault_cycle;
+    r.my_reg_index = my_reg_index;
+    r.reg_pos = reg_pos;
+    r.size = size;
+    r.opcode_str = opcode_str;
+    FaultModel::template inject<Sink>(r, buf);
+  }
+};
+
+} // namespace llfi
+
+#endif
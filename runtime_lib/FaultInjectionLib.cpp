@@ -0,0 +1,156 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <assert.h>
+
+#include "FIRuntime.h"
+#include "Lockstep.h"
+#include "RuntimeStats.h"
+#include "Utils.h"
+#include "VirtualTime.h"
+
+using namespace llfi;
+
+// Runtimes of the injection modes of the config file. initInjections() picks
+// one, so that preFunc only checks what the mode needs.
+typedef FIRuntime<CycleTrigger, SingleFault, RegistryFault, StatSink>
+    CycleRuntime;
+// fi_second_cycle, or fi_next_cycle of fi_max_multiple
+typedef FIRuntime<CycleTrigger, MultipleFaults, RegistryFault, StatSink>
+    MultipleCycleRuntime;
+typedef FIRuntime<IndexTrigger, SingleFault, RegistryFault, StatSink>
+    IndexRuntime;
+typedef FIRuntime<InstanceTrigger, SingleFault, RegistryFault, StatSink>
+    InstanceRuntime;
+
+typedef bool (*PreFuncTy)(long llfi_index, unsigned opcode,
+                          unsigned my_reg_index, unsigned total_reg_target_num);
+typedef void (*InjectFuncTy)(long llfi_index, unsigned size, char *buf,
+                             unsigned my_reg_index, unsigned reg_pos,
+                             char *opcode_str);
+
+// No fault is injected before initInjections().
+static bool noPreFunc(long, unsigned, unsigned, unsigned) {
+  return false;
+}
+
+static PreFuncTy preFuncImpl = noPreFunc;
+static InjectFuncTy injectFuncImpl = NULL;
+
+template <class Runtime> static void useRuntime() {
+  preFuncImpl = Runtime::preFunc;
+  injectFuncImpl = Runtime::injectFunc;
+}
+
+// The runtime picked by initInjections(), wrapped by the hooks below with the
+// runtime_stats option.
+static PreFuncTy statsPreFuncImpl = noPreFunc;
+static InjectFuncTy statsInjectFuncImpl = NULL;
+
+static bool statsPreFunc(long llfi_index, unsigned opcode,
+                         unsigned my_reg_index, unsigned total_reg_target_num) {
+  uint64_t start = llfiHookBegin(LLFI_HOOK_PREFUNC);
+  bool selected = statsPreFuncImpl(llfi_index, opcode, my_reg_index,
+                                   total_reg_target_num);
+  llfiHookEnd(LLFI_HOOK_PREFUNC, llfi_index, start);
+  return selected;
+}
+
+static void statsInjectFunc(long llfi_index, unsigned size, char *buf,
+                            unsigned my_reg_index, unsigned reg_pos,
+                            char *opcode_str) {
+  // the fault may end the program
+  llfiRuntimeStatsInjected();
+  uint64_t start = llfiHookBegin(LLFI_HOOK_INJECTFUNC);
+  statsInjectFuncImpl(llfi_index, size, buf, my_reg_index, reg_pos,
+                      opcode_str);
+  llfiHookEnd(LLFI_HOOK_INJECTFUNC, llfi_index, start);
+}
+
+static void useRuntimeStats(long numSites) {
+  statsPreFuncImpl = preFuncImpl;
+  statsInjectFuncImpl = injectFuncImpl;
+  preFuncImpl = statsPreFunc;
+  injectFuncImpl = statsInjectFunc;
+  llfiStartRuntimeStats(fi_config.runtime_stats, numSites);
+}
+
+/**
+ * private functions
+ */
+static void _initRandomSeed() {
+  unsigned long long seed;
+	FILE* urandom = fopen("/dev/urandom", "r");
+	fread(&seed, sizeof(seed), 1, urandom);
+	fclose(urandom);
+	srand((unsigned int)seed);
+	seedLLFIRandom(seed);
+}
+
+/**
+ * external libraries
+ */
+extern "C" {
+
+void initInjections(long numSites) {
+  _initRandomSeed();
+  parseFIConfigFile();
+  loadSiteBitmap();
+  parseSiteTypesFile();
+  getOpcodeExecCycleArray(OPCODE_CYCLE_ARRAY_LEN, opcodecyclearray);
+  initFICycles();
+  if (fi_config.virtual_time)
+    llfiEnableVirtualSleep();
+
+  // the golden process allocates the same memory as the faulty process
+  // before the program starts, as the lockstep hashes the pointers
+  openInjectedFaultsFile();
+
+  if (fi_config.lockstep > 0 && llfiStartLockstep(fi_config.lockstep)) {
+    // the golden process injects no fault, and does not trace
+    start_tracing_flag = TRACING_FI_RUN_END_TRACING;
+    stopTracing();
+    return;
+  }
+
+  // if both fi_cycle and fi_index are specified, use fi_cycle
+  if (fi_config.fi_cycles.empty() && fi_config.fi_instance > 0)
+    useRuntime<InstanceRuntime>();
+  else if (fi_config.fi_cycles.empty())
+    useRuntime<IndexRuntime>();
+  else if (fi_config.fi_cycles.size() == 1)
+    useRuntime<CycleRuntime>();
+  else
+    useRuntime<MultipleCycleRuntime>();
+  if (fi_config.runtime_stats > 0)
+    useRuntimeStats(numSites);
+
+  start_tracing_flag = TRACING_FI_RUN_INIT; //Tell instTraceLib that we are going to inject faults
+}
+
+bool preFunc(long llfi_index, unsigned opcode, unsigned my_reg_index,
+             unsigned total_reg_target_num) {
+  return preFuncImpl(llfi_index, opcode, my_reg_index, total_reg_target_num);
+}
+
+void injectFunc(long llfi_index, unsigned size,
+                char *buf, unsigned my_reg_index, unsigned reg_pos, char* opcode_str) {
+  injectFuncImpl(llfi_index, size, buf, my_reg_index, reg_pos, opcode_str);
+}
+
+void turnOffInjections() {
+	fi_enabled = false;
+}
+
+void turnOnInjections() {
+	fi_enabled = true;
+}
+
+void postInjections() {
+	if (injectedfaultsFile != NULL)
+		fclose(injectedfaultsFile);
+}
+
+} // extern "C"
@@ -5,9 +5,13 @@
 /  pass performed on them
 *************/
 
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "RuntimeStats.h"
 #include "Utils.h"
 #include "unistd.h"
 
@@ -21,25 +25,419 @@ FILE* OutputFile() {
   return ofile;
 }
 
-static long instCount = 0;
-static long cutOff = 0;
-void printInstTracer(long instID, char *opcode, int size, char* ptr, int maxPrints) {
+/**
+ * Hash checkpoints (-hashcheckpoints)
+ *
+ * The trace pass hashes the value of each traced instruction into
+ * llfi_trace_hash. Every hash_interval instructions, the hash of the interval
+ * is written to llfi.stat.hashes.txt as a level 0 checkpoint, and folded into
+ * the checkpoint of the next level, which is written once it holds
+ * hash_fanout checkpoints, and so on. The golden and the faulty runs write
+ * the same checkpoints up to the fault, and hashdiff compares them level by
+ * level to find the intervals where the faulty run diverged. Programs built
+ * with -hashcheckpoints only trace the golden run within trace windows.
+ *
+ * Lines of llfi.stat.hashes.txt:
+ *   #LLFIHashCheckpoints interval=<n> fanout=<n>
+ *   <level> <hash>         a checkpoint, in hex
+ *   fault=<n>              the faulty trace starts at instruction n
+ *   end=<n>                the program ended after n instructions, after
+ *                          the level 0 checkpoint of its last interval
+ */
+#define HASH_FILENAME "llfi.stat.hashes.txt"
+#define HASH_INTERVAL 1024
+#define HASH_FANOUT 16
+#define HASH_LEVELS 16
+// FNV-1a, on the values instead of the bytes, as in the trace pass
+#define HASH_OFFSET 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+uint64_t llfi_trace_hash = HASH_OFFSET;
+
+static bool hashCheckpoints = false;
+static long long hashInterval = HASH_INTERVAL;
+static int hashFanout = HASH_FANOUT;
+static long long hashNext = LLONG_MAX;
+static FILE *hashFile = NULL;
+// checkpoints of each level above 0 being folded
+static uint64_t hashLevels[HASH_LEVELS];
+static int hashLevelCounts[HASH_LEVELS];
+
+static FILE *_hashFile() {
+  if (hashFile == NULL) {
+    hashFile = fopen(HASH_FILENAME, "w");
+    if (hashFile == NULL) {
+      fprintf(stderr, "ERROR: Unable to open the hash checkpoint file %s\n",
+              HASH_FILENAME);
+      exit(1);
+    }
+    fprintf(hashFile, "#LLFIHashCheckpoints interval=%lld fanout=%d\n",
+            hashInterval, hashFanout);
+  }
+  return hashFile;
+}
+
+static void _writeHash(int level, uint64_t hash) {
+  fprintf(_hashFile(), "%d %016llx\n", level, (unsigned long long)hash);
+  if (level + 1 >= HASH_LEVELS)
+    return;
+  if (hashLevelCounts[level + 1] == 0)
+    hashLevels[level + 1] = HASH_OFFSET;
+  hashLevels[level + 1] = (hashLevels[level + 1] ^ hash) * HASH_PRIME;
+  if (++hashLevelCounts[level + 1] == hashFanout) {
+    hashLevelCounts[level + 1] = 0;
+    _writeHash(level + 1, hashLevels[level + 1]);
+  }
+}
+
+// Writes the checkpoint of the interval that ended at llfi_trace_count
+static void _checkpointHashes() {
+  _writeHash(0, llfi_trace_hash);
+  llfi_trace_hash = HASH_OFFSET;
+  hashNext = (llfi_trace_count / hashInterval + 1) * hashInterval;
+  // the faulty run may crash at any instruction
+  if (start_tracing_flag != TRACING_GOLDEN_RUN)
+    fflush(hashFile);
+}
+
+static void _endHashes() {
+  if (!hashCheckpoints)
+    return;
+  if (llfi_trace_count % hashInterval != 0)
+    _writeHash(0, llfi_trace_hash);
+  fprintf(_hashFile(), "end=%lld\n", llfi_trace_count);
+  fclose(hashFile);
+  hashFile = NULL;
+  hashCheckpoints = false;
+}
+
+/**
+ * Trace windows, read by the golden run from llfi.config.trace.txt:
+ *   trace_window=<first>-<last>  trace the dynamic instructions numbered from
+ *                                first to last (inclusive, last may be left
+ *                                out); may be repeated
+ *   trace_function=<name>        trace the instructions of this function
+ *                                only; may be repeated
+ *   trace_opcode=<name>          trace the instructions of this opcode only;
+ *                                may be repeated
+ *   trace_every=<n>              trace every nth instance of each instruction
+ *   hash_interval=<n>            instructions per hash checkpoint (default
+ *                                1024), read by the faulty runs too
+ *   hash_fanout=<n>              checkpoints per checkpoint of the next level
+ *                                (default 16), read by the faulty runs too
+ * The instructions are numbered from 1 by llfi_trace_count. Outside of the
+ * windows the tracing function is not called. When the trace skips
+ * instructions, the number of the next traced one is written as
+ * "#TraceInstNumber: <n>" before it, so that tracediff can align the golden
+ * trace with the faulty one.
+ *
+ * The windows and trace_every apply to the golden trace only. trace_function
+ * and trace_opcode select the sites of the faulty trace too, except for the
+ * instruction of the fault, which starts it, so that tracediff compares the
+ * same sites. The runtime marks the sites it filtered out in the site array
+ * of the trace pass, whose code then skips them without calling it.
+ */
+#define TRACE_CONFIG_FILENAME "llfi.config.trace.txt"
+
+struct TraceWindow {
+  long long first, last;
+};
+
+// passed by the trace pass to initTracing, sorted by llfi index
+struct TraceFunction {
+  const char *name;
+  long long first, last;
+};
+
+static bool traceConfigLoaded = false;
+// true if any option of the config file restricts the trace
+static bool traceGated = false;
+static struct TraceWindow *traceWindows = NULL;
+static int numTraceWindows = 0, curTraceWindow = 0;
+static char **traceFunctionNames = NULL;
+static int numTraceFunctionNames = 0;
+static char **traceOpcodes = NULL;
+static int numTraceOpcodes = 0;
+static long long traceEvery = 1;
+static long long lastTraced = 0;
+// count at which the trace needs the tracing function next
+static long long traceNext = 0;
+
+static const struct TraceFunction *traceFunctions = NULL;
+static long long numTraceFunctions = 0;
+
+// site array of the trace pass, per llfi index
+#define TRACE_SITE_UNKNOWN 0
+#define TRACE_SITE_SELECTED 1
+#define TRACE_SITE_FILTERED 2
+static unsigned char *traceSites = NULL;
+static long long numTraceSites = 0;
+static unsigned long long *siteInstances = NULL;
+static long numSiteInstances = 0;
+
+// Grows the array of *len elements of the given size to hold index, filling
+// the new elements with zeros
+static void *_growArray(void *array, long *len, long index, size_t size) {
+  if (index < *len)
+    return array;
+  long n = *len == 0 ? 1024 : *len;
+  while (n <= index)
+    n *= 2;
+  array = realloc(array, n * size);
+  if (array == NULL) {
+    fprintf(stderr, "ERROR: Unable to allocate the trace state\n");
+    exit(1);
+  }
+  memset((char*)array + *len * size, 0, (n - *len) * size);
+  *len = n;
+  return array;
+}
+
+static void _addTraceName(char ***names, int *num, const char *name) {
+  *names = (char**) realloc(*names, (*num + 1) * sizeof(char*));
+  if (*names == NULL || ((*names)[*num] = strdup(name)) == NULL) {
+    fprintf(stderr, "ERROR: Unable to allocate the trace config\n");
+    exit(1);
+  }
+  (*num)++;
+}
+
+static int _compareTraceWindows(const void *a, const void *b) {
+  const struct TraceWindow *x = (const struct TraceWindow*) a;
+  const struct TraceWindow *y = (const struct TraceWindow*) b;
+  return x->first < y->first ? -1 : x->first > y->first;
+}
+
+static void _loadTraceConfig() {
+  traceConfigLoaded = true;
+  FILE *config = fopen(TRACE_CONFIG_FILENAME, "r");
+  if (config == NULL)
+    return;
+
+  char line[1024];
+  while (fgets(line, sizeof(line), config) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *value = strchr(line, '=');
+    if (value == NULL)
+      continue;
+    *value++ = '\0';
+    if (strcmp(line, "trace_window") == 0) {
+      struct TraceWindow window = {0, LLONG_MAX};
+      char *last;
+      window.first = strtoll(value, &last, 10);
+      if (*last == '-' && last[1] != '\0')
+        window.last = strtoll(last + 1, NULL, 10);
+      traceWindows = (struct TraceWindow*) realloc(traceWindows,
+          (numTraceWindows + 1) * sizeof(struct TraceWindow));
+      if (traceWindows == NULL) {
+        fprintf(stderr, "ERROR: Unable to allocate the trace config\n");
+        exit(1);
+      }
+      traceWindows[numTraceWindows++] = window;
+    } else if (strcmp(line, "trace_function") == 0) {
+      _addTraceName(&traceFunctionNames, &numTraceFunctionNames, value);
+    } else if (strcmp(line, "trace_opcode") == 0) {
+      _addTraceName(&traceOpcodes, &numTraceOpcodes, value);
+    } else if (strcmp(line, "trace_every") == 0) {
+      traceEvery = atoll(value) > 1 ? atoll(value) : 1;
+    } else if (strcmp(line, "hash_interval") == 0) {
+      hashInterval = atoll(value) > 0 ? atoll(value) : HASH_INTERVAL;
+    } else if (strcmp(line, "hash_fanout") == 0) {
+      hashFanout = atoi(value) > 1 ? atoi(value) : HASH_FANOUT;
+    } else {
+      fprintf(stderr, "ERROR: Unknown option %s in %s\n", line,
+              TRACE_CONFIG_FILENAME);
+      exit(1);
+    }
+  }
+  fclose(config);
+
+  // merge the overlapping windows
+  qsort(traceWindows, numTraceWindows, sizeof(struct TraceWindow),
+        _compareTraceWindows);
+  int i, n = 0;
+  for (i = 0; i < numTraceWindows; i++) {
+    if (n > 0 && traceWindows[i].first <= traceWindows[n - 1].last + 1) {
+      if (traceWindows[i].last > traceWindows[n - 1].last)
+        traceWindows[n - 1].last = traceWindows[i].last;
+    } else {
+      traceWindows[n++] = traceWindows[i];
+    }
+  }
+  numTraceWindows = n;
+  traceGated = numTraceWindows > 0 || numTraceFunctionNames > 0 ||
+               numTraceOpcodes > 0 || traceEvery > 1;
+}
+
+static bool _isTraceName(char **names, int num, const char *name) {
   int i;
-  instCount++;
+  for (i = 0; i < num; i++)
+    if (strcmp(names[i], name) == 0)
+      return true;
+  return false;
+}
+
+static const char *_functionOf(long instID) {
+  long long lo = 0, hi = numTraceFunctions;
+  while (lo < hi) {
+    long long mid = lo + (hi - lo) / 2;
+    if (traceFunctions[mid].last < instID)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo < numTraceFunctions && traceFunctions[lo].first <= instID)
+    return traceFunctions[lo].name;
+  return NULL;
+}
+
+static bool _isSiteSelected(long instID, const char *opcode) {
+  if (instID >= 0 && instID < numTraceSites &&
+      traceSites[instID] != TRACE_SITE_UNKNOWN)
+    return traceSites[instID] == TRACE_SITE_SELECTED;
+
+  bool selected = numTraceOpcodes == 0 ||
+                  _isTraceName(traceOpcodes, numTraceOpcodes, opcode);
+  if (selected && numTraceFunctionNames > 0) {
+    const char *func = _functionOf(instID);
+    selected = func != NULL &&
+               _isTraceName(traceFunctionNames, numTraceFunctionNames, func);
+  }
+  // the sites are not known before initTracing
+  if (instID >= 0 && instID < numTraceSites)
+    traceSites[instID] = selected ? TRACE_SITE_SELECTED : TRACE_SITE_FILTERED;
+  return selected;
+}
+
+// Returns true if the instruction is traced in the golden run, and sets the
+// count at which the tracing function is called next.
+static bool _traceGolden(long instID, const char *opcode,
+                         void (*marker)(long long)) {
+  long long instCount = llfi_trace_count;
+  if (!traceConfigLoaded)
+    _loadTraceConfig();
+  if (!traceGated) {
+    // the hash checkpoints replace the whole golden trace
+    traceNext = hashCheckpoints ? LLONG_MAX : 0;
+    return !hashCheckpoints;
+  }
+
+  if (numTraceWindows > 0) {
+    while (curTraceWindow < numTraceWindows &&
+           instCount > traceWindows[curTraceWindow].last)
+      curTraceWindow++;
+    if (curTraceWindow == numTraceWindows) {
+      traceNext = LLONG_MAX;
+      return false;
+    }
+    if (instCount < traceWindows[curTraceWindow].first) {
+      traceNext = traceWindows[curTraceWindow].first;
+      return false;
+    }
+  }
+  traceNext = 0;
+
+  if (!_isSiteSelected(instID, opcode))
+    return false;
+  if (traceEvery > 1) {
+    siteInstances = (unsigned long long*) _growArray(siteInstances,
+        &numSiteInstances, instID, sizeof(unsigned long long));
+    if (siteInstances[instID]++ % traceEvery != 0)
+      return false;
+  }
+  if (instCount != lastTraced + 1)
+    marker(instCount);
+  lastTraced = instCount;
+  return true;
+}
+
+static long long cutOff = 0;
+
+// Returns true if the instruction is traced, and writes the header of the
+// faulty trace at the first instruction after the fault.
+static bool _traceInst(long instID, const char *opcode, int maxPrints,
+                       void (*header)(long long),
+                       void (*marker)(long long)) {
+  long long instCount = llfi_trace_count;
+
+  if (instCount >= hashNext)
+    _checkpointHashes();
+
+  //The flag is left initialized in utils.c and unchanged in the golden run
+  if (start_tracing_flag == TRACING_GOLDEN_RUN)
+    return _traceGolden(instID, opcode, marker);
 
-  
   if (start_tracing_flag == TRACING_FI_RUN_FAULT_INSERTED) {
     start_tracing_flag = TRACING_FI_RUN_START_TRACING;
     cutOff = instCount + maxPrints;
     //Print faulty trace header (for analysis by traceDiff script)
-    fprintf(OutputFile(), "#TraceStartInstNumber: %ld\n", instCount);
-  }
-  
-  //These flags are set by faultinjection_lib.c (Faulty Run) or left 
-  // initialized in utils.c and left unchanged (Golden run)
-  if ((start_tracing_flag == TRACING_GOLDEN_RUN) || 
-      ((start_tracing_flag == TRACING_FI_RUN_START_TRACING) && 
-       (instCount < cutOff))) {
+    header(instCount);
+    if (hashCheckpoints)
+      fprintf(_hashFile(), "fault=%lld\n", instCount);
+    lastTraced = instCount;
+    return instCount < cutOff;
+  }
+
+  //These flags are set by faultinjection_lib.c (Faulty Run)
+  if (start_tracing_flag != TRACING_FI_RUN_START_TRACING ||
+      instCount >= cutOff || !_isSiteSelected(instID, opcode))
+    return false;
+  if (instCount != lastTraced + 1)
+    marker(instCount);
+  lastTraced = instCount;
+  return true;
+}
+
+static void _endTraceInst() {
+  if ((start_tracing_flag != TRACING_GOLDEN_RUN) && llfi_trace_count >= cutOff )
+  {
+	start_tracing_flag = TRACING_FI_RUN_END_TRACING;
+  }
+  // in the faulty run, the tracing function is called again once a fault is
+  // injected
+  if (start_tracing_flag != TRACING_GOLDEN_RUN)
+    traceNext =
+        start_tracing_flag == TRACING_FI_RUN_START_TRACING ? 0 : LLONG_MAX;
+  llfi_trace_next = traceNext < hashNext ? traceNext : hashNext;
+}
+
+static void _printHeader(long long instNumber) {
+  fprintf(OutputFile(), "#TraceStartInstNumber: %lld\n", instNumber);
+}
+
+static void _printMarker(long long instNumber) {
+  fprintf(OutputFile(), "#TraceInstNumber: %lld\n", instNumber);
+}
+
+void initTracing(const struct TraceFunction *functions, long long num,
+                 int hashes, unsigned char *sites, long long numSites) {
+  traceFunctions = functions;
+  numTraceFunctions = num;
+  traceSites = sites;
+  numTraceSites = numSites;
+
+  if (!traceConfigLoaded)
+    _loadTraceConfig();
+  hashCheckpoints = hashes != 0;
+  if (hashCheckpoints) {
+    llfi_trace_hash = HASH_OFFSET;
+    hashNext = (llfi_trace_count / hashInterval + 1) * hashInterval;
+  }
+  llfi_trace_next = 0;
+}
+
+void stopTracing() {
+  hashCheckpoints = false;
+  hashNext = LLONG_MAX;
+  // the file, if any, belongs to the process that opened it
+  hashFile = NULL;
+}
+
+static void _printInstTracer(long instID, char *opcode, int size, char* ptr,
+                             int maxPrints) {
+  int i;
+
+  if (_traceInst(instID, opcode, maxPrints, _printHeader, _printMarker)) {
     fprintf(OutputFile(), "ID: %ld\tOPCode: %s\tValue: ", instID, opcode);
     
     //Handle endian switch
@@ -57,14 +455,246 @@ void printInstTracer(long instID, char *opcode, int size, char* ptr, int maxPrin
     fflush(OutputFile()); 
 
   }
-  if ((start_tracing_flag != TRACING_GOLDEN_RUN) && instCount >= cutOff )
-  {
-	start_tracing_flag = TRACING_FI_RUN_END_TRACING;
+  _endTraceInst();
+}
+
+// The tracing functions of the trace pass, counted and timed with the
+// runtime_stats option of fault injection runs.
+void printInstTracer(long instID, char *opcode, int size, char* ptr, int maxPrints) {
+  uint64_t start = llfi_runtime_stats ? llfiHookBegin(LLFI_HOOK_TRACE) : 0;
+  _printInstTracer(instID, opcode, size, ptr, maxPrints);
+  if (llfi_runtime_stats)
+    llfiHookEnd(LLFI_HOOK_TRACE, instID, start);
+}
+
+/**
+ * Compressed traces (-compresstrace)
+ *
+ * Each traced value is predicted from the previous values of its instruction
+ * by a finite context method (FCM) predictor and a differential one (DFCM),
+ * and each instruction is predicted to follow the one that followed its
+ * predecessor last time. Only the mispredictions are written. The trace
+ * decoder in tracetools.py keeps the same predictors to expand the trace to
+ * the text trace.
+ *
+ * The file starts with the line "#LLFICompressedTrace 1", followed by tokens:
+ *   0x00-0x7f: n+1 records whose instruction and value are both predicted
+ *   0x80|flags: one record
+ *     0x01: the id of the instruction follows, as a varint
+ *     0x02: first record of the instruction: its opcode follows, NUL
+ *           terminated, then the size of its value, as a varint
+ *     bits 2-3: the value is predicted (0), predicted by the predictor that
+ *           was not selected (1), a zigzag varint of its difference with the
+ *           last value of the instruction (2), or follows as raw bytes (3)
+ *   0xfe: "#TraceInstNumber", the instruction number follows as a varint
+ *   0xff: the faulty trace header, the instruction number follows as a varint
+ * Varints are unsigned LEB128. Values are up to 8 bytes, read in the order of
+ * the text trace; wider values are written raw and never predicted.
+ */
+
+#define TRACE_COMPRESSED_HEADER "#LLFICompressedTrace 1\n"
+#define TRACE_RUN_MAX 128
+#define TRACE_TOKEN_RECORD 0x80
+#define TRACE_TOKEN_ID 0x01
+#define TRACE_TOKEN_SITE 0x02
+#define TRACE_VALUE_SELECTED 0
+#define TRACE_VALUE_OTHER 1
+#define TRACE_VALUE_DELTA 2
+#define TRACE_VALUE_RAW 3
+#define TRACE_TOKEN_MARKER 0xfe
+#define TRACE_TOKEN_HEADER 0xff
+// log2 of the size of the FCM and DFCM tables, shared by all instructions
+#define TRACE_TABLE_BITS 16
+
+struct TraceSite {
+  bool seen;
+  int size;
+  // id of the instruction traced after this one last time, -1 if none
+  long next;
+  uint64_t last;
+  // last two values and strides, most recent first
+  uint64_t values[2];
+  uint64_t strides[2];
+  // the DFCM predictor is selected when >= 2
+  int selector;
+};
+
+static struct TraceSite *sites = NULL;
+static long numSites = 0;
+// the instruction before the start of the trace
+static struct TraceSite startSite = {true, 0, -1, 0, {0, 0}, {0, 0}, 0};
+static struct TraceSite *prevSite = &startSite;
+static uint64_t fcmTable[1 << TRACE_TABLE_BITS];
+static uint64_t dfcmTable[1 << TRACE_TABLE_BITS];
+static int pendingRun = 0;
+
+static struct TraceSite *_getSite(long instID) {
+  long i = numSites;
+  sites = (struct TraceSite*) _growArray(sites, &numSites, instID,
+                                         sizeof(struct TraceSite));
+  // no instruction is traced after the new sites yet, like in _decodeTrace
+  for (; i < numSites; i++)
+    sites[i].next = -1;
+  return &sites[instID];
+}
+
+static inline uint64_t _hashTrace(long instID, uint64_t a, uint64_t b) {
+  uint64_t h = (uint64_t)instID * 0x9e3779b97f4a7c15ULL ^
+               a * 0xc2b2ae3d27d4eb4fULL ^ b * 0x165667b19e3779f9ULL;
+  return h >> (64 - TRACE_TABLE_BITS);
+}
+
+static void _writeVarint(uint64_t v) {
+  while (v >= 0x80) {
+    fputc((int)(v & 0x7f) | 0x80, OutputFile());
+    v >>= 7;
+  }
+  fputc((int)v, OutputFile());
+}
+
+static FILE *CompressedOutputFile() {
+  static bool started = false;
+  if (!started) {
+    started = true;
+    fputs(TRACE_COMPRESSED_HEADER, OutputFile());
+  }
+  return OutputFile();
+}
+
+static void _flushRun() {
+  if (pendingRun > 0) {
+    fputc(pendingRun - 1, OutputFile());
+    pendingRun = 0;
   }
+}
+
+static void _printCompressedHeader(long long instNumber) {
+  CompressedOutputFile();
+  _flushRun();
+  fputc(TRACE_TOKEN_HEADER, OutputFile());
+  _writeVarint(instNumber);
+}
 
+static void _printCompressedMarker(long long instNumber) {
+  CompressedOutputFile();
+  _flushRun();
+  fputc(TRACE_TOKEN_MARKER, OutputFile());
+  _writeVarint(instNumber);
+}
+
+static void _printCompressedInstTracer(long instID, char *opcode, int size,
+                                       char* ptr, int maxPrints) {
+  int i;
+
+  if (!_traceInst(instID, opcode, maxPrints, _printCompressedHeader,
+                  _printCompressedMarker)) {
+    _endTraceInst();
+    return;
+  }
+  CompressedOutputFile();
+
+  struct TraceSite *site = _getSite(instID);
+  bool newSite = !site->seen;
+  bool predictedID = prevSite->next == instID;
+  prevSite->next = instID;
+  prevSite = site;
+  int flags = 0;
+  uint64_t value = 0;
+
+  if (size > (int)sizeof(uint64_t)) {
+    flags = TRACE_VALUE_RAW << 2;
+  } else {
+    // the value as printed in the text trace
+    for (i = 0; i < size; i++)
+      value = (value << 8) |
+              (unsigned char)ptr[isLittleEndian() ? size - 1 - i : i];
+    uint64_t mask = size == 8 ? ~0ULL : (1ULL << (8 * size)) - 1;
+    uint64_t *fcm =
+        &fcmTable[_hashTrace(instID, site->values[0], site->values[1])];
+    uint64_t *dfcm =
+        &dfcmTable[_hashTrace(instID, site->strides[0], site->strides[1])];
+    uint64_t fcmPrediction = *fcm;
+    uint64_t dfcmPrediction = (site->last + *dfcm) & mask;
+    bool fcmHit = !newSite && fcmPrediction == value;
+    bool dfcmHit = !newSite && dfcmPrediction == value;
+    bool dfcmSelected = site->selector >= 2;
+    if (dfcmSelected ? dfcmHit : fcmHit)
+      flags = TRACE_VALUE_SELECTED << 2;
+    else if (fcmHit || dfcmHit)
+      flags = TRACE_VALUE_OTHER << 2;
+    else
+      flags = TRACE_VALUE_DELTA << 2;
+
+    if (dfcmHit && !fcmHit && site->selector < 3)
+      site->selector++;
+    else if (fcmHit && !dfcmHit && site->selector > 0)
+      site->selector--;
+    uint64_t stride = (value - site->last) & mask;
+    *fcm = value;
+    *dfcm = stride;
+    site->values[1] = site->values[0];
+    site->values[0] = value;
+    site->strides[1] = site->strides[0];
+    site->strides[0] = stride;
+  }
+
+  if (!predictedID)
+    flags |= TRACE_TOKEN_ID;
+  if (newSite)
+    flags |= TRACE_TOKEN_SITE;
+
+  if (flags == 0) {
+    if (++pendingRun == TRACE_RUN_MAX)
+      _flushRun();
+  } else {
+    _flushRun();
+    fputc(TRACE_TOKEN_RECORD | flags, OutputFile());
+    if (flags & TRACE_TOKEN_ID)
+      _writeVarint(instID);
+    if (flags & TRACE_TOKEN_SITE) {
+      fputs(opcode, OutputFile());
+      fputc('\0', OutputFile());
+      _writeVarint(size);
+      site->seen = true;
+      site->size = size;
+    }
+    if ((flags >> 2) == TRACE_VALUE_DELTA) {
+      int64_t delta = (int64_t)(value - site->last);
+      if (size < 8) {
+        // sign extend the difference of the size of the value
+        int shift = 64 - 8 * size;
+        delta = (int64_t)((uint64_t)delta << shift) >> shift;
+      }
+      _writeVarint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    } else if ((flags >> 2) == TRACE_VALUE_RAW) {
+      for (i = 0; i < size; i++)
+        fputc((unsigned char)ptr[isLittleEndian() ? size - 1 - i : i],
+              OutputFile());
+    }
+  }
+  site->last = value;
+
+  // the faulty run may crash at any instruction
+  if (start_tracing_flag != TRACING_GOLDEN_RUN) {
+    _flushRun();
+    fflush(OutputFile());
+  }
+  _endTraceInst();
+}
+
+void printCompressedInstTracer(long instID, char *opcode, int size, char* ptr,
+                               int maxPrints) {
+  uint64_t start = llfi_runtime_stats ? llfiHookBegin(LLFI_HOOK_TRACE) : 0;
+  _printCompressedInstTracer(instID, opcode, size, ptr, maxPrints);
+  if (llfi_runtime_stats)
+    llfiHookEnd(LLFI_HOOK_TRACE, instID, start);
 }
 
 void postTracing() {
-  if (ofile != NULL)
+  _endHashes();
+  if (ofile != NULL) {
+    _flushRun();
     fclose(ofile);
+    ofile = NULL;
+  }
 }
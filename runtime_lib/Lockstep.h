@@ -0,0 +1,46 @@
+#ifndef LLFI_LIB_LOCKSTEP_H
+#define LLFI_LIB_LOCKSTEP_H
+
+// Lockstep execution of a fault injection run with a golden process. At the
+// start of the program, the runtime forks a golden process, which injects no
+// fault. At every checkpoint inserted by the lockstep pass (-locksteppass),
+// the golden process publishes the hash of the values it produced since its
+// previous checkpoint in shared memory, and the faulty process compares its
+// own hash with it. The faulty process ends as masked once its hashes match
+// the golden ones again after the fault, and records the checkpoints between
+// which it diverged otherwise.
+//
+// Once masked, the faulty process stops comparing and the golden process
+// ends, but the faulty process runs to its end so that its outputs are
+// complete. The record is written at the exit of the faulty process, so a
+// run that crashes after it was masked is not counted as masked.
+//
+// Only the thread that starts the program takes part in the lockstep. The
+// golden process writes its standard output and error to /dev/null, and reads
+// its standard input from /dev/null. It runs in a private directory under
+// $TMPDIR that links to the files of the working directory, so the files it
+// creates do not mix with the outputs of the faulty process, but the program
+// must not modify its existing files in place. The golden process exits
+// without the exit handlers of the runtime, which write the statistics of the
+// faulty process.
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Written by the faulty process at its exit.
+#define LOCKSTEP_RECORD_FILENAME "llfi.stat.lockstep.txt"
+
+// Forks the golden process, set by the lockstep option. After the fault, the
+// faulty process is masked once window checkpoints in a row match. Returns
+// nonzero in the golden process.
+int llfiStartLockstep(int window);
+void llfiLockstepCheckpoint(uint64_t site, uint64_t hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,365 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Lockstep.h"
+#include "Utils.h"
+
+// The golden process runs ahead of the faulty process by at most this number
+// of checkpoints.
+#define LOCKSTEP_RING_SIZE 4096
+
+// Shared by the two processes. Only the golden process writes golden_count,
+// golden_done and the ring, and only the faulty process writes faulty_count.
+struct LockstepChannel {
+  uint64_t golden_count;
+  uint64_t faulty_count;
+  int golden_done;
+  uint64_t sites[LOCKSTEP_RING_SIZE];
+  uint64_t hashes[LOCKSTEP_RING_SIZE];
+};
+
+enum LockstepRole { LOCKSTEP_OFF, LOCKSTEP_GOLDEN, LOCKSTEP_FAULTY };
+
+static enum LockstepRole role = LOCKSTEP_OFF;
+static struct LockstepChannel *channel = NULL;
+// the thread that takes part in the lockstep
+static __thread bool lockstep_thread = false;
+
+static pid_t golden_pid = 0;
+static pid_t faulty_pid = 0;
+static int masked_window = 1;
+
+// Working directory of the golden process, created by the faulty process
+// before the fork and removed once the golden process ended. It links to the
+// entries of the working directory of the program, so that the golden
+// process reads the same inputs, while the files it creates stay in it. It
+// is named after the faulty process, and the directories of the faulty
+// processes that crashed are removed by the next lockstep run.
+#define SCRATCH_DIR_PREFIX "llfi-golden-"
+static char scratch_dir[PATH_MAX] = "";
+
+// State of the faulty process. The checkpoints are numbered from 0, -1 if
+// there is none.
+static bool comparing = true;
+static bool diverged = false;
+static const char *result = NULL;
+static long long checkpoints = 0;
+static long long fault_checkpoint = -1;
+static long long last_match = -1, last_match_site = -1;
+static long long divergence = -1, divergence_site = -1;
+// first checkpoint of the current run of matches after the fault
+static long long match_start = -1, match_start_site = -1;
+static int matches = 0;
+
+static bool _faultInjected() {
+  return start_tracing_flag >= TRACING_FI_RUN_FAULT_INSERTED;
+}
+
+static int _removeEntry(const char *path,
+                        const struct stat *sb __attribute__((unused)),
+                        int flag __attribute__((unused)),
+                        struct FTW *ftwbuf __attribute__((unused))) {
+  remove(path);
+  return 0;
+}
+
+static void _removeTree(const char *path) {
+  nftw(path, _removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static void _removeScratchDir() {
+  if (scratch_dir[0] == '\0')
+    return;
+  _removeTree(scratch_dir);
+  scratch_dir[0] = '\0';
+}
+
+static void _stopGolden() {
+  if (golden_pid > 0) {
+    kill(golden_pid, SIGKILL);
+    waitpid(golden_pid, NULL, 0);
+    golden_pid = 0;
+  }
+  _removeScratchDir();
+}
+
+static void _removeStaleScratchDirs(const char *tmpdir) {
+  DIR *dir = opendir(tmpdir);
+  if (dir == NULL)
+    return;
+  char path[PATH_MAX];
+  struct dirent *entry;
+  int pid;
+  while ((entry = readdir(dir)) != NULL) {
+    if (sscanf(entry->d_name, SCRATCH_DIR_PREFIX "%d", &pid) == 1 &&
+        kill(pid, 0) != 0 && errno == ESRCH) {
+      snprintf(path, sizeof(path), "%s/%s", tmpdir, entry->d_name);
+      _removeTree(path);
+    }
+  }
+  closedir(dir);
+}
+
+// Links the entries of the working directory from the scratch directory.
+static bool _linkScratchDir() {
+  char cwd[PATH_MAX], target[PATH_MAX + NAME_MAX + 2];
+  DIR *dir;
+  int scratchfd = open(scratch_dir, O_RDONLY | O_DIRECTORY);
+  if (scratchfd < 0)
+    return false;
+  if (getcwd(cwd, sizeof(cwd)) == NULL || (dir = opendir(cwd)) == NULL) {
+    close(scratchfd);
+    return false;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+      continue;
+    snprintf(target, sizeof(target), "%s/%s", cwd, entry->d_name);
+    symlinkat(target, scratchfd, entry->d_name);
+  }
+  closedir(dir);
+  close(scratchfd);
+  return true;
+}
+
+static bool _createScratchDir() {
+  const char *tmpdir = getenv("TMPDIR");
+  if (tmpdir == NULL || tmpdir[0] == '\0')
+    tmpdir = "/tmp";
+  _removeStaleScratchDirs(tmpdir);
+  snprintf(scratch_dir, sizeof(scratch_dir), "%s/" SCRATCH_DIR_PREFIX "%d",
+           tmpdir, (int)getpid());
+  _removeTree(scratch_dir);
+  if (mkdir(scratch_dir, 0700) != 0) {
+    fprintf(stderr, "ERROR: Unable to create the directory %s of the golden "
+            "process\n", scratch_dir);
+    scratch_dir[0] = '\0';
+    return false;
+  }
+  if (!_linkScratchDir()) {
+    fprintf(stderr, "ERROR: Unable to link the working directory from %s\n",
+            scratch_dir);
+    _removeScratchDir();
+    return false;
+  }
+  return true;
+}
+
+static void _writeRecord() {
+  FILE *recordFile = fopen(LOCKSTEP_RECORD_FILENAME, "w");
+  if (recordFile == NULL) {
+    fprintf(stderr, "ERROR: Unable to open the lockstep record file %s\n",
+            LOCKSTEP_RECORD_FILENAME);
+    return;
+  }
+
+  if (result == NULL) {
+    if (diverged)
+      result = "diverged";
+    else if (fault_checkpoint >= 0)
+      result = "not-diverged";
+    else
+      result = "no-fault";
+  }
+  fprintf(recordFile, "result=%s\n", result);
+  fprintf(recordFile, "checkpoints=%lld\n", checkpoints);
+  fprintf(recordFile, "fault_checkpoint=%lld\n", fault_checkpoint);
+  // the state diverged between these two checkpoints
+  fprintf(recordFile, "last_match_checkpoint=%lld\n", last_match);
+  fprintf(recordFile, "last_match_site=%lld\n", last_match_site);
+  fprintf(recordFile, "divergence_checkpoint=%lld\n", divergence);
+  fprintf(recordFile, "divergence_site=%lld\n", divergence_site);
+  // the checkpoints matched again from this one, up to the end or for the
+  // masked window
+  if (diverged && matches > 0) {
+    fprintf(recordFile, "reconvergence_checkpoint=%lld\n", match_start);
+    fprintf(recordFile, "reconvergence_site=%lld\n", match_start_site);
+  }
+  fclose(recordFile);
+}
+
+// A faulty process that crashes writes no record, even once masked.
+static void _endFaultyLockstep() {
+  if (getpid() != faulty_pid)
+    return;
+  _stopGolden();
+  _writeRecord();
+}
+
+// Registered after the handlers of the runtime, which the golden process
+// skips: the statistics and the records belong to the faulty process.
+static void _endGoldenLockstep() {
+  __atomic_store_n(&channel->golden_done, 1, __ATOMIC_RELEASE);
+  _exit(0);
+}
+
+static void _publish(uint64_t site, uint64_t hash) {
+  uint64_t k = channel->golden_count;
+  while (k - __atomic_load_n(&channel->faulty_count, __ATOMIC_ACQUIRE) >=
+         LOCKSTEP_RING_SIZE) {
+    if (getppid() != faulty_pid)
+      _exit(0);
+    sched_yield();
+  }
+  channel->sites[k % LOCKSTEP_RING_SIZE] = site;
+  channel->hashes[k % LOCKSTEP_RING_SIZE] = hash;
+  __atomic_store_n(&channel->golden_count, k + 1, __ATOMIC_RELEASE);
+}
+
+// Waits for checkpoint k of the golden process. Returns false if the golden
+// process ended before it.
+static bool _waitForGolden(uint64_t k) {
+  unsigned spins = 0;
+  while (__atomic_load_n(&channel->golden_count, __ATOMIC_ACQUIRE) <= k) {
+    if (__atomic_load_n(&channel->golden_done, __ATOMIC_ACQUIRE))
+      break;
+    if (++spins % 1024 == 0 &&
+        waitpid(golden_pid, NULL, WNOHANG) == golden_pid) {
+      golden_pid = 0;
+      _removeScratchDir();
+      break;
+    }
+    sched_yield();
+  }
+  return __atomic_load_n(&channel->golden_count, __ATOMIC_ACQUIRE) > k;
+}
+
+static void _diverge(long long k, uint64_t site) {
+  if (!diverged) {
+    diverged = true;
+    divergence = k;
+    divergence_site = (long long)site;
+  }
+  matches = 0;
+}
+
+static void _compare(uint64_t site, uint64_t hash) {
+  long long k = checkpoints++;
+  if (!_waitForGolden(k)) {
+    // the program went on after the end of the golden run
+    _diverge(k, site);
+    comparing = false;
+    _stopGolden();
+    return;
+  }
+
+  bool match = channel->sites[k % LOCKSTEP_RING_SIZE] == site &&
+               channel->hashes[k % LOCKSTEP_RING_SIZE] == hash;
+  __atomic_store_n(&channel->faulty_count, k + 1, __ATOMIC_RELEASE);
+
+  if (!_faultInjected()) {
+    if (match) {
+      last_match = k;
+      last_match_site = (long long)site;
+    } else {
+      // the program does not run the same way twice, e.g. it reads a clock
+      result = "nondeterministic";
+      _diverge(k, site);
+      comparing = false;
+      _stopGolden();
+    }
+    return;
+  }
+
+  if (fault_checkpoint < 0)
+    fault_checkpoint = k;
+  if (!match) {
+    _diverge(k, site);
+    return;
+  }
+  if (!diverged) {
+    last_match = k;
+    last_match_site = (long long)site;
+  }
+  if (matches++ == 0) {
+    match_start = k;
+    match_start_site = (long long)site;
+  }
+  if (matches >= masked_window) {
+    // the faulty process runs to its end, so that its outputs are complete
+    result = "masked";
+    comparing = false;
+    _stopGolden();
+  }
+}
+
+/**
+ * external libraries
+ */
+
+int llfiStartLockstep(int window) {
+  channel = (struct LockstepChannel*) mmap(NULL,
+      sizeof(struct LockstepChannel), PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (channel == MAP_FAILED) {
+    fprintf(stderr, "ERROR: Unable to map the lockstep channel\n");
+    exit(1);
+  }
+  masked_window = window > 0 ? window : 1;
+  faulty_pid = getpid();
+  // before the fork, so that the memory of the two processes matches
+  if (!_createScratchDir())
+    exit(1);
+
+  // the output of the faulty process is written before the fork
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid < 0) {
+    fprintf(stderr, "ERROR: Unable to fork the golden process\n");
+    exit(1);
+  }
+
+  lockstep_thread = true;
+  if (pid == 0) {
+    role = LOCKSTEP_GOLDEN;
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != faulty_pid)
+      _exit(0);
+    if (chdir(scratch_dir) != 0) {
+      fprintf(stderr, "ERROR: Unable to enter the directory %s of the golden "
+              "process\n", scratch_dir);
+      _exit(1);
+    }
+    int devnull = open("/dev/null", O_RDWR);
+    if (devnull >= 0) {
+      dup2(devnull, STDIN_FILENO);
+      dup2(devnull, STDOUT_FILENO);
+      dup2(devnull, STDERR_FILENO);
+      close(devnull);
+    }
+    atexit(_endGoldenLockstep);
+    return 1;
+  }
+
+  role = LOCKSTEP_FAULTY;
+  golden_pid = pid;
+  atexit(_endFaultyLockstep);
+  return 0;
+}
+
+void llfiLockstepCheckpoint(uint64_t site, uint64_t hash) {
+  if (!lockstep_thread)
+    return;
+  if (role == LOCKSTEP_GOLDEN)
+    _publish(site, hash);
+  else if (comparing)
+    _compare(site, hash);
+}
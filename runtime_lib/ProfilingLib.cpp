@@ -6,6 +6,8 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <map>
+#include <limits>
 
 struct layerProfCycle {
   int layerNo;
@@ -33,13 +35,124 @@ static std::vector<layerProfCycle> layerProfileInfo;
 static int64_t globalLayerNo = 0;
 static layerProfCycle *currentLayer = NULL;
 
+// Range of the values stored by each ML layer, learned for the
+// RangeRestrictionPass. Indexed by the layer number.
+struct layerRange {
+  int64_t layerName;
+  double min;
+  double max;
+
+  layerRange() {
+    this->layerName = 0;
+    this->min = std::numeric_limits<double>::infinity();
+    this->max = -std::numeric_limits<double>::infinity();
+  }
+};
+
+static std::vector<layerRange> layerRanges;
+static const char *rangefilename = "llfi.stat.range.txt";
+
+static std::string getLayerNameStr(int64_t layerName) {
+  char *layerNameStr = (char*)&layerName;
+  return std::string(layerNameStr, strnlen(layerNameStr, sizeof(layerName)));
+}
+
+// Merge the ranges of this run with the ones of the previous golden runs,
+// so that running the profiling executable over a set of calibration inputs
+// accumulates the ranges in llfi.stat.range.txt.
+static void writeLayerRanges() {
+  std::map<int64_t, std::pair<std::string, layerRange> > merged;
+
+  FILE *rangeFile = fopen(rangefilename, "r");
+  if (rangeFile != NULL) {
+    char line[1024];
+    while (fgets(line, sizeof(line), rangeFile) != NULL) {
+      long long layerNo;
+      char name[100];
+      double minVal, maxVal;
+      if (sscanf(line, "range=%lld,%99[^,],%lf,%lf", &layerNo, name, &minVal,
+                 &maxVal) != 4)
+        continue;
+      merged[layerNo].first = name;
+      merged[layerNo].second.min = minVal;
+      merged[layerNo].second.max = maxVal;
+    }
+    fclose(rangeFile);
+  }
+
+  for (size_t layerNo = 0; layerNo < layerRanges.size(); layerNo++) {
+    layerRange &range = layerRanges[layerNo];
+    if (range.min > range.max)
+      continue;
+
+    auto &entry = merged[layerNo];
+    entry.first = getLayerNameStr(range.layerName);
+    entry.second.min = std::min(entry.second.min, range.min);
+    entry.second.max = std::max(entry.second.max, range.max);
+  }
+
+  rangeFile = fopen(rangefilename, "w");
+  if (rangeFile == NULL) {
+    fprintf(stderr, "ERROR: Unable to open range result file %s\n",
+            rangefilename);
+    exit(1);
+  }
+
+  fprintf(rangeFile, "# do not edit\n");
+  fprintf(rangeFile, "# range=<layer number>,<layer name>,<min>,<max>\n");
+  for (auto &entry : merged) {
+    fprintf(rangeFile, "range=%lld,%s,%.17g,%.17g\n", (long long)entry.first,
+            entry.second.first.c_str(), entry.second.second.min,
+            entry.second.second.max);
+  }
+
+  fclose(rangeFile);
+}
+
 
 // Export these functions in C dilect.
 extern "C" {
 #include "Utils.h"
 
-static long long unsigned opcodecount[OPCODE_CYCLE_ARRAY_LEN] = {0};
-static long long unsigned globalCycle = 0;
+// Dynamic instruction counts of each thread. A thread registers its counters
+// the first time it is profiled, and only updates them afterwards. The
+// counters outlive the thread, so endProfiling adds up the counters of all
+// the threads, including the ones that have exited.
+struct siteCounter {
+  long long unsigned count;
+  unsigned opcode;
+};
+
+struct threadCounters {
+  long long unsigned opcodecount[OPCODE_CYCLE_ARRAY_LEN];
+  long long unsigned cycle;
+  // dynamic instances and opcode of each site, by llfi index, counted by
+  // doProfilingSite. Allocated once, with the number of sites of the program
+  // given to initProfilingSites, so endProfiling can read the counters of the
+  // threads that are still running.
+  struct siteCounter *sites;
+  int threadId;
+  struct threadCounters *next;
+};
+
+static struct threadCounters *allThreadCounters = NULL;
+// number of llfi indices of the program, with -profilesites
+static long numProfiledSites = 0;
+static __thread struct threadCounters *currThreadCounters = NULL;
+
+static struct threadCounters *registerThreadCounters() {
+  struct threadCounters *counters =
+      (struct threadCounters *)calloc(1, sizeof(struct threadCounters));
+  assert(counters != NULL && "unable to allocate the profiling counters");
+  counters->threadId = getLLFIThreadId();
+  counters->next = __atomic_load_n(&allThreadCounters, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&allThreadCounters, &counters->next,
+                                      counters, true, __ATOMIC_RELEASE,
+                                      __ATOMIC_RELAXED))
+    ;
+  currThreadCounters = counters;
+  return counters;
+}
 
 void lltfiMLLayer(int64_t layerName, int64_t start) {
 
@@ -60,13 +173,67 @@ void lltfiMLLayer(int64_t layerName, int64_t start) {
   }
 }
 
+void lltfiRangeProfile(int64_t layerNo, int64_t layerName, double minVal,
+                       double maxVal) {
+  assert(layerNo > 0 && "Layer numbers start at 1");
+
+  if (layerRanges.size() <= (size_t)layerNo)
+    layerRanges.resize(layerNo + 1);
+
+  layerRange &range = layerRanges[layerNo];
+  range.layerName = layerName;
+  // NaNs are ignored by these comparisons.
+  if (minVal < range.min)
+    range.min = minVal;
+  if (maxVal > range.max)
+    range.max = maxVal;
+}
+
 void doProfiling(int opcode) {
-  assert(opcodecount[opcode] >= 0 &&
-         "dynamic instruction number too large to be handled by llfi");
-  opcodecount[opcode]++;
-  globalCycle++;
-  if (currentLayer != NULL)
-    currentLayer->registerCycle(globalCycle);
+  struct threadCounters *counters = currThreadCounters;
+  if (counters == NULL)
+    counters = registerThreadCounters();
+  counters->opcodecount[opcode]++;
+  counters->cycle++;
+  // the ML layers are announced and timed by the thread running main_graph
+  if (currentLayer != NULL && counters->threadId == 0)
+    currentLayer->registerCycle(counters->cycle);
+}
+
+// Called at the start of main with -profilesites, before the program creates
+// its threads, with the number of llfi indices of the program.
+void initProfilingSites(long numSites) {
+  numProfiledSites = numSites;
+}
+
+// Profiling of union instrumentation (-fisitetable): only the sites that are
+// active in the site bitmap are counted, like preFunc does.
+void doProfilingActiveSite(int opcode, long llfi_index) {
+  if (isSiteActive(llfi_index))
+    doProfiling(opcode);
+}
+
+// Profiling of -profilesites: the dynamic instances of each active site are
+// also counted, for the fault injection planner.
+void doProfilingSite(int opcode, long llfi_index) {
+  if (!isSiteActive(llfi_index))
+    return;
+  doProfiling(opcode);
+
+  struct threadCounters *counters = currThreadCounters;
+  struct siteCounter *sites = counters->sites;
+  if (sites == NULL) {
+    // the instructions executed before initProfilingSites are not counted
+    if (numProfiledSites == 0)
+      return;
+    sites = (struct siteCounter *)calloc(numProfiledSites,
+                                         sizeof(struct siteCounter));
+    assert(sites != NULL && "unable to allocate the site counters");
+    __atomic_store_n(&counters->sites, sites, __ATOMIC_RELEASE);
+  }
+  assert(llfi_index < numProfiledSites && "llfi index out of the sites");
+  sites[llfi_index].count++;
+  sites[llfi_index].opcode = opcode;
 }
 
 void endProfiling() {
@@ -82,16 +249,32 @@ void endProfiling() {
   int opcode_cycle_arr[OPCODE_CYCLE_ARRAY_LEN];
   getOpcodeExecCycleArray(OPCODE_CYCLE_ARRAY_LEN, opcode_cycle_arr);
 
-  unsigned i = 0;
+  // cycles of each thread, by thread id
+  std::map<int, long long unsigned> thread_cycles;
   long long unsigned total_cycle = 0;
-  for (i = 0; i < 100; ++i) {
-    assert(total_cycle >= 0 &&
-            "total dynamic instruction cycle too large to be handled by llfi");
-    if (opcodecount[i] > 0) {
-      assert(opcode_cycle_arr[i] >= 0 &&
-          "opcode does not exist, need to update instructions.def");
-      total_cycle += opcodecount[i] * opcode_cycle_arr[i];
+  // dynamic instances and opcode of each site, over all the threads
+  std::map<long, std::pair<long long unsigned, unsigned> > site_counts;
+  for (struct threadCounters *counters =
+           __atomic_load_n(&allThreadCounters, __ATOMIC_ACQUIRE);
+       counters != NULL; counters = counters->next) {
+    struct siteCounter *sites =
+        __atomic_load_n(&counters->sites, __ATOMIC_ACQUIRE);
+    for (long i = 0; sites != NULL && i < numProfiledSites; ++i) {
+      if (sites[i].count > 0) {
+        site_counts[i].first += sites[i].count;
+        site_counts[i].second = sites[i].opcode;
+      }
+    }
+    long long unsigned thread_cycle = 0;
+    for (unsigned i = 0; i < OPCODE_CYCLE_ARRAY_LEN; ++i) {
+      if (counters->opcodecount[i] > 0) {
+        assert(opcode_cycle_arr[i] >= 0 &&
+            "opcode does not exist, need to update instructions.def");
+        thread_cycle += counters->opcodecount[i] * opcode_cycle_arr[i];
+      }
     }
+    thread_cycles[counters->threadId] += thread_cycle;
+    total_cycle += thread_cycle;
   }
 
   fprintf(profileFile, "# do not edit\n");
@@ -99,11 +282,28 @@ void endProfiling() {
           "# cycle considered the execution cycle of each instruction type\n");
   fprintf(profileFile, "total_cycle=%lld\n", total_cycle);
 
+  // fi_cycle counts the cycles of a single thread, see fi_thread
+  if (thread_cycles.size() > 1) {
+    for (auto &thread : thread_cycles)
+      fprintf(profileFile, "thread_cycle=%d,%lld\n", thread.first,
+              thread.second);
+  }
+
   for (auto layer : layerProfileInfo) {
     fprintf(profileFile, "ml_layer=%d,%s,%lld,%lld\n", layer.layerNo,
             layer.layerName.c_str(), layer.cycleStart, layer.cycleEnd);
   }
 
+  // site=<llfi index>,<dynamic instances>,<cycles>
+  for (auto &site : site_counts) {
+    fprintf(profileFile, "site=%ld,%lld,%lld\n", site.first,
+            site.second.first,
+            site.second.first * opcode_cycle_arr[site.second.second]);
+  }
+
 	fclose(profileFile);
+
+  if (!layerRanges.empty())
+    writeLayerRanges();
 }
 } // End of extern "C"
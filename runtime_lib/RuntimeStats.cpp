@@ -0,0 +1,254 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LLFI_HAS_TSC 1
+#endif
+
+#include "RuntimeStats.h"
+#include "Utils.h"
+
+static const char *hookNames[LLFI_NUM_HOOKS] = {"preFunc", "injectFunc",
+                                                "trace"};
+// sites written to the statistics, in decreasing order of their time
+static const size_t MAX_SITES = 100;
+
+static long long statsPeriod = 1;
+// number of llfi indices of the program, the size of the site statistics
+static long statsNumSites = 0;
+
+static uint64_t _nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Ticks of the timer of the sampled calls: the time stamp counter, converted
+// to nanoseconds with the clock at the end of the run, or the clock itself.
+static inline uint64_t _ticks() {
+#ifdef LLFI_HAS_TSC
+  return __rdtsc();
+#else
+  return _nowNs();
+#endif
+}
+
+static uint64_t startNs = 0, startTicks = 0;
+// ticks of the timer between two back to back reads, taken off each timed call
+static uint64_t timerTicks = 0;
+static uint64_t injectedNs = 0;
+
+// Counters of each thread, registered the first time the thread calls a hook
+// and added up at the exit, like the counters of ProfilingLib.cpp. The site
+// statistics are allocated with the thread, so the exit can read the ones of
+// the threads that are still running.
+struct siteStats {
+  long long unsigned calls[LLFI_NUM_HOOKS];
+  long long unsigned samples[LLFI_NUM_HOOKS];
+  long long unsigned ticks[LLFI_NUM_HOOKS];
+};
+
+struct threadStats {
+  long long unsigned calls[LLFI_NUM_HOOKS];
+  long long unsigned samples[LLFI_NUM_HOOKS];
+  long long unsigned ticks[LLFI_NUM_HOOKS];
+  struct siteStats *sites;
+  struct threadStats *next;
+};
+
+static struct threadStats *allThreadStats = NULL;
+static __thread struct threadStats *currThreadStats = NULL;
+
+static struct threadStats *_registerThreadStats() {
+  struct threadStats *stats =
+      (struct threadStats *)calloc(1, sizeof(struct threadStats));
+  assert(stats != NULL && "unable to allocate the runtime statistics");
+  stats->sites =
+      (struct siteStats *)calloc(statsNumSites, sizeof(struct siteStats));
+  assert((stats->sites != NULL || statsNumSites == 0) &&
+         "unable to allocate the site statistics");
+  stats->next = __atomic_load_n(&allThreadStats, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&allThreadStats, &stats->next, stats,
+                                      true, __ATOMIC_RELEASE,
+                                      __ATOMIC_RELAXED))
+    ;
+  currThreadStats = stats;
+  return stats;
+}
+
+static void _writeRuntimeStats();
+
+extern "C" {
+
+bool llfi_runtime_stats = false;
+
+void llfiStartRuntimeStats(long long period, long numSites) {
+  statsPeriod = period > 0 ? period : 1;
+  statsNumSites = numSites > 0 ? numSites : 0;
+  timerTicks = UINT64_MAX;
+  for (int i = 0; i < 1000; ++i) {
+    uint64_t start = _ticks();
+    timerTicks = std::min(timerTicks, _ticks() - start);
+  }
+  startNs = _nowNs();
+  startTicks = _ticks();
+  llfi_runtime_stats = true;
+  atexit(_writeRuntimeStats);
+}
+
+uint64_t llfiHookBegin(int hook) {
+  struct threadStats *stats = currThreadStats;
+  if (stats == NULL)
+    stats = _registerThreadStats();
+  // the first call is timed, for the hooks called once like injectFunc
+  if (stats->calls[hook]++ % statsPeriod != 0)
+    return 0;
+  uint64_t start = _ticks();
+  return start != 0 ? start : 1;
+}
+
+void llfiHookEnd(int hook, long llfi_index, uint64_t start) {
+  uint64_t ticks = start != 0 ? _ticks() - start : 0;
+  ticks = ticks > timerTicks ? ticks - timerTicks : 0;
+  struct threadStats *stats = currThreadStats;
+  if (start != 0) {
+    stats->samples[hook]++;
+    stats->ticks[hook] += ticks;
+  }
+  if (llfi_index < 0 || llfi_index >= statsNumSites)
+    return;
+
+  struct siteStats *site = &stats->sites[llfi_index];
+  site->calls[hook]++;
+  if (start != 0) {
+    site->samples[hook]++;
+    site->ticks[hook] += ticks;
+  }
+}
+
+void llfiRuntimeStatsInjected() {
+  uint64_t expected = 0;
+  __atomic_compare_exchange_n(&injectedNs, &expected, _nowNs(), false,
+                              __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+} // extern "C"
+
+// Estimated time of the calls, from the mean time of the timed ones, or of
+// the ones of the hook if none of them was timed.
+static double _estimate(long long unsigned calls, long long unsigned samples,
+                        long long unsigned ticks, double hookTicksPerCall) {
+  double perCall = samples > 0 ? (double)ticks / samples : hookTicksPerCall;
+  return calls * perCall;
+}
+
+static void _writeRuntimeStats() {
+  if (!llfi_runtime_stats)
+    return;
+  llfi_runtime_stats = false;
+
+  uint64_t endNs = _nowNs();
+  double wall = (endNs - startNs) * 1e-9;
+  // seconds per tick of the timer
+  double tickSeconds = 1e-9;
+#ifdef LLFI_HAS_TSC
+  uint64_t elapsedTicks = _ticks() - startTicks;
+  if (elapsedTicks > 0)
+    tickSeconds = wall / elapsedTicks;
+#endif
+
+  long long unsigned calls[LLFI_NUM_HOOKS] = {0};
+  long long unsigned samples[LLFI_NUM_HOOKS] = {0};
+  long long unsigned ticks[LLFI_NUM_HOOKS] = {0};
+  std::map<long, struct siteStats> sites;
+  for (struct threadStats *stats =
+           __atomic_load_n(&allThreadStats, __ATOMIC_ACQUIRE);
+       stats != NULL; stats = stats->next) {
+    for (int hook = 0; hook < LLFI_NUM_HOOKS; ++hook) {
+      calls[hook] += stats->calls[hook];
+      samples[hook] += stats->samples[hook];
+      ticks[hook] += stats->ticks[hook];
+    }
+    for (long i = 0; i < statsNumSites; ++i) {
+      struct siteStats &from = stats->sites[i];
+      bool called = false;
+      for (int hook = 0; hook < LLFI_NUM_HOOKS; ++hook)
+        called = called || from.calls[hook] > 0;
+      if (!called)
+        continue;
+      struct siteStats &to = sites[i];
+      for (int hook = 0; hook < LLFI_NUM_HOOKS; ++hook) {
+        to.calls[hook] += from.calls[hook];
+        to.samples[hook] += from.samples[hook];
+        to.ticks[hook] += from.ticks[hook];
+      }
+    }
+  }
+
+  FILE *statsFile = fopen(RUNTIME_STATS_FILENAME, "w");
+  if (statsFile == NULL) {
+    fprintf(stderr, "ERROR: Unable to open runtime statistics file %s\n",
+            RUNTIME_STATS_FILENAME);
+    return;
+  }
+
+  fprintf(statsFile, "# do not edit\n");
+  fprintf(statsFile, "# hook=<name>,<calls>,<timed calls>,<ns per call>,"
+                     "<estimated seconds>\n");
+  fprintf(statsFile, "# site=<llfi index>,<estimated seconds>,<preFunc calls>,"
+                     "<injectFunc calls>,<trace calls>\n");
+#ifdef LLFI_HAS_TSC
+  fprintf(statsFile, "timer=rdtsc\n");
+#else
+  fprintf(statsFile, "timer=clock_gettime\n");
+#endif
+  fprintf(statsFile, "sample_period=%lld\n", statsPeriod);
+  fprintf(statsFile, "wall_seconds=%.6f\n", wall);
+  if (injectedNs != 0) {
+    fprintf(statsFile, "time_to_injection_seconds=%.6f\n",
+            (injectedNs - startNs) * 1e-9);
+    fprintf(statsFile, "time_after_injection_seconds=%.6f\n",
+            (endNs - injectedNs) * 1e-9);
+  }
+
+  double hookTicksPerCall[LLFI_NUM_HOOKS];
+  double hooks = 0;
+  for (int hook = 0; hook < LLFI_NUM_HOOKS; ++hook) {
+    hookTicksPerCall[hook] =
+        samples[hook] > 0 ? (double)ticks[hook] / samples[hook] : 0;
+    double seconds = calls[hook] * hookTicksPerCall[hook] * tickSeconds;
+    hooks += seconds;
+    fprintf(statsFile, "hook=%s,%llu,%llu,%.1f,%.6f\n", hookNames[hook],
+            calls[hook], samples[hook],
+            hookTicksPerCall[hook] * tickSeconds * 1e9, seconds);
+  }
+  fprintf(statsFile, "application_seconds=%.6f\n",
+          wall > hooks ? wall - hooks : 0.0);
+
+  std::vector<std::pair<double, long> > hottest;
+  for (auto &site : sites) {
+    double seconds = 0;
+    for (int hook = 0; hook < LLFI_NUM_HOOKS; ++hook)
+      seconds += _estimate(site.second.calls[hook], site.second.samples[hook],
+                           site.second.ticks[hook], hookTicksPerCall[hook]);
+    hottest.push_back(std::make_pair(seconds * tickSeconds, site.first));
+  }
+  std::sort(hottest.rbegin(), hottest.rend());
+  fprintf(statsFile, "sites=%zu\n", hottest.size());
+  for (size_t i = 0; i < hottest.size() && i < MAX_SITES; ++i) {
+    struct siteStats &site = sites[hottest[i].second];
+    fprintf(statsFile, "site=%ld,%.6f", hottest[i].second, hottest[i].first);
+    for (int hook = 0; hook < LLFI_NUM_HOOKS; ++hook)
+      fprintf(statsFile, ",%llu", site.calls[hook]);
+    fprintf(statsFile, "\n");
+  }
+  fclose(statsFile);
+}
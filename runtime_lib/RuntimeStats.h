@@ -0,0 +1,50 @@
+#ifndef LLFI_LIB_RUNTIME_STATS_H
+#define LLFI_LIB_RUNTIME_STATS_H
+
+// Runtime statistics of a fault injection run, set by the runtime_stats
+// option, to tell where the time of a slow run goes. The runtime counts the
+// calls of its hooks (preFunc, injectFunc and the tracing functions) by hook
+// and by llfi index, and times one call in every runtime_stats calls of each
+// hook, with the time stamp counter where there is one. At the exit of the
+// program, it writes the calls and the estimated time of each hook, the time
+// left to the program itself, the time to the first injection and after it,
+// and the sites in decreasing order of their estimated time: the hottest
+// instrumented sites come first.
+//
+// Without the option, the hooks of the fault injection library are not
+// wrapped at all, and the tracing functions only check llfi_runtime_stats.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Written at the exit of the program, next to llfi.stat.fi.injectedfaults.txt
+#define RUNTIME_STATS_FILENAME "llfi.stat.fi.runtimestats.txt"
+
+enum LLFIHook {
+  LLFI_HOOK_PREFUNC,
+  LLFI_HOOK_INJECTFUNC,
+  LLFI_HOOK_TRACE,
+  LLFI_NUM_HOOKS
+};
+
+extern bool llfi_runtime_stats;
+
+// Starts the statistics, timing the first call of each hook and one in every
+// period calls after it. The sites are the llfi indices below numSites.
+void llfiStartRuntimeStats(long long period, long numSites);
+// Counts a call of the hook. Returns its start time if the call is timed, 0
+// otherwise, to pass to llfiHookEnd with the llfi index of the site.
+uint64_t llfiHookBegin(int hook);
+void llfiHookEnd(int hook, long llfi_index, uint64_t start);
+// Marks the first injected fault, for the time to injection.
+void llfiRuntimeStatsInjected();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Shadow memory of the taint tracking pass (-tainttrackingpass). Each byte of
+// the program memory has a shadow byte, whose bits are set where the byte is
+// derived from an injected fault. The shadow bytes are kept in 64KB pages,
+// found through two levels of tables indexed by the bits 47-32 and 31-16 of
+// the address, and allocated when a tainted byte is first stored in them.
+
+#define SHADOW_L1_BITS 16
+#define SHADOW_L2_BITS 16
+#define SHADOW_PAGE_BITS 16
+#define SHADOW_PAGE_SIZE (1UL << SHADOW_PAGE_BITS)
+
+typedef unsigned char *ShadowPage;
+static ShadowPage *shadow_table[1UL << SHADOW_L1_BITS];
+// no shadow page is allocated until the first tainted store
+static int shadow_pages = 0;
+
+static long long tainted_output_bytes = 0;
+
+static inline unsigned long _l1Index(uintptr_t addr) {
+  return (addr >> (SHADOW_L2_BITS + SHADOW_PAGE_BITS)) &
+      ((1UL << SHADOW_L1_BITS) - 1);
+}
+
+static inline unsigned long _l2Index(uintptr_t addr) {
+  return (addr >> SHADOW_PAGE_BITS) & ((1UL << SHADOW_L2_BITS) - 1);
+}
+
+// Shadow of addr, NULL if its page is not allocated and create is false.
+static unsigned char *_getShadow(uintptr_t addr, int create) {
+  ShadowPage *l2 = __atomic_load_n(&shadow_table[_l1Index(addr)],
+                                   __ATOMIC_ACQUIRE);
+  if (l2 == NULL) {
+    if (!create)
+      return NULL;
+    ShadowPage *table = (ShadowPage*) calloc(1UL << SHADOW_L2_BITS,
+                                             sizeof(ShadowPage));
+    if (table == NULL) {
+      fprintf(stderr, "ERROR: Unable to allocate the taint shadow memory\n");
+      exit(1);
+    }
+    if (__atomic_compare_exchange_n(&shadow_table[_l1Index(addr)], &l2, table,
+                                    0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+      l2 = table;
+    else
+      free(table);
+  }
+
+  ShadowPage page = __atomic_load_n(&l2[_l2Index(addr)], __ATOMIC_ACQUIRE);
+  if (page == NULL) {
+    if (!create)
+      return NULL;
+    ShadowPage newpage = (ShadowPage) calloc(SHADOW_PAGE_SIZE, 1);
+    if (newpage == NULL) {
+      fprintf(stderr, "ERROR: Unable to allocate the taint shadow memory\n");
+      exit(1);
+    }
+    if (__atomic_compare_exchange_n(&l2[_l2Index(addr)], &page, newpage, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      page = newpage;
+      __atomic_fetch_add(&shadow_pages, 1, __ATOMIC_RELAXED);
+    } else {
+      free(newpage);
+    }
+  }
+  return page + (addr & (SHADOW_PAGE_SIZE - 1));
+}
+
+static inline unsigned char _loadShadowByte(uintptr_t addr) {
+  unsigned char *shadow = _getShadow(addr, 0);
+  return shadow != NULL ? *shadow : 0;
+}
+
+static inline void _storeShadowByte(uintptr_t addr, unsigned char value) {
+  unsigned char *shadow = _getShadow(addr, value != 0);
+  if (shadow != NULL)
+    *shadow = value;
+}
+
+/**
+ * external libraries
+ */
+
+// Shadow of a value of size bytes: bit i of the result is the shadow of bit i
+// of the value, for up to 8 bytes. Larger values are either fully tainted or
+// not tainted at all.
+uint64_t llfiTaintLoad(void *ptr, uint64_t size) {
+  if (__atomic_load_n(&shadow_pages, __ATOMIC_RELAXED) == 0)
+    return 0;
+
+  uintptr_t addr = (uintptr_t)ptr;
+  uint64_t shadow = 0;
+  uint64_t i;
+  if (size <= 8) {
+    for (i = 0; i < size; ++i)
+      shadow |= (uint64_t)_loadShadowByte(addr + i) << (8 * i);
+    return shadow;
+  }
+  for (i = 0; i < size; ++i)
+    if (_loadShadowByte(addr + i) != 0)
+      return ~(uint64_t)0;
+  return 0;
+}
+
+void llfiTaintStore(void *ptr, uint64_t size, uint64_t shadow) {
+  if (shadow == 0 && __atomic_load_n(&shadow_pages, __ATOMIC_RELAXED) == 0)
+    return;
+
+  uintptr_t addr = (uintptr_t)ptr;
+  uint64_t i;
+  for (i = 0; i < size; ++i) {
+    if (size <= 8)
+      _storeShadowByte(addr + i, (shadow >> (8 * i)) & 0xff);
+    else
+      _storeShadowByte(addr + i, shadow != 0 ? 0xff : 0);
+  }
+}
+
+// memcpy and memmove
+void llfiTaintCopy(void *dst, void *src, uint64_t size) {
+  if (__atomic_load_n(&shadow_pages, __ATOMIC_RELAXED) == 0)
+    return;
+
+  uintptr_t to = (uintptr_t)dst, from = (uintptr_t)src;
+  uint64_t i;
+  if (to <= from || to >= from + size) {
+    for (i = 0; i < size; ++i)
+      _storeShadowByte(to + i, _loadShadowByte(from + i));
+  } else {
+    for (i = size; i > 0; --i)
+      _storeShadowByte(to + i - 1, _loadShadowByte(from + i - 1));
+  }
+}
+
+// Bytes written by the program to its output: all of them if tainted is set,
+// otherwise the tainted bytes of the buffer.
+void llfiTaintOutput(void *buf, uint64_t size, uint64_t tainted) {
+  long long bytes = 0;
+  uint64_t i;
+  if (tainted) {
+    bytes = size;
+  } else if (buf != NULL &&
+             __atomic_load_n(&shadow_pages, __ATOMIC_RELAXED) != 0) {
+    for (i = 0; i < size; ++i)
+      if (_loadShadowByte((uintptr_t)buf + i) != 0)
+        bytes++;
+  }
+  if (bytes > 0)
+    __atomic_fetch_add(&tainted_output_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+void llfiTaintOutputString(char *str, uint64_t tainted) {
+  if (str != NULL)
+    llfiTaintOutput(str, strlen(str), tainted);
+}
+
+// Report of the taint tracking, written at the exit of the program. sites has
+// one byte per llfi index, set if the instruction produced a tainted value.
+// first and last count the dynamic instructions of the exiting thread up to
+// the first fault and the last tainted instruction, 0 if there is none.
+void postTaintTracking(unsigned char *sites, uint64_t numsites,
+                       uint64_t first, uint64_t last) {
+  FILE *taintFile = fopen("llfi.stat.taint.txt", "w");
+  if (taintFile == NULL) {
+    fprintf(stderr, "ERROR: Unable to open taint tracking stat file "
+            "llfi.stat.taint.txt\n");
+    return;
+  }
+
+  uint64_t i, tainted_sites = 0;
+  for (i = 0; i < numsites; ++i)
+    if (sites[i])
+      tainted_sites++;
+
+  fprintf(taintFile, "# written by the taint tracking of the fault injection "
+          "executable\n");
+  fprintf(taintFile, "tainted_sites=%llu\n", (unsigned long long)tainted_sites);
+  fprintf(taintFile, "tainted_output_bytes=%lld\n",
+          __atomic_load_n(&tainted_output_bytes, __ATOMIC_RELAXED));
+  fprintf(taintFile, "taint_lifetime=%llu\n",
+          first != 0 && last >= first ? (unsigned long long)(last - first) : 0);
+  for (i = 0; i < numsites; ++i)
+    if (sites[i])
+      fprintf(taintFile, "site=%llu\n", (unsigned long long)i);
+  fclose(taintFile);
+}
@@ -0,0 +1,58 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Utils.h"
+
+// pthread_create is defined in llfi-rt, which the profiling and the FI
+// executables are linked with before the C library, so that the threads of
+// the program are numbered in the order in which they are created. The order
+// of creation does not depend on the scheduling when a single thread creates
+// the others, unlike the order in which the threads first enter the runtime.
+
+typedef int (*pthread_create_t)(pthread_t *, const pthread_attr_t *,
+                                void *(*)(void *), void *);
+
+struct _threadStart {
+  void *(*start)(void *);
+  void *arg;
+  int id;
+};
+
+static void *_startThread(void *p) {
+  struct _threadStart start = *(struct _threadStart *)p;
+  free(p);
+  llfi_thread_id = start.id;
+  return start.start(start.arg);
+}
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start_routine)(void *), void *arg) {
+  static pthread_create_t real_pthread_create = NULL;
+  if (real_pthread_create == NULL) {
+    real_pthread_create = (pthread_create_t) dlsym(RTLD_NEXT, "pthread_create");
+    if (real_pthread_create == NULL) {
+      fprintf(stderr, "ERROR: Unable to find the C library function "
+              "pthread_create\n");
+      exit(1);
+    }
+  }
+
+  struct _threadStart *start =
+      (struct _threadStart *) malloc(sizeof(struct _threadStart));
+  if (start == NULL)
+    return EAGAIN;
+  start->start = start_routine;
+  start->arg = arg;
+  // the creating thread is numbered before the threads it creates
+  getLLFIThreadId();
+  start->id = newLLFIThreadId();
+
+  int ret = real_pthread_create(thread, attr, _startThread, start);
+  if (ret != 0)
+    free(start);
+  return ret;
+}
@@ -1,9 +1,12 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 
 #include "Utils.h"
 
 int start_tracing_flag = TRACING_GOLDEN_RUN; //for instTraceLib: initialized to Golden Run setting
+long long llfi_trace_count = 0;
+long long llfi_trace_next = 0;
 
 void getOpcodeExecCycleArray(const unsigned len, int *arr) {
   int i = 0;
@@ -23,3 +26,77 @@ bool isLittleEndian() {
   ptr = (char*)&data; 
   return *ptr == 0x1;
 }
+
+// Read by the injectFault functions generated with -fisitetable.
+// llfi_site_bitmap_bits is -1 until loadSiteBitmap() is called.
+unsigned char *llfi_site_bitmap = NULL;
+long long llfi_site_bitmap_bits = -1;
+
+void loadSiteBitmap() {
+  if (llfi_site_bitmap_bits >= 0)
+    return;
+  llfi_site_bitmap_bits = 0;
+
+  FILE *bitmapFile = fopen(SITE_BITMAP_FILENAME, "rb");
+  if (bitmapFile == NULL)
+    return;
+
+  fseek(bitmapFile, 0, SEEK_END);
+  long size = ftell(bitmapFile);
+  fseek(bitmapFile, 0, SEEK_SET);
+
+  unsigned char *bitmap = (unsigned char*) calloc(size > 0 ? size : 1, 1);
+  if (bitmap == NULL || (long)fread(bitmap, 1, size, bitmapFile) != size) {
+    fprintf(stderr, "ERROR: Unable to read site bitmap file %s\n",
+            SITE_BITMAP_FILENAME);
+    exit(1);
+  }
+  fclose(bitmapFile);
+
+  llfi_site_bitmap = bitmap;
+  llfi_site_bitmap_bits = (long long)size * 8;
+}
+
+static int llfi_thread_count = 0;
+__thread int llfi_thread_id = -1;
+
+int newLLFIThreadId() {
+  return __atomic_fetch_add(&llfi_thread_count, 1, __ATOMIC_RELAXED);
+}
+
+int registerLLFIThread() {
+  llfi_thread_id = newLLFIThreadId();
+  return llfi_thread_id;
+}
+
+// The thread that loads the runtime is thread 0, even if another thread
+// enters the runtime first.
+__attribute__((constructor)) static void _registerMainThread() {
+  getLLFIThreadId();
+}
+
+static unsigned long long llfi_random_seed = 0;
+static __thread unsigned long long llfi_random_state = 0;
+
+void seedLLFIRandom(unsigned long long seed) {
+  llfi_random_seed = seed;
+  llfi_random_state = 0;
+}
+
+// xorshift64*, seeded with splitmix64 of the seed and the thread id.
+double getLLFIRandom() {
+  unsigned long long x = llfi_random_state;
+  if (x == 0) {
+    x = llfi_random_seed + 0x9E3779B97F4A7C15ULL * (getLLFIThreadId() + 1);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    if (x == 0)
+      x = 1;
+  }
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  llfi_random_state = x;
+  return ((x * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
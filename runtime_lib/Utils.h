@@ -2,6 +2,11 @@
 #define LLFI_LIB_UTILS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 // TRACING =  Tracing flag
 #define TRACING_GOLDEN_RUN -1
@@ -11,12 +16,63 @@
 #define TRACING_FI_RUN_END_TRACING 3
 extern int start_tracing_flag;
 
+// Dynamic instructions counted by the trace pass (-insttracepass), which
+// only calls the tracing function once the count reaches llfi_trace_next.
+// The tracing function sets llfi_trace_next to the start of the next trace
+// window, and the fault injection sets it to 0 to start the faulty trace.
+extern long long llfi_trace_count;
+extern long long llfi_trace_next;
+// Ends the trace and the hash checkpoints of this process, in InstTraceLib.c
+void stopTracing();
+
 // assume the max opcode in instruction.def (LLVM) is smaller than 100
 #define OPCODE_CYCLE_ARRAY_LEN 100
 void getOpcodeExecCycleArray(const unsigned len, int *arr);
 
 bool isLittleEndian();
 
+// Site bitmap of union instrumentation (-fisitetable). Bit i (LSB first) of
+// the bitmap file is set if the site with llfi index i is active. Without the
+// file, or before it is loaded, every site is active.
+#define SITE_BITMAP_FILENAME "llfi.config.sitebitmap.bin"
+extern unsigned char *llfi_site_bitmap;
+extern long long llfi_site_bitmap_bits;
+void loadSiteBitmap();
+
+static inline bool isSiteActive(long llfi_index) {
+  if (llfi_site_bitmap_bits < 0)
+    loadSiteBitmap();
+  if (llfi_site_bitmap == NULL)
+    return true;
+  return (unsigned long long)llfi_index < (unsigned long long)llfi_site_bitmap_bits &&
+         ((llfi_site_bitmap[llfi_index >> 3] >> (llfi_index & 7)) & 1);
+}
+
+// Threads of the target program. The cycles and the random numbers of the
+// runtime are per thread, so that the threads do not share any state on the
+// fast path. Thread 0 is the thread that loads the runtime. With llfi-rt,
+// the other threads are numbered in the order in which they are created, see
+// ThreadLib.c, so the ids of the profiling and the FI runs match as long as
+// the program creates its threads in a deterministic order. The threads that
+// are not created with pthread_create, and the threads of the ML runtime, are
+// numbered in the order in which they first enter the runtime.
+extern __thread int llfi_thread_id;
+int newLLFIThreadId();
+int registerLLFIThread();
+
+static inline int getLLFIThreadId() {
+  return llfi_thread_id >= 0 ? llfi_thread_id : registerLLFIThread();
+}
+
+// Per-thread random numbers, uniform in [0, 1). Each thread derives its
+// state from the seed and its thread id.
+void seedLLFIRandom(unsigned long long seed);
+double getLLFIRandom();
+
+#ifdef __cplusplus
+}
+#endif
+
 #define DEBUG
 #ifdef DEBUG
 #define debug(x) printf x; fflush(stdout);
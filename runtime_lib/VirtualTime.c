@@ -0,0 +1,48 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "VirtualTime.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+// Amount by which the virtual clocks are ahead of the real clocks.
+static long long virtual_offset_ns = 0;
+// If set, the sleeps of the program are virtual as well.
+static bool virtual_sleep = false;
+
+/**
+ * external libraries
+ */
+void llfiEnableVirtualSleep() {
+  virtual_sleep = true;
+}
+
+bool llfiVirtualSleepEnabled() {
+  return virtual_sleep;
+}
+
+long long llfiVirtualTimeOffset() {
+  return __atomic_load_n(&virtual_offset_ns, __ATOMIC_RELAXED);
+}
+
+void llfiAdvanceVirtualTime(long long ns) {
+  if (ns > 0)
+    __atomic_fetch_add(&virtual_offset_ns, ns, __ATOMIC_RELAXED);
+}
+
+void llfiVirtualSleep(double seconds) {
+  llfiAdvanceVirtualTime((long long)(seconds * NSEC_PER_SEC));
+}
+
+void llfiInjectHang(long llfi_index) {
+  FILE *hangFile = fopen(HANG_RECORD_FILENAME, "w");
+  if (hangFile != NULL) {
+    fprintf(hangFile, "hang injected at index %ld\n", llfi_index);
+    fclose(hangFile);
+  }
+  // like a program killed at the timeout, without flushing its output
+  _exit(HANG_EXIT_CODE);
+}
+
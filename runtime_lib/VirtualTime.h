@@ -0,0 +1,37 @@
+#ifndef LLFI_LIB_VIRTUAL_TIME_H
+#define LLFI_LIB_VIRTUAL_TIME_H
+
+// Virtual time of the target program. The llfi-vt library, linked into the
+// fault injection executable only, interposes sleep, usleep, nanosleep,
+// clock_gettime, gettimeofday and time, so that the clocks read by the
+// program are the real clocks plus an offset kept by llfi-rt. A virtual
+// sleep advances the offset instead of blocking, and an injected hang ends
+// the program with a hang record instead of spinning until the timeout of
+// injectfault.
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Written by llfiInjectHang(), and detected by injectfault as a hang.
+#define HANG_RECORD_FILENAME "llfi.stat.fi.hang.txt"
+// Exit code of a program that ended with an injected hang.
+#define HANG_EXIT_CODE 124
+
+// Makes the sleeps of the program virtual, set by the virtual_time option.
+void llfiEnableVirtualSleep();
+void llfiVirtualSleep(double seconds);
+void llfiInjectHang(long llfi_index);
+
+// The offset of the virtual clocks, for the interposed functions.
+bool llfiVirtualSleepEnabled();
+long long llfiVirtualTimeOffset();
+void llfiAdvanceVirtualTime(long long ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
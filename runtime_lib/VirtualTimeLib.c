@@ -0,0 +1,153 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "VirtualTime.h"
+
+// The functions below are defined in the llfi-vt library, which the FI
+// executable is linked with before the C library, so the calls of the
+// program resolve to them. The profiling executable is not linked with it,
+// and reads the real clocks. The real functions are looked up on first use.
+
+#define NSEC_PER_SEC 1000000000LL
+
+typedef int (*clock_gettime_t)(clockid_t, struct timespec *);
+typedef int (*nanosleep_t)(const struct timespec *, struct timespec *);
+typedef int (*clock_nanosleep_t)(clockid_t, int, const struct timespec *,
+                                 struct timespec *);
+typedef unsigned (*sleep_t)(unsigned);
+typedef int (*usleep_t)(useconds_t);
+
+static void *_realFunc(const char *name) {
+  void *func = dlsym(RTLD_NEXT, name);
+  if (func == NULL) {
+    fprintf(stderr, "ERROR: Unable to find the C library function %s\n", name);
+    exit(1);
+  }
+  return func;
+}
+
+#define REAL(name) \
+  static name##_t real_##name = NULL; \
+  if (real_##name == NULL) \
+    real_##name = (name##_t) _realFunc(#name)
+
+// Clocks that measure elapsed time, as opposed to CPU time.
+static bool _isVirtualClock(clockid_t clk) {
+  switch (clk) {
+    case CLOCK_REALTIME:
+    case CLOCK_MONOTONIC:
+#ifdef CLOCK_MONOTONIC_RAW
+    case CLOCK_MONOTONIC_RAW:
+#endif
+#ifdef CLOCK_REALTIME_COARSE
+    case CLOCK_REALTIME_COARSE:
+#endif
+#ifdef CLOCK_MONOTONIC_COARSE
+    case CLOCK_MONOTONIC_COARSE:
+#endif
+#ifdef CLOCK_BOOTTIME
+    case CLOCK_BOOTTIME:
+#endif
+#ifdef CLOCK_TAI
+    case CLOCK_TAI:
+#endif
+      return true;
+    default:
+      return false;
+  }
+}
+
+static long long _toNs(const struct timespec *ts) {
+  return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+/**
+ * interposed functions of the C library
+ */
+int clock_gettime(clockid_t clk, struct timespec *ts) {
+  REAL(clock_gettime);
+  int ret = real_clock_gettime(clk, ts);
+  long long offset = llfiVirtualTimeOffset();
+  if (ret == 0 && offset != 0 && _isVirtualClock(clk)) {
+    long long ns = ts->tv_nsec + offset % NSEC_PER_SEC;
+    ts->tv_sec += offset / NSEC_PER_SEC + ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+  }
+  return ret;
+}
+
+// tv is declared nonnull by the C library, and tz is obsolete
+int gettimeofday(struct timeval *tv, void *tz __attribute__((unused))) {
+  struct timespec ts;
+  int ret = clock_gettime(CLOCK_REALTIME, &ts);
+  if (ret == 0) {
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+  }
+  return ret;
+}
+
+time_t time(time_t *t) {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_REALTIME, &ts) != 0)
+    return (time_t)-1;
+  if (t != NULL)
+    *t = ts.tv_sec;
+  return ts.tv_sec;
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+  REAL(nanosleep);
+  if (!llfiVirtualSleepEnabled())
+    return real_nanosleep(req, rem);
+  if (req->tv_nsec < 0 || req->tv_nsec >= NSEC_PER_SEC) {
+    errno = EINVAL;
+    return -1;
+  }
+  llfiAdvanceVirtualTime(_toNs(req));
+  if (rem != NULL)
+    rem->tv_sec = rem->tv_nsec = 0;
+  return 0;
+}
+
+int clock_nanosleep(clockid_t clk, int flags, const struct timespec *req,
+                    struct timespec *rem) {
+  REAL(clock_nanosleep);
+  if (!llfiVirtualSleepEnabled() || !_isVirtualClock(clk))
+    return real_clock_nanosleep(clk, flags, req, rem);
+  if (req->tv_nsec < 0 || req->tv_nsec >= NSEC_PER_SEC)
+    return EINVAL;
+  if (flags & TIMER_ABSTIME) {
+    struct timespec now;
+    clock_gettime(clk, &now);
+    llfiAdvanceVirtualTime(_toNs(req) - _toNs(&now));
+  } else {
+    llfiAdvanceVirtualTime(_toNs(req));
+    if (rem != NULL)
+      rem->tv_sec = rem->tv_nsec = 0;
+  }
+  return 0;
+}
+
+unsigned sleep(unsigned seconds) {
+  REAL(sleep);
+  if (!llfiVirtualSleepEnabled())
+    return real_sleep(seconds);
+  llfiAdvanceVirtualTime(seconds * NSEC_PER_SEC);
+  return 0;
+}
+
+int usleep(useconds_t usec) {
+  REAL(usleep);
+  if (!llfiVirtualSleepEnabled())
+    return real_usleep(usec);
+  llfiAdvanceVirtualTime(usec * 1000LL);
+  return 0;
+}
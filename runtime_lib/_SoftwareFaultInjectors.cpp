@@ -1,5 +1,6 @@
 #include "FaultInjector.h"
 #include "FaultInjectorManager.h"
+#include "VirtualTime.h"
 #include <fstream>
 #include <iostream>
 #include <stdio.h>
@@ -10,6 +11,9 @@
 
 //2^20 == 32MB
 #define MEM_EXHAUSTION_UNIT 33554432
+// Read by injectfault, which counts the run as exceeding its memory limit
+// when the run has one (memoryLimit)
+#define LIMIT_RECORD_FILENAME "llfi.stat.fi.limit.txt"
 
 class BitCorruptionInjector: public SoftwareFaultInjector {
 	public:
@@ -42,7 +46,7 @@ class MemoryLeakInjector: public SoftwareFaultInjector {
 class HangInjector: public SoftwareFaultInjector {
 	public:
 	virtual void injectFault(long llfi_index, unsigned size, unsigned fi_bit,char *buf){
-		while(1);
+		llfiInjectHang(llfi_index);
 		return;
 	}
 };
@@ -50,7 +54,7 @@ class HangInjector: public SoftwareFaultInjector {
 class SleepInjector: public SoftwareFaultInjector {
 	public:
 	virtual void injectFault(long llfi_index, unsigned size, unsigned fi_bit,char *buf){
-		sleep(3);
+		llfiVirtualSleep(3);
 		return;
 	}
 };
@@ -118,6 +122,11 @@ class MemoryExhaustionInjector: public SoftwareFaultInjector {
 			if(p == NULL)	p = malloc(MEM_EXHAUSTION_UNIT>>12);
 			if(p != NULL)	left_space = p;
 		}while(p != NULL);
+		FILE *limitFile = fopen(LIMIT_RECORD_FILENAME, "w");
+		if(limitFile != NULL){
+			fprintf(limitFile, "memory exhausted at index %ld\n", llfi_index);
+			fclose(limitFile);
+		}
 		if(non_left_space){
 			void** newbuf = (void**) buf;
 			*newbuf = p;
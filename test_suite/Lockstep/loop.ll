@@ -0,0 +1,26 @@
+; Ten iterations, with a checkpoint at the back edge of the loop. %high, llfi
+; index 4, is masked by the and of %low in its iteration when bit 4 is flipped,
+; while the fault in %sum, llfi index 6, propagates to the sum printed at the
+; end.
+@.fmt = private unnamed_addr constant [4 x i8] c"%d\0A\00", align 1
+
+declare i32 @printf(i8*, ...)
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %sum, %loop ]
+  %high = add i32 %i, 16
+  %low = and i32 %high, 15
+  %sum = add i32 %acc, %low
+  %next = add i32 %i, 1
+  %done = icmp eq i32 %next, 10
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %call = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @.fmt, i64 0, i64 0), i32 %sum)
+  ret i32 0
+}
@@ -0,0 +1,25 @@
+; The values of getpid differ between the golden process and the faulty one,
+; so the first checkpoint, at the back edge of the loop, does not match before
+; the fault is injected in %sum, llfi index 5, at the eighth iteration.
+@.fmt = private unnamed_addr constant [4 x i8] c"%d\0A\00", align 1
+
+declare i32 @printf(i8*, ...)
+declare i32 @getpid()
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %sum, %loop ]
+  %pid = call i32 @getpid()
+  %sum = add i32 %acc, %pid
+  %next = add i32 %i, 1
+  %done = icmp eq i32 %next, 10
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %call = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @.fmt, i64 0, i64 0), i32 %next)
+  ret i32 0
+}
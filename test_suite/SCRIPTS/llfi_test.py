@@ -9,13 +9,18 @@ Usage: %(prog)s [OPTIONS]
 List of options:
 
 --threads <number of threads to use>: number of threads to be used for fault injections, default value: 1.
---all: Test all the test cases of LLFI test suite, including fault injection tests, trace analysis tests and make file generation tests.
+--all: Test all the test cases of LLFI test suite, including fault injection tests, trace analysis tests, make file generation tests, SDC estimator tests, taint tracking tests, lockstep tests, fault injection planner tests and campaign tests.
 --all_fault_injections: Test all the test cases of fault injections, including HardwareFaults, SoftwareFaults and BatchMode tests.
 --all_software_faults: Test all the test cases of SoftwareFaults.
 --all_hardware_faults: Test all the test cases of HardwareFaults.
 --all_batchmode: Test all the test cases of BatchMode fault injections.
 --all_trace_tools_tests: Test all the tests for trace analysis tools.
 --all_makefile_generation: Test all the tests for makefile generation script.
+--all_sdc_estimator_tests: Test all the tests for the static SDC estimator pass.
+--all_taint_tracking_tests: Test all the tests for the taint tracking of the fault injection runs.
+--all_lockstep_tests: Test all the tests for the fault injection runs in lockstep with a golden process.
+--all_fiplanner_tests: Test all the tests for the planning and the estimates of the fault injection planner.
+--all_campaign_tests: Test all the tests for the campaign coordinator and its workers.
 --test_cases [test case names]: Test only specified test case.
 --clean_after_test: Clean all the generate files after testing.
 
@@ -37,6 +42,11 @@ options = {
 	'all_batchmode':False,
 	'all_trace_tools_tests':False,
 	'all_makefile_generation':False,
+	'all_sdc_estimator_tests':False,
+	'all_taint_tracking_tests':False,
+	'all_lockstep_tests':False,
+	'all_fiplanner_tests':False,
+	'all_campaign_tests':False,
 	'test_cases':[],
 	'threads':1,
 	'clean_after_test':False,
@@ -97,6 +107,21 @@ def parseArgs(args):
 		elif arg == "--all_makefile_generation":
 			options['all_makefile_generation'] = True
 
+		elif arg == "--all_sdc_estimator_tests":
+			options['all_sdc_estimator_tests'] = True
+
+		elif arg == "--all_taint_tracking_tests":
+			options['all_taint_tracking_tests'] = True
+
+		elif arg == "--all_lockstep_tests":
+			options['all_lockstep_tests'] = True
+
+		elif arg == "--all_fiplanner_tests":
+			options['all_fiplanner_tests'] = True
+
+		elif arg == "--all_campaign_tests":
+			options['all_campaign_tests'] = True
+
 		elif arg == "--clean_after_test":
 			options['clean_after_test'] = True
 
@@ -123,6 +148,11 @@ def startTestRoutine():
 	injection_result_list = []
 	trace_result_list = []
 	generate_makefile_result_list = []
+	sdc_estimator_result_list = []
+	taint_tracking_result_list = []
+	lockstep_result_list = []
+	fiplanner_result_list = []
+	campaign_result_list = []
 
 	if options['all'] or options['all_batchmode'] or options['all_hardware_faults']\
 	or options['all_software_faults'] or options['all_fault_injections']\
@@ -220,6 +250,61 @@ def startTestRoutine():
 		verbosePrint('Calling: test_generate_makefile.test_generate_makefile(' + ' '.join(prog_list) + ')')
 		test_generate_makefile_returncode, generate_makefile_result_list = test_generate_makefile.test_generate_makefile(*prog_list)
 
+	## run SDC estimator tests
+	if options['all_sdc_estimator_tests'] or options['all'] or options['test_cases'] != []:
+		import test_sdc_estimator
+		prog_list = []
+		if options['test_cases'] != []:
+			prog_list.extend(options['test_cases'])
+		elif options['all_sdc_estimator_tests'] or options['all']:
+			pass
+		verbosePrint('Calling: test_sdc_estimator.test_sdc_estimator(' + ' '.join(prog_list) + ')')
+		test_sdc_estimator_returncode, sdc_estimator_result_list = test_sdc_estimator.test_sdc_estimator(*prog_list)
+
+	## run taint tracking tests
+	if options['all_taint_tracking_tests'] or options['all'] or options['test_cases'] != []:
+		import test_taint_tracking
+		prog_list = []
+		if options['test_cases'] != []:
+			prog_list.extend(options['test_cases'])
+		elif options['all_taint_tracking_tests'] or options['all']:
+			pass
+		verbosePrint('Calling: test_taint_tracking.test_taint_tracking(' + ' '.join(prog_list) + ')')
+		test_taint_tracking_returncode, taint_tracking_result_list = test_taint_tracking.test_taint_tracking(*prog_list)
+
+	## run lockstep tests
+	if options['all_lockstep_tests'] or options['all'] or options['test_cases'] != []:
+		import test_lockstep
+		prog_list = []
+		if options['test_cases'] != []:
+			prog_list.extend(options['test_cases'])
+		elif options['all_lockstep_tests'] or options['all']:
+			pass
+		verbosePrint('Calling: test_lockstep.test_lockstep(' + ' '.join(prog_list) + ')')
+		test_lockstep_returncode, lockstep_result_list = test_lockstep.test_lockstep(*prog_list)
+
+	## run fault injection planner tests
+	if options['all_fiplanner_tests'] or options['all'] or options['test_cases'] != []:
+		import test_fiplanner
+		prog_list = []
+		if options['test_cases'] != []:
+			prog_list.extend(options['test_cases'])
+		elif options['all_fiplanner_tests'] or options['all']:
+			pass
+		verbosePrint('Calling: test_fiplanner.test_fiplanner(' + ' '.join(prog_list) + ')')
+		test_fiplanner_returncode, fiplanner_result_list = test_fiplanner.test_fiplanner(*prog_list)
+
+	## run campaign tests
+	if options['all_campaign_tests'] or options['all'] or options['test_cases'] != []:
+		import test_campaign
+		prog_list = []
+		if options['test_cases'] != []:
+			prog_list.extend(options['test_cases'])
+		elif options['all_campaign_tests'] or options['all']:
+			pass
+		verbosePrint('Calling: test_campaign.test_campaign(' + ' '.join(prog_list) + ')')
+		test_campaign_returncode, campaign_result_list = test_campaign.test_campaign(*prog_list)
+
 	## collect the results
 	total = 0
 	passed = 0
@@ -246,6 +331,46 @@ def startTestRoutine():
 			if record['result'] == 'PASS':
 				passed += 1
 
+	if len(sdc_estimator_result_list) > 0:
+		print("==== Test SDC Estimator Result ====")
+		for record in sdc_estimator_result_list:
+			print(record["name"], '\t\t', record["result"])
+			total += 1
+			if record['result'] == 'PASS':
+				passed += 1
+
+	if len(taint_tracking_result_list) > 0:
+		print("==== Test Taint Tracking Result ====")
+		for record in taint_tracking_result_list:
+			print(record["name"], '\t\t', record["result"])
+			total += 1
+			if record['result'] == 'PASS':
+				passed += 1
+
+	if len(lockstep_result_list) > 0:
+		print("==== Test Lockstep Result ====")
+		for record in lockstep_result_list:
+			print(record["name"], '\t\t', record["result"])
+			total += 1
+			if record['result'] == 'PASS':
+				passed += 1
+
+	if len(fiplanner_result_list) > 0:
+		print("==== Test Fault Injection Planner Result ====")
+		for record in fiplanner_result_list:
+			print(record["name"], '\t\t', record["result"])
+			total += 1
+			if record['result'] == 'PASS':
+				passed += 1
+
+	if len(campaign_result_list) > 0:
+		print("==== Test Campaign Result ====")
+		for record in campaign_result_list:
+			print(record["name"], '\t\t', record["result"])
+			total += 1
+			if record['result'] == 'PASS':
+				passed += 1
+
 	print("=== Overall Counts ====")
 	print("Total tests:\t", total)
 	print("Passed tests:\t", passed)
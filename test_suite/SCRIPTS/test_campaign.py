@@ -0,0 +1,257 @@
+#! /usr/bin/env python3
+
+import os
+import sys
+import shutil
+import signal
+import subprocess
+import tempfile
+import time
+
+ficoordinator_script = ""
+fiworker_script = ""
+
+token = "llfi-test-campaign"
+
+# The fault injection executable of the campaigns, standing for an instrumented
+# program: the runs whose cycle is a multiple of 5 hang until their timeout, and
+# the ones one past a multiple of 5 end like the lockstep ends a masked run.
+fi_exe = "llfi/campaign-faultinjection.exe"
+fi_exe_script = """#!/bin/sh
+c=$(sed -n 's/^fi_cycle=//p' llfi.config.runtime.txt)
+echo "FI stat: fi_type=bitflip, fi_index=$((c % 10)), fi_cycle=$c" > llfi.stat.fi.injectedfaults.txt
+if [ $((c % 5)) -eq 0 ]; then exec sleep 3; fi
+if [ $((c % 5)) -eq 1 ]; then echo result=masked > llfi.stat.lockstep.txt; fi
+sleep 0.1
+echo out $c
+"""
+
+def makeProgram(progdir, runs):
+	os.makedirs(os.path.join(progdir, "llfi"))
+	with open(os.path.join(progdir, "input.yaml"), 'w') as f:
+		f.write("runOption:\n- run:\n    fi_type: bitflip\n    numOfRuns: %d\n"
+				"    timeOut: 1\n    fi_random_seed: 3\n" % runs)
+	with open(os.path.join(progdir, "llfi.stat.prof.txt"), 'w') as f:
+		f.write("total_cycle=1000\n")
+	exe = os.path.join(progdir, fi_exe)
+	with open(exe, 'w') as f:
+		f.write(fi_exe_script)
+	os.chmod(exe, 0o755)
+
+def startWorkers(work_dir, names):
+	"""Starts a worker on a Unix socket for each name, each in its own copy of
+	the program directory. Returns {name: (process, address)}"""
+	workers = {}
+	for name in names:
+		shutil.copytree(os.path.join(work_dir, "master"), os.path.join(work_dir, name))
+		address = os.path.join(work_dir, name + ".sock")
+		log = open(os.path.join(work_dir, name + ".log"), 'w')
+		p = subprocess.Popen([fiworker_script, "--name", name, "--listen", address,
+							os.path.join(work_dir, name)], stdout=log, stderr=log)
+		workers[name] = (p, address)
+	for i in range(100):
+		if all(os.path.exists(address) for p, address in workers.values()):
+			break
+		time.sleep(0.1)
+	return workers
+
+def stopWorkers(workers):
+	for p, address in workers.values():
+		if p.poll() is None:
+			p.kill()
+		p.wait()
+
+def startCoordinator(work_dir, workers, options, logname):
+	log = open(os.path.join(work_dir, logname), 'w')
+	addresses = ','.join(address for p, address in workers.values())
+	return subprocess.Popen([ficoordinator_script, "--worker", addresses, "--verbose"] +
+						options + [fi_exe], cwd=os.path.join(work_dir, "master"),
+						stdout=log, stderr=log)
+
+def readLog(work_dir, logname):
+	with open(os.path.join(work_dir, logname)) as f:
+		return f.read()
+
+def summaryValue(log, prefix):
+	"""The number after prefix in the summary of the coordinator, or None"""
+	for line in log.splitlines():
+		i = line.find(prefix)
+		if i >= 0:
+			return int(line[i + len(prefix):].split()[0].rstrip(','))
+	return None
+
+def journalRuns(work_dir):
+	path = os.path.join(work_dir, "master", "llfi", "campaign_journal.txt")
+	if not os.path.isfile(path):
+		return []
+	with open(path) as f:
+		return [line[len("run="):].split(',')[0] for line in f if line.startswith("run=")]
+
+def waitJournal(work_dir, runs, timeout):
+	end = time.time() + timeout
+	while time.time() < end and len(journalRuns(work_dir)) < runs:
+		time.sleep(0.1)
+	return len(journalRuns(work_dir)) >= runs
+
+def checkCampaign(work_dir, runs):
+	"""Checks that every run is stored once, with its outputs"""
+	stored = journalRuns(work_dir)
+	if len(stored) != runs or len(set(stored)) != runs:
+		return "FAIL: %d runs in the journal, %d different, instead of %d" % \
+			(len(stored), len(set(stored)), runs)
+	stddir = os.path.join(work_dir, "master", "llfi", "std_output")
+	outputs = os.listdir(stddir) if os.path.isdir(stddir) else []
+	if len(outputs) != runs:
+		return "FAIL: %d standard outputs instead of %d" % (len(outputs), runs)
+	return "PASS"
+
+def maskedRuns(work_dir):
+	"""The runs that the executable ended as masked, from their outputs"""
+	masked = 0
+	stddir = os.path.join(work_dir, "master", "llfi", "std_output")
+	for name in os.listdir(stddir):
+		with open(os.path.join(stddir, name)) as f:
+			words = f.read().split()
+		if len(words) == 2 and words[0] == "out" and int(words[1]) % 5 == 1:
+			masked += 1
+	return masked
+
+def testStealing(work_dir):
+	"""The idle workers take back the runs queued behind the hangs of the
+	others, and the masked runs are counted as MK"""
+	runs = 30
+	makeProgram(os.path.join(work_dir, "master"), runs)
+	workers = startWorkers(work_dir, ["w1", "w2", "w3"])
+	try:
+		p = startCoordinator(work_dir, workers, ["--shard", "16"], "coordinator.log")
+		p.wait(timeout=120)
+	finally:
+		stopWorkers(workers)
+	log = readLog(work_dir, "coordinator.log")
+	if p.returncode != 0:
+		return "FAIL: ficoordinator returned %d" % p.returncode
+	result = checkCampaign(work_dir, runs)
+	if result != "PASS":
+		return result
+	steals = summaryValue(log, "shards stolen:")
+	if steals is None or steals == 0:
+		return "FAIL: no shard was stolen"
+	masked = summaryValue(log, "MK:")
+	if masked != maskedRuns(work_dir) or masked == 0:
+		return "FAIL: %s masked runs counted instead of %d" % (masked, maskedRuns(work_dir))
+	return "PASS"
+
+def testRetry(work_dir):
+	"""The runs of a killed worker are sent again to the others"""
+	runs = 30
+	makeProgram(os.path.join(work_dir, "master"), runs)
+	workers = startWorkers(work_dir, ["w1", "w2", "w3"])
+	try:
+		p = startCoordinator(work_dir, workers, ["--reconnect", "1"], "coordinator.log")
+		if not waitJournal(work_dir, 3, 60):
+			p.kill()
+			return "FAIL: no run stored"
+		workers["w1"][0].send_signal(signal.SIGKILL)
+		p.wait(timeout=120)
+	finally:
+		stopWorkers(workers)
+	log = readLog(work_dir, "coordinator.log")
+	if p.returncode != 0:
+		return "FAIL: ficoordinator returned %d" % p.returncode
+	result = checkCampaign(work_dir, runs)
+	if result != "PASS":
+		return result
+	if summaryValue(log, "Runs sent again:") in (None, 0):
+		return "FAIL: no run of the killed worker was sent again"
+	return "PASS"
+
+def testResume(work_dir):
+	"""A killed coordinator resumes the campaign with --resume, without running
+	the runs stored again"""
+	runs = 30
+	makeProgram(os.path.join(work_dir, "master"), runs)
+	workers = startWorkers(work_dir, ["w1", "w2"])
+	try:
+		p = startCoordinator(work_dir, workers, [], "coordinator.log")
+		if not waitJournal(work_dir, 5, 60):
+			p.kill()
+			return "FAIL: no run stored"
+		p.send_signal(signal.SIGKILL)
+		p.wait()
+		stored = len(journalRuns(work_dir))
+		if stored >= runs:
+			return "FAIL: the campaign ended before the coordinator was killed"
+		p = startCoordinator(work_dir, workers, ["--resume"], "resume.log")
+		p.wait(timeout=120)
+	finally:
+		stopWorkers(workers)
+	log = readLog(work_dir, "resume.log")
+	if p.returncode != 0:
+		return "FAIL: ficoordinator --resume returned %d" % p.returncode
+	if "%d runs on 2 workers, %d stored already" % (runs, stored) not in log:
+		return "FAIL: the %d runs stored were not skipped" % stored
+	return checkCampaign(work_dir, runs)
+
+def testToken(work_dir):
+	"""The workers refuse a coordinator with another token"""
+	makeProgram(os.path.join(work_dir, "master"), 2)
+	workers = startWorkers(work_dir, ["w1"])
+	try:
+		p = startCoordinator(work_dir, workers, ["--token", "not-" + token,
+							"--worker-timeout", "2"], "coordinator.log")
+		p.wait(timeout=60)
+	finally:
+		stopWorkers(workers)
+	if p.returncode == 0:
+		return "FAIL: ficoordinator ran the campaign with another token"
+	if journalRuns(work_dir):
+		return "FAIL: a worker ran a run of a coordinator with another token"
+	if "token" not in readLog(work_dir, "w1.log"):
+		return "FAIL: the worker did not report the token"
+	return "PASS"
+
+tests = {
+	"stealing": testStealing,
+	"retry": testRetry,
+	"resume": testResume,
+	"token": testToken,
+}
+
+def test_campaign(*test_list):
+	global ficoordinator_script
+	global fiworker_script
+
+	r = 0
+	script_dir = os.path.dirname(os.path.realpath(__file__))
+	llfi_bin_dir = os.path.join(script_dir, '../../bin')
+	ficoordinator_script = os.path.join(llfi_bin_dir, "ficoordinator")
+	fiworker_script = os.path.join(llfi_bin_dir, "fiworker")
+	# the workers and the coordinators of the tests share the token
+	os.environ["LLFI_CAMPAIGN_TOKEN"] = token
+
+	result_list = []
+	for test in tests:
+		if len(test_list) != 0 and test not in test_list and "all" not in test_list:
+			continue
+		print ("MSG: Testing the campaign:", test)
+		work_dir = tempfile.mkdtemp(prefix="llfi_test_campaign_")
+		try:
+			result = tests[test](work_dir)
+		except subprocess.TimeoutExpired:
+			result = "FAIL: the campaign did not end"
+		if result != "PASS":
+			r += 1
+			print ("MSG: The files of the campaign are kept in", work_dir)
+		else:
+			shutil.rmtree(work_dir, ignore_errors=True)
+		result_list.append({"name": test, "result": result})
+
+	return r, result_list
+
+if __name__ == "__main__":
+	r, result_list = test_campaign(*sys.argv[1:])
+	print ("=============== Result ===============")
+	for record in result_list:
+		print(record["name"], "\t\t", record["result"])
+
+	sys.exit(r)
@@ -0,0 +1,174 @@
+#! /usr/bin/env python3
+
+import os
+import sys
+import shutil
+import subprocess
+import tempfile
+
+fiplanner_script = ""
+
+# <llfi index>: (opcode, dynamic instances, cycles). By opcode class, the
+# strata have 700 (intarith), 200 (control) and 100 (memory) cycles.
+sites = {
+	1: ("add", 60, 600),
+	2: ("mul", 10, 100),
+	3: ("icmp", 20, 200),
+	4: ("load", 10, 100),
+}
+
+# <test name>: the options of fiplanner and the runs expected in each stratum
+expected_allocations = {
+	# 7.7, 2.2 and 1.1 runs: each stratum gets one, then the largest
+	# remainder gets the last run
+	"proportional": (["--runs", "11", "--allocation", "proportional"],
+					{"intarith": 8, "control": 2, "memory": 1}),
+	# 5.75, 3.07 and 2.17 runs
+	"sqrt": (["--runs", "11", "--allocation", "sqrt"],
+			{"intarith": 6, "control": 3, "memory": 2}),
+	# the minimum runs of the smallest strata first
+	"minruns": (["--runs", "4", "--allocation", "proportional", "--minruns", "2"],
+				{"intarith": 0, "control": 2, "memory": 2}),
+}
+
+def makeProgram(work_dir):
+	with open(os.path.join(work_dir, "llfi.stat.sitetable.txt"), 'w') as f:
+		for index, (opcode, instances, cycles) in sorted(sites.items()):
+			f.write("site=%d,%s,1,0,,main\n" % (index, opcode))
+	with open(os.path.join(work_dir, "llfi.stat.prof.txt"), 'w') as f:
+		f.write("total_cycle=%d\n" % sum(cycles for _, _, cycles in sites.values()))
+		for index, (opcode, instances, cycles) in sorted(sites.items()):
+			f.write("site=%d,%d,%d\n" % (index, instances, cycles))
+
+def runPlanner(work_dir, options):
+	p = subprocess.Popen([fiplanner_script] + options + [work_dir],
+						stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+	output = p.communicate()[0].decode()
+	return p.returncode, output
+
+def readPlan(work_dir):
+	strata = {}
+	site_strata = {}
+	runs = []
+	with open(os.path.join(work_dir, "llfi.config.fiplan.txt")) as f:
+		for line in f:
+			line = line.strip()
+			if line.startswith("stratum="):
+				name, share, numruns = line[len("stratum="):].split(',')
+				strata[name] = int(numruns)
+			elif line.startswith("site="):
+				index, name, weight = line[len("site="):].split(',')
+				site_strata[int(index)] = name
+			elif line.startswith("run="):
+				index, instance = line[len("run="):].split(',')
+				runs.append((int(index), int(instance)))
+	return strata, site_strata, runs
+
+def testAllocation(work_dir, options, expected):
+	"""The runs of each stratum, in the plan and in its runs"""
+	makeProgram(work_dir)
+	r, output = runPlanner(work_dir, options + ["--seed", "1"])
+	if r != 0:
+		return "FAIL: fiplanner returned %d: %s" % (r, output)
+	strata, site_strata, runs = readPlan(work_dir)
+	if strata != expected:
+		return "FAIL: %s runs per stratum, expected %s" % (strata, expected)
+	planned = dict((name, 0) for name in strata)
+	for index, instance in runs:
+		if instance < 1 or instance > sites[index][1]:
+			return "FAIL: run of instance %d of site %d" % (instance, index)
+		planned[site_strata[index]] += 1
+	if planned != expected:
+		return "FAIL: the plan has %s runs per stratum, expected %s" % (planned, expected)
+	return "PASS"
+
+def writeRuns(work_dir, outcomes):
+	"""Writes the outputs of the fault injection runs with the given (llfi
+	index, outcome) as injectfault does, the outcome being sdc or benign"""
+	llfi_dir = os.path.join(work_dir, "llfi")
+	for subdir in ["baseline", "llfi_stat_output", "std_output"]:
+		os.makedirs(os.path.join(llfi_dir, subdir), exist_ok=True)
+	with open(os.path.join(llfi_dir, "baseline", "golden_std_output"), 'w') as f:
+		f.write("golden\n")
+	for run, (index, outcome) in enumerate(outcomes):
+		run_id = "0-%d" % run
+		with open(os.path.join(llfi_dir, "llfi_stat_output",
+				"llfi.stat.fi.injectedfaults.%s.txt" % run_id), 'w') as f:
+			f.write("FI stat: fi_type=bitflip, fi_index=%d, fi_cycle=-1\n" % index)
+		with open(os.path.join(llfi_dir, "std_output",
+				"std_outputfile-run-%s" % run_id), 'w') as f:
+			f.write("golden\n" if outcome == "benign" else "corrupted\n")
+
+def estimatedSDC(output):
+	"""The SDC rate of the program estimated by fiplanner --estimate"""
+	for line in output.splitlines():
+		if line.startswith("program"):
+			return float(line.split()[3].rstrip('%')) / 100
+	return None
+
+def testEstimate(work_dir):
+	"""The sites are sampled uniformly, so that the weight of each site is its
+	share of the cycles over its share of the runs"""
+	makeProgram(work_dir)
+	r, output = runPlanner(work_dir, ["--runs", "8", "--stratify", "none",
+						"--exponent", "0", "--seed", "1"])
+	if r != 0:
+		return "FAIL: fiplanner returned %d: %s" % (r, output)
+
+	# every site has the same SDC rate: the weights cancel out
+	writeRuns(work_dir, [(index, outcome) for index in sites
+						for outcome in ["sdc", "benign"]])
+	r, output = runPlanner(work_dir, ["--estimate"])
+	if r != 0:
+		return "FAIL: fiplanner --estimate returned %d: %s" % (r, output)
+	sdc = estimatedSDC(output)
+	if sdc is None or abs(sdc - 0.5) > 1e-4:
+		return "FAIL: SDC rate %s with uniform outcomes, expected 0.5" % sdc
+
+	# only the runs of site 1 are SDCs: the estimate is the share of the cycles
+	# of site 1, 0.6, instead of the share of its runs, 0.25
+	shutil.rmtree(os.path.join(work_dir, "llfi"))
+	writeRuns(work_dir, [(index, "sdc" if index == 1 else "benign")
+						for index in sites])
+	r, output = runPlanner(work_dir, ["--estimate"])
+	if r != 0:
+		return "FAIL: fiplanner --estimate returned %d: %s" % (r, output)
+	sdc = estimatedSDC(output)
+	if sdc is None or abs(sdc - 0.6) > 1e-4:
+		return "FAIL: SDC rate %s with the SDCs of site 1, expected 0.6" % sdc
+	return "PASS"
+
+def test_fiplanner(*test_list):
+	global fiplanner_script
+
+	r = 0
+	script_dir = os.path.dirname(os.path.realpath(__file__))
+	fiplanner_script = os.path.join(script_dir, '../../bin/fiplanner')
+
+	tests = dict((name, lambda work_dir, test=test: testAllocation(work_dir, *test))
+				for name, test in expected_allocations.items())
+	tests["estimate"] = testEstimate
+
+	result_list = []
+	for test in tests:
+		if len(test_list) != 0 and test not in test_list and "all" not in test_list:
+			continue
+		print ("MSG: Testing fiplanner:", test)
+		work_dir = tempfile.mkdtemp(prefix="llfi_test_fiplanner_")
+		result = tests[test](work_dir)
+		if result != "PASS":
+			r += 1
+			print ("MSG: The files of the test are kept in", work_dir)
+		else:
+			shutil.rmtree(work_dir, ignore_errors=True)
+		result_list.append({"name": test, "result": result})
+
+	return r, result_list
+
+if __name__ == "__main__":
+	r, result_list = test_fiplanner(*sys.argv[1:])
+	print ("=============== Result ===============")
+	for record in result_list:
+		print(record["name"], "\t\t", record["result"])
+
+	sys.exit(r)
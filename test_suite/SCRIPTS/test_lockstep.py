@@ -0,0 +1,127 @@
+#! /usr/bin/env python3
+
+import os
+import sys
+import shutil
+import subprocess
+
+# <test name>: the IR file under Lockstep/, the options of
+# llfi.config.runtime.txt that inject the fault and run the golden process,
+# and the expected fields of llfi.stat.lockstep.txt
+expected_lockstep = {
+	"masked": {
+		"ir": "loop.ll",
+		"config": {"fi_type": "bitflip", "fi_index": 4, "fi_instance": 3,
+					"fi_reg_index": 0, "fi_bit": 4, "lockstep": 2},
+		"record": {"result": "masked", "fault_checkpoint": "2",
+					"divergence_checkpoint": "2", "reconvergence_checkpoint": "3"},
+	},
+	"propagated": {
+		"ir": "loop.ll",
+		"config": {"fi_type": "bitflip", "fi_index": 6, "fi_instance": 3,
+					"fi_reg_index": 0, "fi_bit": 4, "lockstep": 2},
+		"record": {"result": "diverged", "fault_checkpoint": "2",
+					"divergence_checkpoint": "2"},
+	},
+	"nondeterministic": {
+		"ir": "nondeterministic.ll",
+		"config": {"fi_type": "bitflip", "fi_index": 5, "fi_instance": 8,
+					"fi_reg_index": 0, "fi_bit": 4, "lockstep": 2},
+		"record": {"result": "nondeterministic", "fault_checkpoint": "-1",
+					"divergence_checkpoint": "0"},
+	},
+}
+
+def buildFaultInjection(llfi_build_dir, work_dir, ir_file):
+	sys.path.append(os.path.join(llfi_build_dir, "config"))
+	import llvm_paths
+
+	driver = os.path.join(llfi_build_dir, "llvm_passes", "llfi-driver")
+	plugin = os.path.join(llfi_build_dir, "llvm_passes", "llfi-passes.so")
+	llc = os.path.join(llvm_paths.LLVM_DST_ROOT, "bin/llc")
+	clang = os.path.join(llvm_paths.LLVM_GXX_BIN_DIR, "clang")
+	runtime_dir = os.path.join(llfi_build_dir, "runtime_lib")
+	commands_list = [
+		[driver, "-llfi-plugin", plugin, "-insttype", "-includeinst=add",
+		"-fiinstselectorname=insttype", "-regloc", "-dstreg",
+		"-index-passes", "genllfiindexpass", "-index-output", "index.ll",
+		"-prof-passes", "profilingpass", "-prof-output", "profiling.ll",
+		"-fi-passes", "faultinjectionpass,locksteppass",
+		"-fi-output", "faultinjection.ll", "-S", ir_file],
+		[llc, "-filetype=obj", "-o", "faultinjection.o", "faultinjection.ll"],
+		[clang, "-o", "faultinjection.exe", "faultinjection.o", "-L" + runtime_dir,
+		"-lllfi-rt", "-lpthread", "-no-pie", "-Wl,-rpath," + runtime_dir],
+	]
+	for commands in commands_list:
+		p = subprocess.Popen(commands, cwd=work_dir, stdout=subprocess.DEVNULL)
+		p.wait()
+		if p.returncode != 0:
+			return False
+	return True
+
+def readLockstepRecord(work_dir):
+	record = {}
+	with open(os.path.join(work_dir, "llfi.stat.lockstep.txt")) as f:
+		for line in f:
+			if "=" in line:
+				key, value = line.strip().split("=")
+				record[key] = value
+	return record
+
+def test_lockstep(*test_list):
+	r = 0
+	script_dir = os.path.dirname(os.path.realpath(__file__))
+	testsuite_dir = os.path.join(script_dir, os.pardir)
+	llfi_build_dir = os.path.join(script_dir, os.pardir, os.pardir)
+
+	result_list = []
+	for test in expected_lockstep:
+		if len(test_list) != 0 and test not in test_list and "all" not in test_list:
+			continue
+		print ("MSG: Testing the lockstep run of:", test)
+		expected = expected_lockstep[test]
+		ir_file = os.path.abspath(os.path.join(testsuite_dir, "Lockstep", expected["ir"]))
+		work_dir = os.path.abspath(os.path.join(testsuite_dir, "Lockstep",
+												test + ".work"))
+		shutil.rmtree(work_dir, ignore_errors=True)
+		os.makedirs(work_dir)
+
+		result = "PASS"
+		if not buildFaultInjection(llfi_build_dir, work_dir, ir_file):
+			result = "FAIL: unable to build the fault injection executable"
+		else:
+			with open(os.path.join(work_dir, "llfi.config.runtime.txt"), 'w') as f:
+				for option, value in expected["config"].items():
+					f.write("%s=%s\n" % (option, value))
+			p = subprocess.Popen([os.path.join(work_dir, "faultinjection.exe")],
+								cwd=work_dir, stdout=subprocess.DEVNULL)
+			try:
+				p.wait(timeout=60)
+			except subprocess.TimeoutExpired:
+				p.kill()
+				p.wait()
+			if p.returncode != 0:
+				result = "FAIL: the fault injection executable quits unnormally!"
+			elif not os.path.isfile(os.path.join(work_dir, "llfi.stat.lockstep.txt")):
+				result = "FAIL: llfi.stat.lockstep.txt not generated"
+			else:
+				record = readLockstepRecord(work_dir)
+				for key, value in expected["record"].items():
+					if record.get(key) != value:
+						result = "FAIL: %s is %s, expected %s" % (key, record.get(key), value)
+						break
+		if result != "PASS":
+			r += 1
+		else:
+			shutil.rmtree(work_dir, ignore_errors=True)
+		result_list.append({"name": test, "result": result})
+
+	return r, result_list
+
+if __name__ == "__main__":
+	r, result_list = test_lockstep(*sys.argv[1:])
+	print ("=============== Result ===============")
+	for record in result_list:
+		print(record["name"], "\t\t", record["result"])
+
+	sys.exit(r)
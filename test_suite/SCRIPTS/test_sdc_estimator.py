@@ -0,0 +1,82 @@
+#! /usr/bin/env python3
+
+import os
+import sys
+import shutil
+import subprocess
+
+# <IR file under SDCEstimator/>: {<index of the add site>: <expected SDC probability>}
+# The add sites are numbered in the order of the file.
+expected_estimates = {
+	"escaped_output.ll": {0: 0.0, 1: 1.0},
+}
+
+def estimateSDC(llfi_build_dir, work_dir, ir_file):
+	driver = os.path.join(llfi_build_dir, "llvm_passes", "llfi-driver")
+	plugin = os.path.join(llfi_build_dir, "llvm_passes", "llfi-passes.so")
+	commands = [driver, "-llfi-plugin", plugin, "-insttype", "-includeinst=add",
+				"-fiinstselectorname=insttype", "-regloc", "-dstreg",
+				"-index-passes", "genllfiindexpass", "-index-output", "index.ll",
+				"-prof-passes", "sdcestimatorpass,profilingpass",
+				"-prof-output", "profiling.ll",
+				"-fi-passes", "faultinjectionpass", "-fi-output", "faultinjection.ll",
+				"-S", ir_file]
+	p = subprocess.Popen(commands, cwd=work_dir, stdout=subprocess.DEVNULL)
+	p.wait()
+	if p.returncode != 0:
+		return None
+
+	estimates = []
+	with open(os.path.join(work_dir, "llfi.stat.sdc.txt")) as f:
+		for line in f:
+			if line.startswith("site="):
+				index, opcode, sdc = line[len("site="):].strip().split(',')
+				if opcode == "add":
+					estimates.append(float(sdc))
+	return estimates
+
+def test_sdc_estimator(*test_list):
+	r = 0
+	script_dir = os.path.dirname(os.path.realpath(__file__))
+	testsuite_dir = os.path.join(script_dir, os.pardir)
+	llfi_build_dir = os.path.join(script_dir, os.pardir, os.pardir)
+
+	result_list = []
+	for test in expected_estimates:
+		if len(test_list) != 0 and test not in test_list and "all" not in test_list:
+			continue
+		print ("MSG: Testing the SDC estimate of:", test)
+		ir_file = os.path.abspath(os.path.join(testsuite_dir, "SDCEstimator", test))
+		work_dir = os.path.abspath(os.path.join(testsuite_dir, "SDCEstimator",
+												test + ".work"))
+		shutil.rmtree(work_dir, ignore_errors=True)
+		os.makedirs(work_dir)
+
+		estimates = estimateSDC(llfi_build_dir, work_dir, ir_file)
+		if estimates is None:
+			result = "FAIL: \'sdcestimatorpass\' quits unnormally!"
+		else:
+			result = "PASS"
+			for site, sdc in expected_estimates[test].items():
+				if site >= len(estimates):
+					result = "FAIL: no estimate for add site %d" % site
+					break
+				if abs(estimates[site] - sdc) > 1e-6:
+					result = "FAIL: add site %d estimated %f, expected %f" % \
+						(site, estimates[site], sdc)
+					break
+		if result != "PASS":
+			r += 1
+		else:
+			shutil.rmtree(work_dir, ignore_errors=True)
+		result_list.append({"name": test, "result": result})
+
+	return r, result_list
+
+if __name__ == "__main__":
+	r, result_list = test_sdc_estimator(*sys.argv[1:])
+	print ("=============== Result ===============")
+	for record in result_list:
+		print(record["name"], "\t\t", record["result"])
+
+	sys.exit(r)
@@ -0,0 +1,111 @@
+#! /usr/bin/env python3
+
+import os
+import sys
+import shutil
+import subprocess
+
+# <IR file under TaintTracking/>: the options of llfi.config.runtime.txt that
+# inject the fault, and the expected llfi.stat.taint.txt
+expected_taint = {
+	"propagation.ll": {
+		"config": {"fi_type": "bitflip", "fi_index": 2, "fi_reg_index": 0, "fi_bit": 0},
+		"tainted_sites": 2,
+		"tainted_output_bytes": 4,
+		"sites": [2, 3],
+	},
+}
+
+def buildFaultInjection(llfi_build_dir, work_dir, ir_file):
+	sys.path.append(os.path.join(llfi_build_dir, "config"))
+	import llvm_paths
+
+	driver = os.path.join(llfi_build_dir, "llvm_passes", "llfi-driver")
+	plugin = os.path.join(llfi_build_dir, "llvm_passes", "llfi-passes.so")
+	llc = os.path.join(llvm_paths.LLVM_DST_ROOT, "bin/llc")
+	clang = os.path.join(llvm_paths.LLVM_GXX_BIN_DIR, "clang")
+	runtime_dir = os.path.join(llfi_build_dir, "runtime_lib")
+	commands_list = [
+		[driver, "-llfi-plugin", plugin, "-insttype", "-includeinst=add",
+		"-fiinstselectorname=insttype", "-regloc", "-dstreg",
+		"-index-passes", "genllfiindexpass", "-index-output", "index.ll",
+		"-prof-passes", "profilingpass", "-prof-output", "profiling.ll",
+		"-fi-passes", "faultinjectionpass,tainttrackingpass",
+		"-fi-output", "faultinjection.ll", "-S", ir_file],
+		[llc, "-filetype=obj", "-o", "faultinjection.o", "faultinjection.ll"],
+		[clang, "-o", "faultinjection.exe", "faultinjection.o", "-L" + runtime_dir,
+		"-lllfi-rt", "-lpthread", "-no-pie", "-Wl,-rpath," + runtime_dir],
+	]
+	for commands in commands_list:
+		p = subprocess.Popen(commands, cwd=work_dir, stdout=subprocess.DEVNULL)
+		p.wait()
+		if p.returncode != 0:
+			return False
+	return True
+
+def readTaintStats(work_dir):
+	stats = {"sites": []}
+	with open(os.path.join(work_dir, "llfi.stat.taint.txt")) as f:
+		for line in f:
+			if line.startswith("#") or "=" not in line:
+				continue
+			key, value = line.strip().split("=")
+			if key == "site":
+				stats["sites"].append(int(value))
+			else:
+				stats[key] = int(value)
+	return stats
+
+def test_taint_tracking(*test_list):
+	r = 0
+	script_dir = os.path.dirname(os.path.realpath(__file__))
+	testsuite_dir = os.path.join(script_dir, os.pardir)
+	llfi_build_dir = os.path.join(script_dir, os.pardir, os.pardir)
+
+	result_list = []
+	for test in expected_taint:
+		if len(test_list) != 0 and test not in test_list and "all" not in test_list:
+			continue
+		print ("MSG: Testing the taint tracking of:", test)
+		ir_file = os.path.abspath(os.path.join(testsuite_dir, "TaintTracking", test))
+		work_dir = os.path.abspath(os.path.join(testsuite_dir, "TaintTracking",
+												test + ".work"))
+		shutil.rmtree(work_dir, ignore_errors=True)
+		os.makedirs(work_dir)
+
+		expected = expected_taint[test]
+		result = "PASS"
+		if not buildFaultInjection(llfi_build_dir, work_dir, ir_file):
+			result = "FAIL: unable to build the fault injection executable"
+		else:
+			with open(os.path.join(work_dir, "llfi.config.runtime.txt"), 'w') as f:
+				for option, value in expected["config"].items():
+					f.write("%s=%s\n" % (option, value))
+			p = subprocess.Popen([os.path.join(work_dir, "faultinjection.exe")],
+								cwd=work_dir, stdout=subprocess.DEVNULL)
+			p.wait()
+			if p.returncode != 0:
+				result = "FAIL: the fault injection executable quits unnormally!"
+			elif not os.path.isfile(os.path.join(work_dir, "llfi.stat.taint.txt")):
+				result = "FAIL: llfi.stat.taint.txt not generated"
+			else:
+				stats = readTaintStats(work_dir)
+				for key in ["tainted_sites", "tainted_output_bytes", "sites"]:
+					if stats.get(key) != expected[key]:
+						result = "FAIL: %s is %s, expected %s" % (key, stats.get(key), expected[key])
+						break
+		if result != "PASS":
+			r += 1
+		else:
+			shutil.rmtree(work_dir, ignore_errors=True)
+		result_list.append({"name": test, "result": result})
+
+	return r, result_list
+
+if __name__ == "__main__":
+	r, result_list = test_taint_tracking(*sys.argv[1:])
+	print ("=============== Result ===============")
+	for record in result_list:
+		print(record["name"], "\t\t", record["result"])
+
+	sys.exit(r)
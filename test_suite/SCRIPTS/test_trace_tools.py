@@ -10,6 +10,7 @@ tracediff_script = ""
 traceunion_script = ""
 traceontograph_script = ""
 tracetodot_script = ""
+llfi_build_dir = ""
 
 def callTraceTools(work_dir, resources):
 	global tracediff_script
@@ -94,13 +95,131 @@ def callTraceTools(work_dir, resources):
 
 	return "PASS"
 
+def testCompressedTrace(work_dir):
+	"""Writes the trace of tracer.c with and without compression, and checks
+	that tracetools decodes the compressed trace into the text trace: the
+	encoder of InstTraceLib.c and the decoder of tracetools.py are kept in
+	sync by hand"""
+	sys.path.append(os.path.join(llfi_build_dir, 'config'))
+	sys.path.append(os.path.join(llfi_build_dir, 'tools'))
+	import llvm_paths
+	import tracetools
 
+	clang = os.path.join(llvm_paths.LLVM_GXX_BIN_DIR, "clang")
+	runtime_dir = os.path.join(llfi_build_dir, 'runtime_lib')
+	tracer_exe = os.path.join(work_dir, 'tracer')
+	commands = [clang, '-o', tracer_exe, os.path.join(work_dir, 'tracer.c'),
+				'-L' + runtime_dir, '-lllfi-rt', '-Wl,-rpath,' + runtime_dir]
+	p = subprocess.Popen(commands)
+	p.wait()
+	if p.returncode != 0:
+		return ("FAIL: unable to build tracer.c")
+
+	traces = {}
+	for mode in ['text', 'compressed']:
+		p = subprocess.Popen([tracer_exe, mode], cwd=work_dir)
+		p.wait()
+		if p.returncode != 0:
+			return ("FAIL: \'tracer %s\' quits unnormally!" % mode)
+		trace_file = os.path.join(work_dir, 'llfi.stat.trace.%s.txt' % mode)
+		os.rename(os.path.join(work_dir, 'llfi.stat.trace.txt'), trace_file)
+		with open(trace_file, 'rb') as f:
+			compressed = f.read(len(tracetools.COMPRESSED_TRACE_HEADER)) == \
+				tracetools.COMPRESSED_TRACE_HEADER
+		if compressed != (mode == 'compressed'):
+			return ("FAIL: the %s trace is not in the %s format" % (mode, mode))
+		try:
+			traces[mode] = list(tracetools.readTraceLines(trace_file))
+		except Exception as e:
+			return ("FAIL: unable to read the %s trace: %r" % (mode, e))
+
+	for i in range(max(len(traces['text']), len(traces['compressed']))):
+		text = traces['text'][i] if i < len(traces['text']) else None
+		decoded = traces['compressed'][i] if i < len(traces['compressed']) else None
+		if text != decoded:
+			return ("FAIL: line %d of the decoded trace is %r instead of %r" %
+					(i + 1, decoded, text))
+	return "PASS"
+
+def readHeatmapAggregate(aggregate_file):
+	reports = 0
+	sites = {}
+	edges = {}
+	with open(aggregate_file) as f:
+		for line in f:
+			fields = line.split()
+			if len(fields) == 0 or fields[0].startswith('#'):
+				continue
+			if fields[0] == 'reports':
+				reports = int(fields[1])
+			elif fields[0] == 'site':
+				sites[int(fields[1])] = (int(fields[2]), int(fields[3]))
+			elif fields[0] == 'edge':
+				edges[(int(fields[1]), int(fields[2]))] = int(fields[3])
+	return reports, sites, edges
+
+def testHeatmap(work_dir):
+	"""Folds the reports with traceheatmap, both at once and by merging the
+	aggregate of each report file, and checks the counters against the
+	affected instructions and edges of tracetools.py. The reports avoid the
+	control diffs on which getAffectedEdgesSet raises, and the edges it gives
+	without an end are dropped, as traceheatmap does"""
+	sys.path.append(os.path.join(llfi_build_dir, 'tools'))
+	import tracetools
+
+	traceheatmap = os.path.join(llfi_build_dir, 'tools', 'traceheatmap')
+	report_files = sorted(os.path.join(work_dir, f) for f in os.listdir(work_dir)
+						if f.startswith('llfi.trace.report.'))
+
+	reports = 0
+	sites = {}
+	edges = {}
+	for report_file in report_files:
+		for rep in tracetools.parseFaultReportsfromFile(report_file):
+			reports += 1
+			inj, aff = sites.get(rep.faultID, (0, 0))
+			sites[rep.faultID] = (inj + 1, aff)
+			for site in rep.getAffectedSet():
+				inj, aff = sites.get(site, (0, 0))
+				sites[site] = (inj, aff + 1)
+			for start, end in rep.getAffectedEdgesSet():
+				if end is not None:
+					edge = (start, int(end))
+					edges[edge] = edges.get(edge, 0) + 1
+	expected = (reports, sites, edges)
+
+	aggregates = []
+	for i, inputs in enumerate([[f] for f in report_files] + [report_files]):
+		aggregate_file = os.path.join(work_dir, 'llfi.heatmap.%d.txt' % i)
+		p = subprocess.Popen([traceheatmap, '-o', aggregate_file] + inputs)
+		p.wait()
+		if p.returncode != 0:
+			return ("FAIL: \'traceheatmap\' quits unnormally!")
+		aggregates.append(aggregate_file)
+	merged_file = os.path.join(work_dir, 'llfi.heatmap.merged.txt')
+	p = subprocess.Popen([traceheatmap, '-o', merged_file] + aggregates[:-1])
+	p.wait()
+	if p.returncode != 0:
+		return ("FAIL: \'traceheatmap\' quits unnormally on the aggregates!")
+
+	for name, aggregate_file in [("folded", aggregates[-1]), ("merged", merged_file)]:
+		found = readHeatmapAggregate(aggregate_file)
+		if found != expected:
+			return ("FAIL: the %s heatmap is %s instead of %s" % (name, found, expected))
+	return "PASS"
+
+# tests on files of their own under Traces/, besides the traces of test_suite.yaml
+trace_file_tests = {
+	"CompressedTrace": testCompressedTrace,
+	"Heatmap": testHeatmap,
+}
 
 def test_trace_tools(*test_list):
 	global tracediff_script
 	global traceunion_script
 	global traceontograph_script
 	global tracetodot_script
+	global llfi_build_dir
 
 	r = 0
 	suite = {}
@@ -110,6 +229,7 @@ def test_trace_tools(*test_list):
 	traceunion_script = os.path.join(llfi_tools_dir, "traceunion")
 	traceontograph_script = os.path.join(llfi_tools_dir, "traceontograph")
 	tracetodot_script = os.path.join(llfi_tools_dir, "tracetodot")
+	llfi_build_dir = os.path.join(script_dir, os.pardir, os.pardir)
 	
 	testsuite_dir = os.path.join(script_dir, os.pardir)
 	with open(os.path.join(testsuite_dir, "test_suite.yaml")) as f:
@@ -134,6 +254,17 @@ def test_trace_tools(*test_list):
 		record = {"name": test_path, "result": result}
 		result_list.append(record)
 
+	for test in trace_file_tests:
+		if len(test_list) != 0 and test not in test_list and "all" not in test_list:
+			continue
+		test_path = "./Traces/" + test
+		print ("MSG: Testing on trace files of:", test_path)
+		work_dir = os.path.abspath(os.path.join(testsuite_dir, test_path))
+		result = trace_file_tests[test](work_dir)
+		if result != 'PASS':
+			r += 1
+		result_list.append({"name": test_path, "result": result})
+
 	return r, result_list
 
 if __name__ == "__main__":
@@ -0,0 +1,25 @@
+; The first add is stored to heap memory whose address escapes, but that is
+; never written out: printf only writes out a string literal and the second
+; buffer. The second add is stored to the buffer printed by printf.
+@.str = private unnamed_addr constant [7 x i8] c"hello\0A\00", align 1
+@.fmt = private unnamed_addr constant [4 x i8] c"%s\0A\00", align 1
+@sink = global i8* null, align 8
+
+declare i32 @printf(i8*, ...)
+declare noalias i8* @malloc(i64)
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %heap = call noalias i8* @malloc(i64 16)
+  store i8* %heap, i8** @sink, align 8
+  %scratch = add i32 %argc, 1
+  %heapint = bitcast i8* %heap to i32*
+  store i32 %scratch, i32* %heapint, align 4
+  %out = call noalias i8* @malloc(i64 16)
+  %digit = trunc i32 %argc to i8
+  %printed = add i8 %digit, 48
+  store i8 %printed, i8* %out, align 1
+  %call1 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([7 x i8], [7 x i8]* @.str, i64 0, i64 0))
+  %call2 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([4 x i8], [4 x i8]* @.fmt, i64 0, i64 0), i8* %out)
+  ret i32 0
+}
@@ -0,0 +1,20 @@
+; The fault is injected into %injected, llfi index 2. It propagates to %tainted,
+; llfi index 3, which is stored to the first half of the buffer written out,
+; while %clean, llfi index 4, is stored to its second half: 4 of the 8 bytes
+; written out are tainted.
+declare i64 @write(i32, i8*, i64)
+
+define i32 @main(i32 %argc, i8** %argv) {
+entry:
+  %buf = alloca [2 x i32], align 4
+  %injected = add i32 %argc, 1
+  %tainted = mul i32 %injected, 3
+  %clean = add i32 %argc, 2
+  %first = getelementptr inbounds [2 x i32], [2 x i32]* %buf, i64 0, i64 0
+  store i32 %tainted, i32* %first, align 4
+  %second = getelementptr inbounds [2 x i32], [2 x i32]* %buf, i64 0, i64 1
+  store i32 %clean, i32* %second, align 4
+  %bytes = bitcast [2 x i32]* %buf to i8*
+  %written = call i64 @write(i32 1, i8* %bytes, i64 8)
+  ret i32 0
+}
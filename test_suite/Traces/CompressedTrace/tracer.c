@@ -0,0 +1,51 @@
+/*
+ * Writes the same golden trace with the text tracing function of the runtime,
+ * or with the compressed one when given "compressed", for test_trace_tools to
+ * compare the decoded compressed trace with the text trace.
+ *
+ * The trace has site 0, which is not an llfi index, right after a site traced
+ * for the first time, values with a constant stride, constant values, values
+ * that do not repeat, and values too wide to be predicted.
+ */
+#include <stdint.h>
+#include <string.h>
+
+extern long long llfi_trace_count;
+void printInstTracer(long instID, char *opcode, int size, char *ptr,
+                     int maxPrints);
+void printCompressedInstTracer(long instID, char *opcode, int size, char *ptr,
+                               int maxPrints);
+void postTracing();
+
+static void (*tracer)(long, char *, int, char *, int) = printInstTracer;
+
+static void trace(long instID, char *opcode, void *value, int size) {
+  llfi_trace_count++;
+  tracer(instID, opcode, size, (char *)value, 0);
+}
+
+int main(int argc, char **argv) {
+  int i;
+  if (argc > 1 && strcmp(argv[1], "compressed") == 0)
+    tracer = printCompressedInstTracer;
+
+  for (i = 0; i < 1000; i++) {
+    uint32_t counter = 3 * i;
+    uint64_t constant = 0x123456789abcdefULL;
+    uint8_t noise = (uint8_t)(i * i % 251);
+    int16_t down = (int16_t)(1000 - 7 * i);
+    unsigned char wide[16];
+    memset(wide, i & 0xff, sizeof(wide));
+    wide[0] = (unsigned char)(i >> 8);
+
+    trace(3, "add", &counter, sizeof(counter));
+    trace(0, "load", &constant, sizeof(constant));
+    if (i % 3 == 0)
+      trace(7, "icmp", &noise, sizeof(noise));
+    trace(5, "sub", &down, sizeof(down));
+    if (i % 10 < 4)
+      trace(9, "call", wide, sizeof(wide));
+  }
+  postTracing();
+  return 0;
+}
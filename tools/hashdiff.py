@@ -0,0 +1,118 @@
+#! /usr/bin/env python3
+
+#hashdiff.py
+#This script compares the hash checkpoints of the golden run (written by the
+#programs built with the hashCheckpoints option, see runtime_lib/InstTraceLib.c)
+#with the ones of fault injection runs. It compares the checkpoints level by
+#level, from the coarsest one, and only looks into the finer checkpoints of
+#the ones that differ, to find the intervals of dynamic instructions where each
+#faulty run diverged. The diverged window can then be traced on its own with
+#the traceWindows option.
+#Usage:
+#     ./hashdiff.py goldenHashes faultyHashes...
+
+import sys
+import os
+
+prog = os.path.basename(sys.argv[0])
+
+class hashCheckpoints:
+  def __init__(self, target):
+    self.levels = []
+    self.fault = None
+    self.end = None
+    with open(target, 'r') as f:
+      header = f.readline().split()
+      if not header or header[0] != "#LLFIHashCheckpoints":
+        print("ERROR: %s is not a hash checkpoint file" % target, file=sys.stderr)
+        exit(1)
+      fields = dict(field.split('=') for field in header[1:])
+      self.interval = int(fields["interval"])
+      self.fanout = int(fields["fanout"])
+      for line in f:
+        if line.startswith("fault="):
+          self.fault = int(line[len("fault="):])
+        elif line.startswith("end="):
+          self.end = int(line[len("end="):])
+        elif line.strip():
+          level, value = line.split()
+          level = int(level)
+          while len(self.levels) <= level:
+            self.levels.append([])
+          self.levels[level].append(value)
+
+  def length(self, level):
+    return len(self.levels[level]) if level < len(self.levels) else 0
+
+def divergedIntervals(golden, faulty):
+  """Returns the indices of the level 0 checkpoints that differ, up to the end
+  of the shorter run"""
+  fanout = golden.fanout
+  diverged = []
+
+  def descend(level, i):
+    if level == 0:
+      diverged.append(i)
+      return
+    for child in range(i * fanout, (i + 1) * fanout):
+      if golden.levels[level - 1][child] != faulty.levels[level - 1][child]:
+        descend(level - 1, child)
+
+  top = min(len(golden.levels), len(faulty.levels)) - 1
+  # level 0 checkpoints covered by the ones of the levels compared before
+  covered = 0
+  for level in range(top, -1, -1):
+    span = fanout ** level
+    length = min(golden.length(level), faulty.length(level))
+    for i in range(covered // span, length):
+      if golden.levels[level][i] != faulty.levels[level][i]:
+        descend(level, i)
+    covered = max(covered, length * span)
+  return sorted(diverged)
+
+def hashDiff(goldenFile, faultyFile):
+  golden = hashCheckpoints(goldenFile)
+  faulty = hashCheckpoints(faultyFile)
+  if (golden.interval, golden.fanout) != (faulty.interval, faulty.fanout):
+    print("ERROR: %s and %s have different checkpoint intervals" %
+          (goldenFile, faultyFile), file=sys.stderr)
+    exit(1)
+
+  interval = golden.interval
+  diverged = divergedIntervals(golden, faulty)
+  common = min(golden.length(0), faulty.length(0))
+  # the faulty run reconverged if its last checkpoints match the golden ones,
+  # and it ended with the golden run
+  reconverged = faulty.end is not None and faulty.end == golden.end and \
+      (not diverged or diverged[-1] < common - 1)
+
+  stats = [("fault", faulty.fault if faulty.fault is not None else "none"),
+           ("diverged_intervals", len(diverged))]
+  if diverged:
+    first = diverged[0] * interval + 1
+    if reconverged:
+      last = (diverged[-1] + 1) * interval
+    elif faulty.end is not None:
+      # the state stays diverged up to the end of the faulty run
+      last = faulty.end
+    else:
+      last = faulty.length(0) * interval
+    stats.append(("trace_window", "%d-%d" % (first, last)))
+    if faulty.fault is not None and reconverged:
+      stats.append(("latency", last - faulty.fault))
+  stats.append(("reconverged", "yes" if reconverged else "no"))
+  stats.append(("end", faulty.end if faulty.end is not None else "crashed"))
+  stats.append(("golden_end", golden.end))
+  return stats
+
+if __name__ == "__main__":
+  if len(sys.argv) >= 2 and (sys.argv[1] == '-h' or sys.argv[1] == '--help'):
+    print(("%(prog)s compares the hash checkpoints of the golden run and of fault injection runs, and summarizes where each faulty run diverged\n\n"
+    "running option: %(prog)s <golden hashes> <faulty hashes>..." %{"prog": prog}), file=sys.stderr)
+  elif len(sys.argv) >= 3:
+    for faultyFile in sys.argv[2:]:
+      stats = hashDiff(sys.argv[1], faultyFile)
+      print(faultyFile + ": " + ' '.join("%s=%s" % stat for stat in stats))
+  else:
+    print("Error: running option: %(prog)s <golden hashes> <faulty hashes>..." %{"prog": prog}, file=sys.stderr)
+    exit(1)
@@ -28,18 +28,12 @@ def traceDiff(argv, output = 0):
     print("ERROR: running option: %(prog)s <golden output> <faulty output>" % {'prog': prog}, file=sys.stderr)
     exit(1)
 
-  goldFile = open(argv[1], 'r')
-  goldTrace = goldFile.read()
-  goldFile.close()
-
-  faultyFile = open(argv[2], 'r')
-  faultyTrace = faultyFile.read()
-  faultyFile.close()
-
-  goldTraceLines = goldTrace.split("\n")
-  faultyTraceLines =  faultyTrace.split("\n")
+  # the traces may be compressed, see readTraceLines
+  faultyTraceLines = list(readTraceLines(argv[2]))
+  goldTraceLines = readTraceLines(argv[1])
 
   #Examine Header of Trace File
+  goldStartPoint = 1
   header = faultyTraceLines[0].split(' ')
   for i in range(0, len(header) - 1):
     keyword = header[i]
@@ -47,8 +41,19 @@ def traceDiff(argv, output = 0):
     #Remove traces from golden trace that happened before fault injection point
       faultyTraceStartPoint = int(header[i+1])
       faultyTraceLines.pop(0)
-      for i in range (0,faultyTraceStartPoint-1):
-        goldTraceLines.pop(0)
+      goldStartPoint = faultyTraceStartPoint
+  goldTraceLines = list(traceLinesFrom(goldTraceLines, goldStartPoint))
+  # with trace_function or trace_opcode, both traces only hold the selected
+  # sites, and number the records after the instructions they skipped
+  faultyTraceLines = [line for line in faultyTraceLines
+                      if not line.startswith("#TraceInstNumber:")]
+  # the instruction of the fault starts the faulty trace even if its site is
+  # filtered out, the golden trace then has no value for it
+  faultyStartLine = diffLine(faultyTraceLines[0])
+  if len(goldTraceLines) == 0 or \
+      diffLine(goldTraceLines[0]).ID != faultyStartLine.ID:
+    goldTraceLines.insert(0, "ID: %d\tOPCode: %s\tValue:" %
+                          (faultyStartLine.ID, faultyStartLine.OPCode))
 
   #record and report the fault injected line
   goldInjectedLine = diffLine(goldTraceLines[0])
@@ -0,0 +1,400 @@
+// traceheatmap
+// Folds the trace difference reports of a fault injection campaign (written by
+// tracediff or traceunion) into per-instruction and per-edge counters, and
+// overlays them on the program graph as a heatmap. The counters are dense
+// arrays keyed by llfi index, and each report is folded as it is read, so the
+// reports of thousands of runs are never held in memory at once.
+//
+// The counters can be written to an aggregate file, and aggregate files are
+// accepted as inputs next to reports, so that the partial aggregates of
+// parallel workers can be merged.
+//
+// Usage:
+//   traceheatmap [-o aggregate] [-graph program.dot -dot heatmap.dot] file...
+//
+// The affected instructions and edges of a report are the ones
+// traceontograph colours (see getAffectedSet and getAffectedEdgesSet in
+// tracetools.py), with intentional differences on the reports where
+// getAffectedEdgesSet has no edge to give:
+//   - a control diff whose Pre Diff is one of the last two diff lines has no
+//     Ctrl Diff line, and is skipped where tracetools.py reads past the end,
+//   - the edge from the last instruction the faulty run took is skipped when
+//     the next line is a Post Diff or has no faulty index, where tracetools.py
+//     raises,
+//   - a control diff with neither a faulty instruction nor a Post Diff has no
+//     end, and its (start, None) edge is dropped, as no graph node matches it.
+// The Post Diff end, a string in tracetools.py, is an llfi index here.
+// test_trace_tools.py checks both on the reports of Traces/Heatmap.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define AGGREGATE_HEADER "#LLFIHeatmap"
+
+namespace {
+
+class Heatmap {
+ public:
+  Heatmap() : reports(0) {}
+
+  void addReport(long faultID, const std::set<long> &sites,
+                 const std::set<std::pair<long, long> > &edges) {
+    reports++;
+    count(injected, faultID, 1);
+    for (long site : sites)
+      count(affected, site, 1);
+    for (const auto &edge : edges)
+      countEdge(edge.first, edge.second, 1);
+  }
+
+  void write(std::ostream &out) const {
+    out << AGGREGATE_HEADER << " 1\n";
+    out << "reports " << reports << "\n";
+    size_t n = std::max(injected.size(), affected.size());
+    for (size_t i = 0; i < n; i++) {
+      unsigned long inj = get(injected, i), aff = get(affected, i);
+      if (inj != 0 || aff != 0)
+        out << "site " << i << " " << inj << " " << aff << "\n";
+    }
+    for (size_t from = 0; from < edges.size(); from++)
+      for (const auto &edge : edges[from])
+        out << "edge " << from << " " << edge.first << " " << edge.second
+            << "\n";
+  }
+
+  // Adds the counters of an aggregate file
+  bool merge(std::istream &in, const char *filename) {
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line)) {
+      std::istringstream fields(line);
+      std::string kind;
+      if (!(fields >> kind))
+        continue;
+      if (kind == "reports") {
+        unsigned long n;
+        if (!(fields >> n))
+          return malformed(filename, line);
+        reports += n;
+      } else if (kind == "site") {
+        long index;
+        unsigned long inj, aff;
+        if (!(fields >> index >> inj >> aff) || index < 0)
+          return malformed(filename, line);
+        count(injected, index, inj);
+        count(affected, index, aff);
+      } else if (kind == "edge") {
+        long from, to;
+        unsigned long n;
+        if (!(fields >> from >> to >> n) || from < 0)
+          return malformed(filename, line);
+        countEdge(from, to, n);
+      } else {
+        return malformed(filename, line);
+      }
+    }
+    return true;
+  }
+
+  // Copies the program graph written by the dot graph pass, with the affected
+  // instructions filled in red by the fraction of the reports they were
+  // affected in, the injected ones outlined in red, and the affected control
+  // flow edges drawn in red with a width that grows with their count.
+  void overlay(std::istream &in, std::ostream &out) const {
+    std::string line;
+    while (std::getline(in, line)) {
+      const char *prefix = "llfiID_";
+      if (line.compare(0, strlen(prefix), prefix) != 0) {
+        out << line << "\n";
+        continue;
+      }
+      char *rest;
+      long index = strtol(line.c_str() + strlen(prefix), &rest, 10);
+      size_t pos = rest - line.c_str();
+      if (line.compare(pos, 7, " [shape") == 0 &&
+          line.compare(line.size() - 2, 2, "];") == 0)
+        out << line.substr(0, line.size() - 2) << nodeStyle(index) << "];\n";
+      else if (line.compare(pos, 11, " -> llfiID_") == 0 &&
+               line.compare(line.size() - 1, 1, ";") == 0 &&
+               line.find('[') == std::string::npos)
+        out << line.substr(0, line.size() - 1)
+            << edgeStyle(index, atol(line.c_str() + pos + 11)) << ";\n";
+      else
+        out << line << "\n";
+    }
+  }
+
+ private:
+  static unsigned long get(const std::vector<unsigned long> &counters,
+                           size_t index) {
+    return index < counters.size() ? counters[index] : 0;
+  }
+
+  static void count(std::vector<unsigned long> &counters, long index,
+                    unsigned long n) {
+    if (index < 0)
+      return;
+    if ((size_t)index >= counters.size())
+      counters.resize(index + 1, 0);
+    counters[index] += n;
+  }
+
+  void countEdge(long from, long to, unsigned long n) {
+    if (from < 0)
+      return;
+    if ((size_t)from >= edges.size())
+      edges.resize(from + 1);
+    for (auto &edge : edges[from]) {
+      if (edge.first == to) {
+        edge.second += n;
+        return;
+      }
+    }
+    edges[from].push_back(std::make_pair(to, n));
+  }
+
+  unsigned long edgeCount(long from, long to) const {
+    if (from < 0 || (size_t)from >= edges.size())
+      return 0;
+    for (const auto &edge : edges[from])
+      if (edge.first == to)
+        return edge.second;
+    return 0;
+  }
+
+  double fraction(unsigned long n) const {
+    return reports == 0 ? 0.0 : (double)n / reports;
+  }
+
+  std::string nodeStyle(long index) const {
+    unsigned long inj = get(injected, index), aff = get(affected, index);
+    if (inj == 0 && aff == 0)
+      return "";
+    char style[256];
+    int len = snprintf(style, sizeof(style),
+                       ", style=\"filled\", fillcolor=\"0.000 %.3f 1.000\", "
+                       "tooltip=\"affected %lu, injected %lu of %lu\"",
+                       fraction(aff), aff, inj, reports);
+    if (inj != 0)
+      snprintf(style + len, sizeof(style) - len,
+               ", color=\"red\", penwidth=%.2f", 1.0 + 4.0 * fraction(inj));
+    return style;
+  }
+
+  std::string edgeStyle(long from, long to) const {
+    unsigned long n = edgeCount(from, to);
+    if (n == 0)
+      return "";
+    char style[128];
+    snprintf(style, sizeof(style),
+             " [color=\"red\", penwidth=%.2f, tooltip=\"%lu of %lu\"]",
+             1.0 + 4.0 * fraction(n), n, reports);
+    return style;
+  }
+
+  static bool malformed(const char *filename, const std::string &line) {
+    std::cerr << "ERROR: Malformed line in the aggregate " << filename << ": "
+              << line << "\n";
+    return false;
+  }
+
+ private:
+  unsigned long reports;
+  // indexed by llfi index
+  std::vector<unsigned long> injected;
+  std::vector<unsigned long> affected;
+  // indexed by the llfi index of the source, with the count of each target
+  std::vector<std::vector<std::pair<long, unsigned long> > > edges;
+};
+
+bool parseIndex(const std::string &token, long &index) {
+  const char *begin = token.c_str();
+  char *end;
+  errno = 0;
+  index = strtol(begin, &end, 10);
+  return end != begin && *end == '\0' && errno == 0;
+}
+
+std::string token(const std::string &line, size_t n) {
+  std::istringstream fields(line);
+  std::string field;
+  for (size_t i = 0; i <= n; i++)
+    if (!(fields >> field))
+      return "";
+  return field;
+}
+
+bool contains(const std::string &line, const char *text) {
+  return line.find(text) != std::string::npos;
+}
+
+// Folds one fault report: its fault line and its diff lines.
+void foldReport(Heatmap &heatmap, const std::string &faultLine,
+                const std::vector<std::string> &diffs) {
+  long faultID;
+  if (!parseIndex(token(faultLine, 1), faultID))
+    return;
+
+  std::set<long> sites;
+  for (const std::string &diff : diffs) {
+    long index;
+    if (!contains(diff, "@") && contains(diff, "Data") &&
+        parseIndex(token(diff, 3), index))
+      sites.insert(index);
+  }
+  sites.erase(faultID);
+
+  // A control flow diff starts at the Pre Diff instruction, and continues to
+  // the first instruction the faulty run took instead, or to the Post Diff
+  // instruction if the faulty run took none.
+  std::set<std::pair<long, long> > edges;
+  for (size_t i = 0; i + 2 < diffs.size(); i++) {
+    long start, end, next;
+    if (!contains(diffs[i], "Diff@") || !contains(diffs[i + 1], "Pre  Diff") ||
+        !parseIndex(token(diffs[i + 1], 3), start))
+      continue;
+    std::string faulty = token(diffs[i + 2], 5);
+    if (faulty != "" && faulty != "None") {
+      if (!parseIndex(faulty, end))
+        continue;
+      if (i + 3 < diffs.size() && parseIndex(token(diffs[i + 3], 5), next))
+        edges.insert(std::make_pair(end, next));
+      edges.insert(std::make_pair(start, end));
+    } else {
+      for (size_t d = i + 2; d < diffs.size(); d++) {
+        if (contains(diffs[d], "Post Diff")) {
+          if (parseIndex(token(diffs[d], 3), end))
+            edges.insert(std::make_pair(start, end));
+          break;
+        }
+        if (contains(diffs[d], "Pre  Diff"))
+          break;
+      }
+    }
+  }
+
+  heatmap.addReport(faultID, sites, edges);
+}
+
+// Folds the fault reports of a trace difference report file, one at a time.
+// As in parseFaultReportsfromFile, the diff lines of a report end at its first
+// line without a diff.
+void foldReports(Heatmap &heatmap, std::istream &in) {
+  std::string line, faultLine;
+  std::vector<std::string> diffs;
+  // lines of the current report: 0 outside of a report
+  int lineno = 0;
+  bool indiffs = false;
+  while (std::getline(in, line)) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos)
+      continue;
+    if (contains(line, "#FaultReport")) {
+      if (lineno >= 3)
+        foldReport(heatmap, faultLine, diffs);
+      diffs.clear();
+      lineno = 1;
+      indiffs = true;
+      continue;
+    }
+    if (lineno == 0)
+      continue;
+    lineno++;
+    if (lineno == 3) {
+      faultLine = line;
+    } else if (lineno > 3 && indiffs) {
+      if (contains(line, "Diff"))
+        diffs.push_back(line);
+      else
+        indiffs = false;
+    }
+  }
+  if (lineno >= 3)
+    foldReport(heatmap, faultLine, diffs);
+}
+
+void usage(const char *prog) {
+  std::cerr << prog << " folds program trace difference reports into a "
+            << "heatmap of the affected instructions and edges\n\n"
+            << "running option: " << prog << " [-o aggregate] [-graph "
+            << "<program dot-formatted CDFG> -dot <heatmap dot file>] "
+            << "<report or aggregate file>...\n";
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *aggregateFile = NULL, *graphFile = NULL, *dotFile = NULL;
+  std::vector<const char *> inputs;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      usage(argv[0]);
+      return 0;
+    } else if ((arg == "-o" || arg == "-graph" || arg == "-dot") &&
+               i + 1 < argc) {
+      const char **opt = arg == "-o" ? &aggregateFile
+                       : arg == "-graph" ? &graphFile : &dotFile;
+      *opt = argv[++i];
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+  if (inputs.empty() || (graphFile == NULL) != (dotFile == NULL)) {
+    std::cerr << "Error: ";
+    usage(argv[0]);
+    return 1;
+  }
+
+  Heatmap heatmap;
+  for (const char *input : inputs) {
+    std::ifstream in(input);
+    if (!in) {
+      std::cerr << "ERROR: Unable to open " << input << "\n";
+      return 1;
+    }
+    if (in.peek() == '#') {
+      std::string first;
+      std::getline(in, first);
+      in.seekg(0);
+      if (first.compare(0, strlen(AGGREGATE_HEADER), AGGREGATE_HEADER) == 0) {
+        if (!heatmap.merge(in, input))
+          return 1;
+        continue;
+      }
+    }
+    foldReports(heatmap, in);
+  }
+
+  if (graphFile != NULL) {
+    std::ifstream graph(graphFile);
+    std::ofstream dot(dotFile);
+    if (!graph || !dot) {
+      std::cerr << "ERROR: Unable to open " << (graph ? dotFile : graphFile)
+                << "\n";
+      return 1;
+    }
+    heatmap.overlay(graph, dot);
+  }
+
+  if (aggregateFile != NULL) {
+    std::ofstream out(aggregateFile);
+    if (!out) {
+      std::cerr << "ERROR: Unable to open " << aggregateFile << "\n";
+      return 1;
+    }
+    heatmap.write(out);
+  } else if (graphFile == NULL) {
+    heatmap.write(std::cout);
+  }
+  return 0;
+}
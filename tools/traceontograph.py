@@ -10,6 +10,7 @@
 
 import sys
 import os
+import re
 import glob
 from tracetools import *
 
@@ -30,27 +31,41 @@ def traceOntoGraph(traceFile, graphFile, output=0):
   graphLines = graphF.readlines()
   graphF.close()
 
+  # index the node lines and the control flow edge lines by llfi index, as
+  # the graph of a large program has too many lines to scan them per report
+  nodeLines = {}
+  edgeLines = {}
+  controlEdges = {}
+  for i, line in enumerate(graphLines):
+    m = re.match(r"llfiID_(\d+) (\[shape|-> llfiID_(\d+))", line)
+    if not m:
+      continue
+    if m.group(3) is None:
+      nodeLines.setdefault(int(m.group(1)), []).append(i)
+    elif "blue" not in line:
+      s, e = int(m.group(1)), int(m.group(3))
+      controlEdges[s] = controlEdges.get(s, 0) + 1
+      edgeLines.setdefault((s, e), []).append(i)
+
   for rep in faultReports:
     affectedInsts = rep.getAffectedSet()
     affectedEdges = rep.getAffectedEdgesSet()
-    for i in range(len(graphLines)):
-      if ("llfiID_" + str(rep.faultID) + " [shape") in graphLines[i]:
+    for i in nodeLines.get(int(rep.faultID), []):
+      graphLines[i] = graphLines[i][:-3]
+      graphLines[i] = graphLines[i] + ", style=\"filled\", fillcolor=\""+FAULT_INJECTED_BORDER_COLOR +\
+        "\"];\n"
+    for x in affectedInsts:
+      for i in nodeLines.get(int(x), []):
         graphLines[i] = graphLines[i][:-3]
-        graphLines[i] = graphLines[i] + ", style=\"filled\", fillcolor=\""+FAULT_INJECTED_BORDER_COLOR +\
-          "\"];\n"
-      for x in affectedInsts:
-        if ("llfiID_" + str(x) + " [shape") in graphLines[i]:
-          graphLines[i] = graphLines[i][:-3]
-          graphLines[i] = graphLines[i] + ", style=\"filled\", fillcolor=\""+AFFECTED_FILL_COLOR+\
-          "\"];\n"
-      for (s, e) in  affectedEdges:
-        summation = sum(1 for line in graphLines if ("llfiID_" + str(s) + " -> " + "llfiID_" in line) and "blue" not in line)
-        if summation == 2:
+        graphLines[i] = graphLines[i] + ", style=\"filled\", fillcolor=\""+AFFECTED_FILL_COLOR+\
+        "\"];\n"
+    for (s, e) in  affectedEdges:
+      if controlEdges.get(int(s), 0) == 2:
+        for i in edgeLines.get((int(s), int(e)), []):
           if ("llfiID_" + str(s) + " -> " + "llfiID_" + str(e)+";") in graphLines[i]:
             graphLines[i] = graphLines[i][:-2]
             graphLines[i] = graphLines[i] + " [color=\"red\"];\n"
 
-
   print(''.join(graphLines))
 
   #restore stdout
@@ -521,3 +521,151 @@ def parseFaultReportsfromFile(target):
 
   return reports
 
+
+# Compressed traces, written with -compresstrace. The format and the
+# predictors are described in InstTraceLib.c, and have to be kept in sync.
+COMPRESSED_TRACE_HEADER = b"#LLFICompressedTrace 1\n"
+TRACE_TABLE_BITS = 16
+MASK64 = (1 << 64) - 1
+
+class traceSite:
+  def __init__(self):
+    self.opcode = None
+    self.size = 0
+    self.next = -1
+    self.last = 0
+    self.values = [0, 0]
+    self.strides = [0, 0]
+    self.selector = 0
+
+def _hashTrace(instID, a, b):
+  h = ((instID * 0x9e3779b97f4a7c15) ^ (a * 0xc2b2ae3d27d4eb4f) ^ \
+       (b * 0x165667b19e3779f9)) & MASK64
+  return h >> (64 - TRACE_TABLE_BITS)
+
+class _byteReader:
+  def __init__(self, f):
+    self.f = f
+    self.buf = b""
+    self.pos = 0
+
+  def byte(self):
+    if self.pos == len(self.buf):
+      self.buf = self.f.read(65536)
+      self.pos = 0
+      if not self.buf:
+        return None
+    b = self.buf[self.pos]
+    self.pos += 1
+    return b
+
+  def varint(self):
+    v = 0
+    shift = 0
+    while True:
+      b = self.byte()
+      if b is None:
+        return None
+      v |= (b & 0x7f) << shift
+      shift += 7
+      if b < 0x80:
+        return v
+
+  def string(self):
+    s = bytearray()
+    while True:
+      b = self.byte()
+      if b is None or b == 0:
+        return s.decode()
+      s.append(b)
+
+def _decodeTrace(f):
+  reader = _byteReader(f)
+  sites = {}
+  start = traceSite()
+  prev = start
+  fcmTable = [0] * (1 << TRACE_TABLE_BITS)
+  dfcmTable = [0] * (1 << TRACE_TABLE_BITS)
+
+  def record(instID, site, valueKind):
+    if site.size > 8:
+      value = bytes(reader.byte() for i in range(site.size))
+      return "ID: %d\tOPCode: %s\tValue: %s" % (instID, site.opcode, value.hex())
+    mask = MASK64 if site.size == 8 else (1 << (8 * site.size)) - 1
+    fcm = _hashTrace(instID, site.values[0], site.values[1])
+    dfcm = _hashTrace(instID, site.strides[0], site.strides[1])
+    fcmPrediction = fcmTable[fcm]
+    dfcmPrediction = (site.last + dfcmTable[dfcm]) & mask
+    dfcmSelected = site.selector >= 2
+    if valueKind == 0:
+      value = dfcmPrediction if dfcmSelected else fcmPrediction
+    elif valueKind == 1:
+      value = fcmPrediction if dfcmSelected else dfcmPrediction
+    else:
+      z = reader.varint()
+      value = (site.last + ((z >> 1) ^ -(z & 1))) & mask
+    fcmHit = valueKind != 2 and fcmPrediction == value
+    dfcmHit = valueKind != 2 and dfcmPrediction == value
+    if dfcmHit and not fcmHit and site.selector < 3:
+      site.selector += 1
+    elif fcmHit and not dfcmHit and site.selector > 0:
+      site.selector -= 1
+    stride = (value - site.last) & mask
+    fcmTable[fcm] = value
+    dfcmTable[dfcm] = stride
+    site.values = [value, site.values[0]]
+    site.strides = [stride, site.strides[0]]
+    site.last = value
+    return "ID: %d\tOPCode: %s\tValue: %0*x" % \
+           (instID, site.opcode, 2 * site.size, value)
+
+  while True:
+    token = reader.byte()
+    if token is None:
+      return
+    if token == 0xff:
+      yield "#TraceStartInstNumber: %d" % reader.varint()
+    elif token == 0xfe:
+      yield "#TraceInstNumber: %d" % reader.varint()
+    elif token < 0x80:
+      for i in range(token + 1):
+        instID = prev.next
+        site = sites[instID]
+        prev = site
+        yield record(instID, site, 0)
+    else:
+      instID = reader.varint() if token & 0x01 else prev.next
+      if token & 0x02:
+        site = sites[instID] = traceSite()
+        site.opcode = reader.string()
+        site.size = reader.varint()
+      else:
+        site = sites[instID]
+      prev.next = instID
+      prev = site
+      yield record(instID, site, (token >> 2) & 3)
+
+def readTraceLines(target):
+  """Yields the lines of a trace file, without their newlines, decompressing
+  it as it is read if it was written with -compresstrace"""
+  with open(target, 'rb') as f:
+    if f.read(len(COMPRESSED_TRACE_HEADER)) == COMPRESSED_TRACE_HEADER:
+      for line in _decodeTrace(f):
+        yield line
+    else:
+      f.seek(0)
+      for line in f:
+        yield line.decode().rstrip("\n")
+
+def traceLinesFrom(lines, start):
+  """Yields the records of the trace lines from the dynamic instruction
+  numbered start (from 1). The golden trace numbers the records after the
+  instructions it skipped, with the trace windows of llfi.config.trace.txt"""
+  number = 1
+  for line in lines:
+    if line.startswith("#TraceInstNumber:"):
+      number = int(line.split()[1])
+      continue
+    if number >= start:
+      yield line
+    number += 1